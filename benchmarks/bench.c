@@ -0,0 +1,114 @@
+/* Common code for the benchmark suite
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <error.h>
+#include <errno.h>
+
+#include "bench.h"
+
+double
+bench_now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void
+bench_samples_init (struct bench_samples *s, size_t expected)
+{
+  s->count = 0;
+  s->alloced = expected ?: 1024;
+  s->samples = malloc (s->alloced * sizeof *s->samples);
+  if (! s->samples)
+    error (1, ENOMEM, "latency samples");
+}
+
+void
+bench_samples_add (struct bench_samples *s, double secs)
+{
+  if (s->count == s->alloced)
+    {
+      s->alloced *= 2;
+      s->samples = realloc (s->samples, s->alloced * sizeof *s->samples);
+      if (! s->samples)
+	error (1, ENOMEM, "latency samples");
+    }
+  s->samples[s->count++] = secs;
+}
+
+void
+bench_samples_merge (struct bench_samples *to,
+		     const struct bench_samples *from)
+{
+  size_t i;
+
+  for (i = 0; i < from->count; i++)
+    bench_samples_add (to, from->samples[i]);
+}
+
+void
+bench_samples_free (struct bench_samples *s)
+{
+  free (s->samples);
+  s->samples = NULL;
+  s->count = s->alloced = 0;
+}
+
+static int
+compare_samples (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+/* Return the Pth percentile of the sorted samples S, in microseconds.  */
+static double
+percentile (const struct bench_samples *s, int p)
+{
+  size_t i = (s->count * p + 99) / 100;
+  return s->samples[i ? i - 1 : 0] * 1e6;
+}
+
+void
+bench_report (const char *name, const char *params,
+	      size_t ops, double secs, struct bench_samples *latencies)
+{
+  printf ("%s", name);
+  if (params && *params)
+    printf (" %s", params);
+  printf (" ops=%zu secs=%.6f ops_per_sec=%.0f", ops, secs,
+	  secs > 0 ? ops / secs : 0);
+
+  if (latencies && latencies->count > 0)
+    {
+      qsort (latencies->samples, latencies->count,
+	     sizeof *latencies->samples, compare_samples);
+      printf (" p50_us=%.3f p90_us=%.3f p99_us=%.3f max_us=%.3f",
+	      percentile (latencies, 50), percentile (latencies, 90),
+	      percentile (latencies, 99),
+	      latencies->samples[latencies->count - 1] * 1e6);
+    }
+
+  putchar ('\n');
+  fflush (stdout);
+}
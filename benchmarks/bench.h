@@ -0,0 +1,71 @@
+/* Common code for the benchmark suite
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* The benchmark programs all use this, and print one line per
+   measurement, of the form
+
+     NAME KEY=VALUE KEY=VALUE ...
+
+   always with the keys ops, secs and ops_per_sec, and with p50_us,
+   p90_us, p99_us and max_us when latencies were sampled.  Anything else
+   before them describes the measurement (number of threads, sizes...).
+   `make suite' runs the quicker ones, which need nothing set up: rpcs,
+   lookups, packets, hashes, slabs, reads, pipes and procinfos.
+
+   bench.c, hashes.c and slabs.c use nothing but POSIX, so the library
+   harnesses also build on other systems, for instance with
+
+     cc -D_GNU_SOURCE -I<dir with an empty config.h> -o hashes \
+	hashes.c bench.c ../libihash/ihash.c ../libihash/murmur3.c -lpthread  */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+
+/* Latency samples, in seconds.  */
+struct bench_samples
+{
+  double *samples;
+  size_t count, alloced;
+};
+
+/* Return the time now in seconds, from a monotonic clock.  */
+double bench_now (void);
+
+/* Make S empty, with room for EXPECTED samples to begin with.  */
+void bench_samples_init (struct bench_samples *s, size_t expected);
+
+/* Add SECS to S.  */
+void bench_samples_add (struct bench_samples *s, double secs);
+
+/* Add all the samples of FROM to TO.  */
+void bench_samples_merge (struct bench_samples *to,
+			  const struct bench_samples *from);
+
+/* Free the storage of S.  */
+void bench_samples_free (struct bench_samples *s);
+
+/* Print the result line for the benchmark NAME, which did OPS operations
+   in SECS seconds.  PARAMS, if not null, is a string of KEY=VALUE pairs
+   describing the run.  If LATENCIES is not null and has samples, the
+   percentiles are printed too; this sorts its samples.  */
+void bench_report (const char *name, const char *params,
+		   size_t ops, double secs, struct bench_samples *latencies);
+
+#endif /* BENCH_H */
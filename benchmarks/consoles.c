@@ -0,0 +1,135 @@
+/* Console text output benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Replays a text file, such as a large log, to a terminal a number of
+   times and reports the rate at which it was taken.  Run it on a
+   virtual console (for instance with TTY set to /dev/tty2) to measure
+   the console's display emulation; the default is standard output.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <error.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+#define WRITE_SIZE 4096
+
+/* Read all of the file NAME into memory, and return it with its size
+   in *SIZE.  */
+static char *
+slurp (const char *name, size_t *size)
+{
+  struct stat st;
+  char *text;
+  size_t done = 0;
+  int fd;
+
+  fd = open (name, O_RDONLY);
+  if (fd < 0 || fstat (fd, &st) < 0)
+    error (1, errno, "%s", name);
+  text = malloc (st.st_size ?: 1);
+  if (! text)
+    error (1, ENOMEM, "%s", name);
+
+  while (done < st.st_size)
+    {
+      ssize_t rd = read (fd, text + done, st.st_size - done);
+      if (rd < 0)
+	error (1, errno, "%s", name);
+      if (rd == 0)
+	break;
+      done += rd;
+    }
+  close (fd);
+
+  *size = done;
+  return text;
+}
+
+/* Write the SIZE bytes of TEXT to FD, WRITE_SIZE bytes at a time.  */
+static void
+replay (int fd, const char *text, size_t size)
+{
+  size_t done = 0;
+
+  while (done < size)
+    {
+      size_t amount = size - done;
+      ssize_t wr;
+
+      if (amount > WRITE_SIZE)
+	amount = WRITE_SIZE;
+      wr = write (fd, text + done, amount);
+      if (wr < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  error (1, errno, "write");
+	}
+      done += wr;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  int passes = 10, pass;
+  size_t size, lines = 0, i;
+  double start, secs;
+  char params[32], *text;
+  int fd = STDOUT_FILENO;
+
+  if (argc < 2 || argc > 4)
+    {
+      fprintf (stderr, "Usage: %s FILE [PASSES [TTY]]\n", argv[0]);
+      exit (1);
+    }
+  if (argc > 2)
+    passes = atoi (argv[2]);
+  if (argc > 3)
+    {
+      fd = open (argv[3], O_WRONLY | O_NOCTTY);
+      if (fd < 0)
+	error (1, errno, "%s", argv[3]);
+    }
+  if (passes < 1)
+    error (1, 0, "need at least one pass");
+
+  text = slurp (argv[1], &size);
+  for (i = 0; i < size; i++)
+    if (text[i] == '\n')
+      lines++;
+
+  start = bench_now ();
+  for (pass = 0; pass < passes; pass++)
+    replay (fd, text, size);
+  tcdrain (fd);
+  secs = bench_now () - start;
+
+  /* If the text went to standard output too, this comes last.  */
+  snprintf (params, sizeof params, "bytes=%zu", size * passes);
+  bench_report ("console", params, lines * passes, secs, 0);
+
+  return 0;
+}
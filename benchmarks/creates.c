@@ -0,0 +1,148 @@
+/* Parallel file creation benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Creates and then unlinks files from several threads at once, each in
+   its own subdirectory of DIR, and reports the rate of each operation
+   for 1, 2, 4, ... threads.  Using a directory per thread keeps the
+   directory locks out of the picture, so what's left is the
+   filesystem's node allocation and bookkeeping.  Run it on a fresh
+   tmpfs (or any other filesystem) to compare.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <error.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+static const char *top_dir;
+static size_t files_per_thread;
+static pthread_barrier_t barrier;
+
+/* Create FILES_PER_THREAD files in a directory of our own, wait for the
+   other threads, then unlink them all.  ARG is the thread number.  */
+static void *
+worker (void *arg)
+{
+  int id = (int) (intptr_t) arg;
+  char name[strlen (top_dir) + 64];
+  size_t dirlen, i;
+
+  dirlen = snprintf (name, sizeof name, "%s/t%d", top_dir, id);
+  if (mkdir (name, 0755) < 0 && errno != EEXIST)
+    error (1, errno, "%s", name);
+
+  pthread_barrier_wait (&barrier);
+  for (i = 0; i < files_per_thread; i++)
+    {
+      int fd;
+      snprintf (name + dirlen, sizeof name - dirlen, "/f%zu", i);
+      fd = open (name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+      if (fd < 0)
+	error (1, errno, "%s", name);
+      close (fd);
+    }
+
+  pthread_barrier_wait (&barrier);
+  for (i = 0; i < files_per_thread; i++)
+    {
+      snprintf (name + dirlen, sizeof name - dirlen, "/f%zu", i);
+      if (unlink (name) < 0)
+	error (1, errno, "%s", name);
+    }
+
+  pthread_barrier_wait (&barrier);
+  name[dirlen] = '\0';
+  rmdir (name);
+  return 0;
+}
+
+/* Run the benchmark with NTHREADS threads, and store the time taken by
+   the create and unlink phases in *CREATE_SECS and *UNLINK_SECS.  */
+static void
+run (int nthreads, double *create_secs, double *unlink_secs)
+{
+  pthread_t threads[nthreads];
+  double start, mid, end;
+  int i;
+
+  pthread_barrier_init (&barrier, 0, nthreads + 1);
+  for (i = 0; i < nthreads; i++)
+    {
+      int err = pthread_create (&threads[i], 0, worker,
+				(void *) (intptr_t) i);
+      if (err)
+	error (1, err, "pthread_create");
+    }
+
+  pthread_barrier_wait (&barrier);
+  start = bench_now ();
+  pthread_barrier_wait (&barrier);
+  mid = bench_now ();
+  pthread_barrier_wait (&barrier);
+  end = bench_now ();
+
+  for (i = 0; i < nthreads; i++)
+    pthread_join (threads[i], 0);
+  pthread_barrier_destroy (&barrier);
+
+  *create_secs = mid - start;
+  *unlink_secs = end - mid;
+}
+
+int
+main (int argc, char **argv)
+{
+  int max_threads = 8, nthreads;
+  size_t total = 100000;
+
+  if (argc < 2 || argc > 4)
+    {
+      fprintf (stderr, "Usage: %s DIR [MAX-THREADS [FILES]]\n", argv[0]);
+      exit (1);
+    }
+  top_dir = argv[1];
+  if (argc > 2)
+    max_threads = atoi (argv[2]);
+  if (argc > 3)
+    total = strtoul (argv[3], 0, 0);
+  if (max_threads < 1)
+    error (1, 0, "need at least one thread");
+
+  for (nthreads = 1; nthreads <= max_threads; nthreads *= 2)
+    {
+      double create_secs, unlink_secs;
+      char params[32];
+      size_t files;
+
+      files_per_thread = total / nthreads;
+      files = files_per_thread * nthreads;
+      run (nthreads, &create_secs, &unlink_secs);
+      snprintf (params, sizeof params, "threads=%d", nthreads);
+      bench_report ("create", params, files, create_secs, 0);
+      bench_report ("unlink", params, files, unlink_secs, 0);
+    }
+
+  return 0;
+}
@@ -0,0 +1,80 @@
+/* Exec rate benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Forks and execs PROGRAM (by default /bin/true) over and over, waiting
+   for each child to exit, and reports how many execs a second that
+   makes.  Subtract the time `forks' takes for the same number of forks
+   to get the exec overhead itself.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <error.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+int
+main (int argc, char **argv)
+{
+  int nexecs, i;
+  char *program = "/bin/true";
+  char params[1024];
+  struct bench_samples lat;
+  double start, secs;
+
+  if (argc < 2 || argc > 3)
+    {
+      fprintf (stderr, "Usage: %s NUMBER-OF-EXECS [PROGRAM]\n", argv[0]);
+      exit (1);
+    }
+  nexecs = atoi (argv[1]);
+  if (nexecs < 1)
+    error (1, 0, "need at least one exec");
+  if (argc > 2)
+    program = argv[2];
+
+  bench_samples_init (&lat, nexecs);
+  start = bench_now ();
+  for (i = 0; i < nexecs; i++)
+    {
+      int status;
+      double t0 = bench_now ();
+      pid_t pid = fork ();
+
+      if (pid == -1)
+	error (1, errno, "fork");
+      if (pid == 0)
+	{
+	  execl (program, program, (char *) 0);
+	  _exit (127);
+	}
+      if (waitpid (pid, &status, 0) == -1)
+	error (1, errno, "waitpid");
+      if (! WIFEXITED (status) || WEXITSTATUS (status) == 127)
+	error (1, 0, "%s: could not be run", program);
+      bench_samples_add (&lat, bench_now () - t0);
+    }
+  secs = bench_now () - start;
+
+  snprintf (params, sizeof params, "program=%s", program);
+  bench_report ("exec", params, nexecs, secs, &lat);
+  bench_samples_free (&lat);
+  return 0;
+}
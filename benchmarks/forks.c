@@ -3,8 +3,12 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
+#include <hurd.h>
+
+#include "bench.h"
 
 /*
  * Benchmark program to calculate fork+wait
@@ -12,7 +16,96 @@
  * forks and exits while parent waits.
  * The time to run this program is used
  * in calculating exec overhead.
+ *
+ * With more than one forker, that many processes
+ * fork and wait at the same time, and with
+ * queriers, that many more processes keep asking
+ * the proc server about every process, as ps and
+ * top do, meanwhile.  This shows how well process
+ * creation and exit scale, and how much they are
+ * held up by monitoring tools.
+ */
+
+/*
+ * Fork and wait for NFORKS children, one at a time.
+ */
+static void
+forker(nforks)
+	int nforks;
+{
+	int pid, child, status;
+
+	while (nforks-- > 0) {
+		child = fork();
+		if (child == -1) {
+			perror("fork");
+			exit(-1);
+		}
+		if (child == 0)
+			_exit(-1);
+		while ((pid = wait(&status)) != -1 && pid != child)
+			;
+	}
+}
+
+/*
+ * Get the basic information about every process from the
+ * proc server, over and over, until killed.
  */
+static void
+querier()
+{
+	process_t proc = getproc();
+	pid_t *pids;
+	mach_msg_type_number_t npids, i;
+
+	for (;;) {
+		pids = 0;
+		npids = 0;
+		if (proc_getallpids(proc, &pids, &npids)) {
+			perror("proc_getallpids");
+			_exit(1);
+		}
+		for (i = 0; i < npids; i++) {
+			procinfo_t pi = 0;
+			mach_msg_type_number_t pi_len = 0;
+			data_t waits = 0;
+			mach_msg_type_number_t waits_len = 0;
+			int flags = PI_FETCH_TASKINFO;
+
+			if (proc_getprocinfo(proc, pids[i], &flags,
+			    &pi, &pi_len, &waits, &waits_len))
+				continue;
+			if (pi_len > 0)
+				munmap(pi, pi_len * sizeof (int));
+			if (waits_len > 0)
+				munmap(waits, waits_len);
+		}
+		munmap(pids, npids * sizeof (pid_t));
+	}
+}
+
+/*
+ * Start a child process running FN with argument ARG, and
+ * return its pid.
+ */
+static pid_t
+spawn(fn, arg)
+	void (*fn)();
+	int arg;
+{
+	pid_t pid = fork();
+
+	if (pid == -1) {
+		perror("fork");
+		exit(4);
+	}
+	if (pid == 0) {
+		(*fn)(arg);
+		_exit(0);
+	}
+	return pid;
+}
 
 int
 main(argc, argv)
@@ -21,11 +114,14 @@ main(argc, argv)
 {
 	register int nforks, i;
 	char *cp;
-	int pid, child, status, brksize;
-	time_t starttime, endtime;
+	int status, brksize, nforkers = 1, nqueriers = 0;
+	pid_t *forkers, *queriers;
+	double starttime, secs;
+	char params[64];
 
-	if (argc < 3) {
-		printf("usage: %s number-of-forks sbrk-size\n", argv[0]);
+	if (argc < 3 || argc > 5) {
+		printf("usage: %s number-of-forks sbrk-size [forkers [queriers]]\n",
+		    argv[0]);
 		exit(1);
 	}
 	nforks = atoi(argv[1]);
@@ -38,8 +134,26 @@ main(argc, argv)
 		printf("%s: bad size to sbrk\n", argv[2]);
 		exit(3);
 	}
+	if (argc > 3)
+		nforkers = atoi(argv[3]);
+	if (nforkers < 1) {
+		printf("%s: bad number of forkers\n", argv[3]);
+		exit(2);
+	}
+	if (argc > 4)
+		nqueriers = atoi(argv[4]);
+	if (nqueriers < 0) {
+		printf("%s: bad number of queriers\n", argv[4]);
+		exit(2);
+	}
+
+	forkers = malloc(nforkers * sizeof (pid_t));
+	queriers = malloc((nqueriers + 1) * sizeof (pid_t));
+	if (forkers == NULL || queriers == NULL) {
+		perror("malloc");
+		exit(4);
+	}
 
-	time (&starttime);
 	cp = (char *)sbrk(brksize);
 	if (cp == (void *)-1) {
 		perror("sbrk");
@@ -47,18 +161,28 @@ main(argc, argv)
 	}
 	for (i = 0; i < brksize; i += 1024)
 		cp[i] = i;
-	while (nforks-- > 0) {
-		child = fork();
-		if (child == -1) {
-			perror("fork");
-			exit(-1);
-		}
-		if (child == 0)
-			_exit(-1);
-		while ((pid = wait(&status)) != -1 && pid != child)
-			;
+
+	for (i = 0; i < nqueriers; i++)
+		queriers[i] = spawn(querier, 0);
+
+	starttime = bench_now();
+	if (nforkers == 1)
+		forker(nforks);
+	else {
+		for (i = 0; i < nforkers; i++)
+			forkers[i] = spawn(forker, nforks);
+		for (i = 0; i < nforkers; i++)
+			waitpid(forkers[i], &status, 0);
 	}
-	time (&endtime);
-	printf ("Time: %d seconds.\n", (int) (endtime - starttime));
+	secs = bench_now() - starttime;
+
+	for (i = 0; i < nqueriers; i++) {
+		kill(queriers[i], SIGKILL);
+		waitpid(queriers[i], &status, 0);
+	}
+
+	snprintf(params, sizeof params, "sbrk=%d forkers=%d queriers=%d",
+	    brksize, nforkers, nqueriers);
+	bench_report("fork", params, (size_t) nforks * nforkers, secs, 0);
 	exit(0);
 }
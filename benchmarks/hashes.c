@@ -0,0 +1,128 @@
+/* libihash benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Fills a hash table with 1000, 10000, ... keys that look like the
+   object addresses the servers use as keys, then looks each one up,
+   looks up as many keys that are not there, and removes them all
+   again, reporting the rate of each operation.  Latencies are timed
+   over batches of BATCH operations, as a single one is too short to
+   time.  */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <error.h>
+#include <errno.h>
+
+#include "../libihash/ihash.h"
+#include "bench.h"
+
+#define BATCH 64
+
+/* The Ith key.  */
+static inline hurd_ihash_key_t
+key (size_t i)
+{
+  return 0x10000000 + i * 48;
+}
+
+/* What to do to the hash table in a run.  */
+enum op { ADD, FIND, MISS, REMOVE };
+static const char *const op_names[] = { "add", "find", "miss", "remove" };
+
+/* Do OP on HT for keys 0 to NKEYS - 1, and report it.  */
+static void
+run (hurd_ihash_t ht, enum op op, size_t nkeys)
+{
+  struct bench_samples lat;
+  char params[64];
+  double start, batch_start;
+  size_t i;
+
+  bench_samples_init (&lat, nkeys / BATCH + 1);
+  start = batch_start = bench_now ();
+  for (i = 0; i < nkeys; i++)
+    {
+      error_t err;
+
+      switch (op)
+	{
+	case ADD:
+	  err = hurd_ihash_add (ht, key (i), (void *) (i + 1));
+	  if (err)
+	    error (1, err, "hurd_ihash_add");
+	  break;
+	case FIND:
+	  if (hurd_ihash_find (ht, key (i)) != (void *) (i + 1))
+	    error (1, 0, "key %zu not found", i);
+	  break;
+	case MISS:
+	  if (hurd_ihash_find (ht, key (i) + 8))
+	    error (1, 0, "found missing key %zu", i);
+	  break;
+	case REMOVE:
+	  if (! hurd_ihash_remove (ht, key (i)))
+	    error (1, 0, "key %zu not removed", i);
+	  break;
+	}
+
+      if ((i + 1) % BATCH == 0)
+	{
+	  double t = bench_now ();
+	  bench_samples_add (&lat, (t - batch_start) / BATCH);
+	  batch_start = t;
+	}
+    }
+
+  snprintf (params, sizeof params, "op=%s keys=%zu", op_names[op], nkeys);
+  bench_report ("ihash", params, nkeys, bench_now () - start, &lat);
+  bench_samples_free (&lat);
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t max_keys = 1000000, nkeys;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [MAX-KEYS]\n", argv[0]);
+      exit (1);
+    }
+  if (argc == 2)
+    max_keys = strtoul (argv[1], 0, 0);
+  if (max_keys < 1000)
+    error (1, 0, "need at least 1000 keys");
+
+  for (nkeys = 1000; nkeys <= max_keys; nkeys *= 10)
+    {
+      hurd_ihash_t ht;
+      error_t err = hurd_ihash_create (&ht, HURD_IHASH_NO_LOCP);
+      if (err)
+	error (1, err, "hurd_ihash_create");
+
+      run (ht, ADD, nkeys);
+      run (ht, FIND, nkeys);
+      run (ht, MISS, nkeys);
+      run (ht, REMOVE, nkeys);
+
+      hurd_ihash_free (ht);
+    }
+
+  return 0;
+}
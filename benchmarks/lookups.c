@@ -0,0 +1,116 @@
+/* Directory lookup benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Creates FILES files in a new directory in DIR, then looks each of them
+   up, looks up as many names that are not there, and unlinks them all,
+   timing every operation.  Lookups go through the filesystem's name
+   cache, hits and misses both, so the first two show how well it
+   does.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <error.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+
+static char dir[1024];
+
+/* What to do to each name.  */
+enum op { CREATE, LOOKUP, MISS, UNLINK };
+static const char *const op_names[] = { "create", "lookup", "miss", "unlink" };
+
+/* Do OP for the NFILES names in DIR, and report it.  */
+static void
+run (enum op op, size_t nfiles)
+{
+  struct bench_samples lat;
+  char name[1100], params[64];
+  double start;
+  size_t i;
+
+  bench_samples_init (&lat, nfiles);
+  start = bench_now ();
+  for (i = 0; i < nfiles; i++)
+    {
+      struct stat st;
+      double op_start;
+      int fd;
+
+      snprintf (name, sizeof name, "%s/%s%zu", dir,
+		op == MISS ? "m" : "f", i);
+      op_start = bench_now ();
+      switch (op)
+	{
+	case CREATE:
+	  fd = open (name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	  if (fd < 0)
+	    error (1, errno, "%s", name);
+	  close (fd);
+	  break;
+	case LOOKUP:
+	  if (stat (name, &st) < 0)
+	    error (1, errno, "%s", name);
+	  break;
+	case MISS:
+	  if (stat (name, &st) == 0 || errno != ENOENT)
+	    error (1, errno, "%s: found", name);
+	  break;
+	case UNLINK:
+	  if (unlink (name) < 0)
+	    error (1, errno, "%s", name);
+	  break;
+	}
+      bench_samples_add (&lat, bench_now () - op_start);
+    }
+
+  snprintf (params, sizeof params, "op=%s files=%zu", op_names[op], nfiles);
+  bench_report ("lookup", params, nfiles, bench_now () - start, &lat);
+  bench_samples_free (&lat);
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t nfiles = 10000;
+
+  if (argc < 2 || argc > 3)
+    {
+      fprintf (stderr, "Usage: %s DIR [FILES]\n", argv[0]);
+      exit (1);
+    }
+  if (argc > 2)
+    nfiles = strtoul (argv[2], 0, 0);
+  if (nfiles < 1)
+    error (1, 0, "need at least one file");
+
+  snprintf (dir, sizeof dir, "%s/lookups.tmp", argv[1]);
+  if (mkdir (dir, 0755) < 0)
+    error (1, errno, "%s", dir);
+
+  run (CREATE, nfiles);
+  run (LOOKUP, nfiles);
+  run (MISS, nfiles);
+  run (UNLINK, nfiles);
+
+  rmdir (dir);
+  return 0;
+}
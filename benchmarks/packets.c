@@ -0,0 +1,153 @@
+/* libpipe packet queue benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Puts messages of 16 bytes to 64 KiB through a libpipe packet queue
+   the way pipes do it, DEPTH at a time, without any IPC: as datagrams,
+   one packet per message, and as a stream, appending to the packet at
+   the tail.  It reports the rate of messages written and read back, so
+   it shows what pflocal spends in the queue itself.  Latencies are for
+   writing and reading a message, timed over each batch of DEPTH.  */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "../libpipe/pq.h"
+#include "bench.h"
+
+#define MAX_MSG_SIZE (64 * 1024)
+#define DEPTH 16
+
+static char *in_buf, *out_buf;
+
+/* Write a message of SIZE bytes to PQ, as its own packet if DGRAM.  */
+static void
+put (struct pq *pq, size_t size, int dgram)
+{
+  struct packet *packet;
+  error_t err;
+
+  if (dgram)
+    packet = pq_queue (pq, PACKET_TYPE_DATA, NULL);
+  else
+    packet = pq_tail (pq, PACKET_TYPE_DATA, NULL);
+  if (! packet)
+    error (1, ENOMEM, "pq_queue");
+
+  err = packet_write (packet, in_buf, size, NULL);
+  if (err)
+    error (1, err, "packet_write");
+}
+
+/* Read a message of SIZE bytes from PQ, dropping the head packet if it
+   is empty then.  */
+static void
+get (struct pq *pq, size_t size)
+{
+  struct packet *packet = pq_head (pq, PACKET_TYPE_DATA, NULL);
+  char *data = out_buf;
+  size_t len = MAX_MSG_SIZE;
+  error_t err;
+
+  if (! packet)
+    error (1, 0, "queue is empty");
+  err = packet_read (packet, &data, &len, size);
+  if (err)
+    error (1, err, "packet_read");
+  if (len != size)
+    error (1, 0, "read %zu bytes instead of %zu", len, size);
+  if (data != out_buf)
+    munmap (data, len);
+
+  if (packet_readable (packet) == 0)
+    pq_dequeue (pq);
+}
+
+/* Run COUNT messages of SIZE bytes through a new queue.  */
+static void
+run (size_t size, size_t count, int dgram)
+{
+  struct bench_samples lat;
+  struct pq *pq;
+  char params[64];
+  double start;
+  size_t done;
+  error_t err;
+  int i;
+
+  err = pq_create (&pq);
+  if (err)
+    error (1, err, "pq_create");
+
+  bench_samples_init (&lat, count / DEPTH + 1);
+  start = bench_now ();
+  for (done = 0; done < count; done += DEPTH)
+    {
+      double batch_start = bench_now ();
+
+      for (i = 0; i < DEPTH; i++)
+	put (pq, size, dgram);
+      for (i = 0; i < DEPTH; i++)
+	get (pq, size);
+
+      bench_samples_add (&lat, (bench_now () - batch_start) / DEPTH);
+    }
+
+  snprintf (params, sizeof params, "mode=%s size=%zu",
+	    dgram ? "dgram" : "stream", size);
+  bench_report ("pq", params, done, bench_now () - start, &lat);
+  bench_samples_free (&lat);
+  pq_free (pq);
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t total = 256 * 1024 * 1024;
+  size_t size;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [BYTES-PER-SIZE]\n", argv[0]);
+      exit (1);
+    }
+  if (argc == 2)
+    total = strtoul (argv[1], 0, 0);
+
+  in_buf = malloc (MAX_MSG_SIZE);
+  out_buf = malloc (MAX_MSG_SIZE);
+  if (! in_buf || ! out_buf)
+    error (1, ENOMEM, "buffers");
+  memset (in_buf, 'x', MAX_MSG_SIZE);
+
+  for (size = 16; size <= MAX_MSG_SIZE; size *= 16)
+    {
+      size_t count = total / size;
+      if (count > 1000000)
+	count = 1000000;
+      if (count < DEPTH)
+	count = DEPTH;
+      run (size, count, 1);
+      run (size, count, 0);
+    }
+
+  return 0;
+}
@@ -0,0 +1,146 @@
+/* Pipe throughput benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Writes messages of sizes from 1 byte to 1 MiB through a pipe to a child
+   process that reads them, and reports the throughput for each size.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+
+#define MAX_MSG_SIZE  (1024*1024)
+
+/* Don't send more than this many messages of any one size.  */
+#define MAX_MSGS      100000
+
+/* Read from FD until EOF, and return the number of bytes read.  */
+static size_t
+drain (int fd, char *buf)
+{
+  size_t total = 0;
+  for (;;)
+    {
+      ssize_t rd = read (fd, buf, MAX_MSG_SIZE);
+      if (rd < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  error (1, errno, "read");
+	}
+      if (rd == 0)
+	return total;
+      total += rd;
+    }
+}
+
+/* Send COUNT messages of SIZE bytes from BUF through a new pipe, and
+   return the number of seconds it took for them all to be read.  */
+static double
+run (char *buf, size_t size, size_t count)
+{
+  int fds[2], status;
+  pid_t child;
+  double start, end;
+  size_t i;
+
+  if (pipe (fds) < 0)
+    error (1, errno, "pipe");
+
+  child = fork ();
+  if (child < 0)
+    error (1, errno, "fork");
+  if (child == 0)
+    {
+      size_t got;
+      close (fds[1]);
+      got = drain (fds[0], buf);
+      _exit (got == size * count ? 0 : 1);
+    }
+
+  close (fds[0]);
+  start = bench_now ();
+  for (i = 0; i < count; i++)
+    {
+      size_t done = 0;
+      while (done < size)
+	{
+	  ssize_t wr = write (fds[1], buf + done, size - done);
+	  if (wr < 0)
+	    {
+	      if (errno == EINTR)
+		continue;
+	      error (1, errno, "write");
+	    }
+	  done += wr;
+	}
+    }
+  close (fds[1]);
+
+  if (waitpid (child, &status, 0) < 0)
+    error (1, errno, "waitpid");
+  end = bench_now ();
+
+  if (! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    error (1, 0, "reader lost data with %zu byte messages", size);
+
+  return end - start;
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t total = 64 * 1024 * 1024;
+  size_t size;
+  char *buf;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [BYTES-PER-SIZE]\n", argv[0]);
+      exit (1);
+    }
+  if (argc == 2)
+    total = strtoul (argv[1], 0, 0);
+
+  /* Page aligned, so large writes can take the zero-copy path.  */
+  buf = valloc (MAX_MSG_SIZE);
+  if (! buf)
+    error (1, ENOMEM, "buffer");
+  memset (buf, 'x', MAX_MSG_SIZE);
+
+  for (size = 1; size <= MAX_MSG_SIZE; size *= 4)
+    {
+      size_t count = total / size;
+      char params[32];
+
+      if (count > MAX_MSGS)
+	count = MAX_MSGS;
+      if (count == 0)
+	count = 1;
+
+      snprintf (params, sizeof params, "size=%zu", size);
+      bench_report ("pipe", params, count, run (buf, size, count), 0);
+    }
+
+  return 0;
+}
@@ -0,0 +1,126 @@
+/* Process information benchmark: proc_getprocinfo versus proc_getprocinfos
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Gets the same information ps gets by default for every process on the
+   system, first with a proc_getprocinfo call for each process and then
+   with a single proc_getprocinfos call, and reports how long a round of
+   each took.  Run it with more processes around (say with `forks') to
+   see how the two grow.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <hurd.h>
+
+#include "process_U.h"
+#include "bench.h"
+
+#define PI_FLAGS (PI_FETCH_TASKINFO | PI_FETCH_THREADS | PI_FETCH_THREAD_BASIC)
+
+/* Get the information for the NPIDS processes PIDS from PROC one
+   process at a time.  */
+static void
+one_by_one (process_t proc, pid_t *pids, size_t npids)
+{
+  size_t i;
+
+  for (i = 0; i < npids; i++)
+    {
+      procinfo_t pi = 0;
+      mach_msg_type_number_t pi_len = 0;
+      data_t waits = 0;
+      mach_msg_type_number_t waits_len = 0;
+      int flags = PI_FLAGS;
+
+      if (proc_getprocinfo (proc, pids[i], &flags, &pi, &pi_len,
+			    &waits, &waits_len))
+	continue;		/* It's gone.  */
+      if (pi_len > 0)
+	munmap (pi, pi_len * sizeof (int));
+      if (waits_len > 0)
+	munmap (waits, waits_len);
+    }
+}
+
+/* Get the information for the NPIDS processes PIDS from PROC all at
+   once.  */
+static void
+batched (process_t proc, pid_t *pids, size_t npids)
+{
+  procinfo_t pi = 0;
+  int *lengths = 0, *infoflags = 0;
+  mach_msg_type_number_t pi_len = 0, lengths_len = 0, infoflags_len = 0;
+  error_t err;
+
+  err = proc_getprocinfos (proc, pids, npids, PI_FLAGS, &pi, &pi_len,
+			   &lengths, &lengths_len, &infoflags, &infoflags_len);
+  if (err)
+    error (1, err, "proc_getprocinfos");
+  if (pi_len > 0)
+    munmap (pi, pi_len * sizeof (int));
+  if (lengths_len > 0)
+    munmap (lengths, lengths_len * sizeof (int));
+  if (infoflags_len > 0)
+    munmap (infoflags, infoflags_len * sizeof (int));
+}
+
+int
+main (int argc, char **argv)
+{
+  int rounds = 100, round;
+  process_t proc = getproc ();
+  pid_t *pids = 0;
+  mach_msg_type_number_t npids = 0;
+  double start;
+  char params[64];
+  error_t err;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [ROUNDS]\n", argv[0]);
+      exit (1);
+    }
+  if (argc == 2)
+    rounds = atoi (argv[1]);
+  if (rounds < 1)
+    error (1, 0, "need at least one round");
+
+  err = proc_getallpids (proc, &pids, &npids);
+  if (err)
+    error (1, err, "proc_getallpids");
+
+  /* Each operation gets the information of all the processes.  */
+  start = bench_now ();
+  for (round = 0; round < rounds; round++)
+    one_by_one (proc, pids, npids);
+  snprintf (params, sizeof params, "mode=single processes=%u", npids);
+  bench_report ("procinfo", params, rounds, bench_now () - start, 0);
+
+  start = bench_now ();
+  for (round = 0; round < rounds; round++)
+    batched (proc, pids, npids);
+  snprintf (params, sizeof params, "mode=batched processes=%u", npids);
+  bench_report ("procinfo", params, rounds, bench_now () - start, 0);
+
+  munmap (pids, npids * sizeof (pid_t));
+  return 0;
+}
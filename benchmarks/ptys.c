@@ -0,0 +1,183 @@
+/* Pseudo-terminal throughput benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Puts a new pty in raw mode and pushes data through it in both
+   directions, from the slave to the master (program output) and from
+   the master to the slave (program input), with writes of sizes from 1
+   byte to 64 KiB.  Reports the throughput for each size and
+   direction.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <error.h>
+#include <errno.h>
+#include <pthread.h>
+#include <termios.h>
+
+#include "bench.h"
+
+#define MAX_WRITE_SIZE (64 * 1024)
+
+/* Don't do more than this many writes of any one size.  */
+#define MAX_WRITES     200000
+
+struct writer
+{
+  int fd;
+  const char *buf;
+  size_t size, count;
+};
+
+/* Write W->count blocks of W->size bytes from W->buf to W->fd.  */
+static void *
+writer (void *arg)
+{
+  struct writer *w = arg;
+  size_t i;
+
+  for (i = 0; i < w->count; i++)
+    {
+      size_t done = 0;
+      while (done < w->size)
+	{
+	  ssize_t wr = write (w->fd, w->buf + done, w->size - done);
+	  if (wr < 0)
+	    {
+	      if (errno == EINTR)
+		continue;
+	      error (1, errno, "write");
+	    }
+	  done += wr;
+	}
+    }
+  return 0;
+}
+
+/* Open a new pty, and return the master and slave descriptors in
+   *MASTER and *SLAVE.  The slave is put in raw mode.  */
+static void
+open_pty (int *master, int *slave)
+{
+  struct termios t;
+  char *name;
+
+  *master = posix_openpt (O_RDWR | O_NOCTTY);
+  if (*master < 0)
+    error (1, errno, "posix_openpt");
+  if (grantpt (*master) < 0 || unlockpt (*master) < 0)
+    error (1, errno, "pty master");
+  name = ptsname (*master);
+  if (! name)
+    error (1, errno, "ptsname");
+  *slave = open (name, O_RDWR | O_NOCTTY);
+  if (*slave < 0)
+    error (1, errno, "%s", name);
+
+  if (tcgetattr (*slave, &t) < 0)
+    error (1, errno, "tcgetattr");
+  cfmakeraw (&t);
+  if (tcsetattr (*slave, TCSANOW, &t) < 0)
+    error (1, errno, "tcsetattr");
+}
+
+/* Write COUNT blocks of SIZE bytes from BUF to FROM in another thread,
+   read them all back from TO into RBUF, and return the number of
+   seconds it took.  */
+static double
+run (int from, int to, const char *buf, char *rbuf,
+     size_t size, size_t count)
+{
+  struct writer w = { from, buf, size, count };
+  size_t want = size * count, got = 0;
+  pthread_t thread;
+  double start, end;
+  int err;
+
+  start = bench_now ();
+  err = pthread_create (&thread, 0, writer, &w);
+  if (err)
+    error (1, err, "pthread_create");
+
+  while (got < want)
+    {
+      ssize_t rd = read (to, rbuf, MAX_WRITE_SIZE);
+      if (rd < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  error (1, errno, "read");
+	}
+      if (rd == 0)
+	error (1, 0, "unexpected EOF with %zu byte writes", size);
+      got += rd;
+    }
+  end = bench_now ();
+
+  pthread_join (thread, 0);
+  return end - start;
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t total = 16 * 1024 * 1024;
+  size_t size;
+  char *buf, *rbuf;
+  int master, slave;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [BYTES-PER-SIZE]\n", argv[0]);
+      exit (1);
+    }
+  if (argc == 2)
+    total = strtoul (argv[1], 0, 0);
+
+  buf = malloc (MAX_WRITE_SIZE);
+  rbuf = malloc (MAX_WRITE_SIZE);
+  if (! buf || ! rbuf)
+    error (1, ENOMEM, "buffer");
+  memset (buf, 'x', MAX_WRITE_SIZE);
+
+  open_pty (&master, &slave);
+
+  for (size = 1; size <= MAX_WRITE_SIZE; size *= 4)
+    {
+      size_t count = total / size;
+      char params[64];
+
+      if (count > MAX_WRITES)
+	count = MAX_WRITES;
+      if (count == 0)
+	count = 1;
+
+      snprintf (params, sizeof params, "direction=output size=%zu", size);
+      bench_report ("pty", params, count,
+		    run (slave, master, buf, rbuf, size, count), 0);
+      snprintf (params, sizeof params, "direction=input size=%zu", size);
+      bench_report ("pty", params, count,
+		    run (master, slave, buf, rbuf, size, count), 0);
+    }
+
+  close (slave);
+  close (master);
+  return 0;
+}
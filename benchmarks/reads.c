@@ -0,0 +1,127 @@
+/* File read benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Writes a file in DIR, then reads it sequentially over and over with
+   read calls of sizes from 512 bytes to 1 MiB, and reports the rate of
+   calls and bytes for each size.  The file is small enough to stay in
+   memory, so this measures the cost of the calls themselves.  Run it
+   on ext2fs and on tmpfs to compare.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <error.h>
+#include <errno.h>
+
+#include "bench.h"
+
+#define MIN_READ_SIZE 512
+#define MAX_READ_SIZE (1024 * 1024)
+
+/* Fill the file open on FD with FILE_SIZE bytes from BUF.  */
+static void
+fill (int fd, const char *buf, size_t file_size)
+{
+  size_t done = 0;
+
+  while (done < file_size)
+    {
+      size_t amount = file_size - done;
+      ssize_t wr;
+
+      if (amount > MAX_READ_SIZE)
+	amount = MAX_READ_SIZE;
+      wr = write (fd, buf, amount);
+      if (wr < 0)
+	error (1, errno, "write");
+      done += wr;
+    }
+}
+
+/* Read BYTES bytes from the FILE_SIZE byte file open on FD, SIZE bytes
+   at a time from the start of the file on, wrapping around at its
+   end.  */
+static void
+pass (int fd, char *buf, size_t file_size, size_t size, size_t bytes)
+{
+  off_t offset = 0;
+  size_t done;
+
+  for (done = 0; done < bytes; done += size)
+    {
+      ssize_t rd = pread (fd, buf, size, offset);
+      if (rd < 0)
+	error (1, errno, "read");
+      if ((size_t) rd != size)
+	error (1, 0, "short read");
+      offset += size;
+      if (offset + size > file_size)
+	offset = 0;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t file_size = 16 * 1024 * 1024;
+  size_t total = 256 * 1024 * 1024;
+  size_t size;
+  char name[1024];
+  char *buf;
+  int fd;
+
+  if (argc < 2 || argc > 3)
+    {
+      fprintf (stderr, "Usage: %s DIR [BYTES-PER-SIZE]\n", argv[0]);
+      exit (1);
+    }
+  if (argc == 3)
+    total = strtoul (argv[2], 0, 0);
+
+  buf = valloc (MAX_READ_SIZE);
+  if (! buf)
+    error (1, ENOMEM, "buffer");
+  memset (buf, 'x', MAX_READ_SIZE);
+
+  snprintf (name, sizeof name, "%s/reads.tmp", argv[1]);
+  fd = open (name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    error (1, errno, "%s", name);
+  fill (fd, buf, file_size);
+
+  for (size = MIN_READ_SIZE; size <= MAX_READ_SIZE; size *= 2)
+    {
+      size_t bytes = total / size * size;
+      double start;
+      char params[32];
+
+      /* Warm up the file's pages first.  */
+      pass (fd, buf, file_size, size, file_size);
+
+      start = bench_now ();
+      pass (fd, buf, file_size, size, bytes);
+      snprintf (params, sizeof params, "size=%zu", size);
+      bench_report ("read", params, bytes / size, bench_now () - start, 0);
+    }
+
+  close (fd);
+  unlink (name);
+  return 0;
+}
@@ -0,0 +1,192 @@
+/* libports RPC round-trip benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Serves a port with ports_manage_port_operations_multithread, as the
+   servers do, with a demuxer that answers one empty RPC and does
+   nothing else, and has 1, 2, 4, ... client threads call it over and
+   over.  What is measured is Mach IPC plus libports' dispatch: the port
+   lookup, ports_begin_rpc and ports_end_rpc, and its thread pool.  */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <error.h>
+#include <errno.h>
+#include <pthread.h>
+#include <mach.h>
+#include <hurd/ports.h>
+
+#include "bench.h"
+
+/* The id of our RPC; no interface uses it.  */
+#define RPC_ID 31337
+
+static struct port_bucket *bucket;
+static mach_port_t server;
+static size_t calls;
+static pthread_barrier_t barrier;
+
+static int
+demuxer (mach_msg_header_t *inp, mach_msg_header_t *outp)
+{
+  if (inp->msgh_id != RPC_ID)
+    return 0;
+  ((mig_reply_header_t *) outp)->RetCode = 0;
+  return 1;
+}
+
+static void *
+serve (void *arg)
+{
+  ports_manage_port_operations_multithread (bucket, demuxer, 0, 0, 0);
+  return 0;
+}
+
+struct client
+{
+  pthread_t thread;
+  struct bench_samples lat;
+};
+
+/* Call the server CALLS times.  */
+static void *
+client (void *arg)
+{
+  struct client *c = arg;
+  mach_port_t reply = mach_reply_port ();
+  size_t i;
+
+  pthread_barrier_wait (&barrier);
+  for (i = 0; i < calls; i++)
+    {
+      union
+      {
+	mach_msg_header_t head;
+	mig_reply_header_t reply;
+      } msg;
+      double start = bench_now ();
+      error_t err;
+
+      msg.head.msgh_bits = MACH_MSGH_BITS (MACH_MSG_TYPE_COPY_SEND,
+					   MACH_MSG_TYPE_MAKE_SEND_ONCE);
+      msg.head.msgh_size = sizeof msg.head;
+      msg.head.msgh_remote_port = server;
+      msg.head.msgh_local_port = reply;
+      msg.head.msgh_seqno = 0;
+      msg.head.msgh_id = RPC_ID;
+
+      err = mach_msg (&msg.head, MACH_SEND_MSG | MACH_RCV_MSG,
+		      sizeof msg.head, sizeof msg, reply,
+		      MACH_MSG_TIMEOUT_NONE, MACH_PORT_NULL);
+      if (! err)
+	err = msg.reply.RetCode;
+      if (err)
+	error (1, err, "RPC");
+
+      bench_samples_add (&c->lat, bench_now () - start);
+    }
+  pthread_barrier_wait (&barrier);
+
+  mach_port_destroy (mach_task_self (), reply);
+  return 0;
+}
+
+/* Run the benchmark with NTHREADS client threads.  */
+static void
+run (int nthreads)
+{
+  struct client clients[nthreads];
+  struct bench_samples lat;
+  char params[32];
+  double start, end;
+  int i;
+
+  pthread_barrier_init (&barrier, 0, nthreads + 1);
+  for (i = 0; i < nthreads; i++)
+    {
+      error_t err;
+      bench_samples_init (&clients[i].lat, calls);
+      err = pthread_create (&clients[i].thread, 0, client, &clients[i]);
+      if (err)
+	error (1, err, "pthread_create");
+    }
+
+  pthread_barrier_wait (&barrier);
+  start = bench_now ();
+  pthread_barrier_wait (&barrier);
+  end = bench_now ();
+
+  bench_samples_init (&lat, calls * nthreads);
+  for (i = 0; i < nthreads; i++)
+    {
+      pthread_join (clients[i].thread, 0);
+      bench_samples_merge (&lat, &clients[i].lat);
+      bench_samples_free (&clients[i].lat);
+    }
+  pthread_barrier_destroy (&barrier);
+
+  snprintf (params, sizeof params, "threads=%d", nthreads);
+  bench_report ("rpc", params, calls * nthreads, end - start, &lat);
+  bench_samples_free (&lat);
+}
+
+int
+main (int argc, char **argv)
+{
+  struct port_class *class;
+  struct port_info *pi;
+  int max_threads = 8, nthreads;
+  pthread_t thread;
+  error_t err;
+
+  if (argc > 3)
+    {
+      fprintf (stderr, "Usage: %s [MAX-THREADS [CALLS]]\n", argv[0]);
+      exit (1);
+    }
+  calls = 100000;
+  if (argc > 1)
+    max_threads = atoi (argv[1]);
+  if (argc > 2)
+    calls = strtoul (argv[2], 0, 0);
+  if (max_threads < 1)
+    error (1, 0, "need at least one thread");
+  if (calls < 1)
+    error (1, 0, "need at least one call");
+
+  bucket = ports_create_bucket ();
+  class = ports_create_class (0, 0);
+  if (! bucket || ! class)
+    error (1, errno, "libports");
+  err = ports_create_port (class, bucket, sizeof *pi, &pi);
+  if (err)
+    error (1, err, "ports_create_port");
+  server = ports_get_send_right (pi);
+  if (server == MACH_PORT_NULL)
+    error (1, 0, "ports_get_send_right");
+
+  err = pthread_create (&thread, 0, serve, 0);
+  if (err)
+    error (1, err, "pthread_create");
+  pthread_detach (thread);
+
+  for (nthreads = 1; nthreads <= max_threads; nthreads *= 2)
+    run (nthreads);
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+/* Parallel reads of one file benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Writes a file in DIR, then has 1, 2, 4, ... threads read it at the
+   same time, each through its own descriptor, and reports the total
+   rate.  The file stays in memory, so if reads of one file can proceed
+   in parallel the rate should grow with the number of threads, up to
+   the number of processors.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <error.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "bench.h"
+
+#define FILE_SIZE (16 * 1024 * 1024)
+
+static const char *file_name;
+static size_t read_size = 64 * 1024;
+static size_t bytes_per_thread;
+static pthread_barrier_t barrier;
+
+/* Read BYTES_PER_THREAD bytes of the file, READ_SIZE bytes at a time,
+   starting at a different place for each thread and wrapping around at
+   the end.  ARG is the thread number.  */
+static void *
+worker (void *arg)
+{
+  int id = (int) (intptr_t) arg;
+  char *buf = malloc (read_size);
+  off_t offset = (off_t) id * 1024 * 1024 % FILE_SIZE;
+  size_t done;
+  int fd;
+
+  if (! buf)
+    error (1, ENOMEM, "buffer");
+  fd = open (file_name, O_RDONLY);
+  if (fd < 0)
+    error (1, errno, "%s", file_name);
+
+  pthread_barrier_wait (&barrier);
+  for (done = 0; done < bytes_per_thread; done += read_size)
+    {
+      ssize_t rd;
+
+      if (offset + read_size > FILE_SIZE)
+	offset = 0;
+      rd = pread (fd, buf, read_size, offset);
+      if (rd < 0)
+	error (1, errno, "%s", file_name);
+      if ((size_t) rd != read_size)
+	error (1, 0, "%s: short read", file_name);
+      offset += read_size;
+    }
+  pthread_barrier_wait (&barrier);
+
+  close (fd);
+  free (buf);
+  return 0;
+}
+
+/* Run the benchmark with NTHREADS threads, and return the number of
+   seconds it took.  */
+static double
+run (int nthreads)
+{
+  pthread_t threads[nthreads];
+  double start, end;
+  int i;
+
+  pthread_barrier_init (&barrier, 0, nthreads + 1);
+  for (i = 0; i < nthreads; i++)
+    {
+      int err = pthread_create (&threads[i], 0, worker,
+				(void *) (intptr_t) i);
+      if (err)
+	error (1, err, "pthread_create");
+    }
+
+  pthread_barrier_wait (&barrier);
+  start = bench_now ();
+  pthread_barrier_wait (&barrier);
+  end = bench_now ();
+
+  for (i = 0; i < nthreads; i++)
+    pthread_join (threads[i], 0);
+  pthread_barrier_destroy (&barrier);
+
+  return end - start;
+}
+
+int
+main (int argc, char **argv)
+{
+  int max_threads = 8, nthreads;
+  size_t total = 1024 * 1024 * 1024;
+  char name[1024];
+  char *buf;
+  size_t done;
+  int fd;
+
+  if (argc < 2 || argc > 4)
+    {
+      fprintf (stderr, "Usage: %s DIR [MAX-THREADS [READ-SIZE]]\n",
+	       argv[0]);
+      exit (1);
+    }
+  if (argc > 2)
+    max_threads = atoi (argv[2]);
+  if (argc > 3)
+    read_size = strtoul (argv[3], 0, 0);
+  if (max_threads < 1)
+    error (1, 0, "need at least one thread");
+  if (read_size < 1 || read_size > FILE_SIZE)
+    error (1, 0, "read size must be between 1 and %d", FILE_SIZE);
+
+  snprintf (name, sizeof name, "%s/sharedreads.tmp", argv[1]);
+  file_name = name;
+  fd = open (name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    error (1, errno, "%s", name);
+  buf = malloc (read_size);
+  if (! buf)
+    error (1, ENOMEM, "buffer");
+  memset (buf, 'x', read_size);
+  for (done = 0; done < FILE_SIZE; done += read_size)
+    if (write (fd, buf, read_size) < 0)
+      error (1, errno, "%s", name);
+  close (fd);
+  free (buf);
+
+  for (nthreads = 1; nthreads <= max_threads; nthreads *= 2)
+    {
+      char params[64];
+
+      bytes_per_thread = total / nthreads / read_size * read_size;
+      snprintf (params, sizeof params, "threads=%d size=%zu",
+		nthreads, read_size);
+      bench_report ("sharedread", params,
+		    bytes_per_thread / read_size * nthreads, run (nthreads), 0);
+    }
+
+  unlink (name);
+  return 0;
+}
@@ -0,0 +1,152 @@
+/* libhurd-slab benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Has 1, 2, 4, ... threads allocate a batch of objects from one slab
+   space and free them again, over and over, for a few object sizes, and
+   reports the rate of allocations and frees together.  All threads
+   share the space, as the threads of a server do, so this also shows
+   what its lock costs.  Latencies are timed over whole batches.  */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <error.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "../libhurd-slab/slab.h"
+#include "bench.h"
+
+#define BATCH 64
+
+static hurd_slab_space_t space;
+static size_t rounds;
+static pthread_barrier_t barrier;
+
+struct worker
+{
+  pthread_t thread;
+  struct bench_samples lat;
+};
+
+/* Allocate and free BATCH objects ROUNDS times.  */
+static void *
+worker (void *arg)
+{
+  struct worker *w = arg;
+  void *objs[BATCH];
+  size_t round;
+  int i;
+
+  pthread_barrier_wait (&barrier);
+  for (round = 0; round < rounds; round++)
+    {
+      double start = bench_now ();
+
+      for (i = 0; i < BATCH; i++)
+	{
+	  error_t err = hurd_slab_alloc (space, &objs[i]);
+	  if (err)
+	    error (1, err, "hurd_slab_alloc");
+	  *(char *) objs[i] = i;
+	}
+      for (i = 0; i < BATCH; i++)
+	hurd_slab_dealloc (space, objs[i]);
+
+      bench_samples_add (&w->lat, (bench_now () - start) / (2 * BATCH));
+    }
+  pthread_barrier_wait (&barrier);
+  return 0;
+}
+
+/* Run the benchmark for objects of SIZE bytes with NTHREADS threads.  */
+static void
+run (size_t size, int nthreads)
+{
+  struct worker workers[nthreads];
+  struct bench_samples lat;
+  char params[64];
+  double start, end;
+  error_t err;
+  int i;
+
+  err = hurd_slab_create (size, 0, NULL, NULL, NULL, NULL, NULL, &space);
+  if (err)
+    error (1, err, "hurd_slab_create");
+
+  pthread_barrier_init (&barrier, 0, nthreads + 1);
+  for (i = 0; i < nthreads; i++)
+    {
+      bench_samples_init (&workers[i].lat, rounds);
+      err = pthread_create (&workers[i].thread, 0, worker, &workers[i]);
+      if (err)
+	error (1, err, "pthread_create");
+    }
+
+  pthread_barrier_wait (&barrier);
+  start = bench_now ();
+  pthread_barrier_wait (&barrier);
+  end = bench_now ();
+
+  bench_samples_init (&lat, rounds * nthreads);
+  for (i = 0; i < nthreads; i++)
+    {
+      pthread_join (workers[i].thread, 0);
+      bench_samples_merge (&lat, &workers[i].lat);
+      bench_samples_free (&workers[i].lat);
+    }
+  pthread_barrier_destroy (&barrier);
+
+  snprintf (params, sizeof params, "size=%zu threads=%d", size, nthreads);
+  bench_report ("slab", params, rounds * nthreads * 2 * BATCH,
+		end - start, &lat);
+  bench_samples_free (&lat);
+
+  err = hurd_slab_free (space);
+  if (err)
+    error (1, err, "hurd_slab_free");
+}
+
+int
+main (int argc, char **argv)
+{
+  static const size_t sizes[] = { 32, 128, 512 };
+  int max_threads = 8, nthreads;
+  size_t i;
+
+  if (argc > 3)
+    {
+      fprintf (stderr, "Usage: %s [MAX-THREADS [ROUNDS]]\n", argv[0]);
+      exit (1);
+    }
+  rounds = 20000;
+  if (argc > 1)
+    max_threads = atoi (argv[1]);
+  if (argc > 2)
+    rounds = strtoul (argv[2], 0, 0);
+  if (max_threads < 1)
+    error (1, 0, "need at least one thread");
+  if (rounds < 1)
+    error (1, 0, "need at least one round");
+
+  for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++)
+    for (nthreads = 1; nthreads <= max_threads; nthreads *= 2)
+      run (sizes[i], nthreads);
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+/* Small file benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Creates, writes, reads back and removes many small files in DIR, for
+   a range of file sizes, and reports the rate of each phase.  To see
+   what tmpfs inline files buy, run it on tmpfs mounted with the default
+   options and again with --inline-max=0.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <error.h>
+#include <errno.h>
+
+#include "bench.h"
+
+#define MAX_FILE_SIZE (16 * 1024)
+
+/* Write or read (according to WRITING) SIZE bytes of BUF to or from
+   each of COUNT files in DIR, creating them when writing.  */
+static void
+pass (const char *dir, size_t count, char *buf, size_t size, int writing)
+{
+  char name[strlen (dir) + 32];
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    {
+      ssize_t done;
+      int fd;
+
+      snprintf (name, sizeof name, "%s/s%zu", dir, i);
+      fd = open (name, writing ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY,
+		 0644);
+      if (fd < 0)
+	error (1, errno, "%s", name);
+      done = writing ? write (fd, buf, size) : read (fd, buf, size);
+      if (done < 0)
+	error (1, errno, "%s", name);
+      if ((size_t) done != size)
+	error (1, 0, "%s: short %s", name, writing ? "write" : "read");
+      close (fd);
+    }
+}
+
+/* Remove the COUNT files in DIR.  */
+static void
+cleanup (const char *dir, size_t count)
+{
+  char name[strlen (dir) + 32];
+  size_t i;
+
+  for (i = 0; i < count; i++)
+    {
+      snprintf (name, sizeof name, "%s/s%zu", dir, i);
+      if (unlink (name) < 0)
+	error (1, errno, "%s", name);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t count = 10000;
+  size_t size;
+  const char *dir;
+  char *buf;
+
+  if (argc < 2 || argc > 3)
+    {
+      fprintf (stderr, "Usage: %s DIR [FILES]\n", argv[0]);
+      exit (1);
+    }
+  dir = argv[1];
+  if (argc == 3)
+    count = strtoul (argv[2], 0, 0);
+
+  buf = malloc (MAX_FILE_SIZE);
+  if (! buf)
+    error (1, ENOMEM, "buffer");
+  memset (buf, 'x', MAX_FILE_SIZE);
+
+  for (size = 16; size <= MAX_FILE_SIZE; size *= 4)
+    {
+      double start, wrote, readback, removed;
+      char params[32];
+
+      start = bench_now ();
+      pass (dir, count, buf, size, 1);
+      wrote = bench_now ();
+      pass (dir, count, buf, size, 0);
+      readback = bench_now ();
+      cleanup (dir, count);
+      removed = bench_now ();
+
+      snprintf (params, sizeof params, "size=%zu", size);
+      bench_report ("smallfile_write", params, count, wrote - start, 0);
+      bench_report ("smallfile_read", params, count, readback - wrote, 0);
+      bench_report ("smallfile_unlink", params, count, removed - readback, 0);
+    }
+
+  return 0;
+}
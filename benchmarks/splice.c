@@ -0,0 +1,200 @@
+/* Pipe proxy benchmark: read/write versus socket_splice
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* A writer pushes data through one pipe to a proxy, which forwards it down
+   a second pipe to a reader, like the middle of `cat | cat | cat'.  The
+   proxy either copies the data through itself with read and write, or asks
+   pflocal to move it with socket_splice; the time taken for each is
+   reported for several chunk sizes.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <hurd.h>
+
+#include "socket_U.h"
+#include "bench.h"
+
+#define MAX_CHUNK  (1024*1024)
+
+/* Write TOTAL bytes to FD in CHUNK sized pieces.  */
+static void
+produce (int fd, char *buf, size_t chunk, size_t total)
+{
+  while (total > 0)
+    {
+      size_t len = chunk < total ? chunk : total;
+      ssize_t wr = write (fd, buf, len);
+      if (wr < 0)
+	error (1, errno, "write");
+      total -= wr;
+    }
+}
+
+/* Read from FD until EOF, and return the number of bytes read.  */
+static size_t
+consume (int fd, char *buf)
+{
+  size_t total = 0;
+  for (;;)
+    {
+      ssize_t rd = read (fd, buf, MAX_CHUNK);
+      if (rd < 0)
+	error (1, errno, "read");
+      if (rd == 0)
+	return total;
+      total += rd;
+    }
+}
+
+/* Forward everything from IN to OUT in CHUNK sized pieces, by reading and
+   writing if SPLICE is false, or with socket_splice if it's true.  */
+static void
+proxy (int in, int out, char *buf, size_t chunk, int splice)
+{
+  mach_port_t in_port = MACH_PORT_NULL, out_port = MACH_PORT_NULL;
+
+  if (splice)
+    {
+      in_port = getdport (in);
+      out_port = getdport (out);
+    }
+
+  for (;;)
+    {
+      size_t moved;
+
+      if (splice)
+	{
+	  error_t err = socket_splice (out_port, in_port, -1, chunk, &moved);
+	  if (err)
+	    error (1, err, "socket_splice");
+	}
+      else
+	{
+	  ssize_t rd = read (in, buf, chunk);
+	  if (rd < 0)
+	    error (1, errno, "read");
+	  moved = rd;
+	  if (moved > 0)
+	    produce (out, buf, chunk, moved);
+	}
+
+      if (moved == 0)
+	break;
+    }
+
+  if (splice)
+    {
+      mach_port_deallocate (mach_task_self (), in_port);
+      mach_port_deallocate (mach_task_self (), out_port);
+    }
+}
+
+/* Push TOTAL bytes through a proxy forwarding CHUNK bytes at a time, and
+   return how many seconds it took.  */
+static double
+run (char *buf, size_t chunk, size_t total, int splice)
+{
+  int in[2], out[2], status;
+  pid_t writer, reader;
+  double start, end;
+
+  if (pipe (in) < 0 || pipe (out) < 0)
+    error (1, errno, "pipe");
+
+  start = bench_now ();
+
+  writer = fork ();
+  if (writer < 0)
+    error (1, errno, "fork");
+  if (writer == 0)
+    {
+      close (in[0]);
+      close (out[0]);
+      close (out[1]);
+      produce (in[1], buf, chunk, total);
+      _exit (0);
+    }
+
+  reader = fork ();
+  if (reader < 0)
+    error (1, errno, "fork");
+  if (reader == 0)
+    {
+      close (in[0]);
+      close (in[1]);
+      close (out[1]);
+      _exit (consume (out[0], buf) == total ? 0 : 1);
+    }
+
+  close (in[1]);
+  close (out[0]);
+  proxy (in[0], out[1], buf, chunk, splice);
+  close (in[0]);
+  close (out[1]);
+
+  if (waitpid (writer, &status, 0) < 0)
+    error (1, errno, "waitpid");
+  if (waitpid (reader, &status, 0) < 0)
+    error (1, errno, "waitpid");
+  end = bench_now ();
+
+  if (! WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    error (1, 0, "reader lost data with %zu byte chunks", chunk);
+
+  return end - start;
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t total = 64 * 1024 * 1024;
+  size_t chunk;
+  char *buf;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [BYTES]\n", argv[0]);
+      exit (1);
+    }
+  if (argc == 2)
+    total = strtoul (argv[1], 0, 0);
+
+  buf = valloc (MAX_CHUNK);
+  if (! buf)
+    error (1, ENOMEM, "buffer");
+  memset (buf, 'x', MAX_CHUNK);
+
+  for (chunk = 512; chunk <= MAX_CHUNK; chunk *= 8)
+    {
+      size_t chunks = (total + chunk - 1) / chunk;
+      char params[64];
+
+      snprintf (params, sizeof params, "mode=copy size=%zu", chunk);
+      bench_report ("splice", params, chunks, run (buf, chunk, total, 0), 0);
+      snprintf (params, sizeof params, "mode=splice size=%zu", chunk);
+      bench_report ("splice", params, chunks, run (buf, chunk, total, 1), 0);
+    }
+
+  return 0;
+}
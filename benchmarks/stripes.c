@@ -0,0 +1,164 @@
+/* Striped store benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Builds interleaved stores out of 1, 2, 4, ... file stores, each backed
+   by a file in DIR, and reports the rate at which large writes and reads
+   go through them.  libstore hands the pieces of a request that fall in
+   different stripes to the children at the same time, so the rate should
+   grow with the number of stripes for as long as the filesystems holding
+   the files can keep up.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <error.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <hurd/store.h>
+
+#include "bench.h"
+
+#define INTERLEAVE	(64 * 1024)
+
+/* Return a store interleaving NSTRIPES file stores of STRIPE_SIZE bytes
+   each, backed by files created in DIR.  */
+static struct store *
+make_store (const char *dir, int nstripes, size_t stripe_size)
+{
+  struct store *stripes[nstripes], *store;
+  char name[strlen (dir) + 32];
+  error_t err;
+  int i;
+
+  for (i = 0; i < nstripes; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "%s/stripe%d", dir, i);
+      fd = open (name, O_RDWR | O_CREAT, 0644);
+      if (fd < 0 || ftruncate (fd, stripe_size) < 0)
+	error (1, errno, "%s", name);
+      close (fd);
+
+      err = store_file_open (name, 0, &stripes[i]);
+      if (err)
+	error (1, err, "%s", name);
+    }
+
+  err = store_ileave_create (stripes, nstripes, INTERLEAVE, 0, &store);
+  if (err)
+    error (1, err, "store_ileave_create");
+  return store;
+}
+
+/* Write or read (according to WRITING) all of STORE, REQ_SIZE bytes at a
+   time, using BUF.  */
+static void
+pass (struct store *store, char *buf, size_t req_size, int writing)
+{
+  store_offset_t addr;
+  size_t blocks = req_size >> store->log2_block_size;
+
+  for (addr = 0; addr < store->blocks; addr += blocks)
+    {
+      error_t err;
+      size_t amount;
+
+      if (writing)
+	err = store_write (store, addr, buf, req_size, &amount);
+      else
+	{
+	  void *data = buf;
+	  amount = req_size;
+	  err = store_read (store, addr, req_size, &data, &amount);
+	  if (! err && data != buf)
+	    munmap (data, amount);
+	}
+      if (err)
+	error (1, err, "%s", writing ? "store_write" : "store_read");
+      if (amount != req_size)
+	error (1, 0, "short %s", writing ? "write" : "read");
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  int max_stripes = 8, nstripes;
+  size_t total = 256 * 1024 * 1024;
+  size_t req_size = 4 * 1024 * 1024;
+  const char *dir;
+  char *buf;
+
+  if (argc < 2 || argc > 4)
+    {
+      fprintf (stderr, "Usage: %s DIR [MAX-STRIPES [MBYTES]]\n", argv[0]);
+      exit (1);
+    }
+  dir = argv[1];
+  if (argc > 2)
+    max_stripes = atoi (argv[2]);
+  if (argc > 3)
+    total = strtoul (argv[3], 0, 0) * 1024 * 1024;
+  if (max_stripes < 1)
+    error (1, 0, "need at least one stripe");
+  if (total < req_size)
+    total = req_size;
+
+  buf = mmap (0, req_size, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+  if (buf == MAP_FAILED)
+    error (1, errno, "buffer");
+  memset (buf, 'x', req_size);
+
+  for (nstripes = 1; nstripes <= max_stripes; nstripes *= 2)
+    {
+      struct store *store;
+      double start, wrote, readback;
+      size_t stripe_size = total / nstripes / req_size * req_size;
+      size_t reqs;
+      char params[48];
+      int i;
+
+      store = make_store (dir, nstripes, stripe_size);
+      reqs = store->size / req_size;
+
+      start = bench_now ();
+      pass (store, buf, req_size, 1);
+      store_sync (store);
+      wrote = bench_now ();
+      pass (store, buf, req_size, 0);
+      readback = bench_now ();
+
+      snprintf (params, sizeof params, "stripes=%d size=%zu",
+		nstripes, req_size);
+      bench_report ("stripe_write", params, reqs, wrote - start, 0);
+      bench_report ("stripe_read", params, reqs, readback - wrote, 0);
+
+      store_free (store);
+      for (i = 0; i < nstripes; i++)
+	{
+	  char name[strlen (dir) + 32];
+	  snprintf (name, sizeof name, "%s/stripe%d", dir, i);
+	  unlink (name);
+	}
+    }
+
+  return 0;
+}
@@ -115,6 +115,10 @@ struct output
 {
   /* The state of the conversion of output characters.  */
   iconv_t cd;
+  /* Nonzero if the encoding is a superset of ASCII in which the bytes
+     below 0x80 never form part of a longer sequence, so they can skip
+     the conversion.  */
+  int ascii;
   /* The output queue holds the characters that are to be outputted.
      The conversion routine might refuse to handle some incomplete
      multi-byte or composed character at the end of the buffer, so we
@@ -947,6 +951,22 @@ screen_shift_right (display_t display, size_t col1, size_t row1, size_t col2,
 }
 
 
+/* Return nonzero if ENCODING is known to leave ASCII alone, in the
+   sense of the ASCII member of struct output.  */
+static int
+encoding_ascii_p (const char *encoding)
+{
+  static const char *const names[] =
+    { "UTF-8", "UTF8", "ASCII", "US-ASCII", "ANSI_X3.4-1968", "LATIN1" };
+  int i;
+
+  for (i = 0; i < sizeof names / sizeof names[0]; i++)
+    if (!strcasecmp (encoding, names[i]))
+      return 1;
+  return (!strncasecmp (encoding, "ISO-8859-", 9)
+	  || !strncasecmp (encoding, "ISO8859-", 8));
+}
+
 static error_t
 output_init (output_t output, const char *encoding)
 {
@@ -960,6 +980,7 @@ output_init (output_t output, const char *encoding)
   output->cd = iconv_open ("WCHAR_T", encoding);
   if (output->cd == (iconv_t) -1)
     return errno;
+  output->ascii = encoding_ascii_p (encoding);
   return 0;
 }
 
@@ -1778,6 +1799,85 @@ display_output_one (display_t display, wchar_t chr)
     }
 }
 
+/* Return the number of printable ASCII characters (from space to
+   tilde) at the start of the LENGTH bytes at BUFFER.  Whole words are
+   checked at a time, as long output is mostly made of such runs.  */
+static size_t
+printable_run (const char *buffer, size_t length)
+{
+#define ONES ((unsigned long) -1 / 0xff)
+  size_t i = 0;
+
+  while (i + sizeof (unsigned long) <= length)
+    {
+      unsigned long word;
+
+      memcpy (&word, buffer + i, sizeof word);
+      /* Set the top bit of each byte which is below a space, or above
+	 a tilde.  */
+      if (((word - ONES * ' ') & ~word & ONES * 0x80)
+	  | (((word + ONES * (0x7f - '~')) | word) & ONES * 0x80))
+	break;
+      i += sizeof word;
+    }
+#undef ONES
+
+  while (i < length && buffer[i] >= ' ' && buffer[i] <= '~')
+    i++;
+  return i;
+}
+
+/* Output the LENGTH printable ASCII characters at BUFFER.  This does
+   what display_output_one does for them in the normal state outside of
+   insert mode, but a line at a time.  Display must be locked.  */
+static void
+display_output_printable (display_t display, const char *buffer,
+			  size_t length)
+{
+  struct cons_display *user = display->user;
+  conchar_attr_t attr = display->attr.current;
+
+  while (length > 0)
+    {
+      size_t count, i;
+      int line;
+      int idx;
+
+      if (user->cursor.col >= user->screen.width)
+	{
+	  user->cursor.col = 0;
+	  linefeed (display);
+	}
+
+      count = user->screen.width - user->cursor.col;
+      if (count > length)
+	count = length;
+
+      line = (user->screen.cur_line + user->cursor.row)
+	% user->screen.lines;
+      idx = line * user->screen.width + user->cursor.col;
+
+      if (display->attr.altchar)
+	for (i = 0; i < count; i++)
+	  {
+	    user->_matrix[idx+i].chr = altchar_to_ucs4 (buffer[i]);
+	    user->_matrix[idx+i].attr = attr;
+	  }
+      else
+	for (i = 0; i < count; i++)
+	  {
+	    user->_matrix[idx+i].chr = buffer[i];
+	    user->_matrix[idx+i].attr = attr;
+	  }
+
+      user->cursor.col += count;
+      display_record_filechange (display, idx, idx + count - 1);
+
+      buffer += count;
+      length -= count;
+    }
+}
+
 /* Output LENGTH bytes starting from BUFFER in the system encoding.
    Set BUFFER and LENGTH to the new values.  The exact semantics are
    just as in the iconv interface.  */
@@ -1785,6 +1885,7 @@ static error_t
 display_output_some (display_t display, char **buffer, size_t *length)
 {
 #define CONV_OUTBUF_SIZE 256
+  parse_t parse = &display->output.parse;
   error_t err = 0;
 
   display->changes.cursor.col = display->user->cursor.col;
@@ -1803,11 +1904,43 @@ display_output_some (display_t display, char **buffer, size_t *length)
       wchar_t outbuf[CONV_OUTBUF_SIZE];
       char *outptr = (char *) outbuf;
       size_t outsize = CONV_OUTBUF_SIZE * sizeof (wchar_t);
+      size_t inlen = *length, left;
       error_t saved_err;
       int i;
 
-      nconv = iconv (display->output.cd, buffer, length, &outptr, &outsize);
+      if (display->output.ascii)
+	{
+	  unsigned char c = **buffer;
+
+	  if (c < 0x80)
+	    {
+	      size_t run = 0;
+
+	      if (parse->state == STATE_NORMAL && !display->insert_mode)
+		run = printable_run (*buffer, *length);
+	      if (run)
+		display_output_printable (display, *buffer, run);
+	      else
+		{
+		  display_output_one (display, c);
+		  run = 1;
+		}
+	      *buffer += run;
+	      *length -= run;
+	      continue;
+	    }
+
+	  /* Only convert up to the next ASCII byte, so that the text
+	     after it can take the path above.  */
+	  inlen = 1;
+	  while (inlen < *length && (unsigned char) (*buffer)[inlen] >= 0x80)
+	    inlen++;
+	}
+
+      left = inlen;
+      nconv = iconv (display->output.cd, buffer, &left, &outptr, &outsize);
       saved_err = errno;
+      *length -= inlen - left;
 
       /* First process all successfully converted characters.  */
       for (i = 0; i < CONV_OUTBUF_SIZE - outsize / sizeof (wchar_t); i++)
@@ -1818,8 +1951,11 @@ display_output_some (display_t display, char **buffer, size_t *length)
 	    /* Conversion is not completed, look for recoverable
 	       errors.  */
 #define UNICODE_REPLACEMENT_CHARACTER ((wchar_t) 0xfffd)
-	  if (saved_err == EILSEQ)
+	  if (saved_err == EILSEQ
+	      || (saved_err == EINVAL && left < *length))
 	    {
+	      /* A sequence cut short by an ASCII byte is just as
+		 invalid.  */
 	      assert (*length);
 	      (*length)--;
 	      (*buffer)++;
@@ -0,0 +1,248 @@
+/* GNU Hurd standard exec server, cache of checked executable headers.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd; see the file COPYING.  If not, write to
+   the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
+
+/* Most execs are of a few programs and their one interpreter, over and
+   over.  For those we keep what check and check_elf_phdr found, so the
+   next exec need not map and pick apart the headers again.
+
+   A file is known by the name port the kernel gives the memory object
+   io_map hands us for it, which only the kernel makes, so a server
+   cannot pass off its own file as somebody else's, the way it could by
+   lying in io_stat.  We keep a send right to the name port, not to the
+   memory object: that would count as a user of the file's pager, and
+   keep its file system from going away and an unlinked executable from
+   being freed.  A name port dies with the kernel's object, and then
+   stays in our space as a dead name until the entry goes, so its name
+   cannot be reused for another object meanwhile.  The modification time
+   and size catch files that were rewritten in place.  */
+
+#include "priv.h"
+
+/* How many files to remember.  */
+#define EXEC_CACHE_SIZE 32
+
+static struct exec_cache_entry *exec_cache;
+static int exec_cache_count;
+static pthread_mutex_t exec_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Take ENTRY off the list.  The list's reference is now the caller's.
+   EXEC_CACHE_LOCK must be held.  */
+static void
+unlink_entry (struct exec_cache_entry *entry)
+{
+  *entry->prevp = entry->next;
+  if (entry->next)
+    entry->next->prevp = entry->prevp;
+  exec_cache_count--;
+}
+
+/* Put ENTRY at the front of the list.  EXEC_CACHE_LOCK must be held.  */
+static void
+link_entry (struct exec_cache_entry *entry)
+{
+  entry->next = exec_cache;
+  entry->prevp = &exec_cache;
+  if (exec_cache)
+    exec_cache->prevp = &entry->next;
+  exec_cache = entry;
+  exec_cache_count++;
+}
+
+void
+exec_cache_release (struct exec_cache_entry *entry)
+{
+  int last;
+
+  pthread_mutex_lock (&exec_cache_lock);
+  last = --entry->refs == 0;
+  pthread_mutex_unlock (&exec_cache_lock);
+
+  if (last)
+    {
+      mach_port_deallocate (mach_task_self (), entry->objname);
+      free (entry->phdr);
+      free (entry->interp_name);
+      free (entry);
+    }
+}
+
+/* Return a send right to the name port of the kernel's object for the
+   memory object FILEMAP, or MACH_PORT_NULL if there is none.  */
+static mach_port_t
+object_name (memory_object_t filemap)
+{
+  vm_address_t addr = 0, region = 0;
+  vm_size_t size = vm_page_size;
+  vm_prot_t prot, max_prot;
+  vm_inherit_t inh;
+  boolean_t shared;
+  mach_port_t name = MACH_PORT_NULL;
+  vm_offset_t offset;
+
+  /* Map it without copying, so the region is the object itself.
+     Nothing is touched, so this faults nothing in.  */
+  if (vm_map (mach_task_self (), &addr, vm_page_size, 0, 1, filemap, 0, 0,
+	      VM_PROT_READ, VM_PROT_READ, VM_INHERIT_NONE))
+    return MACH_PORT_NULL;
+
+  region = addr;
+  if (vm_region (mach_task_self (), &region, &size, &prot, &max_prot, &inh,
+		 &shared, &name, &offset)
+      || region != addr)
+    {
+      if (MACH_PORT_VALID (name))
+	mach_port_deallocate (mach_task_self (), name);
+      name = MACH_PORT_NULL;
+    }
+
+  munmap ((void *) addr, vm_page_size);
+  return name;
+}
+
+/* Make E use ENTRY, on which the caller has given it a reference.  */
+static void
+use_entry (struct execdata *e, struct exec_cache_entry *entry)
+{
+  e->cached = entry;
+  e->entry = entry->entry;
+  e->info.elf.phdr = entry->phdr;
+  e->info.elf.phdr_addr = entry->phdr_addr;
+  e->info.elf.phnum = entry->phnum;
+  e->info.elf.anywhere = entry->anywhere;
+  e->info.elf.loadbase = 0;
+  e->info.elf.execstack = entry->execstack;
+  e->interp.phdr = entry->interp;
+}
+
+int
+exec_cache_lookup (struct execdata *e)
+{
+  struct exec_cache_entry *entry, *stale = NULL;
+
+  if (e->filemap == MACH_PORT_NULL || e->cntl)
+    return 0;
+
+  e->objname = object_name (e->filemap);
+  if (e->objname == MACH_PORT_NULL)
+    return 0;
+
+  pthread_mutex_lock (&exec_cache_lock);
+  for (entry = exec_cache; entry; entry = entry->next)
+    if (entry->objname == e->objname)
+      break;
+  if (entry
+      && (entry->size != e->file_size
+	  || entry->mtime.tv_sec != e->file_mtime.tv_sec
+	  || entry->mtime.tv_nsec != e->file_mtime.tv_nsec))
+    {
+      /* The file has changed since; forget what we knew.  */
+      unlink_entry (entry);
+      stale = entry;
+      entry = NULL;
+    }
+  else if (entry)
+    {
+      if (entry != exec_cache)
+	{
+	  unlink_entry (entry);
+	  link_entry (entry);
+	}
+      entry->refs++;
+    }
+  pthread_mutex_unlock (&exec_cache_lock);
+
+  if (stale)
+    exec_cache_release (stale);
+  if (! entry)
+    return 0;
+
+  use_entry (e, entry);
+  return 1;
+}
+
+void
+exec_cache_enter (struct execdata *e)
+{
+  struct exec_cache_entry *entry, *evicted = NULL;
+  size_t size = e->info.elf.phnum * sizeof (ElfW(Phdr));
+
+  if (e->objname == MACH_PORT_NULL || e->cntl || e->cached)
+    return;
+
+  entry = calloc (1, sizeof *entry);
+  if (! entry)
+    return;
+  entry->phdr = malloc (size);
+  if (! entry->phdr)
+    goto lose;
+  memcpy (entry->phdr, e->info.elf.phdr, size);
+
+  if (e->interp.phdr)
+    {
+      const ElfW(Phdr) *ph = e->interp.phdr;
+      const char *name = map (e, ph->p_offset & ~(ph->p_align - 1),
+			      ph->p_filesz);	/* XXX/fault */
+      if (! name)
+	{
+	  /* Leave it to the caller to find this out again.  */
+	  e->error = 0;
+	  goto lose;
+	}
+      entry->interp_name = malloc (ph->p_filesz + 1);
+      if (! entry->interp_name)
+	goto lose;
+      memcpy (entry->interp_name, name, ph->p_filesz);
+      entry->interp_name[ph->p_filesz] = '\0';
+      entry->interp = &entry->phdr[ph - e->info.elf.phdr];
+    }
+
+  if (mach_port_mod_refs (mach_task_self (), e->objname,
+			  MACH_PORT_RIGHT_SEND, 1))
+    goto lose;
+  entry->objname = e->objname;
+  entry->mtime = e->file_mtime;
+  entry->size = e->file_size;
+  entry->entry = e->entry;
+  entry->phdr_addr = e->info.elf.phdr_addr;
+  entry->phnum = e->info.elf.phnum;
+  entry->anywhere = e->info.elf.anywhere;
+  entry->execstack = e->info.elf.execstack;
+  entry->refs = 2;		/* The list's and E's.  */
+
+  pthread_mutex_lock (&exec_cache_lock);
+  link_entry (entry);
+  if (exec_cache_count > EXEC_CACHE_SIZE)
+    {
+      for (evicted = entry; evicted->next; evicted = evicted->next)
+	;
+      unlink_entry (evicted);
+    }
+  pthread_mutex_unlock (&exec_cache_lock);
+
+  if (evicted)
+    exec_cache_release (evicted);
+
+  use_entry (e, entry);
+  return;
+
+ lose:
+  free (entry->phdr);
+  free (entry->interp_name);
+  free (entry);
+}
@@ -440,8 +440,10 @@ prepare (file_t file, struct execdata *e)
   e->cntl = NULL;
   e->filemap = MACH_PORT_NULL;
   e->cntlmap = MACH_PORT_NULL;
+  e->objname = MACH_PORT_NULL;
 
   e->interp.section = NULL;
+  e->cached = NULL;
 
   e->start_code = 0;
   e->end_code = 0;
@@ -511,6 +513,7 @@ prepare (file_t file, struct execdata *e)
       if (e->error)
 	return;
       e->file_size = st.st_size;
+      e->file_mtime = st.st_mtim;
       e->optimal_block = st.st_blksize;
     }
 }
@@ -632,6 +635,8 @@ check_elf_phdr (struct execdata *e, const ElfW(Phdr) *mapped_phdr)
 static void
 check (struct execdata *e)
 {
+  if (exec_cache_lookup (e))
+    return;
   check_elf (e);		/* XXX/fault */
 }
 
@@ -666,6 +671,11 @@ finish_mapping (struct execdata *e)
       mach_port_deallocate (mach_task_self (), e->cntlmap);
       e->cntlmap = MACH_PORT_NULL;
     }
+  if (e->objname != MACH_PORT_NULL)
+    {
+      mach_port_deallocate (mach_task_self (), e->objname);
+      e->objname = MACH_PORT_NULL;
+    }
 }
 
 /* Clean up after reading the file (need not be completed).
@@ -675,6 +685,11 @@ void
 finish (struct execdata *e, int dealloc_file)
 {
   finish_mapping (e);
+  if (e->cached)
+    {
+      exec_cache_release (e->cached);
+      e->cached = NULL;
+    }
     {
       if (e->file_data != NULL) {
 	free (e->file_data);
@@ -867,9 +882,14 @@ do_exec (file_t file,
     /* The file is not a valid executable.  */
     goto out;
 
-  const ElfW(Phdr) *phdr = e.info.elf.phdr;
-  e.info.elf.phdr = alloca (e.info.elf.phnum * sizeof (ElfW(Phdr)));
-  check_elf_phdr (&e, phdr);
+  if (! e.cached)
+    {
+      const ElfW(Phdr) *phdr = e.info.elf.phdr;
+      e.info.elf.phdr = alloca (e.info.elf.phnum * sizeof (ElfW(Phdr)));
+      check_elf_phdr (&e, phdr);
+      if (! e.error)
+	exec_cache_enter (&e);
+    }
 
   if (oldtask == MACH_PORT_NULL)
     flags |= EXEC_NEWTASK;
@@ -1075,9 +1095,10 @@ do_exec (file_t file,
 	 along with this executable.  Find the name of the file and open
 	 it.  */
 
-      char *name = map (&e, (e.interp.phdr->p_offset
-			     & ~(e.interp.phdr->p_align - 1)),
-			e.interp.phdr->p_filesz);
+      char *name = (e.cached ? e.cached->interp_name
+		    : map (&e, (e.interp.phdr->p_offset
+				& ~(e.interp.phdr->p_align - 1)),
+			   e.interp.phdr->p_filesz));
       if (! name && ! e.error)
 	e.error = ENOEXEC;
 
@@ -1115,12 +1136,14 @@ do_exec (file_t file,
     {
       /* We opened an interpreter file.  Prepare it for loading too.  */
       prepare_and_check (interp.file, &interp);
-      if (! interp.error)
+      if (! interp.error && ! interp.cached)
 	{
 	  const ElfW(Phdr) *phdr = interp.info.elf.phdr;
 	  interp.info.elf.phdr = alloca (interp.info.elf.phnum *
 					 sizeof (ElfW(Phdr)));
 	  check_elf_phdr (&interp, phdr);
+	  if (! interp.error)
+	    exec_cache_enter (&interp);
 	}
       e.error = interp.error;
     }
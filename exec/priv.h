@@ -96,9 +96,11 @@ struct execdata
 	const ElfW(Phdr) *phdr;
       } interp;
     memory_object_t filemap, cntlmap;
+    mach_port_t objname;	/* Name port of FILEMAP's object, for the cache.  */
     struct shared_io *cntl;
     char *file_data;		/* File data if already copied in core.  */
     off_t file_size;
+    struct timespec file_mtime;	/* Set by prepare if it stats the file.  */
     size_t optimal_block;	/* Optimal size for io_read from file.  */
 
     /* Set by caller of load.  */
@@ -110,7 +112,7 @@ struct execdata
 	  {
 	    /* Program header table read from the executable.
 	       After `check' this is a pointer into the mapping window.
-	       By `load' it is local alloca'd storage.  */
+	       By `load' it is local alloca'd storage or the cache's copy.  */
 	    ElfW(Phdr) *phdr;
 	    ElfW(Addr) phdr_addr;
 	    ElfW(Word) phnum;	/* Number of program header table elements.  */
@@ -119,6 +121,30 @@ struct execdata
 	    int execstack;	/* Zero if stack can be nonexecutable.  */
 	  } elf;
       } info;
+
+    /* Set by check if the headers came from the cache; then the phdrs
+       and interpreter point into it and need no checking.  */
+    struct exec_cache_entry *cached;
+  };
+
+/* The checked headers of a recently executed file (see cache.c).  */
+struct exec_cache_entry
+  {
+    struct exec_cache_entry *next, **prevp; /* Most recently used first.  */
+    unsigned int refs;		/* One for the list, one for each user.  */
+    mach_port_t objname;	/* Identifies the file; we hold a ref.  */
+    struct timespec mtime;
+    off_t size;
+
+    /* What check and check_elf_phdr found in it.  */
+    vm_address_t entry;
+    ElfW(Phdr) *phdr;
+    ElfW(Addr) phdr_addr;
+    ElfW(Word) phnum;
+    int anywhere;
+    int execstack;
+    const ElfW(Phdr) *interp;	/* Into PHDR, or null.  */
+    char *interp_name;		/* Contents of INTERP, null-terminated.  */
   };
 
 error_t elf_machine_matches_host (ElfW(Half) e_machine);
@@ -130,6 +156,17 @@ void finish (struct execdata *, int dealloc_file_port);
    a pointer into the window corresponding to POSN.  */
 void *map (struct execdata *e, off_t posn, size_t len);
 
+/* If the file E was prepared for has been checked before and has not
+   changed since, fill in E from the cache and return nonzero.  */
+int exec_cache_lookup (struct execdata *e);
+
+/* Remember the headers of the file E has just checked, and make E use
+   the cached copy.  Failure is harmless; E is then left alone.  */
+void exec_cache_enter (struct execdata *e);
+
+/* Drop a reference to ENTRY.  */
+void exec_cache_release (struct exec_cache_entry *entry);
+
 
 void check_hashbang (struct execdata *e,
 		     file_t file,
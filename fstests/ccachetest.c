@@ -0,0 +1,377 @@
+/* Test the ftpfs contents cache against a stand-in ftp server
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* This is linked with ftpfs's ccache.o and conn.o, but not with
+   libftpconn: the ftp_conn functions they call are defined here instead,
+   and serve a file held in memory, each transfer sending its data down a
+   socket from a thread of its own.  The server can be told to refuse
+   REST, or to stop sending at some offset as if the file had shrunk, and
+   it counts the transfers it starts.  The on-disk cache is kept in a
+   directory made under /tmp and removed at the end.  */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <dirent.h>
+#include <error.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <hurd/netfs.h>
+
+#include "ccache.h"
+
+#define FILE_SIZE	(16 * CCACHE_BLOCK_SIZE + 1234)
+
+/* The file on the server.  */
+static pthread_mutex_t server_lock = PTHREAD_MUTEX_INITIALIZER;
+static char server_data[FILE_SIZE];
+
+/* If set, REST is refused.  */
+static int refuse_rest;
+
+/* If not -1, transfers stop at this offset of the file.  */
+static off_t short_at = -1;
+
+/* Transfers started, and how many of those started past the beginning.  */
+static int transfers, restarted;
+
+char *ftpfs_remote_fs = "localhost:/";
+
+/* There are no RPCs here to interrupt.  */
+int
+ports_self_interrupted ()
+{
+  return 0;
+}
+
+/* A connection, with the transfer in progress on it if any.  */
+struct fake_conn
+{
+  struct ftp_conn conn;
+  int sending;
+  pthread_t sender;
+  int fd;
+  off_t pos, end;
+};
+
+static void *
+sender (void *arg)
+{
+  struct fake_conn *fc = arg;
+
+  while (fc->pos < fc->end)
+    {
+      ssize_t wr = write (fc->fd, server_data + fc->pos, fc->end - fc->pos);
+      if (wr <= 0)
+	/* The client went away.  */
+	break;
+      fc->pos += wr;
+    }
+  close (fc->fd);
+  return 0;
+}
+
+/* Wait for the transfer on FC to finish.  */
+static void
+join_sender (struct fake_conn *fc)
+{
+  if (fc->sending)
+    {
+      pthread_join (fc->sender, 0);
+      fc->sending = 0;
+    }
+}
+
+error_t
+ftp_conn_create (const struct ftp_conn_params *params,
+		 const struct ftp_conn_hooks *hooks,
+		 struct ftp_conn **conn)
+{
+  struct fake_conn *fc = calloc (1, sizeof *fc);
+  if (! fc)
+    return ENOMEM;
+  *conn = &fc->conn;
+  return 0;
+}
+
+void
+ftp_conn_free (struct ftp_conn *conn)
+{
+  struct fake_conn *fc = (struct fake_conn *) conn;
+  join_sender (fc);
+  free (fc);
+}
+
+error_t
+ftp_conn_set_type (struct ftp_conn *conn, const char *type)
+{
+  return 0;
+}
+
+error_t
+ftp_conn_start_retrieve_at (struct ftp_conn *conn, const char *name,
+			    off_t offset, int *data)
+{
+  struct fake_conn *fc = (struct fake_conn *) conn;
+  int fds[2];
+  error_t err;
+
+  pthread_mutex_lock (&server_lock);
+  if (offset > 0 && refuse_rest)
+    {
+      pthread_mutex_unlock (&server_lock);
+      return EOPNOTSUPP;
+    }
+  transfers++;
+  if (offset > 0)
+    restarted++;
+  fc->pos = offset;
+  fc->end = short_at >= 0 && short_at < FILE_SIZE ? short_at : FILE_SIZE;
+  pthread_mutex_unlock (&server_lock);
+
+  if (socketpair (PF_LOCAL, SOCK_STREAM, 0, fds) < 0)
+    return errno;
+  fc->fd = fds[1];
+  err = pthread_create (&fc->sender, 0, sender, fc);
+  if (err)
+    {
+      close (fds[0]);
+      close (fds[1]);
+      return err;
+    }
+  fc->sending = 1;
+  *data = fds[0];
+  return 0;
+}
+
+error_t
+ftp_conn_start_retrieve (struct ftp_conn *conn, const char *name, int *data)
+{
+  return ftp_conn_start_retrieve_at (conn, name, 0, data);
+}
+
+error_t
+ftp_conn_finish_transfer (struct ftp_conn *conn)
+{
+  join_sender ((struct fake_conn *) conn);
+  return 0;
+}
+
+void
+ftp_conn_abort (struct ftp_conn *conn)
+{
+  /* The caller has closed its end, so the sender stops.  */
+  join_sender ((struct fake_conn *) conn);
+}
+
+/* Return a new node for the file on the server, in a new filesystem
+   fetching over up to FETCH_CONNS connections, and caching in CACHE_DIR
+   if that isn't null.  */
+static struct node *
+make_node (unsigned fetch_conns, const char *cache_dir)
+{
+  struct ftpfs *fs = calloc (1, sizeof *fs);
+  struct netnode *nn = calloc (1, sizeof *nn);
+  struct node *node = calloc (1, sizeof *node);
+
+  if (! fs || ! nn || ! node)
+    error (2, ENOMEM, "node");
+  pthread_spin_init (&fs->conn_lock, PTHREAD_PROCESS_PRIVATE);
+  fs->params.fetch_conns = fetch_conns;
+  fs->params.cache_dir = cache_dir;
+  nn->fs = fs;
+  nn->rmt_path = "file";
+  node->nn = nn;
+  node->nn_stat.st_size = FILE_SIZE;
+  node->nn_stat.st_mtim.tv_sec = 1000;
+  return node;
+}
+
+/* Change the contents of the file on the server, and what NODE says
+   about it, as ftpfs would after refreshing its stat information.  */
+static void
+change_file (struct node *node, int seed)
+{
+  size_t i;
+
+  pthread_mutex_lock (&server_lock);
+  for (i = 0; i < FILE_SIZE; i++)
+    server_data[i] = i * 7 + i / CCACHE_BLOCK_SIZE + seed;
+  pthread_mutex_unlock (&server_lock);
+  if (node)
+    node->nn_stat.st_mtim.tv_sec++;
+}
+
+/* Read LEN bytes at OFFS through CC, expecting to get the bytes of the
+   file on the server there, or EXPECT_ERR, and say so for WHAT.  Return
+   nonzero if something else happens.  */
+static int
+check_read (struct ccache *cc, off_t offs, size_t len, error_t expect_err,
+	    const char *what)
+{
+  static char buf[FILE_SIZE];
+  size_t expect_len = offs + len > FILE_SIZE ? FILE_SIZE - offs : len;
+  error_t err;
+
+  memset (buf, 0, len);
+  err = ccache_read (cc, offs, len, buf);
+  if (err != expect_err)
+    {
+      printf ("FAIL: %s: got error %d (%s) instead of %d\n", what,
+	      err, strerror (err), expect_err);
+      return 1;
+    }
+  if (! err && memcmp (buf, server_data + offs, expect_len) != 0)
+    {
+      printf ("FAIL: %s: wrong data\n", what);
+      return 1;
+    }
+  printf ("PASS: %s\n", what);
+  return 0;
+}
+
+static int
+expect (int cond, const char *what)
+{
+  printf ("%s: %s\n", cond ? "PASS" : "FAIL", what);
+  return ! cond;
+}
+
+/* Remove DIR and the files in it.  */
+static void
+remove_dir (const char *dir)
+{
+  DIR *d = opendir (dir);
+  struct dirent *de;
+
+  if (d)
+    {
+      while ((de = readdir (d)))
+	if (strcmp (de->d_name, ".") && strcmp (de->d_name, ".."))
+	  {
+	    char *name;
+	    if (asprintf (&name, "%s/%s", dir, de->d_name) >= 0)
+	      {
+		unlink (name);
+		free (name);
+	      }
+	  }
+      closedir (d);
+    }
+  rmdir (dir);
+}
+
+int
+main (int argc, char **argv)
+{
+  char cache_dir[] = "/tmp/ccachetest.XXXXXX";
+  struct node *node;
+  struct ccache *cc;
+  int before, failed = 0;
+  error_t err;
+
+  signal (SIGPIPE, SIG_IGN);
+  change_file (0, 0);
+
+  /* A read of the whole file is split between several connections, each
+     starting with REST.  */
+  node = make_node (4, 0);
+  err = ccache_create (node, &cc);
+  if (err)
+    error (2, err, "ccache_create");
+  failed |= check_read (cc, 0, FILE_SIZE, 0, "read of the whole file");
+  failed |= expect (transfers > 1 && restarted > 0,
+		    "fetched over several connections with REST");
+  before = transfers;
+  failed |= check_read (cc, 5 * CCACHE_BLOCK_SIZE + 17, 3 * CCACHE_BLOCK_SIZE,
+			0, "read again");
+  failed |= expect (transfers == before, "read again from the cache");
+
+  /* Reads running past the end of the file only return what there is.  */
+  failed |= check_read (cc, FILE_SIZE - 100, 1000, 0,
+			"read past the end of the file");
+  failed |= check_read (cc, FILE_SIZE, 10, 0, "read at the end of the file");
+  ccache_free (cc);
+
+  /* A server that sends less than it should fails the read, but what it
+     failed to fetch is fetched again by the next one.  */
+  node = make_node (4, 0);
+  ccache_create (node, &cc);
+  short_at = 6 * CCACHE_BLOCK_SIZE + 100;
+  failed |= check_read (cc, 8 * CCACHE_BLOCK_SIZE, CCACHE_BLOCK_SIZE, EIO,
+			"short transfer fails the read");
+  failed |= check_read (cc, 5 * CCACHE_BLOCK_SIZE, CCACHE_BLOCK_SIZE, 0,
+			"blocks before the short transfer's end are fine");
+  short_at = -1;
+  failed |= check_read (cc, 8 * CCACHE_BLOCK_SIZE, CCACHE_BLOCK_SIZE, 0,
+			"failed blocks fetched again");
+  ccache_free (cc);
+
+  /* A server that refuses REST is read from the start, on one
+     connection at a time.  */
+  refuse_rest = 1;
+  node = make_node (4, 0);
+  ccache_create (node, &cc);
+  before = restarted;
+  failed |= check_read (cc, 10 * CCACHE_BLOCK_SIZE + 5, 2 * CCACHE_BLOCK_SIZE,
+			0, "read in the middle without REST");
+  failed |= check_read (cc, 3 * CCACHE_BLOCK_SIZE, 4 * CCACHE_BLOCK_SIZE,
+			0, "read before that without REST");
+  failed |= expect (node->nn->fs->no_restart && restarted == before,
+		    "fell back to transfers from the start");
+  ccache_free (cc);
+  refuse_rest = 0;
+
+  /* The on-disk cache is used again by a new ccache for the same file,
+     but not once the file has changed.  */
+  if (! mkdtemp (cache_dir))
+    error (2, errno, "%s", cache_dir);
+  node = make_node (4, cache_dir);
+  ccache_create (node, &cc);
+  failed |= check_read (cc, 0, 4 * CCACHE_BLOCK_SIZE, 0,
+			"read through the disk cache");
+  ccache_free (cc);
+
+  ccache_create (node, &cc);
+  before = transfers;
+  failed |= check_read (cc, 0, 4 * CCACHE_BLOCK_SIZE, 0,
+			"read from the disk cache of an earlier ccache");
+  failed |= expect (transfers == before, "nothing fetched again");
+  ccache_free (cc);
+
+  change_file (node, 1);
+  ccache_create (node, &cc);
+  failed |= check_read (cc, 0, 4 * CCACHE_BLOCK_SIZE, 0,
+			"changed file isn't read from the disk cache");
+  failed |= expect (transfers > before, "changed file fetched again");
+
+  /* The same goes for a change noticed while the ccache is in use.  */
+  change_file (node, 2);
+  ccache_invalidate (cc);
+  before = transfers;
+  failed |= check_read (cc, 0, 4 * CCACHE_BLOCK_SIZE, 0,
+			"read after the file changed under the ccache");
+  failed |= expect (transfers > before, "invalidated blocks fetched again");
+  ccache_free (cc);
+
+  remove_dir (cache_dir);
+
+  return failed;
+}
@@ -0,0 +1,371 @@
+/* Test the nbd store against a fake server
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* A thread of this program plays an nbd server on a TCP port of the
+   loopback interface, backed by a buffer in memory, and the rest of it
+   opens nbd stores on it with libstore.  The server holds on to the
+   requests that arrive together and answers them last first, so that a
+   transfer of several requests only works if the replies are matched up
+   by handle.  It can also be told to answer requests for one block with
+   an error, or to hang up on the next request, and it keeps count of the
+   FLUSH and TRIM requests it gets.  Nothing has to be set up beforehand,
+   but the pfinet on the loopback interface must be running.  */
+
+#include <hurd.h>
+#include <hurd/store.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <error.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <byteswap.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define BLOCK_SIZE	512
+#define DISK_SIZE	(1024 * 1024)
+
+/* More than one request's worth (libstore sends at most 128 KiB in
+   each), so that several are outstanding at once.  */
+#define XFER_SIZE	(512 * 1024)
+
+/* The most requests the server holds on to before answering.  */
+#define MAX_HELD	32
+
+/* The protocol, as in libstore/nbd.c.  */
+#define NBD_INIT_MAGIC		"NBDMAGIC\x00\x00\x42\x02\x81\x86\x12\x53"
+#define NBD_REQUEST_MAGIC	0x25609513
+#define NBD_REPLY_MAGIC		0x67446698
+#define NBD_CMD_READ		0
+#define NBD_CMD_WRITE		1
+#define NBD_CMD_DISC		2
+#define NBD_CMD_FLUSH		3
+#define NBD_CMD_TRIM		4
+#define NBD_FLAG_HAS_FLAGS	0x01
+#define NBD_FLAG_SEND_FLUSH	0x04
+#define NBD_FLAG_SEND_TRIM	0x20
+
+#if BYTE_ORDER == BIG_ENDIAN
+# define ntohll(x)	(x)
+#else
+# define ntohll(x)	(bswap_64 (x))
+#endif
+#define htonll ntohll
+
+struct nbd_startup
+{
+  char magic[16];
+  uint64_t size;
+  uint32_t flags;
+  char reserved[124];
+};
+
+struct nbd_request
+{
+  uint32_t magic;
+  uint32_t type;
+  uint64_t handle;
+  uint64_t from;
+  uint32_t len;
+} __attribute__ ((packed));
+
+struct nbd_reply
+{
+  uint32_t magic;
+  uint32_t error;
+  uint64_t handle;
+} __attribute__ ((packed));
+
+/* The contents of the fake disk.  */
+static char disk[DISK_SIZE];
+
+/* What the client side tells the server to do.  Requests touching the
+   block at byte offset BAD_OFFSET get an error reply, if it is not -1;
+   if HANG_UP is set, the server closes the connection when the next
+   request arrives, without answering it.  */
+static long long bad_offset = -1;
+static int hang_up;
+
+/* What the server saw.  */
+static int flushes, trims, reordered;
+static size_t trimmed;
+
+static int listen_fd;
+
+/* Read exactly LEN bytes from FD into BUF; return 0 at end of file.  */
+static int
+read_all (int fd, void *buf, size_t len)
+{
+  while (len > 0)
+    {
+      ssize_t rd = read (fd, buf, len);
+      if (rd <= 0)
+	return 0;
+      buf += rd;
+      len -= rd;
+    }
+  return 1;
+}
+
+static void
+write_all (int fd, const void *buf, size_t len)
+{
+  while (len > 0)
+    {
+      ssize_t wr = write (fd, buf, len);
+      if (wr <= 0)
+	return;
+      buf += wr;
+      len -= wr;
+    }
+}
+
+/* Answer REQ on FD.  */
+static void
+reply (int fd, const struct nbd_request *req)
+{
+  struct nbd_reply rep;
+  uint64_t from = ntohll (req->from);
+  uint32_t len = ntohl (req->len);
+  long long bad = __atomic_load_n (&bad_offset, __ATOMIC_SEQ_CST);
+
+  rep.magic = htonl (NBD_REPLY_MAGIC);
+  rep.error = 0;
+  rep.handle = req->handle;
+  if (bad >= 0 && from <= (uint64_t) bad && (uint64_t) bad < from + len)
+    rep.error = htonl (EIO);
+
+  write_all (fd, &rep, sizeof rep);
+  if (ntohl (req->type) == NBD_CMD_READ && rep.error == 0)
+    write_all (fd, disk + from, len);
+}
+
+/* Serve the client on FD until it disconnects.  */
+static void
+serve (int fd)
+{
+  struct nbd_startup ns;
+  struct nbd_request held[MAX_HELD];
+  int nheld = 0;
+
+  memset (&ns, 0, sizeof ns);
+  memcpy (ns.magic, NBD_INIT_MAGIC, sizeof ns.magic);
+  ns.size = htonll ((uint64_t) DISK_SIZE);
+  ns.flags = htonl (NBD_FLAG_HAS_FLAGS | NBD_FLAG_SEND_FLUSH
+		    | NBD_FLAG_SEND_TRIM);
+  write_all (fd, &ns, sizeof ns);
+
+  for (;;)
+    {
+      struct nbd_request req;
+      struct pollfd pfd = { fd: fd, events: POLLIN };
+      uint64_t from;
+      uint32_t len;
+
+      /* Wait a little for more requests before answering those held.  */
+      if (nheld > 0 && (nheld == MAX_HELD || poll (&pfd, 1, 100) == 0))
+	{
+	  if (nheld > 1)
+	    reordered++;
+	  while (nheld > 0)
+	    reply (fd, &held[--nheld]);
+	  continue;
+	}
+
+      if (! read_all (fd, &req, sizeof req)
+	  || ntohl (req.magic) != NBD_REQUEST_MAGIC)
+	break;
+      if (__atomic_exchange_n (&hang_up, 0, __ATOMIC_SEQ_CST))
+	break;
+
+      from = ntohll (req.from);
+      len = ntohl (req.len);
+      if (from > DISK_SIZE || len > DISK_SIZE - from)
+	break;
+
+      switch (ntohl (req.type))
+	{
+	case NBD_CMD_DISC:
+	  close (fd);
+	  return;
+	case NBD_CMD_WRITE:
+	  if (! read_all (fd, disk + from, len))
+	    goto out;
+	  break;
+	case NBD_CMD_FLUSH:
+	  __atomic_add_fetch (&flushes, 1, __ATOMIC_SEQ_CST);
+	  break;
+	case NBD_CMD_TRIM:
+	  memset (disk + from, 0, len);
+	  __atomic_add_fetch (&trims, 1, __ATOMIC_SEQ_CST);
+	  __atomic_add_fetch (&trimmed, len, __ATOMIC_SEQ_CST);
+	  break;
+	}
+      held[nheld++] = req;
+    }
+
+ out:
+  close (fd);
+}
+
+static void *
+server (void *arg)
+{
+  for (;;)
+    {
+      int fd = accept (listen_fd, 0, 0);
+      if (fd < 0)
+	error (2, errno, "accept");
+      serve (fd);
+    }
+  return 0;
+}
+
+/* Open a new store on the server listening on PORT.  */
+static struct store *
+open_store (int port)
+{
+  char name[64];
+  struct store *store;
+  error_t err;
+
+  snprintf (name, sizeof name, "127.0.0.1:%d/%d", port, BLOCK_SIZE);
+  err = store_nbd_open (name, 0, &store);
+  if (err)
+    error (2, err, "%s", name);
+  return store;
+}
+
+/* Report whether COND holds, for WHAT.  Return nonzero if not.  */
+static int
+expect (int cond, const char *what)
+{
+  printf ("%s: %s\n", cond ? "PASS" : "FAIL", what);
+  return ! cond;
+}
+
+/* Read LEN bytes at block ADDR of STORE into BUF, and return the error.  */
+static error_t
+read_store (struct store *store, store_offset_t addr, char *buf, size_t len)
+{
+  void *data = buf;
+  size_t data_len = len;
+  error_t err = store_read (store, addr, len, &data, &data_len);
+
+  if (! err && data != buf)
+    {
+      memcpy (buf, data, data_len < len ? data_len : len);
+      munmap (data, data_len);
+    }
+  if (! err && data_len != len)
+    err = EIO;
+  return err;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct sockaddr_in sin;
+  socklen_t sin_len = sizeof sin;
+  struct store *store;
+  pthread_t thread;
+  char *pattern, *buf;
+  size_t amount, i;
+  int port, failed = 0;
+  error_t err;
+
+  listen_fd = socket (PF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0)
+    error (2, errno, "socket");
+  memset (&sin, 0, sizeof sin);
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (bind (listen_fd, (struct sockaddr *) &sin, sizeof sin) < 0
+      || listen (listen_fd, 1) < 0
+      || getsockname (listen_fd, (struct sockaddr *) &sin, &sin_len) < 0)
+    error (2, errno, "listening socket");
+  port = ntohs (sin.sin_port);
+
+  err = pthread_create (&thread, 0, server, 0);
+  if (err)
+    error (2, err, "pthread_create");
+  pthread_detach (thread);
+
+  pattern = malloc (XFER_SIZE);
+  buf = malloc (XFER_SIZE);
+  if (! pattern || ! buf)
+    error (2, ENOMEM, "buffers");
+  for (i = 0; i < XFER_SIZE; i++)
+    pattern[i] = i * 31 + i / BLOCK_SIZE;
+
+  store = open_store (port);
+  failed |= expect (store->size == DISK_SIZE, "size from the startup packet");
+
+  /* Several requests go out at once for these, and are answered in
+     reverse order.  */
+  err = store_write (store, 1, pattern, XFER_SIZE, &amount);
+  failed |= expect (! err && amount == XFER_SIZE, "write");
+  failed |= expect (! memcmp (disk + BLOCK_SIZE, pattern, XFER_SIZE),
+		    "written data reached the server");
+  memset (buf, 0, XFER_SIZE);
+  err = read_store (store, 1, buf, XFER_SIZE);
+  failed |= expect (! err && ! memcmp (buf, pattern, XFER_SIZE),
+		    "read back with out of order replies");
+  failed |= expect (reordered > 0, "server did answer out of order");
+
+  /* An error reply fails the transfer it is part of, but not the
+     connection.  */
+  __atomic_store_n (&bad_offset, 3 * 128 * 1024, __ATOMIC_SEQ_CST);
+  err = read_store (store, 0, buf, XFER_SIZE);
+  failed |= expect (err == EIO, "read with an error reply fails with EIO");
+  err = store_write (store, 0, pattern, XFER_SIZE, &amount);
+  failed |= expect (err == EIO && amount == 0,
+		    "write with an error reply fails with EIO");
+  __atomic_store_n (&bad_offset, -1, __ATOMIC_SEQ_CST);
+  err = read_store (store, 1, buf, BLOCK_SIZE);
+  failed |= expect (! err, "connection still usable after an error reply");
+
+  err = store_sync (store);
+  failed |= expect (! err && flushes == 1, "sync sends a FLUSH");
+
+  err = store_discard (store, 2, 4 * BLOCK_SIZE);
+  failed |= expect (! err && trims == 1 && trimmed == 4 * BLOCK_SIZE,
+		    "discard sends a TRIM");
+  err = read_store (store, 2, buf, 4 * BLOCK_SIZE);
+  for (i = 0; i < 4 * BLOCK_SIZE && buf[i] == 0; i++)
+    ;
+  failed |= expect (! err && i == 4 * BLOCK_SIZE, "trimmed blocks read back");
+
+  store_free (store);
+
+  /* Losing the connection in the middle of a transfer fails it and
+     everything after it, instead of leaving anyone waiting.  */
+  store = open_store (port);
+  __atomic_store_n (&hang_up, 1, __ATOMIC_SEQ_CST);
+  err = read_store (store, 0, buf, XFER_SIZE);
+  failed |= expect (err != 0, "read fails when the server hangs up");
+  err = store_write (store, 0, pattern, BLOCK_SIZE, &amount);
+  failed |= expect (err != 0, "later write on the lost connection fails");
+  store_free (store);
+
+  return failed;
+}
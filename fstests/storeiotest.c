@@ -0,0 +1,125 @@
+/* Test reads through the block cache of storeio
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* NODE must be a storeio node on a scratch store of at least 16 KiB,
+   whose block size is smaller than a page, for instance a disk
+   partition; its first 16 KiB are overwritten.  The test writes them a
+   block at a time, then reads several blocks at once into a buffer too
+   small for them, both with io_read and through a memory mapping (which
+   storeio's pager serves with a read of a whole page), and checks that
+   every block comes back.  All of this stays below --cache-bypass, so
+   it goes through the cache.  */
+
+#include <hurd.h>
+#include <hurd/io.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <error.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TEST_SIZE (16 * 1024)
+
+static char pattern[TEST_SIZE];
+
+/* Check that the LEN bytes at DATA are those at OFFS in PATTERN, and
+   say so for WHAT.  Return nonzero if they are not.  */
+static int
+check (const char *what, const char *data, size_t len, off_t offs)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    if (data[i] != pattern[offs + i])
+      {
+	printf ("FAIL: %s: byte %zu is %#x instead of %#x\n", what,
+		(size_t) offs + i, (unsigned char) data[i],
+		(unsigned char) pattern[offs + i]);
+	return 1;
+      }
+  printf ("PASS: %s\n", what);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  char small[512], *data;
+  mach_msg_type_number_t data_len;
+  size_t block_size, i;
+  struct stat st;
+  int fd, failed = 0;
+  error_t err;
+
+  if (argc != 2)
+    {
+      fprintf (stderr, "Usage: %s NODE\n", argv[0]);
+      exit (2);
+    }
+
+  fd = open (argv[1], O_RDWR);
+  if (fd < 0)
+    error (2, errno, "%s", argv[1]);
+  if (fstat (fd, &st) < 0)
+    error (2, errno, "%s", argv[1]);
+  if (st.st_size < TEST_SIZE)
+    error (2, 0, "%s: need at least %d bytes", argv[1], TEST_SIZE);
+  block_size = st.st_blksize;
+  if (block_size == 0 || block_size >= (size_t) getpagesize ())
+    error (2, 0, "%s: block size %zu is not smaller than a page",
+	   argv[1], block_size);
+
+  /* Make each block different.  */
+  for (i = 0; i < TEST_SIZE; i++)
+    pattern[i] = i * 31 + i / block_size;
+
+  for (i = 0; i < TEST_SIZE; i += block_size)
+    if (pwrite (fd, pattern + i, block_size, i) != (ssize_t) block_size)
+      error (2, errno, "%s: write at %zu", argv[1], i);
+
+  /* The reply buffer of io_read is smaller than this, so storeio has to
+     allocate a bigger one.  */
+  data = small;
+  data_len = sizeof small;
+  err = HURD_DPORT_USE (fd, io_read (port, &data, &data_len, 0,
+				     8 * block_size));
+  if (err)
+    error (2, err, "%s: io_read", argv[1]);
+  if (data_len != 8 * block_size)
+    {
+      printf ("FAIL: io_read: got %u bytes instead of %zu\n",
+	      (unsigned) data_len, 8 * block_size);
+      failed = 1;
+    }
+  else
+    failed |= check ("io_read of several blocks", data, data_len, 0);
+  if (data != small)
+    munmap (data, data_len);
+
+  data = mmap (0, TEST_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED)
+    error (2, errno, "%s: mmap", argv[1]);
+  failed |= check ("paging in", data, TEST_SIZE, 0);
+  munmap (data, TEST_SIZE);
+
+  close (fd);
+  return failed;
+}
@@ -0,0 +1,249 @@
+/* Test the zblock store
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+/* Builds an image in memory the way mkzblock does, of twice as many
+   blocks as the store caches, some of which compress and some of which
+   don't, and opens a zblock store on it through a buffer store.  All of
+   it is read and checked, more than once so that blocks have been
+   evicted from the cache by then, and blocks are written, in whole and
+   in part, both while they are cached and after they have been evicted,
+   and read back.  Nothing has to be set up beforehand.  */
+
+#include <hurd.h>
+#include <hurd/store.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <error.h>
+#include <errno.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#define ZBLOCK_MAGIC		"HURDZBLK"
+#define ZBLOCK_VERSION		1
+
+/* As in libstore/zblock.c.  */
+#define CACHE_BLOCKS		32
+
+#define BLOCK_SIZE		4096
+#define NUM_BLOCKS		(2 * CACHE_BLOCKS)
+
+/* Not a whole number of blocks, so the last one is short.  */
+#define SIZE			(NUM_BLOCKS * BLOCK_SIZE - 1000)
+
+struct zblock_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t block_size;
+  uint64_t size;
+  uint64_t index_offset;
+};
+
+/* What the store should hold.  */
+static char expected[SIZE];
+
+/* Return a zblock image of EXPECTED in *IMAGE, allocated with mmap, and
+   its length in *LEN.  */
+static void
+make_image (char **image, size_t *len)
+{
+  uLongf room = compressBound (BLOCK_SIZE);
+  size_t max_len = sizeof (struct zblock_header)
+		   + NUM_BLOCKS * room + (NUM_BLOCKS + 1) * sizeof (uint64_t);
+  struct zblock_header hdr;
+  uint64_t index[NUM_BLOCKS + 1], offs = sizeof hdr;
+  char *data;
+  size_t i;
+
+  data = mmap (0, max_len, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+  if (data == MAP_FAILED)
+    error (2, errno, "image");
+
+  for (i = 0; i < NUM_BLOCKS; i++)
+    {
+      const char *block = expected + i * BLOCK_SIZE;
+      size_t block_len = SIZE - i * BLOCK_SIZE;
+      uLongf clen = room;
+
+      if (block_len > BLOCK_SIZE)
+	block_len = BLOCK_SIZE;
+      index[i] = htobe64 (offs);
+      if (compress2 ((Bytef *) data + offs, &clen, (const Bytef *) block,
+		     block_len, 9) != Z_OK || clen >= block_len)
+	{
+	  clen = block_len;
+	  memcpy (data + offs, block, block_len);
+	}
+      offs += clen;
+    }
+  index[NUM_BLOCKS] = htobe64 (offs);
+  memcpy (data + offs, index, sizeof index);
+
+  memset (&hdr, 0, sizeof hdr);
+  memcpy (hdr.magic, ZBLOCK_MAGIC, sizeof hdr.magic);
+  hdr.version = htobe32 (ZBLOCK_VERSION);
+  hdr.block_size = htobe32 (BLOCK_SIZE);
+  hdr.size = htobe64 (SIZE);
+  hdr.index_offset = htobe64 (offs);
+  memcpy (data, &hdr, sizeof hdr);
+
+  *image = data;
+  *len = offs + sizeof index;
+}
+
+/* Read LEN bytes at ADDR of STORE and check them against EXPECTED, saying
+   so for WHAT.  Return nonzero if they don't match.  */
+static int
+check (struct store *store, off_t addr, size_t len, const char *what)
+{
+  char buf[2 * BLOCK_SIZE];
+  void *data = buf;
+  size_t data_len = sizeof buf;
+  size_t i;
+  error_t err;
+  int failed = 0;
+
+  err = store_read (store, addr, len, &data, &data_len);
+  if (err)
+    {
+      printf ("FAIL: %s: %s\n", what, strerror (err));
+      return 1;
+    }
+  if (data_len != len)
+    {
+      printf ("FAIL: %s: read %zu bytes instead of %zu\n",
+	      what, data_len, len);
+      failed = 1;
+    }
+  else
+    for (i = 0; i < len; i++)
+      if (((char *) data)[i] != expected[addr + i])
+	{
+	  printf ("FAIL: %s: byte %zu is %#x instead of %#x\n", what,
+		  (size_t) addr + i, ((unsigned char *) data)[i],
+		  (unsigned char) expected[addr + i]);
+	  failed = 1;
+	  break;
+	}
+  if (data != buf)
+    munmap (data, data_len);
+
+  if (! failed)
+    printf ("PASS: %s\n", what);
+  return failed;
+}
+
+/* Read every block of STORE, in reverse order if BACKWARDS, checking
+   them against EXPECTED.  Return nonzero if any doesn't match.  */
+static int
+check_all (struct store *store, int backwards, const char *what)
+{
+  size_t i;
+
+  for (i = 0; i < NUM_BLOCKS; i++)
+    {
+      size_t block = backwards ? NUM_BLOCKS - 1 - i : i;
+      off_t addr = block * BLOCK_SIZE;
+      size_t len = SIZE - addr < BLOCK_SIZE ? SIZE - addr : BLOCK_SIZE;
+      char name[64];
+
+      snprintf (name, sizeof name, "%s: block %zu", what, block);
+      if (check (store, addr, len, name))
+	return 1;
+    }
+  return 0;
+}
+
+/* Write LEN bytes of FILL at ADDR of STORE and to EXPECTED, saying so for
+   WHAT.  Return nonzero if it fails.  */
+static int
+write_fill (struct store *store, off_t addr, size_t len, char fill,
+	    const char *what)
+{
+  char buf[2 * BLOCK_SIZE];
+  size_t amount;
+  error_t err;
+
+  memset (buf, fill, len);
+  memset (expected + addr, fill, len);
+  err = store_write (store, addr, buf, len, &amount);
+  if (err || amount != len)
+    {
+      printf ("FAIL: %s: %s\n", what, err ? strerror (err) : "short write");
+      return 1;
+    }
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct store *source, *store;
+  char *image;
+  size_t image_len, i;
+  int failed = 0;
+  error_t err;
+
+  /* Even blocks compress well, odd ones hardly at all.  */
+  srandom (1);
+  for (i = 0; i < SIZE; i++)
+    expected[i] = (i / BLOCK_SIZE) % 2 ? random () : (char) (i / 64);
+
+  make_image (&image, &image_len);
+  err = store_buffer_create (image, image_len, STORE_READONLY, &source);
+  if (err)
+    error (2, err, "store_buffer_create");
+  err = store_zblock_create (source, 0, &store);
+  if (err)
+    error (2, err, "store_zblock_create");
+
+  if (store->size != SIZE)
+    {
+      printf ("FAIL: size is %lld instead of %d\n",
+	      (long long) store->size, SIZE);
+      failed = 1;
+    }
+
+  /* By the end of each of these, the first half of the blocks has been
+     evicted from the cache by the second, or the other way round.  */
+  failed |= check_all (store, 0, "first read");
+  failed |= check_all (store, 0, "read again after eviction");
+  failed |= check_all (store, 1, "read backwards");
+  failed |= check (store, BLOCK_SIZE - 100, BLOCK_SIZE + 200,
+		   "read across blocks");
+
+  /* Block 1 was read last, so is cached; NUM_BLOCKS - 2 was evicted.  */
+  failed |= write_fill (store, BLOCK_SIZE + 10, 100, 'a',
+			"part of a cached block");
+  failed |= write_fill (store, (NUM_BLOCKS - 2) * BLOCK_SIZE + 10, 100, 'b',
+			"part of an evicted block");
+  failed |= write_fill (store, 4 * BLOCK_SIZE, BLOCK_SIZE, 'c',
+			"a whole block");
+  failed |= write_fill (store, 7 * BLOCK_SIZE - 50, 100, 'd',
+			"across two blocks");
+  failed |= write_fill (store, SIZE - 20, 20, 'e', "the end of the short block");
+
+  /* Written blocks stay, however much is read through the cache.  */
+  failed |= check_all (store, 0, "read after writes");
+  failed |= check_all (store, 1, "read backwards after writes");
+
+  store_free (store);
+  return failed;
+}
@@ -20,256 +20,704 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
 #include <sys/mman.h>
 
 #include <hurd/netfs.h>
 
 #include "ccache.h"
 
-#define READ_CHUNK_SIZE   (8*1024)
-#define ALLOC_CHUNK_SIZE  (64*1024)
-
-/* Read LEN bytes at OFFS in the file referred to by CC into DATA, or return
-   an error.  */
-error_t
-ccache_read (struct ccache *cc, off_t offs, size_t len, void *data)
+/* The most data read from a data connection at once.  */
+#define READ_CHUNK_SIZE   (16*1024)
+
+/* When reads are sequential, this many blocks past the end of each read
+   are fetched along with it.  */
+#define READAHEAD_BLOCKS  4
+
+/* Ranges shorter than this aren't split between several connections, as
+   setting up the extra transfers would cost more than it gains.  */
+#define MIN_SPLIT_SIZE    (2*CCACHE_BLOCK_SIZE)
+
+/* Upper bound on the number of parallel fetches done for one read.  */
+#define MAX_FETCHES       16
+
+#define BLOCK_START(block) ((off_t) (block) * CCACHE_BLOCK_SIZE)
+
+/* Return the number of blocks of CC wholly before offset POS (the last,
+   partial, block of the file counts once POS reaches the end).  */
+static inline size_t
+blocks_before (struct ccache *cc, off_t pos)
+{
+  return pos >= cc->size ? cc->num_blocks : pos / CCACHE_BLOCK_SIZE;
+}
+
+/* On-disk caching.  Each cached file has two files in the cache
+   directory: the image, holding the file's contents at their natural
+   offsets, and a map, holding a header followed by the name of the
+   remote file and one state byte per block.  A block's state is only
+   recorded as valid after its data has been synced to the image, so a
+   crash can lose fetched data but never expose garbage.  */
+
+#define DISK_CACHE_MAGIC "FTPFSCC1"
+
+struct disk_cache_header
+{
+  char magic[8];
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint32_t block_size;
+  uint32_t key_len;		/* Length of the name that follows.  */
+};
+
+/* Return a hash of KEY, used to name the on-disk cache files.  */
+static uint64_t
+key_hash (const char *key)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  while (*key)
+    hash = (hash ^ (unsigned char) *key++) * 0x100000001b3ULL;
+  return hash;
+}
+
+/* Open the on-disk cache files for CC in DIR, creating them if necessary,
+   and map CC's image from there.  Blocks recorded as valid by an earlier
+   run are reused if the file's size and modification time are unchanged.
+   CC's SIZE, MTIME and BLOCKS should already be set up.  */
+static error_t
+disk_cache_open (struct ccache *cc, const char *dir)
 {
   error_t err = 0;
-  size_t max = offs + len;
+  struct disk_cache_header hdr, old_hdr;
+  char *key, *name = 0, *map_name = 0, *old_key = 0;
+  size_t key_len, b;
+  int image_fd = -1, map_fd = -1;
+  int reuse;
 
-  pthread_mutex_lock (&cc->lock);
+  if (asprintf (&key, "%s:%s", ftpfs_remote_fs, cc->node->nn->rmt_path) < 0)
+    return ENOMEM;
+  key_len = strlen (key) + 1;
+
+  if (asprintf (&name, "%s/%016llx", dir,
+		(unsigned long long) key_hash (key)) < 0)
+    name = 0;
+  if (!name || asprintf (&map_name, "%s.map", name) < 0)
+    {
+      map_name = 0;
+      err = ENOMEM;
+      goto out;
+    }
+
+  image_fd = open (name, O_RDWR | O_CREAT, 0600);
+  if (image_fd >= 0)
+    map_fd = open (map_name, O_RDWR | O_CREAT, 0600);
+  if (map_fd < 0)
+    {
+      err = errno;
+      goto out;
+    }
+
+  memset (&hdr, 0, sizeof hdr);
+  memcpy (hdr.magic, DISK_CACHE_MAGIC, sizeof hdr.magic);
+  hdr.size = cc->size;
+  hdr.mtime_sec = cc->mtime.tv_sec;
+  hdr.mtime_nsec = cc->mtime.tv_nsec;
+  hdr.block_size = CCACHE_BLOCK_SIZE;
+  hdr.key_len = key_len;
+  cc->map_blocks_offs = sizeof hdr + key_len;
+
+  reuse = (pread (map_fd, &old_hdr, sizeof old_hdr, 0) == sizeof old_hdr
+	   && memcmp (&old_hdr, &hdr, sizeof hdr) == 0);
+  if (reuse)
+    /* Make sure it's really the same file, not a hash collision.  */
+    {
+      old_key = malloc (key_len);
+      reuse = (old_key
+	       && pread (map_fd, old_key, key_len, sizeof hdr) == key_len
+	       && memcmp (old_key, key, key_len) == 0
+	       && pread (map_fd, cc->blocks, cc->num_blocks,
+			 cc->map_blocks_offs) == cc->num_blocks);
+    }
+
+  if (reuse)
+    /* Anything that wasn't known valid when we last ran must be fetched
+       again.  */
+    for (b = 0; b < cc->num_blocks; b++)
+      {
+	if (cc->blocks[b] != CCACHE_BLOCK_VALID)
+	  cc->blocks[b] = CCACHE_BLOCK_EMPTY;
+      }
+  else
+    /* Start afresh.  The header is written only after the old contents are
+       gone, so a crash in between just leaves an empty cache.  */
+    {
+      memset (cc->blocks, CCACHE_BLOCK_EMPTY, cc->num_blocks);
+      if (ftruncate (map_fd, 0) < 0
+	  || ftruncate (image_fd, 0) < 0
+	  || ftruncate (image_fd, cc->size) < 0
+	  || pwrite (map_fd, &hdr, sizeof hdr, 0) != sizeof hdr
+	  || pwrite (map_fd, key, key_len, sizeof hdr) != key_len
+	  || ftruncate (map_fd, cc->map_blocks_offs + cc->num_blocks) < 0)
+	err = errno ?: EIO;
+    }
+
+  if (!err && cc->size > 0)
+    {
+      void *image = mmap (0, cc->size, PROT_READ|PROT_WRITE, MAP_SHARED,
+			  image_fd, 0);
+      if (image == MAP_FAILED)
+	err = errno;
+      else
+	cc->image = image;
+    }
+
+ out:
+  if (err)
+    {
+      if (image_fd >= 0)
+	close (image_fd);
+      if (map_fd >= 0)
+	close (map_fd);
+      memset (cc->blocks, CCACHE_BLOCK_EMPTY, cc->num_blocks);
+    }
+  else
+    {
+      cc->image_fd = image_fd;
+      cc->map_fd = map_fd;
+    }
+
+  free (old_key);
+  free (map_name);
+  free (name);
+  free (key);
+
+  return err;
+}
+
+/* Record in CC's on-disk map that blocks FIRST to LAST (exclusive) are
+   valid, after making sure their data has reached the image file.  */
+static void
+disk_cache_commit (struct ccache *cc, size_t first, size_t last)
+{
+  unsigned char valid[256];
+  off_t start = BLOCK_START (first);
+  off_t end = BLOCK_START (last);
+
+  if (cc->map_fd < 0 || first >= last)
+    return;
+
+  if (end > cc->size)
+    end = cc->size;
+  if (msync (cc->image + start, end - start, MS_SYNC) < 0)
+    return;
+
+  memset (valid, CCACHE_BLOCK_VALID, sizeof valid);
+  while (first < last)
+    {
+      size_t n = last - first;
+      if (n > sizeof valid)
+	n = sizeof valid;
+      if (pwrite (cc->map_fd, valid, n, cc->map_blocks_offs + first) != n)
+	break;
+      first += n;
+    }
+}
+
+/* Stop any idle retrieval left in CC.  CC should be locked.  */
+static void
+drop_stream (struct ccache *cc)
+{
+  if (cc->stream_conn)
+    {
+      close (cc->stream_fd);
+      ftp_conn_abort (cc->stream_conn);
+      ftpfs_release_ftp_conn (cc->node->nn->fs, cc->stream_conn);
+      cc->stream_conn = 0;
+      cc->stream_fd = -1;
+    }
+}
+
+/* Set up CC's image and block map for the current size and modification
+   time of its node.  CC should be locked, with no fetches active.  */
+static error_t
+image_setup (struct ccache *cc)
+{
+  struct node *node = cc->node;
+  const char *cache_dir = node->nn->fs->params.cache_dir;
+
+  cc->size = node->nn_stat.st_size;
+  cc->mtime = node->nn_stat.st_mtim;
+  cc->num_blocks = (cc->size + CCACHE_BLOCK_SIZE - 1) / CCACHE_BLOCK_SIZE;
+  cc->blocks = calloc (cc->num_blocks ?: 1, 1);
+  if (! cc->blocks)
+    return ENOMEM;
+
+  cc->image = 0;
+  cc->image_fd = cc->map_fd = -1;
+  cc->last_read_end = 0;
+
+  if (cache_dir && disk_cache_open (cc, cache_dir) == 0)
+    return 0;
+
+  /* No on-disk cache (or it couldn't be used); keep the image in memory.  */
+  if (cc->size > 0)
+    {
+      void *image = mmap (0, cc->size, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (image == MAP_FAILED)
+	{
+	  free (cc->blocks);
+	  cc->blocks = 0;
+	  return errno;
+	}
+      cc->image = image;
+    }
+
+  return 0;
+}
+
+/* Release CC's image and block map.  CC should be locked, with no fetches
+   active.  */
+static void
+image_teardown (struct ccache *cc)
+{
+  drop_stream (cc);
+  if (cc->image)
+    munmap (cc->image, cc->size);
+  if (cc->image_fd >= 0)
+    close (cc->image_fd);
+  if (cc->map_fd >= 0)
+    close (cc->map_fd);
+  free (cc->blocks);
+  cc->image = 0;
+  cc->image_fd = cc->map_fd = -1;
+  cc->blocks = 0;
+  cc->num_blocks = 0;
+}
+
+/* Fetch the bytes [START, END) of CC's file into its image over a single
+   connection.  START must be block aligned and END either block aligned or
+   the end of the file, and the blocks in between must have been claimed
+   (marked CCACHE_BLOCK_FETCHING) by the caller; each is marked valid as
+   soon as it's complete, or returned to empty if the fetch fails.  */
+static error_t
+fetch_range (struct ccache *cc, off_t start, off_t end)
+{
+  error_t err = 0;
+  struct netnode *nn = cc->node->nn;
+  struct ftpfs *fs = nn->fs;
+  struct ftp_conn *conn = 0;
+  int fd = -1;
+  off_t pos = 0;
+  int reused = 0;
+  size_t first = start / CCACHE_BLOCK_SIZE, done = first, b;
 
-  if (max > cc->size)
-    max = cc->size;
+  pthread_mutex_lock (&cc->lock);
+  if (cc->stream_conn
+      && (cc->stream_pos == start
+	  || (fs->no_restart && cc->stream_pos <= start)))
+    /* Pick up where an earlier fetch left off.  */
+    {
+      conn = cc->stream_conn;
+      fd = cc->stream_fd;
+      pos = cc->stream_pos;
+      cc->stream_conn = 0;
+      cc->stream_fd = -1;
+      reused = 1;
+    }
+  pthread_mutex_unlock (&cc->lock);
 
-  while (cc->max < max && !err)
+  while (pos < end && !err)
     {
-      if (cc->fetching_active)
-	/* Some thread is fetching data, so just let it do its thing, but get
-	   a wakeup call when it's done.  */
+      ssize_t rd;
+
+      if (! conn)
+	/* We need to setup a connection to fetch data over.  */
 	{
-	  if (pthread_hurd_cond_wait_np (&cc->wakeup, &cc->lock))
-	    err = EINTR;
+	  err = ftpfs_get_ftp_conn (fs, &conn);
+	  if (err)
+	    break;
+
+	  pos = fs->no_restart ? 0 : start;
+	  err = ftp_conn_start_retrieve_at (conn, nn->rmt_path, pos, &fd);
+	  if (err == EOPNOTSUPP && pos > 0)
+	    /* The server can't start transfers in the middle of a file, so
+	       we'll have to read (and skip) everything before START.  */
+	    {
+	      fs->no_restart = 1;
+	      pos = 0;
+	      err = ftp_conn_start_retrieve (conn, nn->rmt_path, &fd);
+	    }
+	  if (err == ENOENT)
+	    err = ESTALE;
+	  if (err)
+	    {
+	      ftpfs_release_ftp_conn (fs, conn);
+	      conn = 0;
+	      break;
+	    }
+	}
+
+      if (pos < start)
+	{
+	  char discard[READ_CHUNK_SIZE];
+	  size_t amount = start - pos;
+	  rd = read (fd, discard,
+		     amount < sizeof discard ? amount : sizeof discard);
 	}
       else
 	{
-	  int re_connected = 0;
-	  struct netnode *nn = cc->node->nn;
+	  size_t amount = end - pos;
+	  rd = read (fd, cc->image + pos,
+		     amount < READ_CHUNK_SIZE ? amount : READ_CHUNK_SIZE);
+	}
 
-	  cc->fetching_active = 1;
+      if (rd < 0)
+	err = errno;
+      else if (rd == 0)
+	/* EOF.  This either means the file changed size, or our
+	   data-connection got closed while it was idle; we just try to open
+	   the connection a second time, and then if that fails, assume the
+	   size changed.  */
+	{
+	  close (fd);
+	  fd = -1;
+	  ftp_conn_finish_transfer (conn);
+	  ftpfs_release_ftp_conn (fs, conn);
+	  conn = 0;
+	  if (reused)
+	    reused = 0;
+	  else
+	    err = EIO;
+	}
+      else
+	{
+	  size_t upto;
 
-	  while (cc->max < max && !err)
+	  pos += rd;
+	  upto = blocks_before (cc, pos);
+	  if (upto > done)
+	    /* Some more blocks are complete; let any waiters at them.  */
 	    {
+	      pthread_mutex_lock (&cc->lock);
+	      for (b = done; b < upto; b++)
+		cc->blocks[b] = CCACHE_BLOCK_VALID;
+	      pthread_cond_broadcast (&cc->wakeup);
 	      pthread_mutex_unlock (&cc->lock);
+	      done = upto;
+	    }
+	}
 
-	      if (! cc->conn)
-		/* We need to setup a connection to fetch data over.  */
-		{
-		  err = ftpfs_get_ftp_conn (nn->fs, &cc->conn);
-		  if (! err)
-		    {
-		      err = ftp_conn_start_retrieve (cc->conn, nn->rmt_path,
-						     &cc->data_conn);
-		      if (err == ENOENT)
-			err = ESTALE;
-		      if (err)
-			{
-			  ftpfs_release_ftp_conn (nn->fs, cc->conn);
-			  cc->conn = 0;
-			}
-		      else
-			cc->data_conn_pos = 0;
-		    }
-		  re_connected = 1;
-		}
-
-	      if (! err)
-		/* Try and read some data over the connection.  */
-		{
-		  size_t new_end = cc->max + READ_CHUNK_SIZE;
-
-		  if (new_end > cc->size)
-		    new_end = cc->size;
-
-		  if (new_end > cc->alloced)
-		    /* Make some room in memory for the new part of the
-		       image.  */
-		    {
-		      size_t alloc_end = cc->alloced + ALLOC_CHUNK_SIZE;
-
-		      if (alloc_end < new_end)
-			alloc_end = new_end;
-		      else if (alloc_end > cc->size)
-			alloc_end = cc->size;
-
-		      if (cc->alloced == 0)
-			{
-			  vm_address_t addr = 0;
-			  addr = (vm_address_t) mmap (0, alloc_end, 
-						      PROT_READ|PROT_WRITE,
-						      MAP_ANON, 0, 0);
-			  err = (addr == -1) ? errno : 0;
-			  if (! err)
-			    cc->image = (char *)addr;
-			}
-		      else
-			{
-			  vm_address_t addr =
-			    (vm_address_t)cc->image + cc->alloced;
-			  /* XXX.  This can't be replaced with mmap until we
-			     have MAP_EXCL.  -tb  */
-			  err = vm_allocate (mach_task_self (),
-					     &addr, alloc_end - cc->alloced,
-					     0);
-			  if (err == EKERN_NO_SPACE)
-			    /* Gack.  We've goota move the whole splooge.  */
-			    {
-			      addr = 0;
-			      addr = (vm_address_t) mmap (0, alloc_end, 
-							  PROT_READ|PROT_WRITE,
-							  MAP_ANON, 0, 0);
-			      err = (addr == -1) ? errno : 0;
-			      if (! err)
-				/* That worked; copy what's already-fetched. */
-				{
-				  bcopy (cc->image, (void *)addr, cc->max);
-				  munmap (cc->image, cc->alloced);
-				  cc->image = (char *)addr;
-				}
-			    }
-			}
-		      if (! err)
-			cc->alloced = alloc_end;
-		    }
-
-		  if (! err)
-		    {
-		      ssize_t rd =
-			read (cc->data_conn,
-			      cc->image + cc->data_conn_pos,
-			      new_end - cc->data_conn_pos);
-		      if (rd < 0)
-			err = errno;
-		      else if (rd == 0)
-			/* EOF.  This either means the file changed size, or
-			   our data-connection got closed; we just try to
-			   open the connection a second time, and then if
-			   that fails, assume the size changed.  */
-			{
-			  if (re_connected)
-			    err = EIO; /* Something's fucked */
-			  else
-			    /* Try opening the connection again.  */
-			    {
-			      close (cc->data_conn);
-			      ftp_conn_finish_transfer (cc->conn);
-			      ftpfs_release_ftp_conn (nn->fs, cc->conn);
-			      cc->conn = 0;
-			    }
-			}
-		      else
-			{
-			  cc->data_conn_pos += rd;
-			  if (cc->data_conn_pos > cc->max)
-			    cc->max = cc->data_conn_pos;
-			}
-		    }
-
-		  if (!err && ports_self_interrupted ())
-		    err = EINTR;
-		}
+      if (!err && ports_self_interrupted ())
+	err = EINTR;
+    }
 
-	      pthread_mutex_lock (&cc->lock);
+  disk_cache_commit (cc, first, done);
 
-	      if (cc->max < max && !err)
-		/* If anyone's waiting for data, let them look (if we're done
-		   fetching, this gets delayed until below).  */
-		pthread_cond_broadcast (&cc->wakeup);
-	    }
+  pthread_mutex_lock (&cc->lock);
 
-	  if (!err && cc->conn && cc->max == cc->size)
-	    /* We're finished reading all data, close the data connection.  */
-	    {
-	      close (cc->data_conn);
-	      ftp_conn_finish_transfer (cc->conn);
-	      ftpfs_release_ftp_conn (nn->fs, cc->conn);
-	      cc->conn = 0;
-	    }
+  if (err)
+    /* Let someone else have a go at the blocks we didn't get.  */
+    {
+      size_t last = blocks_before (cc, end);
+      for (b = done; b < last; b++)
+	cc->blocks[b] = CCACHE_BLOCK_EMPTY;
+      pthread_cond_broadcast (&cc->wakeup);
+    }
 
-	  /* We're done, error or no.  */
-	  cc->fetching_active = 0;
+  if (conn && !err && pos < cc->size && !cc->stream_conn && !cc->stale)
+    /* Leave the transfer running, for a following sequential fetch.  */
+    {
+      cc->stream_conn = conn;
+      cc->stream_fd = fd;
+      cc->stream_pos = pos;
+      conn = 0;
+    }
 
-	  /* Let others know something's going on.  */
-	  pthread_cond_broadcast (&cc->wakeup);
+  pthread_mutex_unlock (&cc->lock);
+
+  if (conn)
+    {
+      close (fd);
+      if (err || pos < cc->size)
+	ftp_conn_abort (conn);
+      else
+	ftp_conn_finish_transfer (conn);
+      ftpfs_release_ftp_conn (fs, conn);
+    }
+
+  return err;
+}
+
+/* A range being fetched by one of several parallel threads.  */
+struct fetch
+{
+  struct ccache *cc;
+  off_t start, end;
+  error_t err;
+  pthread_t thread;
+  int threaded;
+};
+
+static void *
+fetch_thread (void *arg)
+{
+  struct fetch *f = arg;
+  f->err = fetch_range (f->cc, f->start, f->end);
+  return NULL;
+}
+
+/* Claim runs of empty blocks between FIRST and LAST (exclusive) in CC, and
+   describe them as up to MAX ranges in FETCHES, splitting long runs so
+   that as many ranges as possible can be fetched in parallel.  Returns the
+   number of ranges.  CC should be locked.  */
+static int
+claim_blocks (struct ccache *cc, size_t first, size_t last,
+	      struct fetch *fetches, int max)
+{
+  int num = 0, i;
+  size_t b = first;
+
+  while (b < last && num < max)
+    {
+      size_t run_end;
+
+      if (cc->blocks[b] != CCACHE_BLOCK_EMPTY)
+	{
+	  b++;
+	  continue;
 	}
+
+      for (run_end = b; run_end < last; run_end++)
+	{
+	  if (cc->blocks[run_end] != CCACHE_BLOCK_EMPTY)
+	    break;
+	  cc->blocks[run_end] = CCACHE_BLOCK_FETCHING;
+	}
+
+      fetches[num].cc = cc;
+      fetches[num].start = BLOCK_START (b);
+      fetches[num].end = BLOCK_START (run_end);
+      if (fetches[num].end > cc->size)
+	fetches[num].end = cc->size;
+      num++;
+
+      b = run_end;
+
+      if (cc->node->nn->fs->no_restart)
+	/* Every fetch starts at the beginning of the file, so there's
+	   nothing to gain by doing several at once.  */
+	return num;
     }
 
-  if (! err)
-    bcopy (cc->image + offs, data, max - offs);
+  while (num > 0 && num < max)
+    /* Split the longest range in two, as long as it's worth it.  */
+    {
+      int longest = 0;
+      off_t mid;
+
+      for (i = 1; i < num; i++)
+	if (fetches[i].end - fetches[i].start
+	    > fetches[longest].end - fetches[longest].start)
+	  longest = i;
+
+      if (fetches[longest].end - fetches[longest].start < MIN_SPLIT_SIZE)
+	break;
+
+      mid = fetches[longest].start
+	+ BLOCK_START ((fetches[longest].end - fetches[longest].start)
+		       / CCACHE_BLOCK_SIZE / 2);
+      fetches[num] = fetches[longest];
+      fetches[num].start = mid;
+      fetches[longest].end = mid;
+      num++;
+    }
 
-  pthread_mutex_unlock (&cc->lock);
+  return num;
+}
+
+/* Fetch the NUM ranges in FETCHES, each over its own connection and all
+   but the first in a thread of its own.  Returns the first error.  */
+static error_t
+run_fetches (struct fetch *fetches, int num)
+{
+  error_t err = 0;
+  int i;
+
+  for (i = 1; i < num; i++)
+    fetches[i].threaded =
+      pthread_create (&fetches[i].thread, NULL, fetch_thread, &fetches[i]) == 0;
+
+  fetches[0].err = fetch_range (fetches[0].cc,
+				fetches[0].start, fetches[0].end);
+
+  for (i = 0; i < num; i++)
+    {
+      if (i > 0)
+	{
+	  if (fetches[i].threaded)
+	    pthread_join (fetches[i].thread, NULL);
+	  else
+	    /* Couldn't make a thread; do it ourselves.  */
+	    fetches[i].err = fetch_range (fetches[i].cc,
+					  fetches[i].start, fetches[i].end);
+	}
+      if (fetches[i].err && !err)
+	err = fetches[i].err;
+    }
 
   return err;
 }
-
-/* Discard any cached contents in CC.  */
+
+/* Read LEN bytes at OFFS in the file referred to by CC into DATA, or return
+   an error.  */
 error_t
-ccache_invalidate (struct ccache *cc)
+ccache_read (struct ccache *cc, off_t offs, size_t len, void *data)
 {
   error_t err = 0;
+  off_t end;
+  size_t first, last, fetch_last, b;
+  unsigned int generation;
+  int max_fetches;
 
   pthread_mutex_lock (&cc->lock);
 
-  while  (cc->fetching_active && !err)
-    /* Some thread is fetching data, so just let it do its thing, but get
-       a wakeup call when it's done.  */
+ again:
+  if (cc->stale)
+    /* Rebuild the image for the file as it now is.  */
     {
-      if (pthread_hurd_cond_wait_np (&cc->wakeup, &cc->lock))
-	err = EINTR;
+      while (cc->fetching_active && !err)
+	if (pthread_hurd_cond_wait_np (&cc->wakeup, &cc->lock))
+	  err = EINTR;
+      if (! err && cc->stale)
+	{
+	  image_teardown (cc);
+	  err = image_setup (cc);
+	  if (! err)
+	    {
+	      cc->stale = 0;
+	      cc->generation++;
+	    }
+	}
     }
+  generation = cc->generation;
 
-  if (! err)
+  end = offs + len;
+  if (end > cc->size)
+    end = cc->size;
+  if (err || offs >= end)
     {
-      if (cc->alloced > 0)
-	{
-	  munmap (cc->image, cc->alloced);
-	  cc->image = 0;
-	  cc->alloced = 0;
-	  cc->max = 0;
-	}
-      if (cc->conn)
+      pthread_mutex_unlock (&cc->lock);
+      return err;
+    }
+
+  first = offs / CCACHE_BLOCK_SIZE;
+  last = (end - 1) / CCACHE_BLOCK_SIZE + 1;
+
+  fetch_last = last;
+  if (offs == cc->last_read_end)
+    /* Sequential access; fetch a little ahead.  */
+    {
+      fetch_last += READAHEAD_BLOCKS;
+      if (fetch_last > cc->num_blocks)
+	fetch_last = cc->num_blocks;
+    }
+  cc->last_read_end = end;
+
+  max_fetches = cc->node->nn->fs->params.fetch_conns;
+  if (max_fetches < 1)
+    max_fetches = 1;
+  else if (max_fetches > MAX_FETCHES)
+    max_fetches = MAX_FETCHES;
+
+  while (! err)
+    {
+      struct fetch fetches[MAX_FETCHES];
+      int num = claim_blocks (cc, first, fetch_last, fetches, max_fetches);
+
+      if (num > 0)
 	{
-	  close (cc->data_conn);
-	  ftp_conn_finish_transfer (cc->conn);
-	  ftpfs_release_ftp_conn (cc->node->nn->fs, cc->conn);
-	  cc->conn = 0;
+	  cc->fetching_active++;
+	  pthread_mutex_unlock (&cc->lock);
+
+	  err = run_fetches (fetches, num);
+
+	  pthread_mutex_lock (&cc->lock);
+	  cc->fetching_active--;
+	  pthread_cond_broadcast (&cc->wakeup);
+	  continue;
 	}
+
+      for (b = first; b < last; b++)
+	if (cc->blocks[b] != CCACHE_BLOCK_VALID)
+	  break;
+      if (b == last)
+	break;
+
+      /* Some other thread is fetching what we need, so just let it do its
+	 thing, but get a wakeup call when it's done.  */
+      if (pthread_hurd_cond_wait_np (&cc->wakeup, &cc->lock))
+	err = EINTR;
+      else if (cc->stale || cc->generation != generation)
+	/* The image was rebuilt while we slept, or is about to be, so the
+	   blocks and the end of the file we worked out are no good.  */
+	goto again;
+
+      /* Only wait for what we actually need from now on.  */
+      fetch_last = last;
     }
 
+  if (! err)
+    bcopy (cc->image + offs, data, end - offs);
+
   pthread_mutex_unlock (&cc->lock);
 
   return err;
 }
-
+
+/* Discard any cached contents in CC.  */
+error_t
+ccache_invalidate (struct ccache *cc)
+{
+  pthread_mutex_lock (&cc->lock);
+
+  /* Fetches in progress are left to finish; the image is rebuilt once
+     they have, before the next read.  */
+  cc->stale = 1;
+  drop_stream (cc);
+
+  pthread_mutex_unlock (&cc->lock);
+
+  return 0;
+}
+
 /* Return a ccache object for NODE in CC.  */
 error_t
 ccache_create (struct node *node, struct ccache **cc)
 {
+  error_t err;
   struct ccache *new = malloc (sizeof (struct ccache));
 
   if (! new)
     return ENOMEM;
 
   new->node = node;
-  new->image = 0;
-  new->size = node->nn_stat.st_size;
-  new->max = 0;
-  new->alloced = 0;
+  new->stale = 0;
+  new->generation = 0;
   pthread_mutex_init (&new->lock, NULL);
   pthread_cond_init (&new->wakeup, NULL);
   new->fetching_active = 0;
-  new->conn = 0;
-  new->data_conn = -1;
+  new->stream_conn = 0;
+  new->stream_fd = -1;
+  new->stream_pos = 0;
+
+  err = image_setup (new);
+  if (err)
+    {
+      free (new);
+      return err;
+    }
 
   *cc = new;
 
@@ -280,14 +728,6 @@ ccache_create (struct node *node, struct ccache **cc)
 void
 ccache_free (struct ccache *cc)
 {
-  if (cc->alloced > 0)
-    munmap (cc->image, cc->alloced);
-  if (cc->data_conn >= 0)
-    close (cc->data_conn);
-  if (cc->conn)
-    {
-      ftp_conn_finish_transfer (cc->conn);
-      ftpfs_release_ftp_conn (cc->node->nn->fs, cc->conn);
-    }
+  image_teardown (cc);
   free (cc);
 }
@@ -23,38 +23,69 @@
 
 #include "ftpfs.h"
 
+/* Contents are fetched and tracked in blocks of this many bytes.  */
+#define CCACHE_BLOCK_SIZE  (64*1024)
+
+/* States of a block of the cached image.  */
+enum ccache_block_state
+{
+  CCACHE_BLOCK_EMPTY = 0,	/* Not fetched.  */
+  CCACHE_BLOCK_FETCHING,	/* Some thread is fetching it.  */
+  CCACHE_BLOCK_VALID		/* Holds the file's contents.  */
+};
+
 struct ccache
 {
   /* The filesystem node this is a cache of.  */
   struct node *node;
 
-  /* In memory file image, alloced using vm_allocate.  */
+  /* File image, SIZE bytes long; either anonymous memory, or mapped from
+     the on-disk cache file IMAGE_FD.  */
   char *image;
 
   /* Size of data.  */
   off_t size;
 
-  /* Upper bounds of fetched image.  */
-  off_t max;
+  /* The modification time of the file IMAGE holds.  */
+  struct timespec mtime;
+
+  /* The state of each CCACHE_BLOCK_SIZE block of IMAGE.  */
+  unsigned char *blocks;
+  size_t num_blocks;
+
+  /* True if the contents were invalidated; the image is rebuilt for the
+     file's current size before the next read.  */
+  int stale;
 
-  /* Amount of IMAGE that has been allocated.  */
-  size_t alloced;
+  /* Bumped each time the image is rebuilt, so that readers waiting for a
+     fetch can tell that what they found out about it has gone stale.  */
+  unsigned int generation;
 
   pthread_mutex_t lock;
 
-  /* People can wait for a reading thread on this condition.  */
+  /* People can wait for fetching threads on this condition; it's
+     broadcast whenever a block changes state.  */
   pthread_cond_t wakeup;
 
-  /* True if some thread is now fetching data.  Only that thread should
-     modify the DATA_CONN, DATA_CONN_POS, and MAX fields.  */
+  /* The number of fetches in progress.  */
   int fetching_active;
 
-  /* Ftp connection over which data is being fetched, or 0.  */
-  struct ftp_conn *conn;
-  /* File descriptor over which data is being fetched.  */
-  int data_conn;
-  /* Where DATA_CONN points in the file.  */
-  off_t data_conn_pos;
+  /* Where the last read ended, for detecting sequential access.  */
+  off_t last_read_end;
+
+  /* A retrieval left running by a previous fetch, which a fetch starting
+     at STREAM_POS can pick up without reconnecting, or 0.  */
+  struct ftp_conn *stream_conn;
+  /* File descriptor over which STREAM_CONN's data arrives.  */
+  int stream_fd;
+  /* Where STREAM_FD points in the file.  */
+  off_t stream_pos;
+
+  /* The on-disk cache files holding the image and the valid-block map,
+     or -1 if this cache is memory only.  */
+  int image_fd, map_fd;
+  /* Offset of the block states in MAP_FD.  */
+  off_t map_blocks_offs;
 };
 
 /* Read LEN bytes at OFFS in the file referred to by CC into DATA, or return
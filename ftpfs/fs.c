@@ -57,6 +57,7 @@ ftpfs_create (char *rmt_path, int fsid,
   new->next_inode = 2;
 
   new->params = *params;
+  new->no_restart = 0;
   new->ftp_params = ftp_params;
   new->ftp_hooks = ftp_hooks;
 
@@ -106,6 +106,8 @@ cntl_debug (struct ftp_conn *conn, int type, const char *txt)
 
 #define DEFAULT_NODE_CACHE_MAX	50
 
+#define DEFAULT_FETCH_CONNS	4
+
 /* Return a string corresponding to the printed rep of DEFAULT_what */
 #define ___D(what) #what
 #define __D(what) ___D(what)
@@ -120,6 +122,7 @@ cntl_debug (struct ftp_conn *conn, int type, const char *txt)
 #define OPT_NODE_CACHE_MAX      8
 #define OPT_BULK_STAT_PERIOD    9
 #define OPT_BULK_STAT_THRESHOLD 10
+#define OPT_FETCH_CONNS         11
 
 /* Options usable both at startup and at runtime.  */
 static const struct argp_option common_options[] =
@@ -142,6 +145,10 @@ static const struct argp_option common_options[] =
    "Number of stats within the bulk-stat-period that trigger a bulk stat"
    " (default " _D(BULK_STAT_THRESHOLD) ")"},
 
+  {"fetch-connections", OPT_FETCH_CONNS, "NUM", 0,
+   "Maximum number of connections used to fetch parts of a file in parallel"
+   " (default " _D(FETCH_CONNS) ")"},
+
   {0, 0}
 };
 
@@ -207,6 +214,8 @@ parse_common_opt (int key, char *arg, struct argp_state *state)
       params->name_timeout = atoi (arg); break;
     case OPT_STAT_TIMEOUT:
       params->stat_timeout = atoi (arg); break;
+    case OPT_FETCH_CONNS:
+      params->fetch_conns = atoi (arg); break;
     default:
       return ARGP_ERR_UNKNOWN;
     }
@@ -218,8 +227,12 @@ static struct argp common_argp = { common_options, parse_common_opt };
 
 /* Startup options.  */
 
+#define OPT_CACHE_DIR		20
+
 static const struct argp_option startup_options[] =
 {
+  {"cache-dir", OPT_CACHE_DIR, "DIR", 0,
+   "Keep fetched file contents in DIR, so they survive restarts"},
   { 0 }
 };
 
@@ -229,6 +242,10 @@ parse_startup_opt (int key, char *arg, struct argp_state *state)
 {
   switch (key)
     {
+    case OPT_CACHE_DIR:
+      ftpfs_params.cache_dir = arg;
+      break;
+
     case ARGP_KEY_ARG:
       if (state->arg_num > 1)
 	argp_usage (state);
@@ -363,6 +380,19 @@ netfs_append_args (char **argz, size_t *argz_len)
     FOPT ("--bulk-stat-period=%ld", ftpfs->params.bulk_stat_period);
   if (ftpfs->params.bulk_stat_threshold != DEFAULT_BULK_STAT_THRESHOLD)
     FOPT ("--bulk-stat-threshold=%d", ftpfs->params.bulk_stat_threshold);
+  if (ftpfs->params.fetch_conns != DEFAULT_FETCH_CONNS)
+    FOPT ("--fetch-connections=%u", ftpfs->params.fetch_conns);
+  if (!err && ftpfs->params.cache_dir)
+    {
+      char *rep;
+      if (asprintf (&rep, "--cache-dir=%s", ftpfs->params.cache_dir) < 0)
+	err = ENOMEM;
+      else
+	{
+	  err = argz_add (argz, argz_len, rep);
+	  free (rep);
+	}
+    }
 
   return argz_add (argz, argz_len, ftpfs_remote_fs);
 }
@@ -384,6 +414,8 @@ main (int argc, char **argv)
   ftpfs_params.node_cache_max = DEFAULT_NODE_CACHE_MAX;
   ftpfs_params.bulk_stat_period = DEFAULT_BULK_STAT_PERIOD;
   ftpfs_params.bulk_stat_threshold = DEFAULT_BULK_STAT_THRESHOLD;
+  ftpfs_params.fetch_conns = DEFAULT_FETCH_CONNS;
+  ftpfs_params.cache_dir = 0;
 
   argp_parse (&argp, argc, argv, 0, 0, 0);
 
@@ -145,6 +145,13 @@ struct ftpfs_params
 
   /* The size of the node cache.  */
   size_t node_cache_max;
+
+  /* The most connections used to fetch parts of a file in parallel.  */
+  unsigned fetch_conns;
+
+  /* If non-zero, a directory in which file contents are cached across
+     runs.  */
+  const char *cache_dir;
 };
 
 /* A particular filesystem.  */
@@ -172,6 +179,10 @@ struct ftpfs
 
   struct ftpfs_params params;
 
+  /* True if the server has refused to start a transfer at an offset, so
+     every retrieval must start at the beginning of the file.  */
+  int no_restart;
+
   /* A cache that holds a reference to recently used nodes.  */
   struct node *node_cache_mru, *node_cache_lru;
   size_t node_cache_len;	/* Number of entries in it.  */
@@ -180,6 +191,9 @@ struct ftpfs
 
 extern volatile struct mapped_time_value *ftpfs_maptime;
 
+/* The (user-specified) name of the SERVER:FILESYSTEM we're connected too.  */
+extern char *ftpfs_remote_fs;
+
 /* The current time.  */
 #define NOW \
   ({ struct timeval tv; maptime_read (ftpfs_maptime, &tv); tv.tv_sec; })
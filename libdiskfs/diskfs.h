@@ -105,6 +105,11 @@ struct node
 
   pthread_mutex_t lock;
 
+  /* Held for reading while io_read copies the contents of a regular
+     file without LOCK, and for writing (with LOCK held too) by anything
+     that changes the contents or the size of one.  */
+  pthread_rwlock_t io_lock;
+
   refcounts_t refcounts;
 
   mach_port_t sockaddr;		/* address for S_IFSOCK shortcut */
@@ -586,6 +591,16 @@ error_t (*diskfs_create_symlink_hook)(struct node *np, const char *target);
    used.  If it returns any other error, it is returned to the user. */
 error_t (*diskfs_read_symlink_hook)(struct node *np, char *target);
 
+/* If this function is nonzero it is called to read or write *AMT bytes
+   of the contents of locked node NP at OFFSET directly to or from DATA,
+   instead of going through the memory object.  DIR is set for writing
+   and clear for reading.  If it returns EINVAL or isn't set, then the
+   normal method (copying through the memory object returned by
+   diskfs_get_filemap) is used.  If it returns any other error, it is
+   returned to the user.  */
+error_t (*diskfs_rdwr_hook)(struct node *np, char *data, off_t offset,
+			    size_t *amt, int dir);
+
 /* The user may define this function.  The function must set source to
    the source of CRED. The function may return an EOPNOTSUPP to
    indicate that the concept of a source device is not applicable. The
@@ -30,7 +30,9 @@ diskfs_S_file_set_size (struct protid *cred,
 			 err = EINVAL;
 		       else if (size < np->dn_stat.st_size)
 			 {
+			   pthread_rwlock_wrlock (&np->io_lock);
 			   err = diskfs_truncate (np, size);
+			   pthread_rwlock_unlock (&np->io_lock);
 			   if (!err && np->filemod_reqs)
 			     diskfs_notice_filechange (np, 
 						       FILE_CHANGED_TRUNCATE, 
@@ -38,6 +40,7 @@ diskfs_S_file_set_size (struct protid *cred,
 			 }
 		       else if (size > np->dn_stat.st_size)
 			 {
+			   pthread_rwlock_wrlock (&np->io_lock);
 			   err = diskfs_grow (np, size, cred);
 			   if (! err)
 			     {
@@ -48,6 +51,7 @@ diskfs_S_file_set_size (struct protid *cred,
 							   FILE_CHANGED_EXTEND,
 							   0, size);
 			     }
+			   pthread_rwlock_unlock (&np->io_lock);
 			 }
 		       else
 			 err = 0; /* Setting to same size.  */
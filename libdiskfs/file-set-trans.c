@@ -168,7 +168,9 @@ diskfs_S_file_set_translator (struct protid *cred,
 		  np->dn_stat.st_rdev = makedev (major, minor);
 		}
 
+	      pthread_rwlock_wrlock (&np->io_lock);
 	      err = diskfs_truncate (np, 0);
+	      pthread_rwlock_unlock (&np->io_lock);
 	      if (err)
 		{
 		  pthread_mutex_unlock (&np->lock);
@@ -61,7 +61,9 @@ diskfs_S_io_prenotify (struct protid *cred,
       goto out;
     }
   
+  pthread_rwlock_wrlock (&np->io_lock);
   err = diskfs_grow (np, end, cred);
+  pthread_rwlock_unlock (&np->io_lock);
   if (diskfs_synchronous)
     diskfs_node_update (np, 1);
   if (!err && np->filemod_reqs)
@@ -30,6 +30,7 @@ diskfs_S_io_read (struct protid *cred,
   struct node *np;
   int err;
   off_t off = offset;
+  off_t claimed_end = 0;
   char *buf;
   int ourbuf = 0;
 
@@ -68,6 +69,11 @@ diskfs_S_io_read (struct protid *cred,
 
   *datalen = maxread;
 
+  if (offset == -1)
+    /* Claim this part of the file now, since other readers sharing the
+       file pointer may run while we copy.  */
+    claimed_end = cred->po->filepointer += maxread;
+
   if (maxread == 0)
     err = 0;
   else if (S_ISLNK (np->dn_stat.st_mode))
@@ -91,15 +97,22 @@ diskfs_S_io_read (struct protid *cred,
   else
     err = EINVAL;		/* Use read below.  */
 
-  if (err == EINVAL)
+  if (err == EINVAL && S_ISREG (np->dn_stat.st_mode))
+    err = _diskfs_read_shared (np, buf, off, datalen,
+			       cred->po->openstat & O_NOATIME);
+  else if (err == EINVAL)
     err = _diskfs_rdwr_internal (np, buf, off, datalen, 0,
 				 cred->po->openstat & O_NOATIME);
 
   if (diskfs_synchronous)
     diskfs_node_update (np, 1);	/* atime! */
 
-  if (offset == -1 && !err)
-    cred->po->filepointer += *datalen;
+  if (offset == -1 && cred->po->filepointer == claimed_end)
+    /* Give back what we claimed but did not read.  If the pointer has
+       moved since, another reader has claimed what follows our part
+       (or somebody seeked), and moving it back would have that part
+       read twice; what we did not read is then skipped instead.  */
+    cred->po->filepointer -= err ? maxread : maxread - *datalen;
 
   if (err && ourbuf)
     munmap (buf, maxread);
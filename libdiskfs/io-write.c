@@ -39,6 +39,7 @@ diskfs_S_io_write (struct protid *cred,
     return EBADF;
 
   pthread_mutex_lock (&np->lock);
+  pthread_rwlock_wrlock (&np->io_lock);
 
   assert (!S_ISDIR(np->dn_stat.st_mode));
 
@@ -88,6 +89,7 @@ diskfs_S_io_write (struct protid *cred,
   if (!err && np->filemod_reqs)
     diskfs_notice_filechange (np, FILE_CHANGED_WRITE, off, off + *amt);
  out:
+  pthread_rwlock_unlock (&np->io_lock);
   pthread_mutex_unlock (&np->lock);
   return err;
 }
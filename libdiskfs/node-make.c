@@ -30,6 +30,7 @@ init_node (struct node *np, struct disknode *dn)
   np->author_tracks_uid = 0;
 
   pthread_mutex_init (&np->lock, NULL);
+  pthread_rwlock_init (&np->io_lock, NULL);
   refcounts_init (&np->refcounts, 1, 0);
   np->owner = 0;
   np->sockaddr = MACH_PORT_NULL;
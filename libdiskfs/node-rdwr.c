@@ -40,14 +40,17 @@ diskfs_node_rdwr (struct node *np,
   iohelp_get_conch (&np->conch);
 
   if (dir)
-    while (off + amt > np->allocsize)
-      {
-	err = diskfs_grow (np, off + amt, cred);
-	if (err)
-	  return err;
-	if (np->filemod_reqs)
-	  diskfs_notice_filechange (np, FILE_CHANGED_EXTEND, 0, off + amt);
-      }
+    {
+      pthread_rwlock_wrlock (&np->io_lock);
+      while (off + amt > np->allocsize)
+	{
+	  err = diskfs_grow (np, off + amt, cred);
+	  if (err)
+	    goto out;
+	  if (np->filemod_reqs)
+	    diskfs_notice_filechange (np, FILE_CHANGED_EXTEND, 0, off + amt);
+	}
+    }
 
   if (off + amt > np->dn_stat.st_size)
     {
@@ -73,5 +76,8 @@ diskfs_node_rdwr (struct node *np,
 	diskfs_node_update (np, 1);
     }
 
+ out:
+  if (dir)
+    pthread_rwlock_unlock (&np->io_lock);
   return err;
 }
@@ -86,6 +86,12 @@ typedef struct bootinfo *bootinfo_t;
 error_t _diskfs_rdwr_internal (struct node *np, char *data, off_t offset,
 			       size_t *amt, int dir, int notime);
 
+/* Read regular file NP like _diskfs_rdwr_internal, but release NP's
+   lock while the data is copied so that other readers can proceed.
+   NP must be locked, and is locked again on return.  */
+error_t _diskfs_read_shared (struct node *np, char *data, off_t offset,
+			     size_t *amt, int notime);
+
 /* Called when we have a real user environment (complete with proc
    and auth ports). */
 void _diskfs_init_completed (void);
@@ -20,19 +20,12 @@
 #include <fcntl.h>
 #include <hurd/pager.h>
 
-/* Actually read or write a file.  The file size must already permit
-   the requested access.  NP is the file to read/write.  DATA is a buffer
-   to write from or fill on read.  OFFSET is the absolute address (-1
-   not permitted here); AMT is the size of the read/write to perform;
-   DIR is set for writing and clear for reading.  The inode must
-   be locked.  If NOTIME is set, then don't update the mtime or atime. */
-error_t
-_diskfs_rdwr_internal (struct node *np,
-		       char *data,
-		       off_t offset,
-		       size_t *amt,
-		       int dir,
-		       int notime)
+/* Do the work of _diskfs_rdwr_internal and _diskfs_read_shared.  If
+   SHARED is set, release NP's lock for the copy itself and hold its
+   io_lock for reading instead.  */
+static error_t
+rdwr (struct node *np, char *data, off_t offset, size_t *amt,
+      int dir, int notime, int shared)
 {
   memory_object_t memobj;
   vm_prot_t prot = dir ? (VM_PROT_READ | VM_PROT_WRITE) : VM_PROT_READ;
@@ -53,6 +46,14 @@ _diskfs_rdwr_internal (struct node *np,
 	np->dn_set_atime = 1;
     }
 
+  if (diskfs_rdwr_hook)
+    {
+      err = (*diskfs_rdwr_hook) (np, data, offset, amt, dir);
+      if (err != EINVAL)
+	return err;
+      err = 0;
+    }
+
   memobj = diskfs_get_filemap (np, prot);
 
   if (memobj == MACH_PORT_NULL)
@@ -63,8 +64,25 @@ _diskfs_rdwr_internal (struct node *np,
       offset + *amt > ((off_t) 1) << (sizeof(vm_offset_t) * 8))
     err = EFBIG;
   else
-    err = pager_memcpy (diskfs_get_filemap_pager_struct (np), memobj,
-		      offset, data, amt, prot);
+    {
+      struct pager *pager = diskfs_get_filemap_pager_struct (np);
+
+      if (shared)
+	{
+	  /* No writer can have the io_lock while we hold LOCK, so this
+	     never waits.  */
+	  pthread_rwlock_rdlock (&np->io_lock);
+	  pthread_mutex_unlock (&np->lock);
+	}
+
+      err = pager_memcpy (pager, memobj, offset, data, amt, prot);
+
+      if (shared)
+	{
+	  pthread_rwlock_unlock (&np->io_lock);
+	  pthread_mutex_lock (&np->lock);
+	}
+    }
 
   if (!diskfs_check_readonly () && !notime)
     {
@@ -77,3 +95,36 @@ _diskfs_rdwr_internal (struct node *np,
   mach_port_deallocate (mach_task_self (), memobj);
   return err;
 }
+
+/* Actually read or write a file.  The file size must already permit
+   the requested access.  NP is the file to read/write.  DATA is a buffer
+   to write from or fill on read.  OFFSET is the absolute address (-1
+   not permitted here); AMT is the size of the read/write to perform;
+   DIR is set for writing and clear for reading.  The inode must
+   be locked.  If NOTIME is set, then don't update the mtime or atime. */
+error_t
+_diskfs_rdwr_internal (struct node *np,
+		       char *data,
+		       off_t offset,
+		       size_t *amt,
+		       int dir,
+		       int notime)
+{
+  return rdwr (np, data, offset, amt, dir, notime, 0);
+}
+
+/* Read regular file NP as _diskfs_rdwr_internal does, but let other
+   readers proceed while the data is copied: NP's lock is released
+   during the copy, so the caller must not depend on anything it
+   looked at under the lock except the file size.  NP must be locked,
+   and is locked again on return.  */
+error_t
+_diskfs_read_shared (struct node *np,
+		     char *data,
+		     off_t offset,
+		     size_t *amt,
+		     int notime)
+{
+  assert (S_ISREG (np->dn_stat.st_mode));
+  return rdwr (np, data, offset, amt, 0, notime, 1);
+}
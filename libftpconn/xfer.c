@@ -20,6 +20,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdio.h>
 #include <netinet/in.h>
 
 #include <ftpconn.h>
@@ -200,13 +201,15 @@ ftp_conn_abort_open_data (struct ftp_conn *conn, int data)
 }
 
 /* Start a transfer command CMD/ARG, returning a file descriptor in DATA.
+   If OFFSET is non-zero, the server is first told to restart the transfer
+   at that byte offset; if it doesn't know how to, EOPNOTSUPP is returned.
    POSS_ERRS is a list of errnos to try matching against any resulting error
    text.  */
-error_t
-ftp_conn_start_transfer (struct ftp_conn *conn,
-			 const char *cmd, const char *arg,
-			 const error_t *poss_errs,
-			 int *data)
+static error_t
+start_transfer (struct ftp_conn *conn,
+		const char *cmd, const char *arg, off_t offset,
+		const error_t *poss_errs,
+		int *data)
 {
   error_t err = ftp_conn_start_open_data (conn, data);
 
@@ -215,9 +218,26 @@ ftp_conn_start_transfer (struct ftp_conn *conn,
       int reply;
       const char *txt;
 
-      err = ftp_conn_cmd (conn, cmd, arg, &reply, &txt);
-      if (!err && !REPLY_IS_PRELIM (reply))
-	err = unexpected_reply (conn, reply, txt, poss_errs);
+      if (offset > 0)
+	/* REST must come immediately before the transfer command, so it's
+	   only sent after the data connection has been negotiated.  */
+	{
+	  char offs_buf[30];
+	  snprintf (offs_buf, sizeof offs_buf, "%lld", (long long) offset);
+	  err = ftp_conn_cmd (conn, "rest", offs_buf, &reply, &txt);
+	  if (!err && !REPLY_IS_INCOMPLETE (reply))
+	    err =
+	      REPLY_IS_FAILURE (reply)
+	      ? EOPNOTSUPP
+	      : unexpected_reply (conn, reply, txt, 0);
+	}
+
+      if (! err)
+	{
+	  err = ftp_conn_cmd (conn, cmd, arg, &reply, &txt);
+	  if (!err && !REPLY_IS_PRELIM (reply))
+	    err = unexpected_reply (conn, reply, txt, poss_errs);
+	}
 
       if (err)
 	ftp_conn_abort_open_data (conn, *data);
@@ -228,6 +248,18 @@ ftp_conn_start_transfer (struct ftp_conn *conn,
   return err;
 }
 
+/* Start a transfer command CMD/ARG, returning a file descriptor in DATA.
+   POSS_ERRS is a list of errnos to try matching against any resulting error
+   text.  */
+error_t
+ftp_conn_start_transfer (struct ftp_conn *conn,
+			 const char *cmd, const char *arg,
+			 const error_t *poss_errs,
+			 int *data)
+{
+  return start_transfer (conn, cmd, arg, 0, poss_errs, data);
+}
+
 /* Wait for the reply signalling the end of a data transfer.  */
 error_t
 ftp_conn_finish_transfer (struct ftp_conn *conn)
@@ -250,6 +282,19 @@ ftp_conn_start_retrieve (struct ftp_conn *conn, const char *name, int *data)
     ftp_conn_start_transfer (conn, "retr", name, ftp_conn_poss_file_errs, data);
 }
 
+/* Start retreiving file NAME over CONN, beginning at byte OFFSET, and
+   returning a file descriptor in DATA over which the data can be read.  If
+   the server can't restart transfers at an offset, EOPNOTSUPP is returned.  */
+error_t
+ftp_conn_start_retrieve_at (struct ftp_conn *conn, const char *name,
+			    off_t offset, int *data)
+{
+  if (! name || offset < 0)
+    return EINVAL;
+  return
+    start_transfer (conn, "retr", name, offset, ftp_conn_poss_file_errs, data);
+}
+
 /* Start retreiving a list of files in NAME over CONN, returning a file
    descriptor in DATA over which the data can be read.  */
 error_t
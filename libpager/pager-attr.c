@@ -29,6 +29,11 @@ pager_change_attributes (struct pager *p,
 			 int wait)
 {
   struct attribute_request *ar = 0;
+
+  if (!may_cache)
+    /* The user wants the object to go away once it is unused, which the
+       windows kept by pager_memcpy would prevent.  */
+    _pager_drop_windows (p, 0, ~(vm_size_t) 0);
   
   pthread_mutex_lock (&p->interlock);
 
@@ -44,6 +44,8 @@ _pager_create (size_t size,
   p->termwaiting = 0;
   p->pagemap = 0;
   p->pagemapsize = 0;
+  p->windows = 0;
+  p->nwindows = 0;
 
   return p;
 }
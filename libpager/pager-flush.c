@@ -25,6 +25,7 @@ pager_flush (struct pager *p, int wait)
   vm_address_t offset;
   vm_size_t len;
   
+  _pager_drop_windows (p, 0, ~(vm_size_t) 0);
   pager_report_extent (p->upi, &offset, &len);
   
   _pager_lock_object (p, offset, len, MEMORY_OBJECT_RETURN_NONE, 1,
@@ -39,6 +40,7 @@ void
 pager_flush_some (struct pager *p, vm_address_t offset,
 		 vm_size_t size, int wait)
 {
+  _pager_drop_windows (p, offset, size);
   _pager_lock_object (p, offset, size, MEMORY_OBJECT_RETURN_NONE, 1,
 		      VM_PROT_NO_CHANGE, wait);
 }
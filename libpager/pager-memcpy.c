@@ -47,6 +47,10 @@ pager_memcpy (struct pager *pager, memory_object_t memobj,
 #define MEMCPY_WINDOW_DEFAULT_SIZE (32 * vm_page_size)
   vm_address_t window;
   vm_size_t window_size;
+  /* Where in WINDOW the current copy starts.  */
+  vm_address_t copy_start;
+  /* The cached window WINDOW belongs to, if any.  */
+  struct pager_window *cached = 0;
 
   error_t do_vm_copy (void)
     {
@@ -102,21 +106,41 @@ pager_memcpy (struct pager *pager, memory_object_t memobj,
 	      size_t pageoff = offset & (vm_page_size - 1);
 	      size_t copy_count = window_size - pageoff;
 
-	      /* Map in and copy a standard-sized window, unless that is
-		 more than the total left to be copied.  */
-
-	      if (window_size >= round_page (pageoff + to_copy))
+	      if (pager)
 		{
-		  copy_count = to_copy;
-		  window_size = round_page (pageoff + to_copy);
+		  /* Copy through the cached window holding OFFSET, so
+		     that a run of small calls maps it only once.  */
+		  pageoff = offset % PAGER_WINDOW_SIZE;
+		  copy_count = PAGER_WINDOW_SIZE - pageoff;
+		  if (copy_count > to_copy)
+		    copy_count = to_copy;
+
+		  err = _pager_get_window (pager, memobj, offset - pageoff,
+					   prot, &cached);
+		  if (err)
+		    return err;
+		  window = cached->addr;
+		  window_size = PAGER_WINDOW_SIZE;
 		}
-
-	      window = 0;
-	      err = vm_map (mach_task_self (), &window, window_size, 0, 1,
-			    memobj, offset - pageoff, 0,
-			    prot, prot, VM_INHERIT_NONE);
-	      if (err)
-		return err;
+	      else
+		{
+		  /* Map in and copy a standard-sized window, unless that
+		     is more than the total left to be copied.  */
+
+		  if (window_size >= round_page (pageoff + to_copy))
+		    {
+		      copy_count = to_copy;
+		      window_size = round_page (pageoff + to_copy);
+		    }
+
+		  window = 0;
+		  err = vm_map (mach_task_self (), &window, window_size, 0, 1,
+				memobj, offset - pageoff, 0,
+				prot, prot, VM_INHERIT_NONE);
+		  if (err)
+		    return err;
+		}
+	      copy_start = window + pageoff;
 
 	      /* Realign the fault preemptor for the new mapping window.  */
 	      preemptor->first = window;
@@ -124,11 +148,17 @@ pager_memcpy (struct pager *pager, memory_object_t memobj,
 	      __sync_synchronize();
 
 	      if (prot == VM_PROT_READ)
-		memcpy (other, (const void *) window + pageoff, copy_count);
+		memcpy (other, (const void *) copy_start, copy_count);
 	      else
-		memcpy ((void *) window + pageoff, other, copy_count);
+		memcpy ((void *) copy_start, other, copy_count);
 	      
-	      vm_deallocate (mach_task_self (), window, window_size);
+	      if (cached)
+		{
+		  _pager_release_window (cached, 0);
+		  cached = 0;
+		}
+	      else
+		vm_deallocate (mach_task_self (), window, window_size);
 
 	      offset += copy_count;
 	      other += copy_count;
@@ -174,9 +204,13 @@ pager_memcpy (struct pager *pager, memory_object_t memobj,
   void fault (int signo, long int sigcode, struct sigcontext *scp)
     {
       assert (scp->sc_error == EKERN_MEMORY_ERROR);
-      err = pager_get_error (pager, sigcode - window + offset);
-      n -= sigcode - window;
-      vm_deallocate (mach_task_self (), window, window_size);
+      err = pager_get_error (pager, sigcode - copy_start + offset);
+      n -= sigcode - copy_start;
+      if (cached)
+	/* Don't keep a window that faults.  */
+	_pager_release_window (cached, 1);
+      else
+	vm_deallocate (mach_task_self (), window, window_size);
       siglongjmp (buf, 1);
     }
 
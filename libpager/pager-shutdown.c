@@ -22,7 +22,8 @@
 void
 pager_shutdown (struct pager *p)
 {
-  /* Sync and flush pager */
+  /* Sync and flush pager; that also drops the windows pager_memcpy
+     keeps mapped.  */
   pager_sync (p, 1);
   pager_flush (p, 1);
   pthread_mutex_lock (&p->interlock);
@@ -0,0 +1,238 @@
+/* Cache of mapped windows for pager_memcpy
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA. */
+
+#include "priv.h"
+#include <stdlib.h>
+
+/* Most windows a single pager may have in the cache.  */
+#define PAGER_WINDOWS_PER_PAGER 8
+
+/* Most windows in the cache altogether.  Each one ties up
+   PAGER_WINDOW_SIZE bytes of address space and keeps its memory object
+   from being terminated.  */
+#define PAGER_WINDOWS_MAX 64
+
+/* This lock protects the lists of windows, the counts of them, and the
+   USERS and DROPPED members of each window.  It is never held while
+   copying or while calling into the kernel.  */
+static pthread_mutex_t window_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* All the cached windows, most recently used first.  */
+static struct pager_window *lru_head, *lru_tail;
+static int nwindows;
+
+/* Take W out of the cache.  WINDOW_LOCK must be held.  */
+static void
+unlink_window (struct pager_window *w)
+{
+  *w->prevp = w->next;
+  if (w->next)
+    w->next->prevp = w->prevp;
+  w->pager->nwindows--;
+
+  if (w->lru_prev)
+    w->lru_prev->lru_next = w->lru_next;
+  else
+    lru_head = w->lru_next;
+  if (w->lru_next)
+    w->lru_next->lru_prev = w->lru_prev;
+  else
+    lru_tail = w->lru_prev;
+  nwindows--;
+
+  w->dropped = 1;
+}
+
+/* Make W the most recently used window, both of its pager and of all
+   windows.  W must be in the cache and WINDOW_LOCK held.  */
+static void
+touch_window (struct pager_window *w)
+{
+  struct pager *p = w->pager;
+
+  if (p->windows != w)
+    {
+      *w->prevp = w->next;
+      if (w->next)
+	w->next->prevp = w->prevp;
+      w->next = p->windows;
+      w->next->prevp = &w->next;
+      w->prevp = &p->windows;
+      p->windows = w;
+    }
+
+  if (lru_head != w)
+    {
+      w->lru_prev->lru_next = w->lru_next;
+      if (w->lru_next)
+	w->lru_next->lru_prev = w->lru_prev;
+      else
+	lru_tail = w->lru_prev;
+      w->lru_prev = 0;
+      w->lru_next = lru_head;
+      lru_head->lru_prev = w;
+      lru_head = w;
+    }
+}
+
+/* Take W out of the cache, and if nobody is using it add it to the
+   list *VICTIMS of windows to be freed once WINDOW_LOCK is released.
+   WINDOW_LOCK must be held.  */
+static void
+evict_window (struct pager_window *w, struct pager_window **victims)
+{
+  unlink_window (w);
+  if (w->users == 0)
+    {
+      w->next = *victims;
+      *victims = w;
+    }
+}
+
+/* Unmap and free the windows in the list VICTIMS.  */
+static void
+free_windows (struct pager_window *victims)
+{
+  while (victims)
+    {
+      struct pager_window *w = victims;
+      victims = w->next;
+      vm_deallocate (mach_task_self (), w->addr, PAGER_WINDOW_SIZE);
+      free (w);
+    }
+}
+
+/* Find or make a window of MEMOBJ, the memory object of pager P, which
+   starts at OFFSET (a multiple of PAGER_WINDOW_SIZE) and allows access
+   PROT.  Return it in *WP; the caller must give it back with
+   _pager_release_window.  */
+error_t
+_pager_get_window (struct pager *p, memory_object_t memobj,
+		   vm_offset_t offset, vm_prot_t prot,
+		   struct pager_window **wp)
+{
+  struct pager_window *w, *victims = 0;
+  vm_address_t addr;
+  error_t err;
+
+  pthread_mutex_lock (&window_lock);
+  for (w = p->windows; w; w = w->next)
+    if (w->offset == offset && (w->prot & prot) == prot)
+      {
+	w->users++;
+	touch_window (w);
+	pthread_mutex_unlock (&window_lock);
+	*wp = w;
+	return 0;
+      }
+  pthread_mutex_unlock (&window_lock);
+
+  addr = 0;
+  err = vm_map (mach_task_self (), &addr, PAGER_WINDOW_SIZE, 0, 1,
+		memobj, offset, 0, prot, prot, VM_INHERIT_NONE);
+  if (err)
+    return err;
+
+  w = malloc (sizeof *w);
+  if (! w)
+    {
+      vm_deallocate (mach_task_self (), addr, PAGER_WINDOW_SIZE);
+      return ENOMEM;
+    }
+  w->pager = p;
+  w->offset = offset;
+  w->addr = addr;
+  w->prot = prot;
+  w->users = 1;
+  w->dropped = 0;
+
+  pthread_mutex_lock (&window_lock);
+
+  w->next = p->windows;
+  if (w->next)
+    w->next->prevp = &w->next;
+  w->prevp = &p->windows;
+  p->windows = w;
+  p->nwindows++;
+
+  w->lru_prev = 0;
+  w->lru_next = lru_head;
+  if (lru_head)
+    lru_head->lru_prev = w;
+  else
+    lru_tail = w;
+  lru_head = w;
+  nwindows++;
+
+  /* Make room by dropping the least recently used windows.  */
+  while (p->nwindows > PAGER_WINDOWS_PER_PAGER)
+    {
+      struct pager_window *last = p->windows;
+      while (last->next)
+	last = last->next;
+      evict_window (last, &victims);
+    }
+  while (nwindows > PAGER_WINDOWS_MAX)
+    evict_window (lru_tail, &victims);
+
+  pthread_mutex_unlock (&window_lock);
+
+  free_windows (victims);
+  *wp = w;
+  return 0;
+}
+
+/* Give back window W, gotten from _pager_get_window.  If DROP is set,
+   the window is not to be used again (because it faulted).  */
+void
+_pager_release_window (struct pager_window *w, int drop)
+{
+  struct pager_window *victims = 0;
+
+  pthread_mutex_lock (&window_lock);
+  if (drop && !w->dropped)
+    unlink_window (w);
+  if (--w->users == 0 && w->dropped)
+    {
+      w->next = 0;
+      victims = w;
+    }
+  pthread_mutex_unlock (&window_lock);
+
+  free_windows (victims);
+}
+
+/* Drop the cached windows of pager P which overlap the LEN bytes at
+   START.  Windows in use are unmapped when their last user is done
+   with them.  */
+void
+_pager_drop_windows (struct pager *p, vm_offset_t start, vm_size_t len)
+{
+  struct pager_window *w, *next, *victims = 0;
+
+  pthread_mutex_lock (&window_lock);
+  for (w = p->windows; w; w = next)
+    {
+      next = w->next;
+      if (w->offset + PAGER_WINDOW_SIZE > start
+	  && (w->offset < start || w->offset - start < len))
+	evict_window (w, &victims);
+    }
+  pthread_mutex_unlock (&window_lock);
+
+  free_windows (victims);
+}
@@ -67,6 +67,27 @@ struct pager
 
   short *pagemap;
   int pagemapsize;		/* number of elements in PAGEMAP */
+
+  /* Windows kept mapped for pager_memcpy, most recently used first.  */
+  struct pager_window *windows;
+  int nwindows;
+};
+
+/* Size of the windows pager_memcpy maps and keeps.  */
+#define PAGER_WINDOW_SIZE (32 * vm_page_size)
+
+/* A window of a pager's memory object mapped by pager_memcpy, kept for
+   the next call that copies to or from the same part of the object.  */
+struct pager_window
+{
+  struct pager *pager;
+  vm_offset_t offset;		/* a multiple of PAGER_WINDOW_SIZE */
+  vm_address_t addr;
+  vm_prot_t prot;
+  int users;			/* pager_memcpy calls copying through it */
+  int dropped;			/* no longer cached; unmap when unused */
+  struct pager_window *next, **prevp; /* the pager's windows */
+  struct pager_window *lru_next, *lru_prev; /* all windows */
 };
 
 struct lock_request
@@ -143,4 +164,8 @@ void _pager_lock_object (struct pager *, vm_offset_t, vm_size_t, int, int,
 void _pager_free_structure (struct pager *);
 void _pager_clean (void *arg);
 void _pager_real_dropweak (void *arg);
+error_t _pager_get_window (struct pager *, memory_object_t, vm_offset_t,
+			   vm_prot_t, struct pager_window **);
+void _pager_release_window (struct pager_window *, int);
+void _pager_drop_windows (struct pager *, vm_offset_t, vm_size_t);
 #endif
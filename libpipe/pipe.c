@@ -21,6 +21,8 @@
 #include <string.h>		/* For memset() */
 #include <assert.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>		/* For SOCK_STREAM */
 
 #include <mach/time_value.h>
 #include <mach/mach_host.h>
@@ -304,6 +306,50 @@ pipe_pair_select (struct pipe *rpipe, struct pipe *wpipe,
   return err;
 }
 
+/* Note that data was just added to PIPE, which should be locked, and wake
+   up anyone that might be interested in it.  PIPE is unlocked briefly to
+   let them at it.  */
+static void
+pipe_wakeup_readers (struct pipe *pipe)
+{
+  timestamp (&pipe->write_time);
+
+  pthread_cond_broadcast (&pipe->pending_reads);
+  pthread_mutex_unlock (&pipe->lock);
+
+  pthread_mutex_lock (&pipe->lock);	/* Get back the lock on PIPE.  */
+  /* Only wakeup selects if there's still data available.  */
+  if (pipe_is_readable (pipe, 0))
+    {
+      pthread_cond_broadcast (&pipe->pending_read_selects);
+      pipe_select_cond_broadcast (pipe);
+      /* We leave PIPE locked here, assuming the caller will soon unlock
+	 it and allow others access.  */
+    }
+}
+
+/* Note that data was just removed from PIPE, which should be locked, and
+   wake up anyone waiting to write to it.  PIPE is unlocked briefly to let
+   them at it.  */
+static void
+pipe_wakeup_writers (struct pipe *pipe)
+{
+  timestamp (&pipe->read_time);
+
+  pthread_cond_broadcast (&pipe->pending_writes);
+  pthread_mutex_unlock (&pipe->lock);
+
+  pthread_mutex_lock (&pipe->lock);	/* Get back the lock on PIPE.  */
+  /* Only wakeup selects if there's still writing space available.  */
+  if (pipe_readable (pipe, 1) < pipe->write_limit)
+    {
+      pthread_cond_broadcast (&pipe->pending_write_selects);
+      pipe_select_cond_broadcast (pipe);
+      /* We leave PIPE locked here, assuming the caller will soon unlock
+	 it and allow others access.  */
+    }
+}
+
 /* Writes up to LEN bytes of DATA, to PIPE, which should be locked, and
    returns the amount written in AMOUNT.  If present, the information in
    CONTROL & PORTS is written in a preceding control packet.  If an error is
@@ -368,23 +414,7 @@ pipe_send (struct pipe *pipe, int noblock, void *source,
     err = (*pipe->class->write)(pipe->queue, source, data, data_len, amount);
 
   if (!err)
-    {
-      timestamp (&pipe->write_time);
-
-      /* And wakeup anyone that might be interested in it.  */
-      pthread_cond_broadcast (&pipe->pending_reads);
-      pthread_mutex_unlock (&pipe->lock);
-
-      pthread_mutex_lock (&pipe->lock);	/* Get back the lock on PIPE.  */
-      /* Only wakeup selects if there's still data available.  */
-      if (pipe_is_readable (pipe, 0))
-	{
-	  pthread_cond_broadcast (&pipe->pending_read_selects);
-	  pipe_select_cond_broadcast (pipe);
-	  /* We leave PIPE locked here, assuming the caller will soon unlock
-	     it and allow others access.  */
-	}
-    }
+    pipe_wakeup_readers (pipe);
 
   return err;
 }
@@ -470,22 +500,108 @@ pipe_recv (struct pipe *pipe, int noblock, unsigned *flags, void **source,
     }
 
   if (!err && packet)
+    pipe_wakeup_writers (pipe);
+
+  return err;
+}
+
+/* Removes up to AMOUNT bytes of data from the front of PIPE, which should be
+   locked, appending the packets holding it to PQ, and returns the amount
+   removed in AMOUNT_TAKEN.  Whole packets are moved without their contents
+   being copied; only a final packet of which just part is wanted is split.
+   Control packets, and the port rights in them, are discarded, as by
+   pipe_read.  If NOBLOCK is true, EWOULDBLOCK is returned instead of
+   blocking when no data is immediately available.  Only stream pipes are
+   supported.  */
+error_t
+pipe_take (struct pipe *pipe, int noblock, struct pq *pq,
+	   size_t amount, size_t *amount_taken)
+{
+  error_t err;
+  struct packet *packet;
+  size_t taken = 0;
+
+  if (pipe->class->sock_type != SOCK_STREAM)
+    return EOPNOTSUPP;
+
+  err = pipe_wait_readable (pipe, noblock, 1);
+  if (err)
+    return err;
+
+  while (!err && taken < amount
+	 && (packet = pq_head (pipe->queue, PACKET_TYPE_ANY, NULL)))
     {
-      timestamp (&pipe->read_time);
+      size_t readable = packet_readable (packet);
 
-      /* And wakeup anyone that might be interested in it.  */
-      pthread_cond_broadcast (&pipe->pending_writes);
-      pthread_mutex_unlock (&pipe->lock);
+      if (packet->type == PACKET_TYPE_DATA && readable > amount - taken)
+	/* Only part of this packet is wanted, so copy that much out of it.  */
+	{
+	  char *data = 0;
+	  size_t data_len = 0, written;
+
+	  err = packet_read (packet, &data, &data_len, amount - taken);
+	  if (!err && data_len > 0)
+	    {
+	      err = (*pipe->class->write) (pq, NULL, data, data_len, &written);
+	      munmap (data, data_len);
+	      if (! err)
+		taken += written;
+	    }
+	  break;
+	}
 
-      pthread_mutex_lock (&pipe->lock);	/* Get back the lock on PIPE.  */
-      /* Only wakeup selects if there's still writing space available.  */
-      if (pipe_readable (pipe, 1) < pipe->write_limit)
+      if (packet->type == PACKET_TYPE_CONTROL)
+	/* Splicing is reading and writing the data, which leaves these
+	   behind.  */
+	pq_dequeue (pipe->queue);
+      else
 	{
-	  pthread_cond_broadcast (&pipe->pending_write_selects);
-	  pipe_select_cond_broadcast (pipe);
-	  /* We leave PIPE locked here, assuming the caller will soon unlock
-	     it and allow others access.  */
+	  pq_transfer_head (pipe->queue, pq);
+	  taken += readable;
+	}
+    }
+
+  *amount_taken = taken;
+
+  if (taken > 0)
+    pipe_wakeup_writers (pipe);
+
+  return err;
+}
+
+/* Appends all the packets in PQ to PIPE, which should be locked, leaving PQ
+   empty.  Like pipe_write, this waits for room in PIPE before each packet.
+   If NOBLOCK is true, EWOULDBLOCK is returned instead of blocking when PIPE
+   is full.  If an error is returned, the packets not yet appended are left
+   in PQ.  */
+error_t
+pipe_give (struct pipe *pipe, int noblock, struct pq *pq)
+{
+  error_t err = 0;
+  struct packet *packet;
+
+  if (pipe->class->sock_type != SOCK_STREAM)
+    return EOPNOTSUPP;
+
+  while (!err && (packet = pq_head (pq, PACKET_TYPE_ANY, NULL)))
+    {
+      size_t readable;
+
+      err = pipe_wait_writable (pipe, noblock);
+      if (err)
+	break;
+
+      /* Move as many packets as there is room for, then let the readers
+	 at them before waiting for more room.  */
+      readable = pipe_readable (pipe, 1);
+      while (packet && readable < pipe->write_limit)
+	{
+	  if (packet->type == PACKET_TYPE_DATA)
+	    readable += packet_readable (packet);
+	  pq_transfer_head (pq, pipe->queue);
+	  packet = pq_head (pq, PACKET_TYPE_ANY, NULL);
 	}
+      pipe_wakeup_readers (pipe);
     }
 
   return err;
@@ -420,6 +420,25 @@ error_t pipe_recv (struct pipe *pipe, int noblock, unsigned *flags,
 #define pipe_read(pipe, noblock, source, data, data_len, amount) \
   pipe_recv (pipe, noblock, 0, source, data, data_len, amount, 0,0,0,0)
 
+/* Removes up to AMOUNT bytes of data from the front of PIPE, which should be
+   locked, appending the packets holding it to PQ, and returns the amount
+   removed in AMOUNT_TAKEN.  Whole packets are moved without their contents
+   being copied; only a final packet of which just part is wanted is split.
+   Control packets, and the port rights in them, are discarded, as by
+   pipe_read.  If NOBLOCK is true, EWOULDBLOCK is returned instead of
+   blocking when no data is immediately available.  Only stream pipes are
+   supported.  */
+error_t pipe_take (struct pipe *pipe, int noblock, struct pq *pq,
+		   size_t amount, size_t *amount_taken);
+
+/* Appends all the packets in PQ to PIPE, which should be locked, leaving PQ
+   empty.  Like pipe_write, this waits for room in PIPE before each packet.
+   If NOBLOCK is true, EWOULDBLOCK is returned instead of blocking when PIPE
+   is full.  If an error is returned, the packets not yet appended are left
+   in PQ.  Together
+   with pipe_take, this moves data between pipes without copying it.  */
+error_t pipe_give (struct pipe *pipe, int noblock, struct pq *pq);
+
 /* Hold this lock before attempting to lock multiple pipes. */
 extern pthread_mutex_t pipe_multiple_lock;
 
@@ -105,6 +105,33 @@ pq_dequeue (struct pq *pq)
   return 1;
 }
 
+/* Moves the first packet in FROM, with everything it holds, to the tail of
+   TO.  True is returned if a packet was found, false otherwise.  */
+int
+pq_transfer_head (struct pq *from, struct pq *to)
+{
+  struct packet *packet = from->head;
+
+  if (! packet)
+    return 0;
+
+  from->head = packet->next;
+  if (from->head)
+    from->head->prev = 0;
+  else
+    from->tail = 0;
+
+  packet->next = 0;
+  packet->prev = to->tail;
+  if (to->tail)
+    to->tail->next = packet;
+  to->tail = packet;
+  if (! to->head)
+    to->head = packet;
+
+  return 1;
+}
+
 /* Empties out PQ.  This *will* deallocate any ports in any of the packets.  */
 void
 pq_drain (struct pq *pq)
@@ -136,6 +163,10 @@ pq_queue (struct pq *pq, unsigned type, void *source)
 
   packet->num_ports = 0;
   packet->buf_start = packet->buf_end = packet->buf;
+  /* A ring's buffer is an ordinary malloc'd one, so it can be reused as is
+     if this packet isn't made a ring again.  */
+  packet->buf_ring = 0;
+  packet->ring_start = packet->ring_len = 0;
 
   packet->type = type;
   packet->source = source;
@@ -329,6 +360,28 @@ packet_read_ports (struct packet *packet,
   return 0;
 }
 
+/* Makes BUF, which was allocated with vm_allocate, PACKET's buffer, and
+   DATA_LEN bytes at the start of it PACKET's data.  PACKET should be empty;
+   any buffer it had is freed, and BUF is now owned by PACKET.  */
+void
+packet_set_vm_buf (struct packet *packet, char *buf, size_t data_len)
+{
+  if (packet->buf_len > 0)
+    {
+      if (packet->buf_vm_alloced)
+	munmap (packet->buf, packet->buf_len);
+      else
+	free (packet->buf);
+    }
+
+  packet->buf = buf;
+  packet->buf_len = round_page (data_len);
+  packet->buf_vm_alloced = 1;
+  packet->buf_ring = 0;
+  packet->buf_start = buf;
+  packet->buf_end = buf + data_len;
+}
+
 /* Append the bytes in DATA, of length DATA_LEN, to what's already in PACKET,
    and return the amount appended in AMOUNT if that's not the null pointer.  */
 error_t
@@ -349,6 +402,112 @@ packet_write (struct packet *packet,
   return 0;
 }
 
+/* Append the DATA_LEN bytes in DATA to PACKET, treating its buffer as a ring
+   of PACKET_RING_SIZE bytes, and return the amount appended in AMOUNT if
+   that's not the null pointer.  PACKET must either already be a ring
+   packet, or be empty, in which case it's turned into one.  If the data
+   doesn't fit in the space left (or the buffer can't be allocated), nothing
+   is written and false is returned; otherwise true.  */
+int
+packet_ring_write (struct packet *packet,
+		   char *data, size_t data_len, size_t *amount)
+{
+  size_t tail, chunk;
+
+  if (! packet->buf_ring)
+    {
+      if (packet->buf_len != PACKET_RING_SIZE || packet->buf_vm_alloced)
+	/* Replace whatever buffer PACKET has with one of the right size.
+	   Once this is done, the packet keeps it across recycling.  */
+	{
+	  char *ring = malloc (PACKET_RING_SIZE);
+	  if (! ring)
+	    return 0;
+	  if (packet->buf_len > 0)
+	    {
+	      if (packet->buf_vm_alloced)
+		munmap (packet->buf, packet->buf_len);
+	      else
+		free (packet->buf);
+	    }
+	  packet->buf = ring;
+	  packet->buf_len = PACKET_RING_SIZE;
+	  packet->buf_vm_alloced = 0;
+	}
+      packet->buf_start = packet->buf_end = packet->buf;
+      packet->ring_start = packet->ring_len = 0;
+      packet->buf_ring = 1;
+    }
+
+  if (data_len > PACKET_RING_SIZE - packet->ring_len)
+    return 0;
+
+  tail = packet->ring_start + packet->ring_len;
+  if (tail >= PACKET_RING_SIZE)
+    tail -= PACKET_RING_SIZE;
+
+  chunk = PACKET_RING_SIZE - tail;
+  if (chunk > data_len)
+    chunk = data_len;
+  memcpy (packet->buf + tail, data, chunk);
+  if (chunk < data_len)
+    /* Wrap around to the start of the buffer.  */
+    memcpy (packet->buf, data + chunk, data_len - chunk);
+
+  packet->ring_len += data_len;
+  if (amount != NULL)
+    *amount = data_len;
+
+  return 1;
+}
+
+/* The ring packet version of packet_fetch (q.v.).  */
+static error_t
+ring_fetch (struct packet *packet,
+	    char **data, size_t *data_len, size_t amount, int remove)
+{
+  if (amount > packet->ring_len)
+    amount = packet->ring_len;
+
+  if (amount > 0)
+    {
+      size_t start = packet->ring_start;
+      size_t chunk = PACKET_RING_SIZE - start;
+
+      if (*data_len < amount)
+	{
+	  *data = mmap (0, amount, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+	  if (*data == (char *) -1)
+	    return errno;
+	}
+
+      if (chunk > amount)
+	chunk = amount;
+      memcpy (*data, packet->buf + start, chunk);
+      if (chunk < amount)
+	memcpy (*data + chunk, packet->buf, amount - chunk);
+
+      if (remove)
+	{
+	  packet->ring_len -= amount;
+	  if (packet->ring_len == 0)
+	    /* Start again at the beginning, so the next write (probably
+	       just as small) doesn't wrap.  */
+	    packet->ring_start = 0;
+	  else
+	    {
+	      start += amount;
+	      if (start >= PACKET_RING_SIZE)
+		start -= PACKET_RING_SIZE;
+	      packet->ring_start = start;
+	    }
+	}
+    }
+  *data_len = amount;
+
+  return 0;
+}
+
 /* Remove or peek up to AMOUNT bytes from the beginning of the data in PACKET, and
    puts it into *DATA, and the amount read into DATA_LEN.  If more than the
    original *DATA_LEN bytes are available, new memory is vm_allocated, and
@@ -360,6 +519,9 @@ packet_fetch (struct packet *packet,
   char *start = packet->buf_start;
   char *end = packet->buf_end;
 
+  if (packet->buf_ring)
+    return ring_fetch (packet, data, data_len, amount, remove);
+
   if (amount > end - start)
     amount = end - start;
 
@@ -50,6 +50,11 @@ struct packet
   /* True if BUF was allocated using vm_allocate rather than malloc; only
      valid if BUF_LEN > 0.  */
   int buf_vm_alloced;
+  /* True if BUF is being used as a ring buffer (see packet_ring_write), in
+     which case the data is the RING_LEN bytes starting RING_START bytes into
+     BUF, wrapping around at BUF_LEN, and BUF_START and BUF_END are unused.  */
+  int buf_ring;
+  size_t ring_start, ring_len;
 
   /* Port data */
   mach_port_t *ports;
@@ -81,6 +86,8 @@ extern size_t packet_readable (struct packet *packet);
 PQ_EI size_t
 packet_readable (struct packet *packet)
 {
+  if (packet->buf_ring)
+    return packet->ring_len;
   return packet->buf_end - packet->buf_start;
 }
 
@@ -91,6 +98,25 @@ packet_readable (struct packet *packet)
 error_t packet_write (struct packet *packet,
 		      char *data, size_t data_len, size_t *amount);
 
+/* Makes BUF, which was allocated with vm_allocate, PACKET's buffer, and
+   DATA_LEN bytes at the start of it PACKET's data.  PACKET should be empty;
+   any buffer it had is freed, and BUF is now owned by PACKET.  */
+void packet_set_vm_buf (struct packet *packet, char *buf, size_t data_len);
+
+/* The size of the buffer used by ring packets.  */
+#define PACKET_RING_SIZE	(16*1024)
+
+/* Append the DATA_LEN bytes in DATA to PACKET, treating its buffer as a ring
+   of PACKET_RING_SIZE bytes, and return the amount appended in AMOUNT if
+   that's not the null pointer.  PACKET must either already be a ring
+   packet, or be empty, in which case it's turned into one.  A ring's buffer
+   is never grown or moved, and is kept when the packet is recycled, so a
+   stream of small writes causes no allocation at all.  If the data doesn't
+   fit in the space left (or the buffer can't be allocated), nothing is
+   written and false is returned; otherwise true.  */
+int packet_ring_write (struct packet *packet,
+		       char *data, size_t data_len, size_t *amount);
+
 /* Removes up to AMOUNT bytes from the beginning of the data in PACKET, and
    puts it into *DATA, and the amount read into DATA_LEN.  If more than the
    original *DATA_LEN bytes are available, new memory is vm_allocated, and
@@ -292,6 +318,10 @@ pq_next (struct pq *pq, unsigned type, void *source)
 
 #endif /* Use extern inlines.  */
 
+/* Moves the first packet in FROM, with everything it holds, to the tail of
+   TO.  True is returned if a packet was found, false otherwise.  */
+int pq_transfer_head (struct pq *from, struct pq *to);
+
 /* Dequeues all packets in PQ.  */
 void pq_drain (struct pq *pq);
 
@@ -37,13 +37,35 @@ stream_write (struct pq *pq, void *source,
 {
   struct packet *packet = pq_tail (pq, PACKET_TYPE_DATA, source);
 
-  if (packet_readable (packet) > 0
-      && data_len > PACKET_SIZE_LARGE
-      && (! page_aligned (data - packet->buf_end)
-	  || ! packet_ensure_efficiently (packet, data_len)))
+  if (!packet)
+    return ENOBUFS;
+
+  if (data_len < PACKET_SIZE_LARGE)
+    /* Small writes go into a fixed size ring buffer, which never has to be
+       grown or have its contents moved around.  */
+    {
+      if ((packet->buf_ring || packet_readable (packet) == 0)
+	  && packet_ring_write (packet, data, data_len, amount))
+	return 0;
+      if (packet->buf_ring)
+	/* The ring is full; start another one after it.  */
+	{
+	  packet = pq_queue (pq, PACKET_TYPE_DATA, source);
+	  if (!packet)
+	    return ENOBUFS;
+	  if (packet_ring_write (packet, data, data_len, amount))
+	    return 0;
+	}
+    }
+  else if (packet->buf_ring
+	   || (packet_readable (packet) > 0
+	       && data_len > PACKET_SIZE_LARGE
+	       && (! page_aligned (data - packet->buf_end)
+		   || ! packet_ensure_efficiently (packet, data_len))))
     /* Put a large page-aligned transfer in its own packet, if it's
        page-aligned `differently' than the end of the current packet, or if
-       the current packet can't be extended in place.  */
+       the current packet can't be extended in place (ring packets never
+       can).  */
     packet = pq_queue (pq, PACKET_TYPE_DATA, source);
 
   if (!packet)
@@ -49,5 +49,8 @@ ports_create_bucket ()
   hurd_ihash_init (&ret->htable, offsetof (struct port_info, hentry));
   ret->rpcs = ret->flags = ret->count = 0;
   _ports_threadpool_init (&ret->threadpool);
+  ret->stats = NULL;
+  if (getenv ("LIBPORTS_STATS"))
+    ports_enable_stats (ret);
   return ret;
 }
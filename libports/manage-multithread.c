@@ -126,6 +126,8 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
       int status;
       struct port_info *pi;
       struct rpc_info link;
+      struct ports_stats *stats;
+      struct ports_stats_sample sample;
       register mig_reply_header_t *outp = (mig_reply_header_t *) outheadp;
       static const mach_msg_type_t RetCodeType = {
 		/* msgt_name = */		MACH_MSG_TYPE_INTEGER_32,
@@ -195,7 +197,15 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
 
       if (pi)
 	{
-	  error_t err = ports_begin_rpc (pi, inp->msgh_id, &link);
+	  error_t err;
+
+	  stats = __atomic_load_n (&bucket->stats, __ATOMIC_ACQUIRE);
+	  if (stats && ! _ports_stats_start (stats, inp->msgh_id, &sample))
+	    stats = NULL;
+
+	  err = ports_begin_rpc (pi, inp->msgh_id, &link);
+	  if (stats)
+	    _ports_stats_begun (&sample);
 	  if (err)
 	    {
 	      outp->RetCode = err;
@@ -209,9 +219,15 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
 	      if (inp->msgh_seqno < cancel_threshold)
 		hurd_thread_cancel (link.thread);
 
-	      status = demuxer (inp, outheadp);
+	      if (stats)
+		status = ports_portstats_server (inp, outheadp)
+			 || demuxer (inp, outheadp);
+	      else
+		status = demuxer (inp, outheadp);
 	      ports_end_rpc (pi, &link);
 	    }
+	  if (stats)
+	    _ports_stats_done (&sample, outp->RetCode);
 	  ports_port_deref (pi);
 	}
       else
@@ -277,6 +293,7 @@ ports_manage_port_operations_multithread (struct port_bucket *bucket,
 	    }
 	  __atomic_sub_fetch (&totalthreads, 1, __ATOMIC_RELAXED);
 	}
+      _ports_stats_thread_exit ();
       _ports_thread_offline (&bucket->threadpool, &thread);
       return NULL;
     }
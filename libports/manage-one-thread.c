@@ -34,6 +34,8 @@ ports_manage_port_operations_one_thread (struct port_bucket *bucket,
     {
       struct port_info *pi;
       struct rpc_info link;
+      struct ports_stats *stats;
+      struct ports_stats_sample sample;
       int status;
       error_t err;
       register mig_reply_header_t *outp = (mig_reply_header_t *) outheadp;
@@ -81,7 +83,13 @@ ports_manage_port_operations_one_thread (struct port_bucket *bucket,
 
       if (pi)
 	{
+	  stats = __atomic_load_n (&bucket->stats, __ATOMIC_ACQUIRE);
+	  if (stats && ! _ports_stats_start (stats, inp->msgh_id, &sample))
+	    stats = NULL;
+
 	  err = ports_begin_rpc (pi, inp->msgh_id, &link);
+	  if (stats)
+	    _ports_stats_begun (&sample);
 	  if (err)
 	    {
 	      mach_port_deallocate (mach_task_self (), inp->msgh_remote_port);
@@ -93,9 +101,15 @@ ports_manage_port_operations_one_thread (struct port_bucket *bucket,
 	      /* No need to check cancel threshold here, because
 		 in a single threaded server the cancel is always
 		 handled in order. */
-	      status = demuxer (inp, outheadp);
+	      if (stats)
+		status = ports_portstats_server (inp, outheadp)
+			 || demuxer (inp, outheadp);
+	      else
+		status = demuxer (inp, outheadp);
 	      ports_end_rpc (pi, &link);
 	    }
+	  if (stats)
+	    _ports_stats_done (&sample, outp->RetCode);
 	  ports_port_deref (pi);
 	}
       else
@@ -120,5 +134,6 @@ ports_manage_port_operations_one_thread (struct port_bucket *bucket,
     err = mach_msg_server_timeout (internal_demuxer, 0, bucket->portset, 
 				   timeout ? MACH_RCV_TIMEOUT : 0, timeout);
   while (err != MACH_RCV_TIMED_OUT);
+  _ports_stats_thread_exit ();
   _ports_thread_offline (&bucket->threadpool, &thread);
 }
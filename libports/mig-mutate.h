@@ -34,3 +34,12 @@
   end_using_port_info (port_info_t)
 #define INTERRUPT_IMPORTS					\
   import "libports/mig-decls.h";
+
+#define PORTSTATS_INTRAN					\
+  port_info_t begin_using_port_info_port (mach_port_t)
+#define PORTSTATS_INTRAN_PAYLOAD				\
+  port_info_t begin_using_port_info_payload
+#define PORTSTATS_DESTRUCTOR					\
+  end_using_port_info (port_info_t)
+#define PORTSTATS_IMPORTS					\
+  import "libports/mig-decls.h";
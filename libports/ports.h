@@ -27,6 +27,7 @@
 #include <hurd/ihash.h>
 #include <mach/notify.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <refcount.h>
 
 #include "port-deref-deferred.h"
@@ -80,6 +81,8 @@ struct port_bucket
   int flags;
   int count;
   struct ports_threadpool threadpool;
+  /* RPC statistics, if they are kept (see ports_enable_stats).  */
+  struct ports_stats *stats;
 };
 /* FLAGS above are the following: */
 #define PORT_BUCKET_INHIBITED	PORTS_INHIBITED
@@ -384,6 +387,45 @@ void ports_manage_port_operations_multithread (struct port_bucket *bucket,
 					       int global_timeout,
 					       void (*hook)(void));
 
+/* RPC statistics */
+
+/* Service times are counted in buckets of powers of two microseconds;
+   the first one holds everything under 1us, the last everything from
+   2^(PORTS_STATS_BUCKETS - 2)us on.  */
+#define PORTS_STATS_BUCKETS 24
+
+/* What is known about the RPCs with one message id.  Times are in
+   nanoseconds.  portstats_get returns an array of these.  */
+struct ports_msgid_stats
+{
+  int32_t msgid;
+  uint32_t in_flight;		/* Being handled right now.  */
+  uint64_t count;		/* Handled so far.  */
+  uint64_t errors;		/* Of those, how many failed.  */
+  uint64_t service_time;	/* Total time spent in the demuxer.  */
+  uint64_t max_service_time;
+  uint64_t wait_time;		/* Total time waiting in ports_begin_rpc.  */
+  uint64_t buckets[PORTS_STATS_BUCKETS];
+};
+
+/* Start keeping statistics about the RPCs that
+   ports_manage_port_operations_* handle for the ports in BUCKET, and
+   answering portstats_get on them.  This costs two clock readings and a
+   few stores in thread-local memory per RPC.  Buckets keep them from the
+   start if the environment variable LIBPORTS_STATS is set when they are
+   created.  Statistics cannot be turned off again.  */
+error_t ports_enable_stats (struct port_bucket *bucket);
+
+/* Return in *STATS a malloced array of the statistics kept for BUCKET,
+   one element per message id seen, and their number in *COUNT.  Return
+   EOPNOTSUPP if none are kept.  */
+error_t ports_get_stats (struct port_bucket *bucket,
+			 struct ports_msgid_stats **stats, size_t *count);
+
+/* A portstats server that answers portstats_get.  The manage routines
+   call it themselves for buckets that keep statistics.  */
+int ports_portstats_server (mach_msg_header_t *, mach_msg_header_t *);
+
 /* Interrupt any pending RPC on PORT.  Wait for all pending RPC's to
    finish, and then block any new RPC's starting on that port. */
 error_t ports_inhibit_port_rpcs (void *port);
@@ -484,6 +526,27 @@ extern int _ports_flags;
 #define _PORTS_BLOCKED		PORTS_BLOCKED
 #define _PORTS_INHIBIT_WAIT	PORTS_INHIBIT_WAIT
 void _ports_complete_deallocate (struct port_info *);
+/* What the manage routines remember about an RPC they are counting.  */
+struct ports_stats_sample
+{
+  struct ports_msgid_stats *entry;
+  uint64_t start, begun;
+};
+
+/* Called by the manage routines, for buckets with STATS, when the
+   message with MSGID arrives, when ports_begin_rpc has returned, and
+   when the RPC is over with RETCODE.  If _ports_stats_start returns
+   zero, the RPC is not counted and the others must not be called.  */
+int _ports_stats_start (struct ports_stats *stats, mach_msg_id_t msgid,
+			struct ports_stats_sample *sample);
+void _ports_stats_begun (struct ports_stats_sample *sample);
+void _ports_stats_done (struct ports_stats_sample *sample,
+			kern_return_t retcode);
+
+/* Called by a thread that stops serving messages, so that another may
+   take over its statistics.  */
+void _ports_stats_thread_exit (void);
+
 error_t _ports_create_port_internal (struct port_class *, struct port_bucket *,
 				     size_t, void *, int);
 
@@ -0,0 +1,344 @@
+/* Per-RPC statistics
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include "ports.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <hurd/ihash.h>
+
+#include "portstats_S.h"
+
+/* Statistics are kept in shards, one per server thread, so that
+   counting an RPC takes no lock and shares no cache line with other
+   threads.  Only the thread owning a shard writes to it; readers add
+   up all shards, reading the counters with relaxed atomics, so they
+   may see an RPC half counted but never a torn value.  Shards are
+   never freed: when a thread goes away, the next new thread takes its
+   shard over, counts and all.  */
+
+/* Message ids a shard has room for.  A server thread sees a few dozen
+   at most; RPCs with ids that do not fit are not counted.  */
+#define SHARD_SLOTS 256
+
+struct stats_shard
+{
+  struct stats_shard *next;
+  struct ports_stats *stats;
+  int owned;			/* A thread uses it.  */
+  /* Open-addressed by message id.  Slots are set once by the owner,
+     with a release store, and read with acquire loads.  */
+  struct ports_msgid_stats *slots[SHARD_SLOTS];
+};
+
+struct ports_stats
+{
+  pthread_mutex_t lock;		/* Protects the list of shards.  */
+  struct stats_shard *shards;
+};
+
+/* The shard of the calling thread.  */
+static __thread struct stats_shard *current_shard;
+
+error_t
+ports_enable_stats (struct port_bucket *bucket)
+{
+  struct ports_stats *stats, *old = NULL;
+
+  stats = malloc (sizeof *stats);
+  if (! stats)
+    return ENOMEM;
+  pthread_mutex_init (&stats->lock, NULL);
+  stats->shards = NULL;
+
+  if (! __atomic_compare_exchange_n (&bucket->stats, &old, stats, 0,
+				     __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    /* Somebody else was quicker.  */
+    free (stats);
+  return 0;
+}
+
+static inline uint64_t
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Add N to the counter *P, which only the calling thread writes.  */
+static inline void
+bump (uint64_t *p, uint64_t n)
+{
+  __atomic_store_n (p, __atomic_load_n (p, __ATOMIC_RELAXED) + n,
+		    __ATOMIC_RELAXED);
+}
+
+static inline unsigned int
+slot_hash (mach_msg_id_t msgid)
+{
+  return ((uint32_t) msgid * 2654435761U) >> 24;
+}
+
+/* Return the shard of the calling thread for STATS, taking one over or
+   making one if needed.  */
+static struct stats_shard *
+get_shard (struct ports_stats *stats)
+{
+  struct stats_shard *shard;
+
+  if (current_shard)
+    /* The thread moved to another bucket.  */
+    _ports_stats_thread_exit ();
+
+  pthread_mutex_lock (&stats->lock);
+  for (shard = stats->shards; shard; shard = shard->next)
+    if (! shard->owned)
+      break;
+  if (! shard)
+    {
+      shard = calloc (1, sizeof *shard);
+      if (shard)
+	{
+	  shard->stats = stats;
+	  shard->next = stats->shards;
+	  stats->shards = shard;
+	}
+    }
+  if (shard)
+    shard->owned = 1;
+  pthread_mutex_unlock (&stats->lock);
+
+  current_shard = shard;
+  return shard;
+}
+
+/* Return the entry of SHARD for MSGID, making it if needed, or NULL if
+   it cannot be made.  */
+static struct ports_msgid_stats *
+get_entry (struct stats_shard *shard, mach_msg_id_t msgid)
+{
+  struct ports_msgid_stats *entry;
+  unsigned int i, n;
+
+  for (i = slot_hash (msgid), n = 0; n < SHARD_SLOTS;
+       i = (i + 1) % SHARD_SLOTS, n++)
+    {
+      entry = shard->slots[i];
+      if (! entry)
+	break;
+      if (entry->msgid == msgid)
+	return entry;
+    }
+  if (n == SHARD_SLOTS)
+    return NULL;
+
+  entry = calloc (1, sizeof *entry);
+  if (entry)
+    {
+      entry->msgid = msgid;
+      __atomic_store_n (&shard->slots[i], entry, __ATOMIC_RELEASE);
+    }
+  return entry;
+}
+
+int
+_ports_stats_start (struct ports_stats *stats, mach_msg_id_t msgid,
+		    struct ports_stats_sample *sample)
+{
+  struct stats_shard *shard = current_shard;
+
+  if (! shard || shard->stats != stats)
+    {
+      shard = get_shard (stats);
+      if (! shard)
+	return 0;
+    }
+
+  sample->entry = get_entry (shard, msgid);
+  if (! sample->entry)
+    return 0;
+
+  __atomic_store_n (&sample->entry->in_flight, sample->entry->in_flight + 1,
+		    __ATOMIC_RELAXED);
+  sample->start = now ();
+  return 1;
+}
+
+void
+_ports_stats_begun (struct ports_stats_sample *sample)
+{
+  sample->begun = now ();
+}
+
+void
+_ports_stats_done (struct ports_stats_sample *sample, kern_return_t retcode)
+{
+  struct ports_msgid_stats *entry = sample->entry;
+  uint64_t service = now () - sample->begun;
+  uint64_t us = service / 1000;
+  int b = us ? 64 - __builtin_clzll (us) : 0;
+
+  if (b >= PORTS_STATS_BUCKETS)
+    b = PORTS_STATS_BUCKETS - 1;
+
+  bump (&entry->count, 1);
+  if (retcode && retcode != MIG_NO_REPLY)
+    bump (&entry->errors, 1);
+  bump (&entry->service_time, service);
+  if (service > entry->max_service_time)
+    __atomic_store_n (&entry->max_service_time, service, __ATOMIC_RELAXED);
+  bump (&entry->wait_time, sample->begun - sample->start);
+  bump (&entry->buckets[b], 1);
+  __atomic_store_n (&entry->in_flight, entry->in_flight - 1,
+		    __ATOMIC_RELAXED);
+}
+
+void
+_ports_stats_thread_exit (void)
+{
+  struct stats_shard *shard = current_shard;
+
+  if (! shard)
+    return;
+
+  pthread_mutex_lock (&shard->stats->lock);
+  shard->owned = 0;
+  pthread_mutex_unlock (&shard->stats->lock);
+  current_shard = NULL;
+}
+
+/* Add the counters of FROM to TO.  */
+static void
+merge_entry (struct ports_msgid_stats *to,
+	     const struct ports_msgid_stats *from)
+{
+  uint64_t max;
+  int b;
+
+#define LOAD(field) __atomic_load_n (&from->field, __ATOMIC_RELAXED)
+  to->in_flight += LOAD (in_flight);
+  to->count += LOAD (count);
+  to->errors += LOAD (errors);
+  to->service_time += LOAD (service_time);
+  max = LOAD (max_service_time);
+  if (max > to->max_service_time)
+    to->max_service_time = max;
+  to->wait_time += LOAD (wait_time);
+  for (b = 0; b < PORTS_STATS_BUCKETS; b++)
+    to->buckets[b] += LOAD (buckets[b]);
+#undef LOAD
+}
+
+error_t
+ports_get_stats (struct port_bucket *bucket,
+		 struct ports_msgid_stats **stats, size_t *count)
+{
+  struct ports_stats *ps = __atomic_load_n (&bucket->stats, __ATOMIC_ACQUIRE);
+  struct hurd_ihash ids = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+  struct ports_msgid_stats *all = NULL;
+  struct stats_shard *shard;
+  size_t n = 0, alloced = 0;
+  error_t err = 0;
+  int i;
+
+  if (! ps)
+    return EOPNOTSUPP;
+
+  /* IDS maps message ids to their index in ALL, plus one.  */
+  pthread_mutex_lock (&ps->lock);
+  for (shard = ps->shards; shard && ! err; shard = shard->next)
+    for (i = 0; i < SHARD_SLOTS && ! err; i++)
+      {
+	struct ports_msgid_stats *entry
+	  = __atomic_load_n (&shard->slots[i], __ATOMIC_ACQUIRE);
+	uintptr_t index;
+
+	if (! entry)
+	  continue;
+
+	index = (uintptr_t) hurd_ihash_find (&ids, entry->msgid);
+	if (! index)
+	  {
+	    if (n == alloced)
+	      {
+		struct ports_msgid_stats *new;
+		alloced = alloced ? 2 * alloced : 32;
+		new = realloc (all, alloced * sizeof *all);
+		if (! new)
+		  {
+		    err = ENOMEM;
+		    break;
+		  }
+		all = new;
+	      }
+	    memset (&all[n], 0, sizeof all[n]);
+	    all[n].msgid = entry->msgid;
+	    n++;
+	    index = n;
+	    err = hurd_ihash_add (&ids, entry->msgid, (void *) index);
+	    if (err)
+	      break;
+	  }
+	merge_entry (&all[index - 1], entry);
+      }
+  pthread_mutex_unlock (&ps->lock);
+  hurd_ihash_destroy (&ids);
+
+  if (err)
+    {
+      free (all);
+      return err;
+    }
+  *stats = all;
+  *count = n;
+  return 0;
+}
+
+/* Implement portstats_get as described in <hurd/portstats.defs>.  */
+kern_return_t
+ports_S_portstats_get (struct port_info *pi,
+		       data_t *data, mach_msg_type_number_t *data_len)
+{
+  struct ports_msgid_stats *stats;
+  size_t count, size;
+  error_t err;
+
+  if (! pi)
+    return EOPNOTSUPP;
+
+  err = ports_get_stats (pi->bucket, &stats, &count);
+  if (err)
+    return err;
+
+  size = count * sizeof *stats;
+  if (size > *data_len)
+    {
+      *data = mmap (0, size, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (*data == MAP_FAILED)
+	{
+	  free (stats);
+	  return ENOMEM;
+	}
+    }
+  memcpy (*data, stats, size);
+  *data_len = size;
+  free (stats);
+  return 0;
+}
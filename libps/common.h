@@ -42,3 +42,22 @@
 #ifndef TRUE
 #define TRUE 1
 #endif
+
+/* Fetch with a single call to the proc server the procinfo that setting
+   FLAGS in each of the NUM_PROCS proc_stats in PROCS would otherwise
+   fetch one process at a time, and attach it to them so that
+   proc_stat_set_flags uses it.  The information is returned in *BUF and
+   *BUF_SIZE, which must be passed to _proc_stats_forget_procinfo once
+   the flags have been set.  If the proc server can't do this, nothing
+   is attached and 0 is returned; an error is only returned if a memory
+   allocation error occurred.  */
+error_t _proc_stats_prefetch_procinfo (struct proc_stat **procs,
+				       unsigned num_procs, ps_flags_t flags,
+				       void **buf, size_t *buf_size);
+
+/* Detach the procinfo attached to the NUM_PROCS proc_stats in PROCS by
+   _proc_stats_prefetch_procinfo, and free BUF and BUF_SIZE, which it
+   returned.  */
+void _proc_stats_forget_procinfo (struct proc_stat **procs,
+				  unsigned num_procs,
+				  void *buf, size_t buf_size);
@@ -372,22 +372,7 @@ proc_stat_list_add_pgrp (struct proc_stat_list *pp, pid_t pgrp,
 error_t
 proc_stat_list_set_flags (struct proc_stat_list *pp, ps_flags_t flags)
 {
-  unsigned nprocs = pp->num_procs;
-  struct proc_stat **procs = pp->proc_stats;
-
-  while (nprocs-- > 0)
-    {
-      struct proc_stat *ps = *procs++;
-
-      if (!proc_stat_has (ps, flags))
-	{
-	  error_t err = proc_stat_set_flags (ps, flags);
-	  if (err)
-	    return err;
-	}
-    }
-
-  return 0;
+  return proc_stats_set_flags (pp->proc_stats, pp->num_procs, flags);
 }
 
 /* ---------------------------------------------------------------- */
@@ -27,6 +27,7 @@
 #include "common.h"
 
 #include "ps_msg.h"
+#include "ps_process.h"
 
 /* ---------------------------------------------------------------- */
 
@@ -100,48 +101,92 @@ thread_state (thread_basic_info_t bi)
 #define PSTAT_PROCINFO_MERGE    (PSTAT_TASK_BASIC | PSTAT_TASK_EVENTS)
 #define PSTAT_PROCINFO_REFETCH  (PSTAT_PROCINFO - PSTAT_PROCINFO_MERGE)
 
-/* Fetches process information from the set in PSTAT_PROCINFO, returning it
-   in PI & PI_SIZE.  NEED is the information, and HAVE is the what we already
-   have.  */
+/* How PSTAT_ flags in PSTAT_PROCINFO correspond to the PI_FETCH_ flags
+   that must be passed to proc_getprocinfo to get them.  */
+static const struct { ps_flags_t ps_flag; int pi_flags; } procinfo_map[] =
+{
+  { PSTAT_TASK_BASIC,     PI_FETCH_TASKINFO				},
+  { PSTAT_TASK_EVENTS,    PI_FETCH_TASKEVENTS				},
+  { PSTAT_NUM_THREADS,    PI_FETCH_THREADS				},
+  { PSTAT_THREAD_BASIC,   PI_FETCH_THREAD_BASIC | PI_FETCH_THREADS	},
+  { PSTAT_THREAD_SCHED,   PI_FETCH_THREAD_SCHED | PI_FETCH_THREADS	},
+  { PSTAT_THREAD_WAITS,   PI_FETCH_THREAD_WAITS | PI_FETCH_THREADS	},
+  { 0, }
+};
+
+/* Return the PI_FETCH_ flags needed to get the information in NEED that
+   isn't in HAVE.  */
+static int
+procinfo_fetch_flags (ps_flags_t need, ps_flags_t have)
+{
+  int pi_flags = 0;
+  int i;
+
+  for (i = 0; procinfo_map[i].ps_flag; i++)
+    if ((need & procinfo_map[i].ps_flag) && !(have & procinfo_map[i].ps_flag))
+      pi_flags |= procinfo_map[i].pi_flags;
+
+  return pi_flags;
+}
+
+/* Copy the SIZE bytes of procinfo at SRC to *PI, which is *PI_SIZE bytes
+   long, the way proc_getprocinfo would return them: if they don't fit,
+   *PI is replaced by newly mmapped memory.  */
 static error_t
-fetch_procinfo (process_t server, pid_t pid,
+copy_procinfo (struct procinfo *src, size_t size,
+	       struct procinfo **pi, size_t *pi_size)
+{
+  if (size > *pi_size)
+    {
+      void *mem = mmap (0, size, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (mem == MAP_FAILED)
+	return ENOMEM;
+      *pi = mem;
+    }
+  memcpy (*pi, src, size);
+  *pi_size = size;
+  return 0;
+}
+
+/* Fetches process information from the set in PSTAT_PROCINFO for PS,
+   returning it in PI & PI_SIZE.  NEED is the information, and HAVE is the
+   what we already have.  If proc_stat_list_set_flags has already fetched
+   what's needed, that is used instead of asking the proc server.  */
+static error_t
+fetch_procinfo (struct proc_stat *ps,
 		ps_flags_t need, ps_flags_t *have,
 		struct procinfo **pi, size_t *pi_size,
 		char **waits, size_t *waits_len)
 {
-  static const struct { ps_flags_t ps_flag; int pi_flags; } map[] =
-  {
-    { PSTAT_TASK_BASIC,     PI_FETCH_TASKINFO				},
-    { PSTAT_TASK_EVENTS,    PI_FETCH_TASKEVENTS				},
-    { PSTAT_NUM_THREADS,    PI_FETCH_THREADS				},
-    { PSTAT_THREAD_BASIC,   PI_FETCH_THREAD_BASIC | PI_FETCH_THREADS	},
-    { PSTAT_THREAD_SCHED,   PI_FETCH_THREAD_SCHED | PI_FETCH_THREADS	},
-    { PSTAT_THREAD_WAITS,   PI_FETCH_THREAD_WAITS | PI_FETCH_THREADS	},
-    { 0, }
-  };
-  int pi_flags = 0;
+  int pi_flags = procinfo_fetch_flags (need, *have);
   int i;
 
-  for (i = 0; map[i].ps_flag; i++)
-    if ((need & map[i].ps_flag) && !(*have & map[i].ps_flag))
-      pi_flags |= map[i].pi_flags;
-
   if (pi_flags || ((need & PSTAT_PROC_INFO) && !(*have & PSTAT_PROC_INFO)))
     {
       error_t err;
 
-      *pi_size /= sizeof (int);	/* getprocinfo takes an array of ints.  */
-      err = proc_getprocinfo (server, pid, &pi_flags,
-			      (procinfo_t *)pi, pi_size, waits, waits_len);
-      *pi_size *= sizeof (int);
+      if (ps->prefetched_info && !(pi_flags & ~ps->prefetched_pi_wanted))
+	{
+	  err = copy_procinfo (ps->prefetched_info, ps->prefetched_info_size,
+			       pi, pi_size);
+	  pi_flags = ps->prefetched_pi_flags;
+	}
+      else
+	{
+	  *pi_size /= sizeof (int); /* getprocinfo takes an array of ints.  */
+	  err = proc_getprocinfo (ps->context->server, ps->pid, &pi_flags,
+				  (procinfo_t *)pi, pi_size, waits, waits_len);
+	  *pi_size *= sizeof (int);
+	}
 
       if (! err)
 	/* Update *HAVE to reflect what we've successfully fetched.  */
 	{
 	  *have |= PSTAT_PROC_INFO;
-	  for (i = 0; map[i].ps_flag; i++)
-	    if ((pi_flags & map[i].pi_flags) == map[i].pi_flags)
-	      *have |= map[i].ps_flag;
+	  for (i = 0; procinfo_map[i].ps_flag; i++)
+	    if ((pi_flags & procinfo_map[i].pi_flags)
+		== procinfo_map[i].pi_flags)
+	      *have |= procinfo_map[i].ps_flag;
 	}
       return err;
     }
@@ -207,7 +252,7 @@ merge_procinfo (struct proc_stat *ps, ps_flags_t need, ps_flags_t have)
       new_waits_len = ps->thread_waits_len;
     }
 
-  err = fetch_procinfo (ps->context->server, ps->pid, really_need, &really_have,
+  err = fetch_procinfo (ps, really_need, &really_have,
 			&new_pi, &new_pi_size,
 			&new_waits, &new_waits_len);
   if (err)
@@ -1037,6 +1082,164 @@ proc_stat_set_flags (struct proc_stat *ps, ps_flags_t flags)
   return 0;
 }
 
+/* ---------------------------------------------------------------- */
+
+/* Fetch with a single call to the proc server the procinfo that setting
+   FLAGS in each of the NUM_PROCS proc_stats in PROCS would otherwise
+   fetch one process at a time, and attach it to them so that
+   proc_stat_set_flags uses it.  The information is returned in *BUF and
+   *BUF_SIZE, which must be passed to _proc_stats_forget_procinfo once
+   the flags have been set.  */
+error_t
+_proc_stats_prefetch_procinfo (struct proc_stat **procs, unsigned num_procs,
+			       ps_flags_t flags, void **buf, size_t *buf_size)
+{
+  error_t err;
+  unsigned i, num_pids = 0;
+  pid_t *pids;
+  struct proc_stat **pid_procs;
+  process_t server = MACH_PORT_NULL;
+  int pi_wanted = 0;
+  int *pi = 0, *lengths = 0, *infoflags = 0;
+  mach_msg_type_number_t pi_len = 0, lengths_len = 0, infoflags_len = 0;
+  size_t offs;
+
+  *buf = 0;
+  *buf_size = 0;
+
+  for (i = 0; i < num_procs; i++)
+    procs[i]->prefetched_info = 0;
+
+  pids = malloc (num_procs * (sizeof (pid_t) + sizeof (struct proc_stat *)));
+  if (! pids)
+    return ENOMEM;
+  pid_procs = (struct proc_stat **) (pids + num_procs);
+
+  for (i = 0; i < num_procs; i++)
+    {
+      struct proc_stat *ps = procs[i];
+      ps_flags_t have = ps->flags;
+      ps_flags_t need;
+
+      if (! (have & PSTAT_PID))
+	continue;
+
+      /* Work out what proc_stat_set_flags will want from the procinfo,
+	 in the same way it does.  */
+      need = flags & ~ps->failed;
+      if (have & PSTAT_NO_MSGPORT)
+	need = SUPPRESS_MSGPORT_FLAGS (need);
+      need = add_preconditions (need, ps->context);
+      if (need & PSTAT_USES_MSGPORT)
+	need |= add_preconditions (PSTAT_TEST_MSGPORT, ps->context);
+      need &= ~have & ~ps->failed & PSTAT_PROCINFO;
+      if (! need)
+	continue;
+
+      /* Thread-specific info is always fetched afresh; see
+	 merge_procinfo.  */
+      pi_wanted |=
+	procinfo_fetch_flags (need | (have & PSTAT_PROCINFO_REFETCH),
+			      have & ~PSTAT_PROCINFO_REFETCH);
+      server = ps_context_server (ps->context);
+      pid_procs[num_pids] = ps;
+      pids[num_pids++] = ps->pid;
+    }
+
+  /* Thread waits can't be fetched this way, and are left to
+     proc_stat_set_flags.  */
+  pi_wanted &= ~PI_FETCH_THREAD_WAITS;
+
+  if (num_pids < 2)
+    /* Not worth it.  */
+    {
+      free (pids);
+      return 0;
+    }
+
+  err = ps_proc_getprocinfos (server, pids, num_pids, pi_wanted,
+			      &pi, &pi_len, &lengths, &lengths_len,
+			      &infoflags, &infoflags_len);
+  if (err)
+    /* Probably an old proc server; things will just be fetched one
+       process at a time.  */
+    {
+      free (pids);
+      return 0;
+    }
+
+  offs = 0;
+  for (i = 0; i < num_pids && i < lengths_len && i < infoflags_len; i++)
+    {
+      size_t len = lengths[i];
+
+      if (len * sizeof (int) < sizeof (struct procinfo)
+	  || offs + len > pi_len)
+	/* No information for this one.  */
+	{
+	  offs += len;
+	  continue;
+	}
+
+      pid_procs[i]->prefetched_info = (struct procinfo *) (pi + offs);
+      pid_procs[i]->prefetched_info_size = len * sizeof (int);
+      pid_procs[i]->prefetched_pi_wanted = pi_wanted;
+      pid_procs[i]->prefetched_pi_flags = infoflags[i];
+      offs += len;
+    }
+
+  if (lengths_len > 0)
+    munmap (lengths, lengths_len * sizeof (int));
+  if (infoflags_len > 0)
+    munmap (infoflags, infoflags_len * sizeof (int));
+  free (pids);
+
+  if (pi_len > 0)
+    {
+      *buf = pi;
+      *buf_size = pi_len * sizeof (int);
+    }
+  return 0;
+}
+
+/* Detach the procinfo attached to the NUM_PROCS proc_stats in PROCS by
+   _proc_stats_prefetch_procinfo, and free BUF and BUF_SIZE, which it
+   returned.  */
+void
+_proc_stats_forget_procinfo (struct proc_stat **procs, unsigned num_procs,
+			     void *buf, size_t buf_size)
+{
+  unsigned i;
+
+  for (i = 0; i < num_procs; i++)
+    procs[i]->prefetched_info = 0;
+  if (buf)
+    munmap (buf, buf_size);
+}
+
+error_t
+proc_stats_set_flags (struct proc_stat **procs, unsigned num_procs,
+		      ps_flags_t flags)
+{
+  void *pi_buf;
+  size_t pi_buf_size;
+  unsigned i;
+  error_t err;
+
+  err = _proc_stats_prefetch_procinfo (procs, num_procs, flags,
+				       &pi_buf, &pi_buf_size);
+  if (err)
+    return err;
+
+  for (i = 0; i < num_procs && !err; i++)
+    if (!proc_stat_has (procs[i], flags))
+      err = proc_stat_set_flags (procs[i], flags);
+
+  _proc_stats_forget_procinfo (procs, num_procs, pi_buf, pi_buf_size);
+
+  return err;
+}
+
 /* ---------------------------------------------------------------- */
 /* Discard PS and any resources it holds.  */
 void
@@ -1100,6 +1303,7 @@ _proc_stat_create (pid_t pid, struct ps_context *context, struct proc_stat **ps)
   (*ps)->inapp = PSTAT_THREAD;
   (*ps)->context = context;
   (*ps)->hook = 0;
+  (*ps)->prefetched_info = 0;
 
   return 0;
 }
@@ -1139,6 +1343,7 @@ proc_stat_thread_create (struct proc_stat *ps, unsigned index, struct proc_stat
       tps->thread_index = index;
 
       tps->context = ps->context;
+      tps->prefetched_info = 0;
 
       *thread_ps = tps;
 
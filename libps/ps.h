@@ -305,6 +305,17 @@ struct proc_stat
   size_t env_len;
 
   unsigned num_ports;
+
+  /* Procinfo for this process fetched together with that of the other
+     processes by proc_stats_set_flags, which proc_stat_set_flags uses
+     instead of asking the proc server again.  It points into a buffer
+     belonging to proc_stats_set_flags, and is only valid while that is
+     running.  PREFETCHED_PI_WANTED are the PI_FETCH_ flags that were asked
+     for, and PREFETCHED_PI_FLAGS the ones that were returned for this
+     process.  */
+  struct procinfo *prefetched_info;
+  size_t prefetched_info_size;
+  int prefetched_pi_wanted, prefetched_pi_flags;
 };
 
 /* Proc_stat flag bits; each bit is set in the FLAGS field if that
@@ -472,6 +483,14 @@ void _proc_stat_free (struct proc_stat *ps);
    a system error code if a fatal error occurred, and 0 otherwise.  */
 error_t proc_stat_set_flags (struct proc_stat *ps, ps_flags_t flags);
 
+/* Set FLAGS in each of the NUM_PROCS proc_stats in PROCS, as
+   proc_stat_set_flags would, but fetching their procinfo from the proc
+   server all at once if it can, rather than one process at a time.  As
+   with proc_stat_set_flags, you must check which flags each one actually
+   got; an error is only returned if a fatal one occurred.  */
+error_t proc_stats_set_flags (struct proc_stat **procs, unsigned num_procs,
+			      ps_flags_t flags);
+
 /* Returns in THREAD_PS a proc_stat for the Nth thread in the proc_stat
    PS (N should be between 0 and the number of threads in the process).  The
    resulting proc_stat isn't fully functional -- most flags can't be set in
@@ -0,0 +1,679 @@
+/* Copy-on-write store backend
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111, USA. */
+
+/* A cow store reads from a base store, which it never writes to.  The
+   first write to a chunk of the base copies the chunk into a delta, and
+   from then on the chunk is read from and written to there.  Only the
+   chunks that have been written take up any space, so any number of cow
+   stores can share one base image cheaply.
+
+   The delta is either kept in memory, or in a second store, in which case
+   it survives the cow store and can be opened again later.  A delta store
+   starts with a header chunk (struct cow_header), and is followed by
+   segments, each made of an index chunk and as many data chunks as an
+   index chunk has 64-bit entries.  The Nth entry (in network byte order)
+   of an index chunk holds one more than the number of the base chunk
+   whose contents are in the Nth data chunk of its segment, or 0 if that
+   data chunk is unused.  Chunks are handed out in order, so the first
+   unused entry ends the delta.
+
+   If the delta store starts with a chunk of zeros, such as a new sparse
+   file, a new, empty delta is made by writing the header and the first
+   index chunk, so starting a fresh snapshot costs the same however large
+   the base is.  Anything else without a valid header is refused, so that
+   naming the wrong store as the delta can't destroy it.  Opening an
+   existing delta reads its index chunks.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "store.h"
+
+#define COW_MAGIC		"HURDCOW1"
+
+/* The default size of a chunk, the unit in which data is copied.  */
+#define COW_CHUNK_SIZE		4096
+
+struct cow_header
+{
+  char magic[8];		/* COW_MAGIC */
+  uint32_t chunk_size;		/* In bytes, a power of two.  */
+  uint32_t reserved;
+  uint64_t base_size;		/* Size of the base, in bytes.  */
+};
+
+/* A base chunk that has been copied to the delta.  */
+struct cow_slot
+{
+  store_offset_t chunk;		/* Number of the chunk in the base.  */
+  size_t slot;			/* Where its contents are in the delta.  */
+  struct cow_slot *next;	/* Next in its hash bucket.  */
+};
+
+/* The state of a cow store, kept in its hook and shared by its clones.
+   The base and the delta store, if any, are its children, in that
+   order.  */
+struct cow
+{
+  pthread_mutex_t lock;		/* Protects everything below.  */
+  unsigned refs;
+
+  size_t chunk_size;
+  size_t entries;		/* Index entries in each segment.  */
+
+  struct cow_slot **buckets;	/* Which chunks are in the delta.  */
+  size_t num_buckets;
+  size_t num_slots;		/* Chunks used in the delta.  */
+  size_t max_slots;		/* How many chunks fit in the delta.  */
+
+  char **mem;			/* Without a delta store, the chunks.  */
+  size_t mem_alloced;
+  uint64_t *index;		/* The index chunk of the last segment.  */
+
+  char *buf;			/* A chunk's worth of scratch space.  */
+};
+
+/* Return the slot holding base chunk CHUNK in C, or -1.  */
+static ssize_t
+cow_lookup (struct cow *c, store_offset_t chunk)
+{
+  struct cow_slot *s;
+
+  for (s = c->buckets[chunk % c->num_buckets]; s; s = s->next)
+    if (s->chunk == chunk)
+      return s->slot;
+  return -1;
+}
+
+/* Record in C that base chunk CHUNK is in slot SLOT.  */
+static error_t
+cow_insert (struct cow *c, store_offset_t chunk, size_t slot)
+{
+  struct cow_slot *s;
+
+  if (c->num_slots >= c->num_buckets)
+    /* Keep the chains short by doubling the table.  */
+    {
+      size_t n = c->num_buckets * 2, i;
+      struct cow_slot **b = calloc (n, sizeof *b);
+
+      if (! b)
+	return ENOMEM;
+      for (i = 0; i < c->num_buckets; i++)
+	while (c->buckets[i])
+	  {
+	    s = c->buckets[i];
+	    c->buckets[i] = s->next;
+	    s->next = b[s->chunk % n];
+	    b[s->chunk % n] = s;
+	  }
+      free (c->buckets);
+      c->buckets = b;
+      c->num_buckets = n;
+    }
+
+  s = malloc (sizeof *s);
+  if (! s)
+    return ENOMEM;
+  s->chunk = chunk;
+  s->slot = slot;
+  s->next = c->buckets[chunk % c->num_buckets];
+  c->buckets[chunk % c->num_buckets] = s;
+  return 0;
+}
+
+/* Return the byte offset in the delta of index chunk of segment SEG.  */
+static inline store_offset_t
+cow_index_offset (struct cow *c, size_t seg)
+{
+  return (store_offset_t) (1 + seg * (c->entries + 1)) * c->chunk_size;
+}
+
+/* Return the byte offset in the delta of the data chunk of SLOT.  */
+static inline store_offset_t
+cow_slot_offset (struct cow *c, size_t slot)
+{
+  return cow_index_offset (c, slot / c->entries)
+    + (store_offset_t) (1 + slot % c->entries) * c->chunk_size;
+}
+
+/* Read the LEN bytes at byte offset OFFS of STORE into BUF.  */
+static error_t
+cow_read_store (struct store *store, store_offset_t offs, void *buf,
+		size_t len)
+{
+  void *data = buf;
+  size_t data_len = len;
+  error_t err;
+
+  err = store_read (store, offs >> store->log2_block_size, len,
+		    &data, &data_len);
+  if (err)
+    return err;
+  if (data != buf)
+    {
+      memcpy (buf, data, data_len < len ? data_len : len);
+      munmap (data, data_len);
+    }
+  return data_len < len ? EIO : 0;
+}
+
+/* Write the LEN bytes at BUF to byte offset OFFS of STORE.  */
+static error_t
+cow_write_store (struct store *store, store_offset_t offs, const void *buf,
+		 size_t len)
+{
+  size_t amount;
+  error_t err;
+
+  err = store_write (store, offs >> store->log2_block_size, buf, len,
+		     &amount);
+  return err ?: amount < len ? EIO : 0;
+}
+
+/* Copy the N bytes at IN_CHUNK in slot SLOT of C to or from (according to
+   WRITING) BUF.  DELTA is the delta store, or 0.  */
+static error_t
+cow_slot_rw (struct cow *c, struct store *delta, size_t slot,
+	     size_t in_chunk, void *buf, size_t n, int writing)
+{
+  store_offset_t offs;
+  error_t err;
+
+  if (! delta)
+    {
+      if (writing)
+	memcpy (c->mem[slot] + in_chunk, buf, n);
+      else
+	memcpy (buf, c->mem[slot] + in_chunk, n);
+      return 0;
+    }
+
+  offs = cow_slot_offset (c, slot);
+  if (((in_chunk | n) & (delta->block_size - 1)) == 0)
+    return writing
+      ? cow_write_store (delta, offs + in_chunk, buf, n)
+      : cow_read_store (delta, offs + in_chunk, buf, n);
+
+  /* Not aligned to DELTA's blocks; go through the whole chunk.  */
+  err = cow_read_store (delta, offs, c->buf, c->chunk_size);
+  if (err)
+    return err;
+  if (! writing)
+    {
+      memcpy (buf, c->buf + in_chunk, n);
+      return 0;
+    }
+  memcpy (c->buf + in_chunk, buf, n);
+  return cow_write_store (delta, offs, c->buf, c->chunk_size);
+}
+
+/* Put DATA, the new contents of base chunk CHUNK, in a new slot of C.
+   DELTA is the delta store, or 0.  */
+static error_t
+cow_new_slot (struct cow *c, struct store *delta, store_offset_t chunk,
+	      const char *data)
+{
+  size_t slot = c->num_slots;
+  error_t err;
+
+  if (slot >= c->max_slots)
+    return ENOSPC;
+
+  if (! delta)
+    {
+      if (slot == c->mem_alloced)
+	{
+	  size_t n = c->mem_alloced ? 2 * c->mem_alloced : 64;
+	  char **m = realloc (c->mem, n * sizeof *m);
+	  if (! m)
+	    return ENOMEM;
+	  c->mem = m;
+	  c->mem_alloced = n;
+	}
+      c->mem[slot] = malloc (c->chunk_size);
+      if (! c->mem[slot])
+	return ENOMEM;
+      memcpy (c->mem[slot], data, c->chunk_size);
+    }
+  else
+    {
+      size_t seg = slot / c->entries, entry = slot % c->entries;
+
+      if (entry == 0)
+	memset (c->index, 0, c->chunk_size);
+
+      /* The data goes out before the index entry that points at it.  */
+      err = cow_write_store (delta, cow_slot_offset (c, slot), data,
+			     c->chunk_size);
+      if (err)
+	return err;
+      c->index[entry] = htobe64 (chunk + 1);
+      err = cow_write_store (delta, cow_index_offset (c, seg), c->index,
+			     c->chunk_size);
+      if (! err && entry == c->entries - 1
+	  && slot + 1 < c->max_slots)
+	/* That filled the segment.  Clear the next index chunk, so whatever
+	   the delta held before can't be taken for entries.  */
+	{
+	  memset (c->buf, 0, c->chunk_size);
+	  err = cow_write_store (delta, cow_index_offset (c, seg + 1),
+				 c->buf, c->chunk_size);
+	}
+      if (err)
+	{
+	  c->index[entry] = 0;
+	  return err;
+	}
+    }
+
+  err = cow_insert (c, chunk, slot);
+  if (! err)
+    c->num_slots++;
+  else if (! delta)
+    {
+      free (c->mem[slot]);
+      c->mem[slot] = 0;
+    }
+  return err;
+}
+
+/* Copy between BUF and the LEN bytes of STORE at byte offset OFFS, in the
+   direction given by WRITING.  */
+static error_t
+cow_rw (struct store *store, store_offset_t offs, char *buf, size_t len,
+	int writing)
+{
+  struct cow *c = store->hook;
+  struct store *base = store->children[0];
+  struct store *delta = store->num_children > 1 ? store->children[1] : 0;
+  error_t err = 0;
+
+  pthread_mutex_lock (&c->lock);
+
+  while (len > 0 && ! err)
+    {
+      store_offset_t chunk = offs / c->chunk_size;
+      size_t in_chunk = offs % c->chunk_size;
+      size_t chunk_len = c->chunk_size;
+      size_t n;
+      ssize_t slot;
+
+      if ((chunk + 1) * c->chunk_size > store->size)
+	chunk_len = store->size - chunk * c->chunk_size;
+      n = chunk_len - in_chunk;
+      if (n > len)
+	n = len;
+
+      slot = cow_lookup (c, chunk);
+      if (slot >= 0)
+	err = cow_slot_rw (c, delta, slot, in_chunk, buf, n, writing);
+      else if (! writing)
+	{
+	  /* Read as many chunks that are still only in BASE as we can in
+	     one go.  */
+	  while (n < len
+		 && cow_lookup (c, (offs + n) / c->chunk_size) < 0)
+	    n += (len - n < c->chunk_size) ? len - n : c->chunk_size;
+	  err = cow_read_store (base, offs, buf, n);
+	}
+      else
+	{
+	  /* The first write to this chunk: copy it.  */
+	  if (n < chunk_len)
+	    err = cow_read_store (base, chunk * c->chunk_size, c->buf,
+				  chunk_len);
+	  if (! err)
+	    {
+	      memset (c->buf + chunk_len, 0, c->chunk_size - chunk_len);
+	      memcpy (c->buf + in_chunk, buf, n);
+	      err = cow_new_slot (c, delta, chunk, c->buf);
+	    }
+	}
+
+      offs += n;
+      buf += n;
+      len -= n;
+    }
+
+  pthread_mutex_unlock (&c->lock);
+  return err;
+}
+
+static error_t
+cow_read (struct store *store,
+	  store_offset_t addr, size_t index, size_t amount,
+	  void **buf, size_t *len)
+{
+  error_t err;
+  char *data = *buf;
+
+  if (*len < amount)
+    {
+      data = mmap (0, amount, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (data == MAP_FAILED)
+	return errno;
+    }
+
+  err = cow_rw (store, addr << store->log2_block_size, data, amount, 0);
+  if (err)
+    {
+      if (data != *buf)
+	munmap (data, amount);
+      return err;
+    }
+
+  *buf = data;
+  *len = amount;
+  return 0;
+}
+
+static error_t
+cow_write (struct store *store,
+	   store_offset_t addr, size_t index, const void *buf, size_t len,
+	   size_t *amount)
+{
+  error_t err = cow_rw (store, addr << store->log2_block_size,
+			(char *) buf, len, 1);
+  *amount = err ? 0 : len;
+  return err;
+}
+
+static error_t
+cow_set_size (struct store *store, size_t newsize)
+{
+  return EOPNOTSUPP;
+}
+
+/* Only the delta can hold anything that needs syncing.  */
+static error_t
+cow_sync (struct store *store)
+{
+  return store->num_children > 1 ? store_sync (store->children[1]) : 0;
+}
+
+static error_t
+cow_open (const char *name, int flags,
+	  const struct store_class *const *classes,
+	  struct store **store)
+{
+  return store_cow_open (name, flags, classes, store);
+}
+
+static void
+cow_free (struct cow *c)
+{
+  size_t i;
+
+  for (i = 0; i < c->num_buckets; i++)
+    while (c->buckets[i])
+      {
+	struct cow_slot *s = c->buckets[i];
+	c->buckets[i] = s->next;
+	free (s);
+      }
+  free (c->buckets);
+  if (c->mem)
+    for (i = 0; i < c->num_slots; i++)
+      free (c->mem[i]);
+  free (c->mem);
+  free (c->index);
+  free (c->buf);
+  pthread_mutex_destroy (&c->lock);
+  free (c);
+}
+
+static void
+cow_cleanup (struct store *store)
+{
+  struct cow *c = store->hook;
+  int last;
+
+  if (! c)
+    return;
+
+  pthread_mutex_lock (&c->lock);
+  last = --c->refs == 0;
+  pthread_mutex_unlock (&c->lock);
+
+  if (last)
+    cow_free (c);
+  store->hook = 0;
+}
+
+/* Clones see the same delta, just as clones of a device store see the
+   same device.  */
+static error_t
+cow_clone (const struct store *from, struct store *to)
+{
+  struct cow *c = from->hook;
+
+  pthread_mutex_lock (&c->lock);
+  c->refs++;
+  pthread_mutex_unlock (&c->lock);
+  to->hook = c;
+
+  return 0;
+}
+
+const struct store_class
+store_cow_class =
+{
+  STORAGE_OTHER, "cow",
+  read: cow_read,
+  write: cow_write,
+  set_size: cow_set_size,
+  set_flags: store_set_child_flags,
+  clear_flags: store_clear_child_flags,
+  cleanup: cow_cleanup,
+  clone: cow_clone,
+  open: cow_open,
+  sync: cow_sync,
+};
+STORE_STD_CLASS (cow);
+
+/* Set up C to use the delta store DELTA over BASE, either by reading the
+   delta that's there, or by starting a new one.  */
+static error_t
+cow_load (struct cow *c, struct store *base, struct store *delta)
+{
+  struct cow_header *hdr = (struct cow_header *) c->buf;
+  size_t seg, entry, i;
+  error_t err;
+
+  err = cow_read_store (delta, 0, c->buf, c->chunk_size);
+  if (err)
+    return err;
+
+  if (memcmp (hdr->magic, COW_MAGIC, sizeof hdr->magic) == 0)
+    {
+      if (be32toh (hdr->chunk_size) != c->chunk_size
+	  || be64toh (hdr->base_size) != base->size)
+	/* Made with some other base, or by a different version of us.  */
+	return EINVAL;
+    }
+  else
+    {
+      for (i = 0; i < c->chunk_size; i++)
+	if (c->buf[i])
+	  /* Not a delta, and not blank either.  */
+	  return EINVAL;
+
+      memcpy (hdr->magic, COW_MAGIC, sizeof hdr->magic);
+      hdr->chunk_size = htobe32 (c->chunk_size);
+      hdr->base_size = htobe64 (base->size);
+      err = cow_write_store (delta, 0, c->buf, c->chunk_size);
+      if (! err && c->max_slots > 0)
+	{
+	  memset (c->index, 0, c->chunk_size);
+	  err = cow_write_store (delta, cow_index_offset (c, 0),
+				 c->index, c->chunk_size);
+	}
+      return err;
+    }
+
+  /* Read back the index.  */
+  for (seg = 0; c->num_slots < c->max_slots; seg++)
+    {
+      err = cow_read_store (delta, cow_index_offset (c, seg),
+			    c->index, c->chunk_size);
+      if (err)
+	return err;
+      for (entry = 0; entry < c->entries; entry++)
+	{
+	  uint64_t chunk = be64toh (c->index[entry]);
+	  if (chunk == 0 || (chunk - 1) * c->chunk_size >= base->size
+	      || c->num_slots == c->max_slots)
+	    return 0;
+	  err = cow_insert (c, chunk - 1, c->num_slots);
+	  if (err)
+	    return err;
+	  c->num_slots++;
+	}
+    }
+
+  return 0;
+}
+
+/* Return a new store in STORE that reads from BASE, except for the chunks
+   that have been written to, which are kept in DELTA, or in memory if
+   DELTA is 0.  BASE is never written to.  On success, BASE and DELTA are
+   consumed.  */
+error_t
+store_cow_create (struct store *base, struct store *delta, int flags,
+		  struct store **store)
+{
+  struct store *kids[2] = { base, delta };
+  struct store_run run;
+  struct cow *c;
+  size_t chunk_size = COW_CHUNK_SIZE;
+  error_t err;
+
+  while (chunk_size < base->block_size
+	 || (delta && chunk_size < delta->block_size))
+    chunk_size *= 2;
+  if ((chunk_size & (base->block_size - 1)) != 0
+      || (delta && (chunk_size & (delta->block_size - 1)) != 0))
+    return EINVAL;
+
+  c = calloc (1, sizeof *c);
+  if (! c)
+    return ENOMEM;
+  pthread_mutex_init (&c->lock, 0);
+  c->refs = 1;
+  c->chunk_size = chunk_size;
+  c->entries = chunk_size / sizeof (uint64_t);
+  c->num_buckets = 64;
+  c->buckets = calloc (c->num_buckets, sizeof *c->buckets);
+  c->buf = malloc (chunk_size);
+  c->index = malloc (chunk_size);
+  if (! c->buckets || ! c->buf || ! c->index)
+    {
+      cow_free (c);
+      return ENOMEM;
+    }
+
+  if (delta)
+    {
+      /* Everything after the header, in whole segments plus whatever
+	 part of a segment fits at the end.  */
+      size_t chunks = delta->size / chunk_size;
+      size_t segs, rest;
+
+      if (chunks < 1)
+	err = ENOSPC;
+      else
+	{
+	  chunks--;
+	  segs = chunks / (c->entries + 1);
+	  rest = chunks % (c->entries + 1);
+	  c->max_slots = segs * c->entries + (rest > 0 ? rest - 1 : 0);
+	  err = cow_load (c, base, delta);
+	}
+      if (err)
+	{
+	  cow_free (c);
+	  return err;
+	}
+    }
+  else
+    c->max_slots = base->size / chunk_size + 1;
+
+  run.start = 0;
+  run.length = base->blocks;
+
+  err = _store_create (&store_cow_class, MACH_PORT_NULL,
+		       flags, base->block_size, &run, 1, 0, store);
+  if (err)
+    {
+      cow_free (c);
+      return err;
+    }
+  (*store)->hook = c;
+
+  err = store_set_children (*store, kids, delta ? 2 : 1);
+  if (! err)
+    {
+      err = store_children_name (*store, &(*store)->name);
+      if (err == EINVAL)
+	err = 0;		/* Can't find a name; deal. */
+      if (err)
+	(*store)->num_children = 0;
+    }
+  if (err)
+    store_free (*store);
+
+  return err;
+}
+
+/* Open the cow store NAME, which is a list of one or two store names in
+   the syntax of store_open_children: the base, and optionally the store to
+   keep the delta in.  The base is opened read-only.  */
+error_t
+store_cow_open (const char *name, int flags,
+		const struct store_class *const *classes,
+		struct store **store)
+{
+  struct store **stores;
+  size_t num_stores, k;
+  error_t err =
+    store_open_children (name, flags, classes, &stores, &num_stores);
+
+  if (err)
+    return err;
+
+  if (num_stores < 1 || num_stores > 2)
+    err = EINVAL;
+  if (! err)
+    err = store_set_flags (stores[0], STORE_READONLY);
+  if (! err)
+    err = store_cow_create (stores[0], num_stores > 1 ? stores[1] : 0,
+			    flags, store);
+  if (err)
+    for (k = 0; k < num_stores; k++)
+      store_free (stores[k]);
+  free (stores);
+
+  return err;
+}
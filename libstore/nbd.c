@@ -20,6 +20,7 @@
 #include "store.h"
 #include <hurd.h>
 #include <hurd/io.h>
+#include <hurd/socket.h>
 #include <errno.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -29,6 +30,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <pthread.h>
 
 
 // Avoid dragging in the resolver when linking statically.
@@ -44,19 +46,38 @@
 #define NBD_REQUEST_MAGIC	(htonl (0x25609513))
 #define NBD_REPLY_MAGIC		(htonl (0x67446698))
 
-#define NBD_IO_MAX		10240
+#define NBD_CMD_READ		0
+#define NBD_CMD_WRITE		1
+#define NBD_CMD_DISC		2
+#define NBD_CMD_FLUSH		3
+#define NBD_CMD_TRIM		4
+
+/* Bits in the flags word of the startup packet.  */
+#define NBD_FLAG_HAS_FLAGS	0x01
+#define NBD_FLAG_READ_ONLY	0x02
+#define NBD_FLAG_SEND_FLUSH	0x04
+#define NBD_FLAG_SEND_TRIM	0x20
+
+/* The largest read or write we put in a single request, and the largest
+   range we trim with one.  */
+#define NBD_IO_MAX		(128 * 1024)
+#define NBD_TRIM_MAX		(1U << 30)
+
+/* How many requests a single read, write or discard keeps outstanding.  */
+#define NBD_MAX_INFLIGHT	16
 
 struct nbd_startup
 {
   char magic[16];		/* NBD_INIT_MAGIC */
   uint64_t size;		/* size in bytes, 64 bits in net order */
-  char reserved[128];		/* zeros, we don't check it */
+  uint32_t flags;		/* NBD_FLAG_*, in net order */
+  char reserved[124];		/* zeros, we don't check it */
 };
 
 struct nbd_request
 {
   uint32_t magic;		/* NBD_REQUEST_MAGIC */
-  uint32_t type;		/* 0 read, 1 write, 2 disconnect */
+  uint32_t type;		/* NBD_CMD_* */
   uint64_t handle;		/* returned in reply */
   uint64_t from;
   uint32_t len;
@@ -69,7 +90,43 @@ struct nbd_reply
   uint64_t handle;		/* value from request */
 } __attribute__ ((packed));
 
-
+/* A request that has been sent and is waiting for its reply.  These live
+   on the stack of the thread that sent the request.  */
+struct nbd_waiter
+{
+  struct nbd_waiter *next;
+  uint64_t handle;
+  char *buf;			/* Where the data of a read reply goes.  */
+  size_t len;
+  int done;
+  error_t err;
+};
+
+/* The state of a connection to an nbd server, kept in STORE->hook and
+   shared by clones of the store.  Requests from any number of threads are
+   written to the socket as they come, and a single reader thread takes the
+   replies off it and hands each to the waiter with the matching handle, so
+   the server always has work queued up instead of one request per round
+   trip.  The connection is closed when the last store using it is made
+   inactive, and opened again when one of them is made active.  */
+struct nbd_conn
+{
+  pthread_mutex_t active_lock;	/* Protects ACTIVE; held to change PORT.  */
+  unsigned active;		/* Stores without STORE_INACTIVE.  */
+  pthread_mutex_t lock;		/* Protects the fields below.  */
+  pthread_mutex_t send_lock;	/* Held while writing one request.  */
+  pthread_cond_t wakeup;	/* Broadcast when a waiter is done.  */
+  unsigned refs;
+  mach_port_t port;		/* The socket, or null if closed.  */
+  uint32_t server_flags;	/* NBD_FLAG_* from the startup packet.  */
+  struct nbd_waiter *pending;
+  uint64_t next_handle;
+  int reader_active;		/* READER exists and must be joined.  */
+  pthread_t reader;
+  error_t err;			/* Set once the connection is unusable.  */
+};
+
+
 /* i/o functions.  */
 
 #if BYTE_ORDER == BIG_ENDIAN
@@ -83,185 +140,304 @@ struct nbd_reply
 #define ntohll htonll
 
 
-static inline error_t
-read_reply (struct store *store, uint64_t handle)
+/* Read exactly LEN bytes from PORT into BUF.  */
+static error_t
+read_fully (mach_port_t port, void *buf, size_t len)
 {
-  struct nbd_reply reply;
-  char *buf = (void *) &reply;
-  mach_msg_type_number_t cc = sizeof reply;
-  error_t err = io_read (store->port, &buf, &cc, -1, cc);
-  if (err)
-    return err;
-  if (buf != (void *) &reply)
+  while (len > 0)
     {
-      memcpy (&reply, buf, sizeof reply);
-      munmap (buf, cc);
+      char *data = buf;
+      mach_msg_type_number_t cc = len;
+      error_t err = io_read (port, &data, &cc, -1, len);
+      if (err)
+	return err;
+      if (cc == 0)
+	return EIO;		/* The server hung up.  */
+      if (data != buf)
+	{
+	  memcpy (buf, data, cc);
+	  munmap (data, cc);
+	}
+      buf += cc;
+      len -= cc;
     }
-  if (cc != sizeof reply)
-    return EIO;
-  if (reply.magic != NBD_REPLY_MAGIC)
-    return EIO;
-  if (reply.handle != handle)
-    return EIO;
-  if (reply.error != 0)
-    return EIO;
   return 0;
 }
 
+/* Write exactly LEN bytes from BUF to PORT.  */
 static error_t
-nbd_write (struct store *store,
-	   store_offset_t addr, size_t index, const void *buf, size_t len,
-	   size_t *amount)
+write_fully (mach_port_t port, const void *buf, size_t len)
 {
-  struct nbd_request req =
-  {
-    magic: NBD_REQUEST_MAGIC,
-    type: htonl (1),		/* WRITE */
-  };
-  error_t err;
-  mach_msg_type_number_t cc;
+  while (len > 0)
+    {
+      mach_msg_type_number_t cc;
+      error_t err = io_write (port, (char *) buf, len, -1, &cc);
+      if (err)
+	return err;
+      if (cc == 0)
+	return EIO;
+      buf += cc;
+      len -= cc;
+    }
+  return 0;
+}
 
-  addr <<= store->log2_block_size;
-  *amount = 0;
+/* The body of the reader thread of the connection ARG.  It runs until the
+   connection fails or is shut down, and then fails every request still
+   waiting for a reply.  */
+static void *
+nbd_reader (void *arg)
+{
+  struct nbd_conn *conn = arg;
+  struct nbd_waiter *w, **wp;
+  error_t err;
 
-  do
+  for (;;)
     {
-      size_t chunk = len < NBD_IO_MAX ? len : NBD_IO_MAX, nwrote;
-      req.from = htonll (addr);
-      req.len = htonl (chunk);
+      struct nbd_reply reply;
 
-      err = io_write (store->port, (char *) &req, sizeof req, -1, &cc);
+      err = read_fully (conn->port, &reply, sizeof reply);
       if (err)
-	return err;
-      if (cc != sizeof req)
-	return EIO;
+	break;
+      if (reply.magic != NBD_REPLY_MAGIC)
+	{
+	  err = EIO;
+	  break;
+	}
+
+      pthread_mutex_lock (&conn->lock);
+      for (wp = &conn->pending; *wp; wp = &(*wp)->next)
+	if ((*wp)->handle == reply.handle)
+	  break;
+      w = *wp;
+      if (w)
+	*wp = w->next;
+      pthread_mutex_unlock (&conn->lock);
 
-      nwrote = 0;
-      do
+      if (! w)
 	{
-	  err = io_write (store->port, (char *) buf, chunk - nwrote, -1, &cc);
-	  if (err)
-	    return err;
-	  buf += cc;
-	  nwrote += cc;
-	} while (nwrote < chunk);
+	  /* A reply to something we never asked for.  */
+	  err = EIO;
+	  break;
+	}
+
+      /* W is off the pending list, so nobody else will touch it, and its
+	 sender is blocked until we mark it done.  The server sends no data
+	 with an error reply.  */
+      if (reply.error != 0)
+	w->err = EIO;
+      else if (w->buf)
+	err = w->err = read_fully (conn->port, w->buf, w->len);
+
+      pthread_mutex_lock (&conn->lock);
+      w->done = 1;
+      pthread_cond_broadcast (&conn->wakeup);
+      pthread_mutex_unlock (&conn->lock);
 
-      err = read_reply (store, req.handle);
       if (err)
-	return err;
+	break;
+    }
 
-      addr += chunk;
-      *amount += chunk;
-      len -= chunk;
-    } while (len > 0);
+  pthread_mutex_lock (&conn->lock);
+  if (! conn->err)
+    conn->err = err;
+  while (conn->pending)
+    {
+      w = conn->pending;
+      conn->pending = w->next;
+      w->err = conn->err;
+      w->done = 1;
+    }
+  pthread_cond_broadcast (&conn->wakeup);
+  pthread_mutex_unlock (&conn->lock);
 
   return 0;
 }
 
+/* Send CONN's server a request of type TYPE for the LEN bytes at byte
+   offset FROM, and queue W to receive its reply.  For a write, DATA is what
+   to write; for a read, it is where the reply data will go.  If an error is
+   returned, W has already been dealt with; otherwise, wait_request must be
+   called on it.  */
 static error_t
-nbd_read (struct store *store,
-	  store_offset_t addr, size_t index, size_t amount,
-	  void **buf, size_t *len)
+send_request (struct nbd_conn *conn, uint32_t type, store_offset_t from,
+	      char *data, size_t len, struct nbd_waiter *w)
 {
   struct nbd_request req =
   {
     magic: NBD_REQUEST_MAGIC,
-    type: htonl (0),		/* READ */
+    type: htonl (type),
+    from: htonll (from),
+    len: htonl (len),
   };
   error_t err;
-  size_t ofs, chunk;
-  char *databuf, *piecebuf;
-  size_t databuflen, piecelen;
-
-  /* Send a request for the largest possible piece of remaining data and
-     read the first piece of its reply into PIECEBUF, PIECELEN.  The amount
-     requested can be found in CHUNK.  */
-  inline error_t request_chunk (char **buf, size_t *len)
+
+  w->buf = type == NBD_CMD_READ ? data : 0;
+  w->len = len;
+  w->done = 0;
+  w->err = 0;
+
+  pthread_mutex_lock (&conn->lock);
+  err = conn->err;
+  if (! err && ! conn->reader_active)
     {
-      mach_msg_type_number_t cc;
+      err = pthread_create (&conn->reader, 0, nbd_reader, conn);
+      if (! err)
+	conn->reader_active = 1;
+    }
+  if (err)
+    {
+      pthread_mutex_unlock (&conn->lock);
+      return err;
+    }
+  w->handle = req.handle = conn->next_handle++;
+  w->next = conn->pending;
+  conn->pending = w;
+  pthread_mutex_unlock (&conn->lock);
+
+  /* Once W is on the pending list its reply may arrive at any time, even
+     before we are done sending.  */
+  pthread_mutex_lock (&conn->send_lock);
+  err = write_fully (conn->port, &req, sizeof req);
+  if (! err && type == NBD_CMD_WRITE)
+    err = write_fully (conn->port, data, len);
+  pthread_mutex_unlock (&conn->send_lock);
+
+  if (err)
+    {
+      /* Part of a request may have gone out, so nothing else we send can
+	 be understood.  Shut the connection down; the reader then fails
+	 everything pending, W included.  */
+      pthread_mutex_lock (&conn->lock);
+      if (! conn->err)
+	conn->err = err;
+      pthread_mutex_unlock (&conn->lock);
+      socket_shutdown (conn->port, 2);
+
+      pthread_mutex_lock (&conn->lock);
+      while (! w->done)
+	pthread_cond_wait (&conn->wakeup, &conn->lock);
+      pthread_mutex_unlock (&conn->lock);
+    }
+
+  return err;
+}
 
-      chunk = (amount - ofs) < NBD_IO_MAX ? (amount - ofs) : NBD_IO_MAX;
+/* Wait for the reply to the request W, and return its status.  */
+static error_t
+wait_request (struct nbd_conn *conn, struct nbd_waiter *w)
+{
+  pthread_mutex_lock (&conn->lock);
+  while (! w->done)
+    pthread_cond_wait (&conn->wakeup, &conn->lock);
+  pthread_mutex_unlock (&conn->lock);
+  return w->err;
+}
 
-      req.from = htonll (addr);
-      req.len = htonl (chunk);
+/* Do the LEN bytes at byte offset ADDR with requests of type TYPE, each
+   covering at most CHUNK bytes, keeping up to NBD_MAX_INFLIGHT of them
+   outstanding.  DATA is what to write or where to read into, or 0 if TYPE
+   carries no data.  */
+static error_t
+nbd_transfer (struct store *store, uint32_t type, store_offset_t addr,
+	      char *data, size_t len, size_t chunk)
+{
+  struct nbd_conn *conn = store->hook;
+  struct nbd_waiter waiters[NBD_MAX_INFLIGHT];
+  size_t nreqs = (len + chunk - 1) / chunk;
+  size_t issued = 0, finished = 0;
+  error_t err = 0;
 
-      /* Advance ADDR immediately, so it always points past what we've
-	 already requested.  */
-      addr += chunk;
+  while (finished < issued || (! err && issued < nreqs))
+    if (! err && issued < nreqs && issued - finished < NBD_MAX_INFLIGHT)
+      {
+	size_t ofs = issued * chunk;
+	size_t piece = len - ofs < chunk ? len - ofs : chunk;
 
-      return (io_write (store->port, (char *) &req, sizeof req, -1, &cc) ?
-	      : cc != sizeof req ? EIO
-	      : read_reply (store, req.handle) ?
-	      : io_read (store->port, buf, len, (off_t) -1, chunk));
-    }
+	err = send_request (conn, type, addr + ofs, data ? data + ofs : 0,
+			    piece, &waiters[issued % NBD_MAX_INFLIGHT]);
+	if (! err)
+	  issued++;
+      }
+    else
+      {
+	error_t e = wait_request (conn, &waiters[finished % NBD_MAX_INFLIGHT]);
+	if (e && ! err)
+	  err = e;
+	finished++;
+      }
 
-  addr <<= store->log2_block_size;
+  return err;
+}
 
-  /* Read the first piece, which can go directly into the caller's buffer.  */
-  databuf = *buf;
-  piecelen = databuflen = *len;
-  err = request_chunk (&databuf, &piecelen);
-  if (err)
-    return err;
-  if (databuflen >= amount)
+static error_t
+nbd_write (struct store *store,
+	   store_offset_t addr, size_t index, const void *buf, size_t len,
+	   size_t *amount)
+{
+  error_t err;
+
+  err = nbd_transfer (store, NBD_CMD_WRITE, addr << store->log2_block_size,
+		      (char *) buf, len, NBD_IO_MAX);
+  *amount = err ? 0 : len;
+  return err;
+}
+
+static error_t
+nbd_read (struct store *store,
+	  store_offset_t addr, size_t index, size_t amount,
+	  void **buf, size_t *len)
+{
+  error_t err;
+  char *data = *buf;
+
+  if (*len < amount)
     {
-      /* That got it all.  We're done.  */
-      *buf = databuf;
-      *len = piecelen;
-      return 0;
+      data = mmap (0, amount, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (data == MAP_FAILED)
+	return errno;
     }
 
-  /* We haven't read the entire amount yet.  */
-  ofs = 0;
-  do
+  err = nbd_transfer (store, NBD_CMD_READ, addr << store->log2_block_size,
+		      data, amount, NBD_IO_MAX);
+  if (err)
     {
-      /* Account for what we just read.  */
-      ofs += piecelen;
-      chunk -= piecelen;
-      if (ofs == amount)
-	{
-	  /* That got it all.  We're done.  */
-	  *buf = databuf;
-	  *len = ofs;
-	  return 0;
-	}
+      if (data != *buf)
+	munmap (data, amount);
+      return err;
+    }
 
-      /* Now we'll read another piece of the data, hopefully
-	 into the latter part of the existing buffer.  */
-      piecebuf = databuf + ofs;
-      piecelen = databuflen - ofs;
+  *buf = data;
+  *len = amount;
+  return 0;
+}
 
-      if (chunk > 0)
-	/* We haven't finishing reading the last chunk we requested.  */
-	err = io_read (store->port, &piecebuf, &piecelen,
-		       (off_t) -1, chunk);
-      else
-	/* Request the next chunk from the server.  */
-	err = request_chunk (&piecebuf, &piecelen);
+static error_t
+nbd_sync (struct store *store)
+{
+  struct nbd_conn *conn = store->hook;
+  struct nbd_waiter w;
+  error_t err;
 
-      if (!err && piecebuf != databuf + ofs)
-	{
-	  /* Now we have two discontiguous pieces of the buffer.  */
-	  size_t newbuflen = round_page (databuflen + piecelen);
-	  char *newbuf = mmap (0, newbuflen,
-			       PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
-	  if (newbuf == MAP_FAILED)
-	    {
-	      err = errno;
-	      break;
-	    }
-	  memcpy (newbuf, databuf, ofs);
-	  memcpy (newbuf + ofs, piecebuf, piecelen);
-	  if (databuf != *buf)
-	    munmap (databuf, databuflen);
-	  databuf = newbuf;
-	  databuflen = newbuflen;
-	}
-    } while (! err);
+  if (! (conn->server_flags & NBD_FLAG_SEND_FLUSH))
+    /* The server doesn't cache writes, or won't say.  */
+    return 0;
 
-  if (databuf != *buf)
-    munmap (databuf, databuflen);
-  return err;
+  err = send_request (conn, NBD_CMD_FLUSH, 0, 0, 0, &w);
+  return err ?: wait_request (conn, &w);
+}
+
+static error_t
+nbd_discard (struct store *store,
+	     store_offset_t addr, size_t index, size_t len)
+{
+  struct nbd_conn *conn = store->hook;
+
+  if (! (conn->server_flags & NBD_FLAG_SEND_TRIM))
+    return EOPNOTSUPP;
+
+  return nbd_transfer (store, NBD_CMD_TRIM, addr << store->log2_block_size,
+		       0, len, NBD_TRIM_MAX);
 }
 
 static error_t
@@ -328,7 +504,8 @@ nbd_validate_name (const char *name,
 
 static error_t
 nbdopen (const char *name, int *mod_flags,
-	 socket_t *sockport, size_t *blocksize, store_offset_t *size)
+	 socket_t *sockport, size_t *blocksize, store_offset_t *size,
+	 uint32_t *server_flags)
 {
   int sock;
   struct sockaddr_in sin;
@@ -418,40 +595,85 @@ nbdopen (const char *name, int *mod_flags,
     }
 
   *size = ntohll (ns.size);
+  *server_flags = ntohl (ns.flags);
+  if (! (*server_flags & NBD_FLAG_HAS_FLAGS))
+    *server_flags = 0;
   *sockport = getdport (sock);
   close (sock);
 
   return 0;
 }
 
+/* Make CONN unusable and get rid of its reader thread.  */
 static void
-nbdclose (struct store *store)
+stop_reader (struct nbd_conn *conn)
 {
-  if (store->port != MACH_PORT_NULL)
-    {
-      /* Send a disconnect message, but don't wait for a reply.  */
-      struct nbd_request req =
-      {
-	magic: NBD_REQUEST_MAGIC,
-	type: htonl (2),	/* disconnect */
-      };
-      mach_msg_type_number_t cc;
-      (void) io_write (store->port, (char *) &req, sizeof req, -1, &cc);
+  int active;
 
-      /* Close the socket.  */
-      mach_port_deallocate (mach_task_self (), store->port);
-      store->port = MACH_PORT_NULL;
+  pthread_mutex_lock (&conn->lock);
+  if (! conn->err)
+    conn->err = EIO;
+  active = conn->reader_active;
+  conn->reader_active = 0;
+  pthread_mutex_unlock (&conn->lock);
+
+  if (active)
+    {
+      /* Wake the reader up from its read, if it is still in one.  */
+      socket_shutdown (conn->port, 2);
+      pthread_join (conn->reader, 0);
     }
 }
 
+/* Tell the server of CONN we are done and close its socket.  Nobody
+   else may change CONN->port meanwhile.  */
+static void
+nbd_disconnect (struct nbd_conn *conn)
+{
+  /* Send a disconnect message, but don't wait for a reply.  */
+  struct nbd_request req =
+  {
+    magic: NBD_REQUEST_MAGIC,
+    type: htonl (NBD_CMD_DISC),
+  };
+
+  if (conn->port == MACH_PORT_NULL)
+    return;
+
+  pthread_mutex_lock (&conn->send_lock);
+  (void) write_fully (conn->port, &req, sizeof req);
+  pthread_mutex_unlock (&conn->send_lock);
+  stop_reader (conn);
+
+  /* Close the socket, once nobody is writing to it.  */
+  pthread_mutex_lock (&conn->send_lock);
+  pthread_mutex_lock (&conn->lock);
+  mach_port_deallocate (mach_task_self (), conn->port);
+  conn->port = MACH_PORT_NULL;
+  pthread_mutex_unlock (&conn->lock);
+  pthread_mutex_unlock (&conn->send_lock);
+}
+
 static error_t
 nbd_set_flags (struct store *store, int flags)
 {
+  struct nbd_conn *conn = store->hook;
+
   if ((flags & ~STORE_INACTIVE) != 0)
     /* Trying to set flags we don't support.  */
     return EINVAL;
 
-  nbdclose (store);
+  pthread_mutex_lock (&conn->active_lock);
+  if (--conn->active == 0)
+    /* Clones still using the connection keep it open.  */
+    nbd_disconnect (conn);
+  pthread_mutex_unlock (&conn->active_lock);
+
+  if (store->port != MACH_PORT_NULL)
+    {
+      mach_port_deallocate (mach_task_self (), store->port);
+      store->port = MACH_PORT_NULL;
+    }
   store->flags |= STORE_INACTIVE;
 
   return 0;
@@ -460,18 +682,96 @@ nbd_set_flags (struct store *store, int flags)
 static error_t
 nbd_clear_flags (struct store *store, int flags)
 {
+  struct nbd_conn *conn = store->hook;
+  uint32_t server_flags;
+  socket_t port;
   error_t err = 0;
+
   if ((flags & ~STORE_INACTIVE) != 0)
-    err = EINVAL;
-  err = store->name
-    ? nbdopen (store->name, &store->flags,
-	       &store->port, &store->block_size, &store->size)
-    : ENOENT;
+    return EINVAL;
+
+  pthread_mutex_lock (&conn->active_lock);
+  if (conn->port == MACH_PORT_NULL)
+    {
+      /* Nobody was using the connection; make a new one.  */
+      err = store->name
+	? nbdopen (store->name, &store->flags,
+		   &port, &store->block_size, &store->size,
+		   &server_flags)
+	: ENOENT;
+      if (! err)
+	{
+	  pthread_mutex_lock (&conn->lock);
+	  conn->port = port;
+	  conn->server_flags = server_flags;
+	  conn->err = 0;
+	  pthread_mutex_unlock (&conn->lock);
+	}
+    }
+  if (! err)
+    err = mach_port_mod_refs (mach_task_self (), conn->port,
+			      MACH_PORT_RIGHT_SEND, 1);
   if (! err)
-    store->flags &= ~STORE_INACTIVE;
+    {
+      store->port = conn->port;
+      conn->active++;
+      store->flags &= ~STORE_INACTIVE;
+    }
+  pthread_mutex_unlock (&conn->active_lock);
+
   return err;
 }
 
+static void
+nbd_cleanup (struct store *store)
+{
+  struct nbd_conn *conn = store->hook;
+  int last;
+
+  if (! conn)
+    return;
+
+  pthread_mutex_lock (&conn->active_lock);
+  if (! (store->flags & STORE_INACTIVE) && --conn->active == 0)
+    nbd_disconnect (conn);
+  pthread_mutex_unlock (&conn->active_lock);
+
+  pthread_mutex_lock (&conn->lock);
+  last = --conn->refs == 0;
+  pthread_mutex_unlock (&conn->lock);
+
+  if (last)
+    {
+      nbd_disconnect (conn);
+      stop_reader (conn);
+      pthread_cond_destroy (&conn->wakeup);
+      pthread_mutex_destroy (&conn->send_lock);
+      pthread_mutex_destroy (&conn->lock);
+      pthread_mutex_destroy (&conn->active_lock);
+      free (conn);
+    }
+  store->hook = 0;
+}
+
+/* Clones talk to the server over the same socket, so they share the
+   connection and its reader.  */
+static error_t
+nbd_clone (const struct store *from, struct store *to)
+{
+  struct nbd_conn *conn = from->hook;
+
+  pthread_mutex_lock (&conn->active_lock);
+  if (! (from->flags & STORE_INACTIVE))
+    conn->active++;
+  pthread_mutex_unlock (&conn->active_lock);
+  pthread_mutex_lock (&conn->lock);
+  conn->refs++;
+  pthread_mutex_unlock (&conn->lock);
+  to->hook = conn;
+
+  return 0;
+}
+
 const struct store_class store_nbd_class =
 {
   STORAGE_NETWORK, "nbd",
@@ -484,6 +784,10 @@ const struct store_class store_nbd_class =
   encode: store_std_leaf_encode,
   decode: nbd_decode,
   set_flags: nbd_set_flags, clear_flags: nbd_clear_flags,
+  cleanup: nbd_cleanup,
+  clone: nbd_clone,
+  sync: nbd_sync,
+  discard: nbd_discard,
 };
 STORE_STD_CLASS (nbd);
 
@@ -494,8 +798,43 @@ _store_nbd_create (mach_port_t port, int flags, size_t block_size,
 		   const struct store_run *runs, size_t num_runs,
 		   struct store **store)
 {
-  return _store_create (&store_nbd_class,
-			port, flags, block_size, runs, num_runs, 0, store);
+  error_t err;
+  struct nbd_conn *conn = calloc (1, sizeof *conn);
+
+  if (! conn)
+    return ENOMEM;
+  pthread_mutex_init (&conn->active_lock, 0);
+  pthread_mutex_init (&conn->lock, 0);
+  pthread_mutex_init (&conn->send_lock, 0);
+  pthread_cond_init (&conn->wakeup, 0);
+  conn->refs = 1;
+  conn->active = ! (flags & STORE_INACTIVE);
+
+  /* The connection keeps a right to the socket of its own, so that it
+     outlives the store's.  */
+  if (port != MACH_PORT_NULL)
+    {
+      err = mach_port_mod_refs (mach_task_self (), port,
+				MACH_PORT_RIGHT_SEND, 1);
+      if (err)
+	{
+	  free (conn);
+	  return err;
+	}
+    }
+  conn->port = port;
+
+  err = _store_create (&store_nbd_class,
+		       port, flags, block_size, runs, num_runs, 0, store);
+  if (err)
+    {
+      if (port != MACH_PORT_NULL)
+	mach_port_deallocate (mach_task_self (), port);
+      free (conn);
+    }
+  else
+    (*store)->hook = conn;
+  return err;
 }
 
 /* Open a new store backed by the named nbd server.  */
@@ -506,15 +845,17 @@ store_nbd_open (const char *name, int flags, struct store **store)
   socket_t sock;
   struct store_run run;
   size_t blocksize;
+  uint32_t server_flags;
 
   run.start = 0;
-  err = nbdopen (name, &flags, &sock, &blocksize, &run.length);
+  err = nbdopen (name, &flags, &sock, &blocksize, &run.length, &server_flags);
   if (!err)
     {
       run.length /= blocksize;
       err = _store_nbd_create (sock, flags, blocksize, &run, 1, store);
       if (! err)
 	{
+	  ((struct nbd_conn *) (*store)->hook)->server_flags = server_flags;
 	  if (!strncmp (name, url_prefix, sizeof url_prefix - 1))
 	    err = store_set_name (*store, name);
 	  else
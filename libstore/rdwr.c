@@ -19,6 +19,8 @@
    59 Temple Place - Suite 330, Boston, MA 02111, USA. */
 
 #include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
 #include <sys/mman.h>
 
 #include "store.h"
@@ -89,6 +91,229 @@ store_next_run (struct store *store, struct store_run *runs_end,
     return 1;
 }
 
+/* The most threads a single request spanning several children of a store
+   is split among, counting the caller's.  */
+#define STORE_MAX_WORKERS	16
+
+/* The least a thread is given to do.  Below this, making and joining the
+   thread costs more than doing the work in the caller's thread.  */
+#define STORE_MIN_WORK		(64 * 1024)
+
+/* The part of a request that falls into one run.  */
+struct store_seg
+{
+  store_offset_t addr;		/* Underlying address.  */
+  size_t index;			/* Index of the run.  */
+  size_t offs;			/* Where in the caller's buffer.  */
+  mach_msg_type_number_t len;
+  mach_msg_type_number_t done;	/* How much was actually transferred.  */
+  error_t err;
+};
+
+/* A request split into segments, and being done by several threads.  */
+struct store_job
+{
+  struct store *store;
+  int writing;
+  void *buf;
+  struct store_seg *segs;
+  size_t num_segs;
+  size_t num_workers;
+  size_t limit;			/* No segment from here on is started.  */
+};
+
+struct store_worker
+{
+  struct store_job *job;
+  size_t id;
+  pthread_t thread;
+};
+
+/* Split the LEN bytes at ADDR in STORE into one segment per run, stopping
+   at a hole or the end of STORE, and return them in SEGS and NUM_SEGS.  The
+   caller must free SEGS.  */
+static error_t
+store_split (struct store *store, store_offset_t addr, size_t len,
+	     struct store_seg **segs, size_t *num_segs)
+{
+  size_t index, offs = 0, num = 0, alloced = 0;
+  store_offset_t base;
+  struct store_run *run, *runs_end;
+  int block_shift = store->log2_block_size;
+  struct store_seg *v = 0;
+
+  addr = store_find_first_run (store, addr, &run, &runs_end, &base, &index);
+  if (addr < 0)
+    return EIO;
+
+  while (offs < len && run->start >= 0)
+    {
+      size_t seg_len = len - offs;
+
+      if ((seg_len >> block_shift) > run->length - addr)
+	seg_len = (run->length - addr) << block_shift;
+
+      if (num == alloced)
+	{
+	  struct store_seg *nv;
+	  alloced = alloced ? 2 * alloced : 16;
+	  nv = realloc (v, alloced * sizeof *v);
+	  if (! nv)
+	    {
+	      free (v);
+	      return ENOMEM;
+	    }
+	  v = nv;
+	}
+
+      v[num].addr = base + run->start + addr;
+      v[num].index = index;
+      v[num].offs = offs;
+      v[num].len = seg_len;
+      v[num].done = 0;
+      v[num].err = 0;
+      num++;
+
+      offs += seg_len;
+      addr = 0;
+      if (offs < len && ! store_next_run (store, runs_end, &run, &base, &index))
+	break;
+    }
+
+  *segs = v;
+  *num_segs = num;
+  return 0;
+}
+
+/* Do the segments of JOB that belong to worker ID, in order, stopping at
+   the first one that fails or comes up short, or that comes after one that
+   did in another worker.  Segments are dealt out by run index, so each
+   run, and thus each child of a striped store, is only ever used by one
+   worker.  */
+static void
+store_work (struct store_job *job, size_t id)
+{
+  struct store *store = job->store;
+  size_t i;
+
+  for (i = 0; i < job->num_segs; i++)
+    {
+      struct store_seg *seg = &job->segs[i];
+      void *seg_buf = job->buf + seg->offs;
+
+      if (seg->index % job->num_workers != id)
+	continue;
+      if (i >= __atomic_load_n (&job->limit, __ATOMIC_RELAXED))
+	break;
+
+      if (job->writing)
+	seg->err = (*store->class->write) (store, seg->addr, seg->index,
+					   seg_buf, seg->len, &seg->done);
+      else
+	{
+	  void *rbuf = seg_buf;
+	  mach_msg_type_number_t rlen = seg->len;
+
+	  seg->err = (*store->class->read) (store, seg->addr, seg->index,
+					    seg->len, &rbuf, &rlen);
+	  if (! seg->err)
+	    {
+	      if (rbuf != seg_buf)
+		{
+		  memcpy (seg_buf, rbuf, rlen < seg->len ? rlen : seg->len);
+		  munmap (rbuf, rlen);
+		}
+	      seg->done = rlen < seg->len ? rlen : seg->len;
+	    }
+	}
+
+      if (seg->err || seg->done < seg->len)
+	{
+	  /* Keep the other workers from going past this segment.  */
+	  size_t limit = __atomic_load_n (&job->limit, __ATOMIC_RELAXED);
+	  while (i + 1 < limit
+		 && ! __atomic_compare_exchange_n (&job->limit, &limit, i + 1,
+						   0, __ATOMIC_RELAXED,
+						   __ATOMIC_RELAXED))
+	    ;
+	  break;
+	}
+    }
+}
+
+static void *
+store_worker_thread (void *arg)
+{
+  struct store_worker *w = arg;
+  store_work (w->job, w->id);
+  return 0;
+}
+
+/* Read into or write from (according to WRITING) BUF the LEN bytes at ADDR
+   in STORE, which spans several runs, doing runs in different children of
+   STORE at the same time.  The amount transferred is returned in AMOUNT;
+   as for a sequential transfer, it ends at the first segment that fails or
+   comes up short, and an error is only returned if that is the first.
+   No segment after that one is started, but when writing, those that
+   other workers already had under way are still written, beyond AMOUNT.  */
+static error_t
+store_parallel_rw (struct store *store, store_offset_t addr,
+		   void *buf, size_t len, int writing, size_t *amount)
+{
+  struct store_job job = { store: store, writing: writing, buf: buf };
+  struct store_worker workers[STORE_MAX_WORKERS];
+  size_t i, started;
+  error_t err;
+
+  *amount = 0;
+  err = store_split (store, addr, len, &job.segs, &job.num_segs);
+  if (err)
+    return err;
+  job.limit = job.num_segs;
+
+  job.num_workers = store->num_runs;
+  if (job.num_workers > job.num_segs)
+    job.num_workers = job.num_segs;
+  if (job.num_workers > len / STORE_MIN_WORK)
+    job.num_workers = len / STORE_MIN_WORK ?: 1;
+  if (job.num_workers > STORE_MAX_WORKERS)
+    job.num_workers = STORE_MAX_WORKERS;
+
+  /* The caller's thread is worker 0.  If we can't get a thread for some
+     worker, do its share here as well.  */
+  started = 0;
+  for (i = 1; i < job.num_workers; i++)
+    {
+      workers[started].job = &job;
+      workers[started].id = i;
+      if (pthread_create (&workers[started].thread, 0,
+			  store_worker_thread, &workers[started]) == 0)
+	started++;
+      else
+	store_work (&job, i);
+    }
+  store_work (&job, 0);
+  for (i = 0; i < started; i++)
+    pthread_join (workers[i].thread, 0);
+
+  for (i = 0; i < job.num_segs; i++)
+    {
+      struct store_seg *seg = &job.segs[i];
+      if (seg->err)
+	{
+	  if (i == 0)
+	    err = seg->err;
+	  break;
+	}
+      *amount += seg->done;
+      if (seg->done < seg->len)
+	break;
+    }
+
+  free (job.segs);
+  return err;
+}
+
 /* Write LEN bytes from BUF to STORE at ADDR.  Returns the amount written
    in AMOUNT.  ADDR is in BLOCKS (as defined by STORE->block_size).  */
 error_t
@@ -97,7 +322,7 @@ store_write (struct store *store,
 {
   error_t err;
   size_t index;
-  store_offset_t base;
+  store_offset_t base, start = addr;
   struct store_run *run, *runs_end;
   int block_shift = store->log2_block_size;
   store_write_meth_t write = store->class->write;
@@ -117,6 +342,10 @@ store_write (struct store *store,
   else if ((len >> block_shift) <= run->length - addr)
     /* The first run has it all... */
     err = (*write)(store, base + run->start + addr, index, buf, len, amount);
+  else if (store->num_children > 1 && len >= 2 * STORE_MIN_WORK)
+    /* The runs are likely in different children, which can all be busy at
+       once.  */
+    err = store_parallel_rw (store, start, (void *) buf, len, 1, amount);
   else
     /* ARGH, we've got to split up the write ... */
     {
@@ -176,7 +405,7 @@ store_read (struct store *store,
 	    store_offset_t addr, size_t amount, void **buf, size_t *len)
 {
   size_t index;
-  store_offset_t base;
+  store_offset_t base, start = addr;
   struct store_run *run, *runs_end;
   int block_shift = store->log2_block_size;
   store_read_meth_t read = store->class->read;
@@ -194,6 +423,41 @@ store_read (struct store *store,
   if ((amount >> block_shift) <= run->length - addr)
     /* The first run has it all... */
     return (*read) (store, base + run->start + addr, index, amount, buf, len);
+  else if (store->num_children > 1 && amount >= 2 * STORE_MIN_WORK)
+    /* The runs are likely in different children, which can all be busy at
+       once.  */
+    {
+      error_t err;
+      void *whole_buf = *buf;
+      size_t whole_buf_len = *len;
+
+      if (whole_buf_len < amount)
+	{
+	  whole_buf_len = amount;
+	  whole_buf = mmap (0, amount, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+	  if (whole_buf == (void *) -1)
+	    return errno;
+	}
+
+      err = store_parallel_rw (store, start, whole_buf, amount, 0, len);
+      if (err && *len > 0)
+	err = 0;		/* Return a short read instead of an error.  */
+
+      if (whole_buf != *buf)
+	{
+	  if (err)
+	    munmap (whole_buf, whole_buf_len);
+	  else
+	    {
+	      vm_size_t unused = whole_buf_len - round_page (*len);
+	      if (unused)
+		munmap (whole_buf + whole_buf_len - unused, unused);
+	      *buf = whole_buf;
+	    }
+	}
+
+      return err;
+    }
   else
     /* ARGH, we've got to split up the read ... This isn't fun. */
     {
@@ -296,3 +560,73 @@ store_set_size (struct store *store, size_t newsize)
 
   return err;
 }
+
+/* Wait until everything written to STORE so far is on stable storage.  */
+error_t
+store_sync (struct store *store)
+{
+  error_t err = 0;
+  size_t i;
+
+  if (store->class->sync)
+    return (*store->class->sync) (store);
+
+  for (i = 0; i < store->num_children && !err; i++)
+    err = store_sync (store->children[i]);
+
+  return err;
+}
+
+/* Tell STORE that the LEN bytes at ADDR no longer hold useful data.  ADDR
+   is in BLOCKS (as defined by STORE->block_size).  Holes in the run list
+   are skipped, since there's nothing behind them to discard.  */
+error_t
+store_discard (struct store *store, store_offset_t addr, size_t len)
+{
+  error_t err = 0;
+  size_t index;
+  store_offset_t base;
+  struct store_run *run, *runs_end;
+  int block_shift = store->log2_block_size;
+  store_discard_meth_t discard = store->class->discard;
+
+  if (! discard)
+    return EOPNOTSUPP;
+
+  if (store->flags & STORE_READONLY)
+    return EROFS;
+
+  if ((addr << block_shift) + len > store->size)
+    return EIO;
+
+  if (store->block_size != 0 && (len & (store->block_size - 1)) != 0)
+    return EINVAL;
+
+  addr = store_find_first_run (store, addr, &run, &runs_end, &base, &index);
+  if (addr < 0)
+    return EIO;
+
+  while (len > 0)
+    {
+      size_t try;
+
+      if ((len >> block_shift) <= run->length - addr)
+	try = len;
+      else
+	try = (run->length - addr) << block_shift;
+
+      if (run->start >= 0)
+	{
+	  err = (*discard) (store, base + run->start + addr, index, try);
+	  if (err)
+	    break;
+	}
+
+      len -= try;
+      addr = 0;
+      if (len > 0 && ! store_next_run (store, runs_end, &run, &base, &index))
+	break;
+    }
+
+  return err;
+}
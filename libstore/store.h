@@ -136,6 +136,10 @@ typedef error_t (*store_read_meth_t)(struct store *store,
 				     void **buf, mach_msg_type_number_t *len);
 typedef error_t (*store_set_size_meth_t)(struct store *store,
 					 size_t newsize);
+typedef error_t (*store_sync_meth_t)(struct store *store);
+typedef error_t (*store_discard_meth_t)(struct store *store,
+					store_offset_t addr, size_t index,
+					size_t len);
 
 struct store_enc;		/* fwd decl */
 
@@ -208,6 +212,18 @@ struct store_class
 
   /* Return a memory object paging on STORE.  */
   error_t (*map) (const struct store *store, vm_prot_t prot, mach_port_t *memobj);
+
+  /* The fields from here on were added after the others.  libstore reads
+     them from every class, so class modules built against a <hurd/store.h>
+     without them must be rebuilt.  */
+
+  /* Make sure everything written to STORE so far is on stable storage.
+     If 0, the children of STORE (if any) are synced instead.  */
+  store_sync_meth_t sync;
+  /* Tell the storage that the LEN bytes at the underlying address ADDR are
+     no longer in use.  INDEX varies from 0 to the number of runs in
+     STORE.  If 0, discarding isn't supported.  */
+  store_discard_meth_t discard;
 };
 
 /* Return a new store in STORE, which refers to the storage underlying
@@ -320,6 +336,15 @@ error_t store_read (struct store *store,
 /* Set STORE's size to NEWSIZE (in bytes).  */
 error_t store_set_size (struct store *store, size_t newsize);
 
+/* Wait until everything written to STORE so far is on stable storage.  */
+error_t store_sync (struct store *store);
+
+/* Tell STORE that the LEN bytes at ADDR no longer hold useful data, so the
+   backing storage may reclaim them; reading them afterwards returns
+   unspecified contents.  ADDR is in BLOCKS (as defined by
+   STORE->block_size).  Returns EOPNOTSUPP if STORE's class can't do it.  */
+error_t store_discard (struct store *store, store_offset_t addr, size_t len);
+
 /* If STORE was created using store_create, remove the reference to the
    source from which it was created.  */
 void store_close_source (struct store *store);
@@ -499,6 +524,37 @@ error_t store_bunzip2_open (const char *name, int flags,
 			    const struct store_class *const *classes,
 			    struct store **store);
 
+/* Return a new store in STORE which contains the uncompressed contents of
+   the block-compressed image in FROM; FROM is consumed.  Only the blocks
+   that are read are decompressed.  */
+error_t store_zblock_create (struct store *from, int flags,
+			     struct store **store);
+
+/* Open the block-compressed store NAME -- which consists of another
+   store-class name, a ':', and a name for that store class to open -- and
+   return the corresponding store in STORE.  CLASSES is as if passed to
+   store_find_class, which see.  */
+error_t store_zblock_open (const char *name, int flags,
+			   const struct store_class *const *classes,
+			   struct store **store);
+
+/* Return a new store in STORE that reads from BASE, except for the chunks
+   that have been written to, which are copied to DELTA first, or to memory
+   if DELTA is 0.  BASE is never written to.  DELTA must hold a delta
+   made by an earlier cow store over BASE, or start with a chunk of zeros
+   to get a new one; otherwise EINVAL is returned.  BASE and DELTA are
+   consumed.  */
+error_t store_cow_create (struct store *base, struct store *delta, int flags,
+			  struct store **store);
+
+/* Open the copy-on-write store NAME, which is a list of one or two store
+   names as parsed by store_open_children: the base, and optionally a store
+   to keep the changes in.  CLASSES is as if passed to store_find_class,
+   which see.  */
+error_t store_cow_open (const char *name, int flags,
+			const struct store_class *const *classes,
+			struct store **store);
+
 /* Return a new store in STORE that multiplexes multiple physical volumes
    from PHYS as one larger virtual volume.  SWAP_VOLS is a function that will
    be called whenever the volume currently active isn't correct.  PHYS is
@@ -623,8 +679,10 @@ extern const struct store_class store_concat_class;
 extern const struct store_class store_remap_class;
 extern const struct store_class store_query_class;
 extern const struct store_class store_copy_class;
+extern const struct store_class store_cow_class;
 extern const struct store_class store_gunzip_class;
 extern const struct store_class store_bunzip2_class;
+extern const struct store_class store_zblock_class;
 extern const struct store_class store_typed_open_class;
 extern const struct store_class store_url_open_class;
 extern const struct store_class store_module_open_class;
@@ -0,0 +1,585 @@
+/* Block-compressed store backend
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111, USA. */
+
+/* Unlike the gunzip and bunzip2 stores, which decompress their whole
+   source into memory when opened, this one works on an image made of
+   independently compressed blocks, and only decompresses the blocks that
+   are actually read, keeping the most recently used ones around.
+
+   The image starts with a struct zblock_header, all of whose fields are
+   in network byte order.  At INDEX_OFFSET there are NUM_BLOCKS + 1 64-bit
+   byte offsets (also in network order), where NUM_BLOCKS is SIZE divided
+   by BLOCK_SIZE, rounded up; block N of the uncompressed data is stored
+   in the bytes from offset N up to offset N + 1.  A block is stored as a
+   zlib stream, unless it takes up as many bytes as it would uncompressed,
+   in which case it is stored as is.  The mkzblock utility makes such
+   images.
+
+   Unless the store is opened read-only, blocks written to are kept in
+   memory on top of the image, which is never modified.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include "store.h"
+
+#define ZBLOCK_MAGIC		"HURDZBLK"
+#define ZBLOCK_VERSION		1
+
+/* How many decompressed blocks are cached.  */
+#define ZBLOCK_CACHE_BLOCKS	32
+
+struct zblock_header
+{
+  char magic[8];		/* ZBLOCK_MAGIC */
+  uint32_t version;		/* ZBLOCK_VERSION */
+  uint32_t block_size;		/* Uncompressed size of a block.  */
+  uint64_t size;		/* Uncompressed size of the image.  */
+  uint64_t index_offset;	/* Where the block index starts.  */
+};
+
+/* A decompressed block in the cache.  */
+struct zblock_buf
+{
+  size_t block;			/* Which block, or -1 if none.  */
+  char *data;
+  struct zblock_buf *next, *prev; /* LRU list, most recent first.  */
+};
+
+/* The state of a zblock store, in its hook.  The image itself is the
+   store's only child.  */
+struct zblock
+{
+  uint64_t size;		/* Uncompressed size.  */
+  size_t block_size;
+  size_t num_blocks;
+  uint64_t *index;		/* NUM_BLOCKS + 1 offsets, in host order.  */
+
+  pthread_mutex_t lock;		/* Protects the fields below.  */
+  unsigned refs;		/* Stores sharing this, through clones.  */
+  struct zblock_buf bufs[ZBLOCK_CACHE_BLOCKS];
+  struct zblock_buf *mru, *lru;
+  char **overlay;		/* Blocks that have been written to.  */
+  char *cbuf;			/* Space to read compressed blocks into.  */
+  size_t cbuf_size;
+};
+
+/* Read the bytes from OFFS to END of SOURCE into Z->cbuf, and return
+   where they start in *DATA.  SOURCE is read whole blocks at a time, so
+   the data may not be at the start of CBUF.  */
+static error_t
+zblock_read_source (struct zblock *z, struct store *source,
+		    uint64_t offs, uint64_t end, char **data)
+{
+  size_t mask = source->block_size - 1;
+  uint64_t start = offs & ~(uint64_t) mask;
+  size_t amount = ((end + mask) & ~(uint64_t) mask) - start;
+  void *buf;
+  size_t len;
+  error_t err;
+
+  if (amount > z->cbuf_size)
+    {
+      char *new = realloc (z->cbuf, amount);
+      if (! new)
+	return ENOMEM;
+      z->cbuf = new;
+      z->cbuf_size = amount;
+    }
+
+  buf = z->cbuf;
+  len = z->cbuf_size;
+  err = store_read (source, start >> source->log2_block_size, amount,
+		    &buf, &len);
+  if (err)
+    return err;
+  if (buf != z->cbuf)
+    {
+      memcpy (z->cbuf, buf, len < amount ? len : amount);
+      munmap (buf, len);
+    }
+  if (len < end - start)
+    return EIO;
+
+  *data = z->cbuf + (offs - start);
+  return 0;
+}
+
+/* Decompress block BLOCK of Z, whose uncompressed length is LEN, from
+   SOURCE into DATA.  Z must be locked.  */
+static error_t
+zblock_inflate (struct zblock *z, struct store *source,
+		size_t block, size_t len, char *data)
+{
+  uint64_t offs = z->index[block], end = z->index[block + 1];
+  char *cdata;
+  uLongf out_len = len;
+  error_t err;
+
+  err = zblock_read_source (z, source, offs, end, &cdata);
+  if (err)
+    return err;
+
+  if (end - offs == len)
+    /* Stored as is.  */
+    memcpy (data, cdata, len);
+  else if (uncompress ((Bytef *) data, &out_len,
+		       (const Bytef *) cdata, end - offs) != Z_OK
+	   || out_len != len)
+    return EIO;
+
+  return 0;
+}
+
+/* Return in *DATA the contents of block BLOCK of Z, whose uncompressed
+   length is LEN, from the overlay, the cache, or by decompressing it from
+   SOURCE into the least recently used cache buffer.  Z must be locked, and
+   *DATA is only valid until it is unlocked.  */
+static error_t
+zblock_get (struct zblock *z, struct store *source,
+	    size_t block, size_t len, char **data)
+{
+  struct zblock_buf *b;
+  error_t err;
+
+  if (z->overlay && z->overlay[block])
+    {
+      *data = z->overlay[block];
+      return 0;
+    }
+
+  for (b = z->mru; b; b = b->next)
+    if (b->block == block)
+      break;
+
+  if (! b)
+    {
+      b = z->lru;
+      if (! b->data)
+	{
+	  b->data = malloc (z->block_size);
+	  if (! b->data)
+	    return ENOMEM;
+	}
+      b->block = -1;
+      err = zblock_inflate (z, source, block, len, b->data);
+      if (err)
+	return err;
+      b->block = block;
+    }
+
+  /* Move B to the front of the LRU list.  */
+  if (b != z->mru)
+    {
+      b->prev->next = b->next;
+      if (b->next)
+	b->next->prev = b->prev;
+      else
+	z->lru = b->prev;
+      b->prev = 0;
+      b->next = z->mru;
+      z->mru->prev = b;
+      z->mru = b;
+    }
+
+  *data = b->data;
+  return 0;
+}
+
+/* Copy between the caller's buffer BUF and the LEN bytes of STORE at byte
+   offset OFFS, a block at a time, in the direction given by WRITING.  */
+static error_t
+zblock_rw (struct store *store, store_offset_t offs, char *buf, size_t len,
+	   int writing)
+{
+  struct zblock *z = store->hook;
+  struct store *source = store->children[0];
+  error_t err = 0;
+
+  pthread_mutex_lock (&z->lock);
+
+  while (len > 0 && ! err)
+    {
+      size_t block = offs / z->block_size;
+      size_t in_block = offs % z->block_size;
+      size_t block_len = z->block_size;
+      size_t n;
+      char *data;
+
+      if ((block + 1) * z->block_size > z->size)
+	block_len = z->size - block * z->block_size;
+      n = block_len - in_block;
+      if (n > len)
+	n = len;
+
+      if (! writing)
+	{
+	  err = zblock_get (z, source, block, block_len, &data);
+	  if (! err)
+	    memcpy (buf, data + in_block, n);
+	}
+      else
+	{
+	  if (! z->overlay)
+	    {
+	      z->overlay = calloc (z->num_blocks, sizeof *z->overlay);
+	      if (! z->overlay)
+		err = ENOMEM;
+	    }
+	  if (! err && ! z->overlay[block])
+	    {
+	      char *copy = malloc (z->block_size);
+	      if (! copy)
+		err = ENOMEM;
+	      else if (n < block_len)
+		/* Only part of the block is being written; start with what
+		   it holds now.  */
+		{
+		  err = zblock_get (z, source, block, block_len, &data);
+		  if (! err)
+		    memcpy (copy, data, block_len);
+		}
+	      if (! err)
+		z->overlay[block] = copy;
+	      else
+		free (copy);
+	    }
+	  if (! err)
+	    memcpy (z->overlay[block] + in_block, buf, n);
+	}
+
+      offs += n;
+      buf += n;
+      len -= n;
+    }
+
+  pthread_mutex_unlock (&z->lock);
+  return err;
+}
+
+static error_t
+zblock_read (struct store *store,
+	     store_offset_t addr, size_t index, size_t amount,
+	     void **buf, size_t *len)
+{
+  error_t err;
+  char *data = *buf;
+
+  if (*len < amount)
+    {
+      data = mmap (0, amount, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+      if (data == MAP_FAILED)
+	return errno;
+    }
+
+  err = zblock_rw (store, addr << store->log2_block_size, data, amount, 0);
+  if (err)
+    {
+      if (data != *buf)
+	munmap (data, amount);
+      return err;
+    }
+
+  *buf = data;
+  *len = amount;
+  return 0;
+}
+
+static error_t
+zblock_write (struct store *store,
+	      store_offset_t addr, size_t index, const void *buf, size_t len,
+	      size_t *amount)
+{
+  error_t err = zblock_rw (store, addr << store->log2_block_size,
+			   (char *) buf, len, 1);
+  *amount = err ? 0 : len;
+  return err;
+}
+
+static error_t
+zblock_set_size (struct store *store, size_t newsize)
+{
+  return EOPNOTSUPP;
+}
+
+/* Nothing written to a zblock store goes anywhere but memory.  */
+static error_t
+zblock_sync (struct store *store)
+{
+  return 0;
+}
+
+static error_t
+zblock_open (const char *name, int flags,
+	     const struct store_class *const *classes,
+	     struct store **store)
+{
+  return store_zblock_open (name, flags, classes, store);
+}
+
+static error_t
+zblock_set_flags (struct store *store, int flags)
+{
+  if ((flags & ~STORE_INACTIVE) != 0)
+    /* Trying to set flags we don't support.  */
+    return EINVAL;
+  store->flags |= flags;
+  return 0;
+}
+
+static error_t
+zblock_clear_flags (struct store *store, int flags)
+{
+  if ((flags & ~STORE_INACTIVE) != 0)
+    return EINVAL;
+  store->flags &= ~flags;
+  return 0;
+}
+
+static void
+zblock_free (struct zblock *z)
+{
+  size_t i;
+
+  for (i = 0; i < ZBLOCK_CACHE_BLOCKS; i++)
+    free (z->bufs[i].data);
+  if (z->overlay)
+    {
+      for (i = 0; i < z->num_blocks; i++)
+	free (z->overlay[i]);
+      free (z->overlay);
+    }
+  free (z->cbuf);
+  free (z->index);
+  pthread_mutex_destroy (&z->lock);
+  free (z);
+}
+
+static void
+zblock_cleanup (struct store *store)
+{
+  struct zblock *z = store->hook;
+  int last;
+
+  if (! z)
+    return;
+
+  pthread_mutex_lock (&z->lock);
+  last = --z->refs == 0;
+  pthread_mutex_unlock (&z->lock);
+
+  if (last)
+    zblock_free (z);
+  store->hook = 0;
+}
+
+/* Clones share the cache and what has been written, just as clones of a
+   device store see the same device.  Each has its own clone of the image
+   as its child, and reads through that.  */
+static error_t
+zblock_clone (const struct store *from, struct store *to)
+{
+  struct zblock *z = from->hook;
+
+  pthread_mutex_lock (&z->lock);
+  z->refs++;
+  pthread_mutex_unlock (&z->lock);
+  to->hook = z;
+
+  return 0;
+}
+
+const struct store_class
+store_zblock_class =
+{
+  STORAGE_OTHER, "zblock",
+  read: zblock_read,
+  write: zblock_write,
+  set_size: zblock_set_size,
+  set_flags: zblock_set_flags,
+  clear_flags: zblock_clear_flags,
+  cleanup: zblock_cleanup,
+  clone: zblock_clone,
+  open: zblock_open,
+  sync: zblock_sync,
+};
+STORE_STD_CLASS (zblock);
+
+/* Read and check the header and index of the image in SOURCE, and return
+   the state of a store on top of it in *Z.  */
+static error_t
+zblock_load (struct store *source, struct zblock **z)
+{
+  struct zblock_header hdr;
+  struct zblock *new;
+  uint64_t size, index_offset, index_len;
+  size_t block_size, num_blocks, i;
+  char *index_data;
+  void *buf = &hdr;
+  size_t len = sizeof hdr;
+  size_t header_amount = (sizeof hdr + source->block_size - 1)
+			 & ~(source->block_size - 1);
+  error_t err;
+
+  err = store_read (source, 0, header_amount, &buf, &len);
+  if (err)
+    return err;
+  if (buf != &hdr)
+    {
+      memcpy (&hdr, buf, len < sizeof hdr ? len : sizeof hdr);
+      munmap (buf, len);
+    }
+  if (len < sizeof hdr)
+    return EINVAL;
+
+  block_size = be32toh (hdr.block_size);
+  size = be64toh (hdr.size);
+  index_offset = be64toh (hdr.index_offset);
+  if (memcmp (hdr.magic, ZBLOCK_MAGIC, sizeof hdr.magic) != 0
+      || be32toh (hdr.version) != ZBLOCK_VERSION
+      || block_size == 0 || (block_size & (block_size - 1)) != 0
+      || size == 0)
+    return EINVAL;
+
+  num_blocks = (size + block_size - 1) / block_size;
+  index_len = (num_blocks + 1) * sizeof (uint64_t);
+  if (index_offset + index_len > source->size)
+    return EINVAL;
+
+  new = calloc (1, sizeof *new);
+  if (! new)
+    return ENOMEM;
+  new->size = size;
+  new->block_size = block_size;
+  new->num_blocks = num_blocks;
+  new->refs = 1;
+  pthread_mutex_init (&new->lock, 0);
+
+  err = zblock_read_source (new, source, index_offset, index_offset + index_len,
+			    &index_data);
+  if (! err)
+    {
+      new->index = malloc (index_len);
+      if (! new->index)
+	err = ENOMEM;
+    }
+  if (! err)
+    for (i = 0; i <= num_blocks; i++)
+      {
+	uint64_t offs;
+	memcpy (&offs, index_data + i * sizeof offs, sizeof offs);
+	new->index[i] = be64toh (offs);
+	if (i > 0
+	    && (new->index[i] < new->index[i - 1]
+		|| new->index[i] - new->index[i - 1] > block_size
+		|| new->index[i] > source->size))
+	  err = EINVAL;
+      }
+  if (err)
+    {
+      zblock_free (new);
+      return err;
+    }
+
+  for (i = 0; i < ZBLOCK_CACHE_BLOCKS; i++)
+    {
+      new->bufs[i].block = -1;
+      new->bufs[i].prev = i > 0 ? &new->bufs[i - 1] : 0;
+      new->bufs[i].next = i + 1 < ZBLOCK_CACHE_BLOCKS ? &new->bufs[i + 1] : 0;
+    }
+  new->mru = &new->bufs[0];
+  new->lru = &new->bufs[ZBLOCK_CACHE_BLOCKS - 1];
+
+  *z = new;
+  return 0;
+}
+
+/* Return a new store in STORE which contains the uncompressed contents of
+   the block-compressed image in FROM, which is consumed on success.  */
+error_t
+store_zblock_create (struct store *from, int flags, struct store **store)
+{
+  struct zblock *z;
+  struct store_run run;
+  error_t err;
+
+  err = zblock_load (from, &z);
+  if (err)
+    return err;
+
+  run.start = 0;
+  run.length = z->size;
+
+  err = _store_create (&store_zblock_class, MACH_PORT_NULL,
+		       flags, 1, &run, 1, 0, store);
+  if (err)
+    {
+      zblock_free (z);
+      return err;
+    }
+  (*store)->hook = z;
+
+  if (from->name)
+    {
+      size_t len =
+	strlen (from->class->name) + 1 + strlen (from->name) + 1;
+      (*store)->name = malloc (len);
+      if ((*store)->name)
+	snprintf ((*store)->name, len,
+		  "%s:%s", from->class->name, from->name);
+    }
+  else
+    (*store)->name = strdup (from->class->name);
+
+  err = (*store)->name ? store_set_children (*store, &from, 1) : ENOMEM;
+  if (err)
+    store_free (*store);
+
+  return err;
+}
+
+/* Open the block-compressed store NAME -- which consists of another
+   store-class name, a ':', and a name for that store class to open -- and
+   return the corresponding store in STORE.  CLASSES is used to select
+   classes specified by the type name; if it is 0, STORE_STD_CLASSES is
+   used.  */
+error_t
+store_zblock_open (const char *name, int flags,
+		   const struct store_class *const *classes,
+		   struct store **store)
+{
+  struct store *from;
+  error_t err =
+    store_typed_open (name, flags | STORE_HARD_READONLY, classes, &from);
+
+  if (! err)
+    {
+      err = store_zblock_create (from, flags, store);
+      if (err)
+	store_free (from);
+    }
+
+  return err;
+}
@@ -25,6 +25,7 @@
 
 #define MOUNTPROG 100005
 #define MOUNTVERS 1
+#define MOUNTVERS3 3		/* RFC 1813 */
 
 /* Obnoxious arbitrary limits */
 #define MOUNT_MNTPATHLEN 1024
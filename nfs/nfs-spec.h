@@ -92,6 +92,12 @@ enum stable_how {
   FILE_SYNC = 2,
 };
 
+/* PROPERTIES result of NFS3PROC_FSINFO */
+#define FSF3_LINK        0x0001
+#define FSF3_SYMLINK     0x0002
+#define FSF3_HOMOGENEOUS 0x0008
+#define FSF3_CANSETTIME  0x0010
+
 /* MODE arg to NFS3PROC_CREATE */
 enum createmode 
 {
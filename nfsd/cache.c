@@ -41,6 +41,9 @@
 #define IDHASH_TABLE_SIZE 1024
 #define FHHASH_TABLE_SIZE 1024
 #define REPLYHASH_TABLE_SIZE 1024
+#define FHHASH_STRIPES 64
+#define REPLYHASH_STRIPES 64
+#define MAX_FREE_REPLY_BUFFERS 64
 
 
 static struct idspec *idhashtable[IDHASH_TABLE_SIZE];
@@ -253,61 +256,77 @@ scan_creds ()
 
 
 static struct cache_handle *fhhashtable[FHHASH_TABLE_SIZE];
-pthread_mutex_t fhhashlock = PTHREAD_MUTEX_INITIALIZER;
-static int nfreefh;
-static int leastfhlastuse;
+
+/* The file handle and reply tables are striped: bucket N is protected
+   by the lock of stripe N % *_STRIPES, which also keeps the count of
+   unreferenced entries in its buckets for the benefit of the
+   scanners.  */
+struct fh_stripe
+{
+  pthread_mutex_t lock;
+  int nfree;
+  int leastlastuse;
+};
+
+static struct fh_stripe fhstripes[FHHASH_STRIPES];
 
 static int
 fh_hash (char *fhandle, struct idspec *i)
 {
-  int hash = 0, n;
+  unsigned int hash = 0;
+  int n;
 
   for (n = 0; n < NFS2_FHSIZE; n++)
-    hash += fhandle[n];
-  hash += (intptr_t) i >> 6;
+    hash = hash * 31 + (unsigned char) fhandle[n];
+  hash += (uintptr_t) i >> 6;
   return hash % FHHASH_TABLE_SIZE;
 }
 
-int *
-lookup_cache_handle (int *p, struct cache_handle **cp, struct idspec *i)
+/* Look up FHANDLE for I in bucket HASH, whose stripe must be locked,
+   and return it with a new reference, or return null.  */
+static struct cache_handle *
+fh_find (int hash, char *fhandle, struct idspec *i)
 {
-  int hash;
+  struct fh_stripe *s = &fhstripes[hash % FHHASH_STRIPES];
   struct cache_handle *c;
-  fsys_t fsys;
-  file_t port;
 
-  hash = fh_hash ((char *)p, i);
-  pthread_mutex_lock (&fhhashlock);
   for (c = fhhashtable[hash]; c; c = c->next)
-    if (c->ids == i && ! bcmp (c->handle.array, p, NFS2_FHSIZE))
+    if (c->ids == i && ! bcmp (c->handle.array, fhandle, NFS2_FHSIZE))
       {
 	if (c->references == 0)
-	  nfreefh--;
+	  s->nfree--;
 	c->references++;
-	pthread_mutex_unlock (&fhhashlock);
-	*cp = c;
-	return p + NFS2_FHSIZE / sizeof (int);
+	return c;
       }
+  return 0;
+}
 
-  /* Not found.  */
+/* Enter a new handle for FHANDLE, I and PORT in bucket HASH and return
+   it with one reference.  If another thread entered the same handle
+   while we were talking to the filesystem, use that one instead and
+   drop PORT.  */
+static struct cache_handle *
+fh_enter (int hash, char *fhandle, struct idspec *i, file_t port)
+{
+  struct fh_stripe *s = &fhstripes[hash % FHHASH_STRIPES];
+  struct cache_handle *c;
 
-  /* First four bytes are our internal table of filesystems.  */
-  fsys = lookup_filesystem (*p);
-  if (fsys == MACH_PORT_NULL
-      || fsys_getfile (fsys, i->uids, i->nuids, i->gids, i->ngids,
-		       (char *)(p + 1), NFS2_FHSIZE - sizeof (int), &port))
+  pthread_mutex_lock (&s->lock);
+  c = fh_find (hash, fhandle, i);
+  if (c)
     {
-      pthread_mutex_unlock (&fhhashlock);
-      *cp = 0;
-      return p + NFS2_FHSIZE / sizeof (int);
+      pthread_mutex_unlock (&s->lock);
+      mach_port_deallocate (mach_task_self (), port);
+      return c;
     }
 
   c = malloc (sizeof (struct cache_handle));
-  memcpy (c->handle.array, p, NFS2_FHSIZE);
+  memcpy (c->handle.array, fhandle, NFS2_FHSIZE);
   cred_ref (i);
   c->ids = i;
   c->port = port;
   c->references = 1;
+  c->unstable = 0;
 
   c->next = fhhashtable[hash];
   if (c->next)
@@ -315,67 +334,144 @@ lookup_cache_handle (int *p, struct cache_handle **cp, struct idspec *i)
   c->prevp = &fhhashtable[hash];
   fhhashtable[hash] = c;
 
-  pthread_mutex_unlock (&fhhashlock);
-  *cp = c;
+  pthread_mutex_unlock (&s->lock);
+  return c;
+}
+
+/* Decode the file handle at P, which is in the format of protocol
+   VERSION, and return the cached handle for it and I in *CP, or null
+   if it is stale.  Return the next thing to come after the handle.  */
+int *
+lookup_cache_handle (int *p, struct cache_handle **cp, struct idspec *i,
+		     int version)
+{
+  int hash;
+  struct fh_stripe *s;
+  struct cache_handle *c;
+  fsys_t fsys;
+  file_t port;
+
+  if (version == 3)
+    {
+      /* NFSv3 handles are variable length, but we only ever hand out
+	 ones of NFS2_FHSIZE bytes.  */
+      int len = ntohl (*p);
+      p++;
+      if (len != NFS2_FHSIZE)
+	{
+	  *cp = 0;
+	  return p + INTSIZE (len);
+	}
+    }
+
+  hash = fh_hash ((char *)p, i);
+  s = &fhstripes[hash % FHHASH_STRIPES];
+  pthread_mutex_lock (&s->lock);
+  c = fh_find (hash, (char *) p, i);
+  pthread_mutex_unlock (&s->lock);
+  if (c)
+    {
+      *cp = c;
+      return p + NFS2_FHSIZE / sizeof (int);
+    }
+
+  /* Not found.  Ask the filesystem without holding the stripe lock, so
+     that a slow filesystem doesn't stall lookups of unrelated
+     handles.  */
+
+  /* First four bytes are our internal table of filesystems.  */
+  fsys = lookup_filesystem (*p);
+  if (fsys == MACH_PORT_NULL
+      || fsys_getfile (fsys, i->uids, i->nuids, i->gids, i->ngids,
+		       (char *)(p + 1), NFS2_FHSIZE - sizeof (int), &port))
+    {
+      *cp = 0;
+      return p + NFS2_FHSIZE / sizeof (int);
+    }
+
+  *cp = fh_enter (hash, (char *) p, i, port);
   return p + NFS2_FHSIZE / sizeof (int);
 }
 
 void
 cache_handle_rele (struct cache_handle *c)
 {
-  pthread_mutex_lock (&fhhashlock);
+  struct fh_stripe *s;
+
+  s = &fhstripes[fh_hash (c->handle.array, c->ids) % FHHASH_STRIPES];
+  pthread_mutex_lock (&s->lock);
   c->references--;
   if (c->references == 0)
     {
       c->lastuse = mapped_time->seconds;
-      if (c->lastuse < leastfhlastuse || nfreefh == 0)
-	leastfhlastuse = c->lastuse;
-      nfreefh++;
+      if (c->lastuse < s->leastlastuse || s->nfree == 0)
+	s->leastlastuse = c->lastuse;
+      s->nfree++;
     }
-  pthread_mutex_unlock (&fhhashlock);
+  pthread_mutex_unlock (&s->lock);
 }
 
 void
 scan_fhs ()
 {
-  int n;
-  int newleast = mapped_time->seconds;
-
-  pthread_mutex_lock (&fhhashlock);
+  int n, stripe;
 
-  if (mapped_time->seconds - leastfhlastuse > FH_KEEP_TIMEOUT)
+  for (stripe = 0; stripe < FHHASH_STRIPES; stripe++)
     {
-      for (n = 0; n < FHHASH_TABLE_SIZE && nfreefh; n++)
-	{
-	  struct cache_handle *c = fhhashtable[n];
+      struct fh_stripe *s = &fhstripes[stripe];
+      struct cache_handle *doomed = NULL;
+      int newleast = mapped_time->seconds;
+
+      pthread_mutex_lock (&s->lock);
 
-	  while (c && nfreefh)
+      if (mapped_time->seconds - s->leastlastuse > FH_KEEP_TIMEOUT)
+	{
+	  for (n = stripe; n < FHHASH_TABLE_SIZE && s->nfree;
+	       n += FHHASH_STRIPES)
 	    {
-	      struct cache_handle *next_c = c->next;
+	      struct cache_handle *c = fhhashtable[n];
 
-	      if (!c->references
-		  && mapped_time->seconds - c->lastuse > FH_KEEP_TIMEOUT)
+	      while (c && s->nfree)
 		{
-		  nfreefh--;
-		  *c->prevp = c->next;
-		  if (c->next)
-		    c->next->prevp = c->prevp;
-		  cred_rele (c->ids);
-		  mach_port_deallocate (mach_task_self (), c->port);
-		  free (c);
+		  struct cache_handle *next_c = c->next;
+
+		  if (!c->references
+		      && mapped_time->seconds - c->lastuse > FH_KEEP_TIMEOUT)
+		    {
+		      s->nfree--;
+		      *c->prevp = c->next;
+		      if (c->next)
+			c->next->prevp = c->prevp;
+		      /* Free it once the lock is dropped.  */
+		      c->next = doomed;
+		      doomed = c;
+		    }
+		  else if (!c->references && newleast > c->lastuse)
+		    newleast = c->lastuse;
+
+		  c = next_c;
 		}
-	      else if (!c->references && newleast > c->lastuse)
-		newleast = c->lastuse;
-
-	      c = next_c;
 	    }
+
+	  /* If we didn't bail early, then this is valid.  */
+	  if (s->nfree)
+	    s->leastlastuse = newleast;
 	}
+      pthread_mutex_unlock (&s->lock);
 
-      /* If we didn't bail early, then this is valid.  */
-      if (nfreefh)
-	leastfhlastuse = newleast;
+      while (doomed)
+	{
+	  struct cache_handle *c = doomed;
+
+	  doomed = c->next;
+	  if (__atomic_load_n (&c->unstable, __ATOMIC_RELAXED))
+	    /* Start writing out data that was never committed.  */
+	    file_sync (c->port, 0, 0);
+	  cred_rele (c->ids);
+	  mach_port_deallocate (mach_task_self (), c->port);
+	  free (c);
+	}
     }
-  pthread_mutex_unlock (&fhhashlock);
 }
 
 struct cache_handle *
@@ -383,6 +479,7 @@ create_cached_handle (int fs, struct cache_handle *credc, file_t userport)
 {
   union cache_handle_array fhandle;
   error_t err;
+  struct fh_stripe *s;
   struct cache_handle *c;
   int hash;
   char *bp = fhandle.array + sizeof (int);
@@ -416,20 +513,14 @@ create_cached_handle (int fs, struct cache_handle *credc, file_t userport)
       munmap (bp, handlelen);
     }
 
-  /* Cache it.  */
+  /* Check the cache first.  */
   hash = fh_hash (fhandle.array, credc->ids);
-  pthread_mutex_lock (&fhhashlock);
-  for (c = fhhashtable[hash]; c; c = c->next)
-    if (c->ids == credc->ids &&
-        ! bcmp (fhandle.array, c->handle.array, NFS2_FHSIZE))
-      {
-	/* Return this one.  */
-	if (c->references == 0)
-	  nfreefh--;
-	c->references++;
-	pthread_mutex_unlock (&fhhashlock);
-	return c;
-      }
+  s = &fhstripes[hash % FHHASH_STRIPES];
+  pthread_mutex_lock (&s->lock);
+  c = fh_find (hash, fhandle.array, credc->ids);
+  pthread_mutex_unlock (&s->lock);
+  if (c)
+    return c;
 
   /* Always call fsys_getfile so that we don't depend on the
      particular open modes of the port passed in.  */
@@ -440,36 +531,81 @@ create_cached_handle (int fs, struct cache_handle *credc, file_t userport)
 		      fhandle.array + sizeof (int), NFS2_FHSIZE - sizeof (int),
 		      &newport);
   if (err)
-    {
-      pthread_mutex_unlock (&fhhashlock);
-      return 0;
-    }
-
-  /* Create it anew.  */
-  c = malloc (sizeof (struct cache_handle));
-  memcpy (c->handle.array, fhandle.array, NFS2_FHSIZE);
-  cred_ref (credc->ids);
-  c->ids = credc->ids;
-  c->port = newport;
-  c->references = 1;
+    return 0;
 
   /* And add it to the hash table.  */
-  c->next = fhhashtable[hash];
-  if (c->next)
-    c->next->prevp = &c->next;
-  c->prevp = &fhhashtable[hash];
-  fhhashtable[hash] = c;
-  pthread_mutex_unlock (&fhhashlock);
-
-  return c;
+  return fh_enter (hash, fhandle.array, credc->ids, newport);
 }
 
 
 
 static struct cached_reply *replyhashtable [REPLYHASH_TABLE_SIZE];
-static pthread_spinlock_t replycachelock = PTHREAD_SPINLOCK_INITIALIZER;
-static int nfreereplies;
-static int leastreplylastuse;
+
+struct reply_stripe
+{
+  pthread_spinlock_t lock;
+  int nfree;
+  int leastlastuse;
+};
+
+static struct reply_stripe replystripes[REPLYHASH_STRIPES];
+
+/* Reply buffers of MAXIOSIZE bytes that are not in use, chained
+   through their first word.  */
+static void *free_reply_buffers;
+static int nfree_reply_buffers;
+static pthread_spinlock_t reply_buffer_lock = PTHREAD_SPINLOCK_INITIALIZER;
+
+/* Return a buffer of at least SIZE bytes for building a reply in.  */
+char *
+alloc_reply_buffer (size_t size)
+{
+  void *buf = 0;
+
+  if (size > MAXIOSIZE)
+    return malloc (size);
+
+  pthread_spin_lock (&reply_buffer_lock);
+  if (free_reply_buffers)
+    {
+      buf = free_reply_buffers;
+      free_reply_buffers = *(void **) buf;
+      nfree_reply_buffers--;
+    }
+  pthread_spin_unlock (&reply_buffer_lock);
+
+  return buf ?: malloc (MAXIOSIZE);
+}
+
+/* BUF, of SIZE bytes, was returned by alloc_reply_buffer and is no
+   longer in use.  */
+void
+free_reply_buffer (char *buf, size_t size)
+{
+  if (size <= MAXIOSIZE)
+    {
+      pthread_spin_lock (&reply_buffer_lock);
+      if (nfree_reply_buffers < MAX_FREE_REPLY_BUFFERS)
+	{
+	  *(void **) buf = free_reply_buffers;
+	  free_reply_buffers = buf;
+	  nfree_reply_buffers++;
+	  buf = 0;
+	}
+      pthread_spin_unlock (&reply_buffer_lock);
+    }
+  free (buf);
+}
+
+static int
+reply_hash (int xid, struct sockaddr_in *sender)
+{
+  unsigned int hash;
+
+  hash = ((unsigned int) xid ^ sender->sin_addr.s_addr
+	  ^ ((unsigned int) sender->sin_port << 16)) * 2654435761U;
+  return (hash >> 16) % REPLYHASH_TABLE_SIZE;
+}
 
 /* Check the list of cached replies to see if this is a replay of a
    previous transaction; if so, return the cache record.  Otherwise,
@@ -479,19 +615,21 @@ check_cached_replies (int xid,
 		      struct sockaddr_in *sender)
 {
   struct cached_reply *cr;
+  struct reply_stripe *s;
   int hash;
 
-  hash = abs(xid % REPLYHASH_TABLE_SIZE);
+  hash = reply_hash (xid, sender);
+  s = &replystripes[hash % REPLYHASH_STRIPES];
 
-  pthread_spin_lock (&replycachelock);
+  pthread_spin_lock (&s->lock);
   for (cr = replyhashtable[hash]; cr; cr = cr->next)
     if (cr->xid == xid
 	&& !bcmp (sender, &cr->source, sizeof (struct sockaddr_in)))
       {
 	cr->references++;
 	if (cr->references == 1)
-	  nfreereplies--;
-	pthread_spin_unlock (&replycachelock);
+	  s->nfree--;
+	pthread_spin_unlock (&s->lock);
 	pthread_mutex_lock (&cr->lock);
 	return cr;
       }
@@ -502,6 +640,8 @@ check_cached_replies (int xid,
   memcpy (&cr->source, sender, sizeof (struct sockaddr_in));
   cr->xid = xid;
   cr->data = 0;
+  cr->ool = 0;
+  cr->ool_len = 0;
   cr->references = 1;
 
   cr->next = replyhashtable[hash];
@@ -510,7 +650,7 @@ check_cached_replies (int xid,
   cr->prevp = &replyhashtable[hash];
   replyhashtable[hash] = cr;
 
-  pthread_spin_unlock (&replycachelock);
+  pthread_spin_unlock (&s->lock);
   return cr;
 }
 
@@ -519,58 +659,81 @@ check_cached_replies (int xid,
 void
 release_cached_reply (struct cached_reply *cr)
 {
+  struct reply_stripe *s;
+
+  s = &replystripes[reply_hash (cr->xid, &cr->source) % REPLYHASH_STRIPES];
   pthread_mutex_unlock (&cr->lock);
-  pthread_spin_lock (&replycachelock);
+  pthread_spin_lock (&s->lock);
   cr->references--;
   if (cr->references == 0)
     {
       cr->lastuse = mapped_time->seconds;
-      if (cr->lastuse < leastreplylastuse || nfreereplies == 0)
-	leastreplylastuse = cr->lastuse;
-      nfreereplies++;
+      if (cr->lastuse < s->leastlastuse || s->nfree == 0)
+	s->leastlastuse = cr->lastuse;
+      s->nfree++;
     }
-  pthread_spin_unlock (&replycachelock);
+  pthread_spin_unlock (&s->lock);
 }
 
 void
 scan_replies ()
 {
-  int n;
-  int newleast = mapped_time->seconds;
-
-  pthread_spin_lock (&replycachelock);
+  int n, stripe;
 
-  if (mapped_time->seconds - leastreplylastuse > REPLY_KEEP_TIMEOUT)
+  for (stripe = 0; stripe < REPLYHASH_STRIPES; stripe++)
     {
-      for (n = 0; n < REPLYHASH_TABLE_SIZE && nfreereplies; n++)
-	{
-	  struct cached_reply *cr = replyhashtable[n];
+      struct reply_stripe *s = &replystripes[stripe];
+      int newleast = mapped_time->seconds;
+
+      pthread_spin_lock (&s->lock);
 
-	  while (cr && nfreereplies)
+      if (mapped_time->seconds - s->leastlastuse > REPLY_KEEP_TIMEOUT)
+	{
+	  for (n = stripe; n < REPLYHASH_TABLE_SIZE && s->nfree;
+	       n += REPLYHASH_STRIPES)
 	    {
-	      struct cached_reply *next_cr = cr->next;
+	      struct cached_reply *cr = replyhashtable[n];
 
-	      if (!cr->references
-		  && mapped_time->seconds - cr->lastuse > REPLY_KEEP_TIMEOUT)
+	      while (cr && s->nfree)
 		{
-		  nfreereplies--;
-		  *cr->prevp = cr->next;
-		  if (cr->next)
-		    cr->next->prevp = cr->prevp;
-		  if (cr->data)
-		    free (cr->data);
-		  free (cr);
+		  struct cached_reply *next_cr = cr->next;
+
+		  if (!cr->references
+		      && mapped_time->seconds - cr->lastuse > REPLY_KEEP_TIMEOUT)
+		    {
+		      s->nfree--;
+		      *cr->prevp = cr->next;
+		      if (cr->next)
+			cr->next->prevp = cr->prevp;
+		      if (cr->data)
+			free_reply_buffer (cr->data, cr->size);
+		      if (cr->ool)
+			munmap (cr->ool, cr->ool_len);
+		      free (cr);
+		    }
+		  else if (!cr->references && newleast > cr->lastuse)
+		    newleast = cr->lastuse;
+
+		  cr = next_cr;
 		}
-	      else if (!cr->references && newleast > cr->lastuse)
-		newleast = cr->lastuse;
-
-	      cr = next_cr;
 	    }
-	}
 
-      /* If we didn't bail early, then this is valid.  */
-      if (nfreereplies)
-	leastreplylastuse = newleast;
+	  /* If we didn't bail early, then this is valid.  */
+	  if (s->nfree)
+	    s->leastlastuse = newleast;
+	}
+      pthread_spin_unlock (&s->lock);
     }
-  pthread_spin_unlock (&replycachelock);
+}
+
+/* Initialize the locks of the striped caches.  */
+void
+init_caches (void)
+{
+  int n;
+
+  for (n = 0; n < FHHASH_STRIPES; n++)
+    pthread_mutex_init (&fhstripes[n].lock, NULL);
+  for (n = 0; n < REPLYHASH_STRIPES; n++)
+    pthread_spin_init (&replystripes[n].lock, PTHREAD_PROCESS_PRIVATE);
 }
@@ -20,6 +20,10 @@
 
 #include <string.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 
 #include "nfsd.h"
 
@@ -35,190 +39,556 @@
 #include <rpc/rpc_msg.h>
 #undef malloc
 
+/* A TCP connection to a client.  */
+struct connection
+{
+  int fd;
+  struct sockaddr_in peer;
+  pthread_mutex_t lock;		/* Serializes replies.  */
+  int references;		/* Protected by queue_lock.  */
+};
+
+/* An RPC read by receive_loop or stream_receive_loop, waiting for a
+   worker thread.  */
+struct request
+{
+  struct request *next;
+  int fd;
+  struct connection *conn;	/* Null for datagrams.  */
+  struct sockaddr_in sender;
+  socklen_t addrlen;
+  int data[INTSIZE (MAXREQUESTSIZE)];
+};
+
+/* Requests waiting for a worker, and request buffers not in use.  */
+static struct request *queue_head, **queue_tail = &queue_head;
+static int nqueued;
+static struct request *free_requests;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_space_cond = PTHREAD_COND_INITIALIZER;
+
+/* The reply this worker thread is currently building.  */
+static __thread struct cached_reply *current_reply;
+
+/* Nonzero if the request this worker thread is processing came in a
+   datagram.  */
+static __thread int current_datagram;
+
+/* Return the largest NFSv3 READ or WRITE to allow for the current
+   request.  Over UDP a whole READ reply must fit in one datagram, which
+   MAXDATA3 of data would not.  */
+size_t
+max_data3 (void)
+{
+  return current_datagram ? MAXDATA3_UDP : MAXDATA3;
+}
+
+/* Encode the length LEN and arrange for DATA, which must have been
+   returned out of line by an RPC, to be sent after the rest of the
+   reply without being copied into it.  The reply cache takes over
+   DATA.  This must be the last thing encoded in a reply.  */
+int *
+reply_attach_data (int *p, char *data, size_t len)
+{
+  assert (current_reply && !current_reply->ool);
+  *(p++) = htonl (len);
+  current_reply->ool = data;
+  current_reply->ool_len = len;
+  return p;
+}
+
+/* Write all of the N buffers in IOV to the stream socket FD.  */
+static void
+write_all (int fd, struct iovec *iov, int n)
+{
+  ssize_t cc;
+
+  while (n > 0)
+    {
+      cc = writev (fd, iov, n);
+      if (cc == -1)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return;		/* The reader will notice.  */
+	}
+      while (n > 0 && (size_t) cc >= iov->iov_len)
+	{
+	  cc -= iov->iov_len;
+	  iov++;
+	  n--;
+	}
+      if (n > 0)
+	{
+	  iov->iov_base = (char *) iov->iov_base + cc;
+	  iov->iov_len -= cc;
+	}
+    }
+}
+
+/* Send the reply CR to the client that sent REQ.  */
+static void
+send_reply (struct request *req, struct cached_reply *cr)
+{
+  static const char pad[sizeof (int)];
+  struct iovec iov[4];
+  struct msghdr msg;
+  int mark;
+  int n = 0;
+
+  if (req->conn)
+    {
+      /* A single record marking fragment (RFC 1831, section 10).  */
+      mark = htonl (0x80000000
+		    | (cr->len + INTSIZE (cr->ool_len) * sizeof (int)));
+      iov[n].iov_base = &mark;
+      iov[n++].iov_len = sizeof mark;
+    }
+
+  iov[n].iov_base = cr->data;
+  iov[n++].iov_len = cr->len;
+  if (cr->ool)
+    {
+      iov[n].iov_base = cr->ool;
+      iov[n++].iov_len = cr->ool_len;
+      iov[n].iov_base = (void *) pad;
+      iov[n++].iov_len = INTSIZE (cr->ool_len) * sizeof (int) - cr->ool_len;
+    }
+
+  if (req->conn)
+    {
+      pthread_mutex_lock (&req->conn->lock);
+      write_all (req->fd, iov, n);
+      pthread_mutex_unlock (&req->conn->lock);
+      return;
+    }
+
+  memset (&msg, 0, sizeof msg);
+  msg.msg_name = &req->sender;
+  msg.msg_namelen = req->addrlen;
+  msg.msg_iov = iov;
+  msg.msg_iovlen = n;
+  sendmsg (req->fd, &msg, 0);
+}
+
+/* Return an unused request buffer.  */
+static struct request *
+get_request (void)
+{
+  struct request *req;
+
+  pthread_mutex_lock (&queue_lock);
+  req = free_requests;
+  if (req)
+    free_requests = req->next;
+  pthread_mutex_unlock (&queue_lock);
+  if (!req)
+    req = malloc (sizeof (struct request));
+  return req;
+}
+
+/* Drop a reference to CONN; queue_lock must be held.  */
+static void
+connection_rele (struct connection *conn)
+{
+  if (--conn->references == 0)
+    {
+      close (conn->fd);
+      free (conn);
+    }
+}
+
+/* Put REQ back on the free list; queue_lock must be held.  */
+static void
+put_request (struct request *req)
+{
+  if (req->conn)
+    connection_rele (req->conn);
+  req->next = free_requests;
+  free_requests = req;
+}
+
+/* Add REQ to the queue of work; queue_lock must be held.  */
+static void
+enqueue_request (struct request *req)
+{
+  if (req->conn)
+    req->conn->references++;
+  req->next = 0;
+  *queue_tail = req;
+  queue_tail = &req->next;
+  nqueued++;
+  pthread_cond_signal (&queue_cond);
+}
+
+/* Read datagrams from the socket ARG and queue them for the worker
+   threads running server_loop.  */
 void *
-server_loop (void *arg)
+receive_loop (void *arg)
 {
   int fd = (int) arg;
-  char buf[MAXIOSIZE];
+  struct request *req = 0;
+  int cc;
+
+  for (;;)
+    {
+      if (!req)
+	req = get_request ();
+
+      req->addrlen = sizeof (struct sockaddr_in);
+      cc = recvfrom (fd, req->data, MAXREQUESTSIZE, 0,
+		     (struct sockaddr *) &req->sender, &req->addrlen);
+      if (cc == -1)
+	continue;		/* Ignore errors.  */
+      req->fd = fd;
+      req->conn = 0;
+
+      pthread_mutex_lock (&queue_lock);
+      if (nqueued < MAX_QUEUED_REQUESTS)
+	{
+	  enqueue_request (req);
+	  req = 0;
+	}
+      /* Otherwise drop it and reuse the buffer; the client will
+	 retransmit.  */
+      pthread_mutex_unlock (&queue_lock);
+    }
+}
+
+/* Read exactly LEN bytes from FD into BUF.  Return zero on success
+   and -1 on error or end of file.  */
+static int
+read_all (int fd, void *buf, size_t len)
+{
+  ssize_t cc;
+
+  while (len > 0)
+    {
+      cc = read (fd, buf, len);
+      if (cc == -1 && errno == EINTR)
+	continue;
+      if (cc <= 0)
+	return -1;
+      buf = (char *) buf + cc;
+      len -= cc;
+    }
+  return 0;
+}
+
+/* Read record marked RPCs from the TCP connection ARG and queue them
+   for the worker threads running server_loop.  */
+static void *
+stream_receive_loop (void *arg)
+{
+  struct connection *conn = arg;
+  struct request *req = 0;
+  size_t len, fraglen;
+  uint32_t mark;
+
+  for (;;)
+    {
+      if (!req)
+	req = get_request ();
+
+      len = 0;
+      do
+	{
+	  if (read_all (conn->fd, &mark, sizeof mark))
+	    goto out;
+	  mark = ntohl (mark);
+	  fraglen = mark & 0x7fffffff;
+	  if (len + fraglen > MAXREQUESTSIZE)
+	    goto out;		/* Too big; give up on this client.  */
+	  if (read_all (conn->fd, (char *) req->data + len, fraglen))
+	    goto out;
+	  len += fraglen;
+	}
+      while (!(mark & 0x80000000));
+
+      req->fd = conn->fd;
+      req->conn = conn;
+      req->sender = conn->peer;
+      req->addrlen = sizeof (struct sockaddr_in);
+
+      /* Unlike datagrams, a request on a stream is not retransmitted
+	 soon, so wait for room instead of dropping it.  */
+      pthread_mutex_lock (&queue_lock);
+      while (nqueued >= MAX_QUEUED_REQUESTS)
+	pthread_cond_wait (&queue_space_cond, &queue_lock);
+      enqueue_request (req);
+      pthread_mutex_unlock (&queue_lock);
+      req = 0;
+    }
+
+ out:
+  pthread_mutex_lock (&queue_lock);
+  if (req)
+    {
+      req->conn = 0;
+      put_request (req);
+    }
+  connection_rele (conn);
+  pthread_mutex_unlock (&queue_lock);
+  return 0;
+}
+
+/* Accept TCP connections on the listening socket ARG and start a
+   thread reading requests from each.  */
+void *
+accept_loop (void *arg)
+{
+  int fd = (int) arg;
+  struct connection *conn;
+  struct sockaddr_in peer;
+  socklen_t peerlen;
+  pthread_t thread;
+  int s;
+
+  for (;;)
+    {
+      peerlen = sizeof peer;
+      s = accept (fd, (struct sockaddr *) &peer, &peerlen);
+      if (s == -1)
+	continue;
+
+      conn = malloc (sizeof (struct connection));
+      conn->fd = s;
+      conn->peer = peer;
+      conn->references = 1;
+      pthread_mutex_init (&conn->lock, NULL);
+
+      if (pthread_create (&thread, NULL, stream_receive_loop, conn))
+	{
+	  close (s);
+	  free (conn);
+	  continue;
+	}
+      pthread_detach (thread);
+    }
+}
+
+/* Process the RPC in REQ and send the reply.  */
+static void
+process_request (struct request *req)
+{
   int xid;
   int *p, *r;
   char *rbuf;
+  size_t rbufsize;
   struct cached_reply *cr;
   int program;
-  struct sockaddr_in sender;
-  int version;
+  struct sockaddr_in *sender = &req->sender;
+  int version, lowvers, highvers;
   int procedure;
   struct proctable *table = 0;
   struct procedure *proc;
   struct idspec *cred;
   struct cache_handle *c, fakec;
   error_t err;
-  socklen_t addrlen;
-  int cc;
 
   memset (&fakec, 0, sizeof (struct cache_handle));
 
-  for (;;)
-    {
-      p = (int *) buf;
-      proc = 0;
-      addrlen = sizeof (struct sockaddr_in);
-      cc = recvfrom (fd, buf, MAXIOSIZE, 0, &sender, &addrlen);
-      if (cc == -1)
-	continue;		/* Ignore errors.  */
-      xid = *(p++);
+  p = req->data;
+  proc = 0;
+  xid = *(p++);
 
-      /* Ignore things that aren't proper RPCs.  */
-      if (ntohl (*p) != CALL)
-	continue;
-      p++;
-
-      cr = check_cached_replies (xid, &sender);
-      if (cr->data)
-	/* This transacation has already completed.  */
-	goto repost_reply;
+  /* Ignore things that aren't proper RPCs.  */
+  if (ntohl (*p) != CALL)
+    return;
+  p++;
 
-      r = (int *) (rbuf = malloc (MAXIOSIZE));
+  cr = check_cached_replies (xid, sender);
+  if (cr->data)
+    /* This transacation has already completed.  */
+    goto repost_reply;
 
-      if (ntohl (*p) != RPC_MSG_VERSION)
-	{
-	  /* Reject RPC.  */
-	  *(r++) = xid;
-	  *(r++) = htonl (REPLY);
-	  *(r++) = htonl (MSG_DENIED);
-	  *(r++) = htonl (RPC_MISMATCH);
-	  *(r++) = htonl (RPC_MSG_VERSION);
-	  *(r++) = htonl (RPC_MSG_VERSION);
-	  goto send_reply;
-	}
-      p++;
+  current_reply = cr;
+  current_datagram = req->conn == NULL;
+  rbufsize = MAXIOSIZE;
+  r = (int *) (rbuf = alloc_reply_buffer (rbufsize));
 
-      program = ntohl (*p);
-      p++;
-      switch (program)
-	{
-	case MOUNTPROG:
-	  version = MOUNTVERS;
-	  table = &mounttable;
-	  break;
-
-	case NFS_PROGRAM:
-	  version = NFS_VERSION;
-	  table = &nfs2table;
-	  break;
-
-	case PMAPPROG:
-	  version = PMAPVERS;
-	  table = &pmaptable;
-	  break;
-
-	default:
-	  /* Program unavailable.  */
-	  *(r++) = xid;
-	  *(r++) = htonl (REPLY);
-	  *(r++) = htonl (MSG_ACCEPTED);
-	  *(r++) = htonl (AUTH_NULL);
-	  *(r++) = htonl (0);
-	  *(r++) = htonl (PROG_UNAVAIL);
-	  goto send_reply;
-	}
+  if (ntohl (*p) != RPC_MSG_VERSION)
+    {
+      /* Reject RPC.  */
+      *(r++) = xid;
+      *(r++) = htonl (REPLY);
+      *(r++) = htonl (MSG_DENIED);
+      *(r++) = htonl (RPC_MISMATCH);
+      *(r++) = htonl (RPC_MSG_VERSION);
+      *(r++) = htonl (RPC_MSG_VERSION);
+      goto send_reply;
+    }
+  p++;
 
-      if (ntohl (*p) != version)
-	{
-	  /* Program mismatch.  */
-	  *(r++) = xid;
-	  *(r++) = htonl (REPLY);
-	  *(r++) = htonl (MSG_ACCEPTED);
-	  *(r++) = htonl (AUTH_NULL);
-	  *(r++) = htonl (0);
-	  *(r++) = htonl (PROG_MISMATCH);
-	  *(r++) = htonl (version);
-	  *(r++) = htonl (version);
-	  goto send_reply;
-	}
-      p++;
+  program = ntohl (*p);
+  p++;
+  version = ntohl (*p);
+  switch (program)
+    {
+    case MOUNTPROG:
+      lowvers = MOUNTVERS;
+      highvers = MOUNTVERS3;
+      table = &mounttable;
+      break;
 
-      procedure = htonl (*p);
-      p++;
-      if (procedure < table->min
-	  || procedure > table->max
-	  || table->procs[procedure - table->min].func == 0)
-	{
-	  /* Procedure unavailable.  */
-	  *(r++) = xid;
-	  *(r++) = htonl (REPLY);
-	  *(r++) = htonl (MSG_ACCEPTED);
-	  *(r++) = htonl (AUTH_NULL);
-	  *(r++) = htonl (0);
-	  *(r++) = htonl (PROC_UNAVAIL);
-	  *(r++) = htonl (table->min);
-	  *(r++) = htonl (table->max);
-	  goto send_reply;
-	}
-      proc = &table->procs[procedure - table->min];
+    case NFS_PROGRAM:
+      lowvers = NFS_VERSION;
+      highvers = 3;
+      table = version == 3 ? &nfs3table : &nfs2table;
+      break;
 
-      p = process_cred (p, &cred);
+    case PMAPPROG:
+      lowvers = highvers = PMAPVERS;
+      table = &pmaptable;
+      break;
 
-      if (proc->need_handle)
-	p = lookup_cache_handle (p, &c, cred);
-      else
-	{
-	  fakec.ids = cred;
-	  c = &fakec;
-	}
+    default:
+      /* Program unavailable.  */
+      *(r++) = xid;
+      *(r++) = htonl (REPLY);
+      *(r++) = htonl (MSG_ACCEPTED);
+      *(r++) = htonl (AUTH_NULL);
+      *(r++) = htonl (0);
+      *(r++) = htonl (PROG_UNAVAIL);
+      goto send_reply;
+    }
 
-      if (proc->alloc_reply)
-	{
-	  size_t amt;
-	  amt = (*proc->alloc_reply) (p, version) + 256;
-	  if (amt > MAXIOSIZE)
-	    {
-	      free (rbuf);
-	      r = (int *) (rbuf = malloc (amt));
-	    }
-	}
+  if (version < lowvers || version > highvers)
+    {
+      /* Program mismatch.  */
+      *(r++) = xid;
+      *(r++) = htonl (REPLY);
+      *(r++) = htonl (MSG_ACCEPTED);
+      *(r++) = htonl (AUTH_NULL);
+      *(r++) = htonl (0);
+      *(r++) = htonl (PROG_MISMATCH);
+      *(r++) = htonl (lowvers);
+      *(r++) = htonl (highvers);
+      goto send_reply;
+    }
+  p++;
 
-      /* Fill in beginning of reply.  */
+  procedure = htonl (*p);
+  p++;
+  if (procedure < table->min
+      || procedure > table->max
+      || table->procs[procedure - table->min].func == 0)
+    {
+      /* Procedure unavailable.  */
       *(r++) = xid;
       *(r++) = htonl (REPLY);
       *(r++) = htonl (MSG_ACCEPTED);
       *(r++) = htonl (AUTH_NULL);
       *(r++) = htonl (0);
-      *(r++) = htonl (SUCCESS);
-      if (!proc->process_error)
-	/* The function does its own error processing, and we ignore
-	   its return value.  */
-	(void) (*proc->func) (c, p, &r, version);
+      *(r++) = htonl (PROC_UNAVAIL);
+      *(r++) = htonl (table->min);
+      *(r++) = htonl (table->max);
+      goto send_reply;
+    }
+  proc = &table->procs[procedure - table->min];
+
+  p = process_cred (p, &cred);
+
+  if (proc->need_handle)
+    p = lookup_cache_handle (p, &c, cred, version);
+  else
+    {
+      fakec.ids = cred;
+      c = &fakec;
+    }
+
+  if (proc->alloc_reply)
+    {
+      size_t amt;
+      amt = (*proc->alloc_reply) (p, version) + 256;
+      if (amt > rbufsize)
+	{
+	  free_reply_buffer (rbuf, rbufsize);
+	  r = (int *) (rbuf = alloc_reply_buffer (amt));
+	  rbufsize = amt;
+	}
+    }
+
+  /* Fill in beginning of reply.  */
+  *(r++) = xid;
+  *(r++) = htonl (REPLY);
+  *(r++) = htonl (MSG_ACCEPTED);
+  *(r++) = htonl (AUTH_NULL);
+  *(r++) = htonl (0);
+  *(r++) = htonl (SUCCESS);
+  if (!proc->process_error)
+    /* The function does its own error processing, and we ignore
+       its return value.  */
+    (void) (*proc->func) (c, p, &r, version);
+  else
+    {
+      /* Assume success for now and patch it later if necessary.  */
+      int *errloc = r;
+
+      if (c)
+	{
+	  *(r++) = htonl (0);
+	  /* Call processing function, its output after error code.  */
+	  err = (*proc->func) (c, p, &r, version);
+	}
       else
+	err = ESTALE;
+
+      if (err)
 	{
-	  if (c)
+	  r = errloc;	/* Back up, patch error code, discard rest.  */
+	  *(r++) = htonl (nfs_error_trans (err, version));
+	  /* NFSv3 failures still carry (empty) attributes.  */
+	  memset (r, 0, proc->error_words * sizeof (int));
+	  r += proc->error_words;
+	  if (cr->ool)
 	    {
-	      /* Assume success for now and patch it later if necessary.  */
-	      int *errloc = r;
-	      *(r++) = htonl (0);
-	      /* Call processing function, its output after error code.  */
-	      err = (*proc->func) (c, p, &r, version);
-	      if (err)
-		{
-		  r = errloc;	/* Back up, patch error code, discard rest.  */
-		  *(r++) = htonl (nfs_error_trans (err, version));
-		}
+	      munmap (cr->ool, cr->ool_len);
+	      cr->ool = 0;
+	      cr->ool_len = 0;
 	    }
-	  else
-	    *(r++) = htonl (nfs_error_trans (ESTALE, version));
 	}
+    }
+
+  cred_rele (cred);
+  if (c && c != &fakec)
+    cache_handle_rele (c);
+
+ send_reply:
+  cr->data = rbuf;
+  cr->size = rbufsize;
+  cr->len = (char *)r - rbuf;
+  current_reply = 0;
 
-      cred_rele (cred);
-      if (c && c != &fakec)
-	cache_handle_rele (c);
+ repost_reply:
+  send_reply (req, cr);
+  release_cached_reply (cr);
+}
+
+/* Worker thread: process requests queued by receive_loop.  */
+void *
+server_loop (void *arg)
+{
+  struct request *req;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&queue_lock);
+      while (!queue_head)
+	pthread_cond_wait (&queue_cond, &queue_lock);
+      req = queue_head;
+      queue_head = req->next;
+      if (!queue_head)
+	queue_tail = &queue_head;
+      nqueued--;
+      pthread_cond_signal (&queue_space_cond);
+      pthread_mutex_unlock (&queue_lock);
 
-    send_reply:
-      cr->data = rbuf;
-      cr->len = (char *)r - rbuf;
+      process_request (req);
 
-    repost_reply:
-      sendto (fd, cr->data, cr->len, 0,
-	      (struct sockaddr *) &sender, addrlen);
-      release_cached_reply (cr);
+      pthread_mutex_lock (&queue_lock);
+      put_request (req);
+      pthread_mutex_unlock (&queue_lock);
     }
 }
@@ -27,19 +27,20 @@
 #include <pthread.h>
 #include <error.h>
 
-int main_udp_socket, pmap_udp_socket;
+int main_udp_socket, pmap_udp_socket, main_tcp_socket;
 struct sockaddr_in main_address, pmap_address;
+int write_verifier[2];
 static char index_file[] = LOCALSTATEDIR "/state/misc/nfsd.index";
 char *index_file_name = index_file;
 
-/* Launch a server loop thread */
+/* Launch a thread running FN (ARG) */
 static void
-create_server_thread (int socket)
+create_server_thread (void *(*fn) (void *), void *arg)
 {
   pthread_t thread;
   int fail;
 
-  fail = pthread_create (&thread, NULL, server_loop, (void *) socket);
+  fail = pthread_create (&thread, NULL, fn, arg);
   if (fail)
     error (1, fail, "Creating main server thread");
 
@@ -68,6 +69,8 @@ main (int argc, char **argv)
 
   authserver = getauth ();
   maptime_map (0, 0, &mapped_time);
+  write_verifier[0] = mapped_time->seconds;
+  write_verifier[1] = mapped_time->microseconds;
 
   main_address.sin_family = AF_INET;
   main_address.sin_port = htons (NFS_PORT);
@@ -78,6 +81,7 @@ main (int argc, char **argv)
 
   main_udp_socket = socket (PF_INET, SOCK_DGRAM, 0);
   pmap_udp_socket = socket (PF_INET, SOCK_DGRAM, 0);
+  main_tcp_socket = socket (PF_INET, SOCK_STREAM, 0);
   fail = bind (main_udp_socket, (struct sockaddr *)&main_address,
 	       sizeof (struct sockaddr_in));
   if (fail)
@@ -88,12 +92,24 @@ main (int argc, char **argv)
   if (fail)
     error (1, errno, "Binding PMAP socket");
 
+  fail = bind (main_tcp_socket, (struct sockaddr *)&main_address,
+	       sizeof (struct sockaddr_in));
+  if (!fail)
+    fail = listen (main_tcp_socket, SOMAXCONN);
+  if (fail)
+    error (1, errno, "Binding NFS TCP socket");
+
+  init_caches ();
   init_filesystems ();
 
-  create_server_thread (pmap_udp_socket);
+  /* One thread reads each socket, or each TCP connection, and hands
+     the requests to a pool of NTHREADS workers.  */
+  create_server_thread (receive_loop, (void *) pmap_udp_socket);
+  create_server_thread (receive_loop, (void *) main_udp_socket);
+  create_server_thread (accept_loop, (void *) main_tcp_socket);
 
   while (nthreads--)
-    create_server_thread (main_udp_socket);
+    create_server_thread (server_loop, 0);
 
   for (;;)
     {
@@ -19,6 +19,7 @@
    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111, USA. */
 
 #include <sys/types.h>
+#include <stdint.h>
 #include <sys/socket.h>
 #include <errno.h>
 #include <netinet/in.h>
@@ -32,6 +33,10 @@
 #define FH_KEEP_TIMEOUT 600	/* ten minutes */
 #define REPLY_KEEP_TIMEOUT 120	/* two minutes */
 #define MAXIOSIZE 10240
+#define MAXDATA3 65536		/* Largest NFSv3 READ or WRITE */
+#define MAXDATA3_UDP 32768	/* Same, over UDP, so replies fit a datagram */
+#define MAXREQUESTSIZE (MAXDATA3 + 1024)
+#define MAX_QUEUED_REQUESTS 128	/* UDP requests beyond this are dropped */
 
 struct idspec
 {
@@ -55,6 +60,8 @@ struct cache_handle
   file_t port;
   time_t lastuse;
   int references;
+  int unstable;			/* Written to without being synced;
+				   accessed atomically */
 };
 
 struct cached_reply
@@ -66,7 +73,11 @@ struct cached_reply
   time_t lastuse;
   int references;
   size_t len;
+  size_t size;			/* Allocated size of DATA.  */
   char *data;
+  /* Out-of-line file data sent after DATA; see reply_attach_data.  */
+  char *ool;
+  size_t ool_len;
 };
 
 struct procedure
@@ -75,8 +86,15 @@ struct procedure
   size_t (*alloc_reply) (int *, int);
   int need_handle;
   int process_error;
+  /* Number of words of empty (all zero) results that follow the
+     status of a failed NFSv3 reply.  */
+  int error_words;
 };
 
+/* Error returned by op functions when an NFSv3 SETATTR guard check
+   fails; it has no Hurd equivalent.  */
+#define ENFSNOTSYNC (-1)
+
 struct proctable
 {
   int min;
@@ -90,9 +108,13 @@ volatile struct mapped_time_value *mapped_time;
 
 /* We don't actually distinguish between these two sockets, but
    we have to listen on two different ports, so that's why they're here. */
-extern int main_udp_socket, pmap_udp_socket;
+extern int main_udp_socket, pmap_udp_socket, main_tcp_socket;
 extern struct sockaddr_in main_address, pmap_address;
 
+/* NFSv3 write verifier; changes whenever nfsd is restarted, so that
+   clients resend unstable writes that were not committed.  */
+extern int write_verifier[2];
+
 /* Name of the file on disk containing the filesystem index table */
 extern char *index_file_name;
 
@@ -105,25 +127,37 @@ int *process_cred (int *, struct idspec **);
 void cred_rele (struct idspec *);
 void cred_ref (struct idspec *);
 void scan_creds (void);
-int *lookup_cache_handle (int *, struct cache_handle **, struct idspec *);
+int *lookup_cache_handle (int *, struct cache_handle **, struct idspec *,
+			  int);
 void cache_handle_rele (struct cache_handle *);
 void scan_fhs (void);
 struct cache_handle *create_cached_handle (int, struct cache_handle *, file_t);
 struct cached_reply *check_cached_replies (int, struct sockaddr_in *);
 void release_cached_reply (struct cached_reply *cr);
 void scan_replies (void);
+char *alloc_reply_buffer (size_t);
+void free_reply_buffer (char *, size_t);
+void init_caches (void);
 
 /* loop.c */
-void * server_loop (void *);
+void *receive_loop (void *);
+void *accept_loop (void *);
+void *server_loop (void *);
+int *reply_attach_data (int *, char *, size_t);
+size_t max_data3 (void);
 
 /* ops.c */
-extern struct proctable nfs2table, mounttable, pmaptable;
+extern struct proctable nfs2table, nfs3table, mounttable, pmaptable;
 
 /* xdr.c */
 int nfs_error_trans (error_t, int);
 int *encode_fattr (int *, struct stat *, int version);
 int *decode_name (int *, char **);
-int *encode_fhandle (int *, char *);
+int *encode_fhandle (int *, char *, int version);
+int *encode_post_op_attr (int *, struct stat *);
+int *encode_wcc_data (int *, struct stat *, struct stat *);
+int *encode_uint64 (int *, uint64_t);
+int *decode_uint64 (int *, uint64_t *);
 int *encode_string (int *, char *);
 int *encode_data (int *, char *, size_t);
 int *encode_statfs (int *, struct statfs *);
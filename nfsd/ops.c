@@ -28,11 +28,20 @@
 #include <dirent.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <limits.h>
+#include <unistd.h>
 
 #include "nfsd.h"
 #include "../nfs/mount.h" /* XXX */
 #include <rpc/pmap_prot.h>
 
+#undef TRUE
+#undef FALSE
+#define malloc spoogie_woogie	/* For AUTH_UNIX.  */
+#include <rpc/types.h>
+#include <rpc/auth.h>
+#undef malloc
+
 static error_t
 op_null (struct cache_handle *c,
 	 int *p,
@@ -42,6 +51,17 @@ op_null (struct cache_handle *c,
   return 0;
 }
 
+/* Encode NFSv3 weak cache consistency data for the directory DIR
+   after an operation on it.  We don't fetch attributes before the
+   operation, which the protocol allows.  */
+static int *
+encode_dir_wcc (int *p, file_t dir)
+{
+  struct stat st;
+
+  return encode_wcc_data (p, 0, io_stat (dir, &st) ? 0 : &st);
+}
+
 static error_t
 op_getattr (struct cache_handle *c,
 	    int *p,
@@ -184,8 +204,16 @@ op_lookup (struct cache_handle *c,
   newc = create_cached_handle (c->handle.fs, c, newport);
   if (!newc)
     return ESTALE;
-  *reply = encode_fhandle (*reply, newc->handle.array);
-  *reply = encode_fattr (*reply, &st, version);
+  *reply = encode_fhandle (*reply, newc->handle.array, version);
+  cache_handle_rele (newc);
+  if (version == 3)
+    {
+      *reply = encode_post_op_attr (*reply, &st);
+      *reply = encode_post_op_attr (*reply,
+				    io_stat (c->port, &st) ? 0 : &st);
+    }
+  else
+    *reply = encode_fattr (*reply, &st, version);
   return 0;
 }
 
@@ -214,6 +242,12 @@ op_readlink (struct cache_handle *c,
 
   transp += sizeof (_HURD_SYMLINK);
 
+  if (version == 3)
+    {
+      struct stat st;
+      *reply = encode_post_op_attr (*reply,
+				    io_stat (c->port, &st) ? 0 : &st);
+    }
   *reply = encode_string (*reply, transp);
 
   if (transp != buf)
@@ -242,10 +276,21 @@ op_read (struct cache_handle *c,
   struct stat st;
   error_t err;
 
-  offset = ntohl (*p);
-  p++;
+  if (version == 3)
+    {
+      uint64_t off;
+      p = decode_uint64 (p, &off);
+      offset = off;
+    }
+  else
+    {
+      offset = ntohl (*p);
+      p++;
+    }
   count = ntohl (*p);
   p++;
+  if (version == 3 && count > max_data3 ())
+    count = max_data3 ();
 
   err = io_read (c->port, &bp, &buflen, offset, count);
   if (err)
@@ -257,13 +302,27 @@ op_read (struct cache_handle *c,
 
   err = io_stat (c->port, &st);
   if (err)
-    return err;
+    {
+      if (bp != buf)
+	munmap (bp, buflen);
+      return err;
+    }
 
-  *reply = encode_fattr (*reply, &st, version);
-  *reply = encode_data (*reply, bp, buflen);
+  if (version == 3)
+    {
+      *reply = encode_post_op_attr (*reply, &st);
+      *(*reply)++ = htonl (buflen);
+      *(*reply)++ = htonl (offset + buflen >= st.st_size);	/* EOF.  */
+    }
+  else
+    *reply = encode_fattr (*reply, &st, version);
 
+  /* Data the filesystem returned out of line is sent from where it
+     is, instead of being copied into the reply.  */
   if (bp != buf)
-    munmap (bp, buflen);
+    *reply = reply_attach_data (*reply, bp, buflen);
+  else
+    *reply = encode_data (*reply, bp, buflen);
 
   return 0;
 }
@@ -275,19 +334,33 @@ op_write (struct cache_handle *c,
 	  int version)
 {
   off_t offset;
-  size_t count;
+  size_t count, total;
+  int stable;
   error_t err;
   mach_msg_type_number_t amt;
   char *bp;
   struct stat st;
 
+  if (version == 3)
+    {
+      uint64_t off;
+      p = decode_uint64 (p, &off);
+      offset = off;
+      p++;			/* Skip COUNT; the data length follows.  */
+      stable = ntohl (*p);
+      p++;
+    }
+  else
+    {
+      p++;
+      offset = ntohl (*p);
+      p++;
+      p++;
+      stable = FILE_SYNC;
+    }
+  total = count = ntohl (*p);
   p++;
-  offset = ntohl (*p);
-  p++;
-  p++;
-  count = ntohl (*p);
-  p++;
-  bp = (char *) *reply;
+  bp = (char *) p;
 
   while (count)
     {
@@ -301,12 +374,26 @@ op_write (struct cache_handle *c,
       offset += amt;
     }
 
-  file_sync (c->port, 1, 0);
+  /* Unstable writes are left for the filesystem to write out in its own
+     time, or until the client sends a COMMIT.  */
+  if (stable == UNSTABLE)
+    __atomic_store_n (&c->unstable, 1, __ATOMIC_RELAXED);
+  else
+    file_sync (c->port, 1, 0);
 
   err = io_stat (c->port, &st);
   if (err)
     return err;
-  *reply = encode_fattr (*reply, &st, version);
+  if (version == 3)
+    {
+      *reply = encode_wcc_data (*reply, 0, &st);
+      *(*reply)++ = htonl (total);
+      *(*reply)++ = htonl (stable == UNSTABLE ? UNSTABLE : FILE_SYNC);
+      *(*reply)++ = write_verifier[0];
+      *(*reply)++ = write_verifier[1];
+    }
+  else
+    *reply = encode_fattr (*reply, &st, version);
   return 0;
 }
 
@@ -379,7 +466,8 @@ op_create (struct cache_handle *c,
   if (!newc)
     return ESTALE;
 
-  *reply = encode_fhandle (*reply, newc->handle.array);
+  *reply = encode_fhandle (*reply, newc->handle.array, version);
+  cache_handle_rele (newc);
   *reply = encode_fattr (*reply, &st, version);
   return 0;
 }
@@ -398,6 +486,8 @@ op_remove (struct cache_handle *c,
   err = dir_unlink (c->port, name);
   free (name);
 
+  if (!err && version == 3)
+    *reply = encode_dir_wcc (*reply, c->port);
   return err;
 }
 
@@ -412,13 +502,20 @@ op_rename (struct cache_handle *fromc,
   error_t err = 0;
 
   p = decode_name (p, &fromname);
-  p = lookup_cache_handle (p, &toc, fromc->ids);
+  p = lookup_cache_handle (p, &toc, fromc->ids, version);
   decode_name (p, &toname);
 
   if (!toc)
     err = ESTALE;
   if (!err)
     err = dir_rename (fromc->port, fromname, toc->port, toname, 0);
+  if (!err && version == 3)
+    {
+      *reply = encode_dir_wcc (*reply, fromc->port);
+      *reply = encode_dir_wcc (*reply, toc->port);
+    }
+  if (toc)
+    cache_handle_rele (toc);
   free (fromname);
   free (toname);
   return err;
@@ -434,52 +531,74 @@ op_link (struct cache_handle *filec,
   char *name;
   error_t err = 0;
 
-  p = lookup_cache_handle (p, &dirc, filec->ids);
+  p = lookup_cache_handle (p, &dirc, filec->ids, version);
   decode_name (p, &name);
 
   if (!dirc)
     err = ESTALE;
   if (!err)
     err = dir_link (dirc->port, filec->port, name, 1);
+  if (!err && version == 3)
+    {
+      struct stat st;
+      *reply = encode_post_op_attr (*reply,
+				    io_stat (filec->port, &st) ? 0 : &st);
+      *reply = encode_dir_wcc (*reply, dirc->port);
+    }
+  if (dirc)
+    cache_handle_rele (dirc);
 
   free (name);
   return err;
 }
 
+/* Create a symlink to TARGET called NAME in DIR with MODE, and return
+   a port to it in *NEWPORT.  */
 static error_t
-op_symlink (struct cache_handle *c,
-	    int *p,
-	    int **reply,
-	    int version)
+make_symlink (file_t dir, char *name, char *target, mode_t mode,
+	      file_t *newport)
 {
-  char *name, *target;
   error_t err;
-  mode_t mode;
-  file_t newport = MACH_PORT_NULL;
   size_t len;
   char *buf;
 
-  p = decode_name (p, &name);
-  p = decode_name (p, &target);
-  mode = ntohl (*p);
-  p++;
-  if (mode == -1)
-    mode = 0777;
-
   len = strlen (target) + 1;
   buf = alloca (sizeof (_HURD_SYMLINK) + len);
   memcpy (buf, _HURD_SYMLINK, sizeof (_HURD_SYMLINK));
   memcpy (buf + sizeof (_HURD_SYMLINK), target, len);
 
-  err = dir_mkfile (c->port, O_WRITE, mode, &newport);
+  *newport = MACH_PORT_NULL;
+  err = dir_mkfile (dir, O_WRITE, mode, newport);
   if (!err)
-    err = file_set_translator (newport,
+    err = file_set_translator (*newport,
 			       FS_TRANS_EXCL|FS_TRANS_SET,
 			       FS_TRANS_EXCL|FS_TRANS_SET, 0,
 			       buf, sizeof (_HURD_SYMLINK) + len,
 			       MACH_PORT_NULL, MACH_MSG_TYPE_COPY_SEND);
   if (!err)
-    err = dir_link (c->port, newport, name, 1);
+    err = dir_link (dir, *newport, name, 1);
+  return err;
+}
+
+static error_t
+op_symlink (struct cache_handle *c,
+	    int *p,
+	    int **reply,
+	    int version)
+{
+  char *name, *target;
+  error_t err;
+  mode_t mode;
+  file_t newport;
+
+  p = decode_name (p, &name);
+  p = decode_name (p, &target);
+  mode = ntohl (*p);
+  p++;
+  if (mode == -1)
+    mode = 0777;
+
+  err = make_symlink (c->port, name, target, mode, &newport);
 
   free (name);
   free (target);
@@ -536,7 +655,8 @@ op_mkdir (struct cache_handle *c,
   newc = create_cached_handle (c->handle.fs, c, newport);
   if (!newc)
     return ESTALE;
-  *reply = encode_fhandle (*reply, newc->handle.array);
+  *reply = encode_fhandle (*reply, newc->handle.array, version);
+  cache_handle_rele (newc);
   *reply = encode_fattr (*reply, &st, version);
   return 0;
 }
@@ -554,6 +674,8 @@ op_rmdir (struct cache_handle *c,
 
   err = dir_rmdir (c->port, name);
   free (name);
+  if (!err && version == 3)
+    *reply = encode_dir_wcc (*reply, c->port);
   return err;
 }
 
@@ -666,7 +788,14 @@ op_mnt (struct cache_handle *c,
   free (name);
   if (!newc)
     return ESTALE;
-  *reply = encode_fhandle (*reply, newc->handle.array);
+  *reply = encode_fhandle (*reply, newc->handle.array, version);
+  cache_handle_rele (newc);
+  if (version == MOUNTVERS3)
+    {
+      /* The authentication flavors we accept.  */
+      *(*reply)++ = htonl (1);
+      *(*reply)++ = htonl (AUTH_UNIX);
+    }
   return 0;
 }
 
@@ -685,12 +814,12 @@ op_getport (struct cache_handle *c,
   prot = ntohl (*p);
   p++;
 
-  if (prot != IPPROTO_UDP)
+  if (prot != IPPROTO_UDP && prot != IPPROTO_TCP)
     *(*reply)++ = htonl (0);
-  else if ((prog == MOUNTPROG && vers == MOUNTVERS)
-	   || (prog == NFS_PROGRAM && vers == NFS_VERSION))
+  else if ((prog == MOUNTPROG && vers >= MOUNTVERS && vers <= MOUNTVERS3)
+	   || (prog == NFS_PROGRAM && (vers == NFS_VERSION || vers == 3)))
     *(*reply)++ = htonl (NFS_PORT);
-  else if (prog == PMAPPROG && vers == PMAPVERS)
+  else if (prog == PMAPPROG && vers == PMAPVERS && prot == IPPROTO_UDP)
     *(*reply)++ = htonl (PMAPPORT);
   else
     *(*reply)++ = 0;
@@ -698,6 +827,626 @@ op_getport (struct cache_handle *c,
   return 0;
 }
 
+
+/* Operations that only exist in NFSv3.  */
+
+/* Attributes to set, as given by an NFSv3 sattr3.  */
+struct sattr3
+{
+  int set_mode, set_uid, set_gid, set_size;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  uint64_t size;
+  int set_atime, set_mtime;	/* enum sattr_time_how */
+  time_value_t atime, mtime;
+};
+
+/* Decode a set_atime or set_mtime at P into *HOW and *T and return the
+   next thing to come after it.  */
+static int *
+decode_set_time (int *p, int *how, time_value_t *t)
+{
+  *how = ntohl (*p);
+  p++;
+  if (*how == SET_TO_CLIENT_TIME)
+    {
+      t->seconds = ntohl (*p);
+      p++;
+      t->microseconds = ntohl (*p) / 1000;
+      p++;
+    }
+  else if (*how == SET_TO_SERVER_TIME)
+    {
+      /* file_utimes takes this to mean the current time.  */
+      t->seconds = 0;
+      t->microseconds = -1;
+    }
+  return p;
+}
+
+/* Decode P into SA and return the next thing to come after it.  */
+static int *
+decode_sattr3 (int *p, struct sattr3 *sa)
+{
+  sa->set_mode = ntohl (*p);
+  p++;
+  if (sa->set_mode)
+    {
+      sa->mode = ntohl (*p);
+      p++;
+    }
+  sa->set_uid = ntohl (*p);
+  p++;
+  if (sa->set_uid)
+    {
+      sa->uid = ntohl (*p);
+      p++;
+    }
+  sa->set_gid = ntohl (*p);
+  p++;
+  if (sa->set_gid)
+    {
+      sa->gid = ntohl (*p);
+      p++;
+    }
+  sa->set_size = ntohl (*p);
+  p++;
+  if (sa->set_size)
+    p = decode_uint64 (p, &sa->size);
+  p = decode_set_time (p, &sa->set_atime, &sa->atime);
+  p = decode_set_time (p, &sa->set_mtime, &sa->mtime);
+  return p;
+}
+
+/* Apply the attributes in SA other than the mode to PORT, whose
+   current attributes are ST.  */
+static error_t
+apply_sattr3 (file_t port, struct sattr3 *sa, struct stat *st)
+{
+  error_t err = 0;
+
+  if ((sa->set_uid && sa->uid != st->st_uid)
+      || (sa->set_gid && sa->gid != st->st_gid))
+    err = file_chown (port,
+		      sa->set_uid ? sa->uid : st->st_uid,
+		      sa->set_gid ? sa->gid : st->st_gid);
+  if (!err && sa->set_size && sa->size != st->st_size)
+    err = file_set_size (port, sa->size);
+  if (!err && (sa->set_atime != DONT_CHANGE || sa->set_mtime != DONT_CHANGE))
+    {
+      if (sa->set_atime == DONT_CHANGE)
+	{
+	  sa->atime.seconds = st->st_atim.tv_sec;
+	  sa->atime.microseconds = st->st_atim.tv_nsec / 1000;
+	}
+      if (sa->set_mtime == DONT_CHANGE)
+	{
+	  sa->mtime.seconds = st->st_mtim.tv_sec;
+	  sa->mtime.microseconds = st->st_mtim.tv_nsec / 1000;
+	}
+      err = file_utimes (port, sa->atime, sa->mtime);
+    }
+  return err;
+}
+
+static error_t
+op3_setattr (struct cache_handle *c,
+	     int *p,
+	     int **reply,
+	     int version)
+{
+  struct sattr3 sa;
+  struct stat pre, st;
+  error_t err;
+
+  p = decode_sattr3 (p, &sa);
+
+  err = io_stat (c->port, &pre);
+  if (err)
+    return err;
+
+  if (ntohl (*p))
+    {
+      /* Only go ahead if the ctime is what the client thinks it is.  */
+      if (ntohl (p[1]) != pre.st_ctim.tv_sec
+	  || ntohl (p[2]) != pre.st_ctim.tv_nsec)
+	return ENFSNOTSYNC;
+    }
+
+  if (sa.set_mode)
+    err = file_chmod (c->port, sa.mode);
+  if (!err)
+    err = apply_sattr3 (c->port, &sa, &pre);
+  if (!err)
+    err = io_stat (c->port, &st);
+  if (err)
+    return err;
+
+  *reply = encode_wcc_data (*reply, &pre, &st);
+  return 0;
+}
+
+static error_t
+op3_access (struct cache_handle *c,
+	    int *p,
+	    int **reply,
+	    int version)
+{
+  int wanted, allowed, access = 0;
+  struct stat st;
+  error_t err;
+
+  wanted = ntohl (*p);
+  p++;
+
+  err = io_stat (c->port, &st);
+  if (!err)
+    err = file_check_access (c->port, &allowed);
+  if (err)
+    return err;
+
+  if (allowed & O_READ)
+    access |= ACCESS3_READ;
+  if (allowed & O_WRITE)
+    access |= (ACCESS3_MODIFY | ACCESS3_EXTEND
+	       | (S_ISDIR (st.st_mode) ? ACCESS3_DELETE : 0));
+  if (allowed & O_EXEC)
+    access |= S_ISDIR (st.st_mode) ? ACCESS3_LOOKUP : ACCESS3_EXECUTE;
+
+  *reply = encode_post_op_attr (*reply, &st);
+  *(*reply)++ = htonl (access & wanted);
+  return 0;
+}
+
+/* Finish an NFSv3 operation that created NAME in the directory C: put a
+   handle and attributes for NEWPORT, and the directory's attributes,
+   into REPLY.  Consumes NEWPORT.  */
+static error_t
+reply_created (struct cache_handle *c, char *name, file_t newport,
+	       int **reply)
+{
+  struct cache_handle *newc;
+  struct stat st;
+  error_t err;
+
+  err = io_stat (newport, &st);
+  if (err)
+    {
+      mach_port_deallocate (mach_task_self (), newport);
+      return err;
+    }
+
+  newc = create_cached_handle (c->handle.fs, c, newport);
+  if (newc)
+    {
+      *(*reply)++ = htonl (1);
+      *reply = encode_fhandle (*reply, newc->handle.array, 3);
+      cache_handle_rele (newc);
+      *reply = encode_post_op_attr (*reply, &st);
+    }
+  else
+    {
+      /* The client can still find it with LOOKUP.  */
+      *(*reply)++ = htonl (0);
+      *reply = encode_post_op_attr (*reply, 0);
+    }
+  *reply = encode_dir_wcc (*reply, c->port);
+  return 0;
+}
+
+static error_t
+op3_create (struct cache_handle *c,
+	    int *p,
+	    int **reply,
+	    int version)
+{
+  error_t err;
+  char *name;
+  int how;
+  int flags = O_NOTRANS | O_CREAT;
+  struct sattr3 sa;
+  retry_type do_retry;
+  char retry_name [1024];
+  mach_port_t newport;
+  struct stat st;
+  int created = 1;
+
+  p = decode_name (p, &name);
+  how = ntohl (*p);
+  p++;
+
+  memset (&sa, 0, sizeof sa);
+  if (how == EXCLUSIVE)
+    /* We don't keep the create verifier, so a retransmitted exclusive
+       create that missed the reply cache fails with EEXIST.  */
+    flags |= O_EXCL;
+  else
+    {
+      p = decode_sattr3 (p, &sa);
+      if (how == GUARDED)
+	flags |= O_EXCL;
+      if (sa.set_size && sa.size == 0)
+	{
+	  flags |= O_TRUNC;
+	  sa.set_size = 0;
+	}
+    }
+
+  /* Even an unchecked create is tried exclusively first, so that we know
+     whether the file is ours to remove if setting its attributes fails.  */
+  err = dir_lookup (c->port, name, flags | O_EXCL,
+		    sa.set_mode ? sa.mode : 0666,
+		    &do_retry, retry_name, &newport);
+  if (err == EEXIST && !(flags & O_EXCL))
+    {
+      created = 0;
+      err = dir_lookup (c->port, name, flags, sa.set_mode ? sa.mode : 0666,
+			&do_retry, retry_name, &newport);
+    }
+  if (!err
+      && (do_retry != FS_RETRY_NORMAL
+	  || retry_name[0] != '\0'))
+    err = EACCES;
+  if (err)
+    {
+      free (name);
+      return err;
+    }
+
+  err = io_stat (newport, &st);
+  if (!err)
+    err = apply_sattr3 (newport, &sa, &st);
+  if (err)
+    {
+      mach_port_deallocate (mach_task_self (), newport);
+      if (created)
+	/* Don't leave a file behind that the client was told we could not
+	   make; one that was there already is the client's, though.  */
+	dir_unlink (c->port, name);
+      free (name);
+      return err;
+    }
+
+  err = reply_created (c, name, newport, reply);
+  free (name);
+  return err;
+}
+
+static error_t
+op3_mkdir (struct cache_handle *c,
+	   int *p,
+	   int **reply,
+	   int version)
+{
+  char *name;
+  struct sattr3 sa;
+  retry_type do_retry;
+  char retry_name [1024];
+  mach_port_t newport;
+  error_t err;
+
+  p = decode_name (p, &name);
+  p = decode_sattr3 (p, &sa);
+
+  err = dir_mkdir (c->port, name, sa.set_mode ? sa.mode : 0777);
+  if (!err)
+    err = dir_lookup (c->port, name, O_NOTRANS, 0, &do_retry,
+		      retry_name, &newport);
+  if (!err
+      && (do_retry != FS_RETRY_NORMAL
+	  || retry_name[0] != '\0'))
+    err = EACCES;
+
+  if (!err)
+    err = reply_created (c, name, newport, reply);
+  free (name);
+  return err;
+}
+
+static error_t
+op3_symlink (struct cache_handle *c,
+	     int *p,
+	     int **reply,
+	     int version)
+{
+  char *name, *target;
+  struct sattr3 sa;
+  file_t newport;
+  error_t err;
+
+  p = decode_name (p, &name);
+  p = decode_sattr3 (p, &sa);
+  p = decode_name (p, &target);
+
+  err = make_symlink (c->port, name, target,
+		      sa.set_mode ? sa.mode : 0777, &newport);
+  if (!err)
+    {
+      err = reply_created (c, name, newport, reply);
+      newport = MACH_PORT_NULL;
+    }
+
+  free (name);
+  free (target);
+  if (newport != MACH_PORT_NULL)
+    mach_port_deallocate (mach_task_self (), newport);
+  return err;
+}
+
+static error_t
+op3_mknod (struct cache_handle *c,
+	   int *p,
+	   int **reply,
+	   int version)
+{
+  /* Device and fifo nodes are translators in the Hurd.  */
+  return EOPNOTSUPP;
+}
+
+/* Implement NFSv3 READDIR, or READDIRPLUS if PLUS is set.  */
+static error_t
+readdir3 (struct cache_handle *c,
+	  int *p,
+	  int **reply,
+	  int plus)
+{
+  uint64_t cookie;
+  unsigned count;
+  error_t err;
+  char *buf;
+  struct dirent *dp;
+  size_t bufsize;
+  int nentries;
+  int i;
+  int *r;
+  char *limit;
+  struct stat st;
+
+  p = decode_uint64 (p, &cookie);
+  p += NFS3_COOKIEVERFSIZE / sizeof (int);
+  if (plus)
+    p++;			/* Skip DIRCOUNT; MAXCOUNT limits us.  */
+  count = ntohl (*p);
+  p++;
+
+  buf = (char *) 0;
+  bufsize = 0;
+  err = dir_readdir (c->port, &buf, &bufsize, cookie, -1, count, &nentries);
+  if (!err)
+    err = io_stat (c->port, &st);
+  if (err)
+    {
+      if (buf)
+	munmap (buf, bufsize);
+      return err;
+    }
+
+  r = *reply;
+  /* Leave room for the two words that end the reply.  */
+  limit = (char *) r + count - 2 * sizeof (int);
+
+  r = encode_post_op_attr (r, &st);
+  *(r++) = 0;			/* Cookie verifier.  */
+  *(r++) = 0;
+
+  for (i = 0, dp = (struct dirent *) buf;
+       (char *)dp < buf + bufsize && i < nentries;
+       i++, dp = (struct dirent *) ((char *)dp + dp->d_reclen))
+    {
+      size_t namelen = strlen (dp->d_name);
+      size_t need;
+
+      /* Present bit, fileid, name and cookie, then attributes and a
+	 handle for READDIRPLUS.  */
+      need = (6 + INTSIZE (namelen)) * sizeof (int);
+      if (plus)
+	need += (2 + 21 + 2) * sizeof (int) + NFS2_FHSIZE;
+      if ((char *) r + need > limit)
+	break;
+
+      *(r++) = htonl (1);			/* Entry present.  */
+      r = encode_uint64 (r, dp->d_ino);
+      r = encode_data (r, dp->d_name, namelen);
+      r = encode_uint64 (r, cookie + i + 1);	/* Next entry.  */
+
+      if (plus)
+	{
+	  retry_type do_retry;
+	  char retry_name [1024];
+	  mach_port_t port;
+	  struct cache_handle *newc = 0;
+	  struct stat est;
+
+	  if (!dir_lookup (c->port, dp->d_name, O_NOTRANS, 0, &do_retry,
+			   retry_name, &port))
+	    {
+	      /* Don't hand out handles outside this filesystem, e.g. for
+		 `..' at its root.  */
+	      if (do_retry == FS_RETRY_NORMAL && retry_name[0] == '\0'
+		  && !io_stat (port, &est))
+		newc = create_cached_handle (c->handle.fs, c, port);
+	      else
+		mach_port_deallocate (mach_task_self (), port);
+	    }
+
+	  if (newc)
+	    {
+	      r = encode_post_op_attr (r, &est);
+	      *(r++) = htonl (1);
+	      r = encode_fhandle (r, newc->handle.array, 3);
+	      cache_handle_rele (newc);
+	    }
+	  else
+	    {
+	      r = encode_post_op_attr (r, 0);
+	      *(r++) = htonl (0);
+	    }
+	}
+    }
+
+  if (nentries > 0 && i == 0)
+    {
+      /* Not even one entry fits in COUNT.  */
+      munmap (buf, bufsize);
+      return EOVERFLOW;
+    }
+
+  *(r++) = htonl (0);			/* No more entries.  */
+  *(r++) = htonl (nentries == 0);	/* EOF.  */
+
+  *reply = r;
+
+  if (buf)
+    munmap (buf, bufsize);
+
+  return 0;
+}
+
+static error_t
+op3_readdir (struct cache_handle *c,
+	     int *p,
+	     int **reply,
+	     int version)
+{
+  return readdir3 (c, p, reply, 0);
+}
+
+static error_t
+op3_readdirplus (struct cache_handle *c,
+		 int *p,
+		 int **reply,
+		 int version)
+{
+  return readdir3 (c, p, reply, 1);
+}
+
+static size_t
+count_readdir3_buffersize (int *p, int version)
+{
+  p += 2 + NFS3_COOKIEVERFSIZE / sizeof (int);	/* Skip COOKIE, VERF.  */
+  return ntohl (*p);	/* Return COUNT.  */
+}
+
+static size_t
+count_readdirplus_buffersize (int *p, int version)
+{
+  p += 2 + NFS3_COOKIEVERFSIZE / sizeof (int);	/* Skip COOKIE, VERF.  */
+  p++;			/* Skip DIRCOUNT.  */
+  return ntohl (*p);	/* Return MAXCOUNT.  */
+}
+
+static error_t
+op3_fsstat (struct cache_handle *c,
+	    int *p,
+	    int **reply,
+	    int version)
+{
+  struct statfs sfs;
+  struct stat st;
+  error_t err;
+
+  err = file_statfs (c->port, &sfs);
+  if (!err)
+    err = io_stat (c->port, &st);
+  if (err)
+    return err;
+
+  *reply = encode_post_op_attr (*reply, &st);
+  *reply = encode_uint64 (*reply, (uint64_t) sfs.f_blocks * sfs.f_bsize);
+  *reply = encode_uint64 (*reply, (uint64_t) sfs.f_bfree * sfs.f_bsize);
+  *reply = encode_uint64 (*reply, (uint64_t) sfs.f_bavail * sfs.f_bsize);
+  *reply = encode_uint64 (*reply, sfs.f_files);
+  *reply = encode_uint64 (*reply, sfs.f_ffree);
+  *reply = encode_uint64 (*reply, sfs.f_ffree);
+  *(*reply)++ = htonl (0);	/* Invarsec: the numbers may change.  */
+  return 0;
+}
+
+static error_t
+op3_fsinfo (struct cache_handle *c,
+	    int *p,
+	    int **reply,
+	    int version)
+{
+  struct stat st;
+  size_t max = max_data3 ();
+  error_t err;
+
+  err = io_stat (c->port, &st);
+  if (err)
+    return err;
+
+  *reply = encode_post_op_attr (*reply, &st);
+  *(*reply)++ = htonl (max);		/* rtmax */
+  *(*reply)++ = htonl (max);		/* rtpref */
+  *(*reply)++ = htonl (st.st_blksize);	/* rtmult */
+  *(*reply)++ = htonl (max);		/* wtmax */
+  *(*reply)++ = htonl (max);		/* wtpref */
+  *(*reply)++ = htonl (st.st_blksize);	/* wtmult */
+  *(*reply)++ = htonl (MAXIOSIZE - 1024);	/* dtpref */
+  *reply = encode_uint64 (*reply, INT64_MAX);	/* maxfilesize */
+  *(*reply)++ = htonl (0);		/* time_delta: one microsecond.  */
+  *(*reply)++ = htonl (1000);
+  *(*reply)++ = htonl (FSF3_LINK | FSF3_SYMLINK | FSF3_HOMOGENEOUS
+		       | FSF3_CANSETTIME);
+  return 0;
+}
+
+static error_t
+op3_pathconf (struct cache_handle *c,
+	      int *p,
+	      int **reply,
+	      int version)
+{
+  struct stat st;
+  int linkmax, namemax;
+  error_t err;
+
+  err = io_stat (c->port, &st);
+  if (err)
+    return err;
+
+  if (io_pathconf (c->port, _PC_LINK_MAX, &linkmax))
+    linkmax = INT_MAX;		/* No fixed limit.  */
+  if (io_pathconf (c->port, _PC_NAME_MAX, &namemax))
+    namemax = NFS_MAXNAMLEN;
+
+  *reply = encode_post_op_attr (*reply, &st);
+  *(*reply)++ = htonl (linkmax);
+  *(*reply)++ = htonl (namemax);
+  *(*reply)++ = htonl (1);	/* no_trunc */
+  *(*reply)++ = htonl (1);	/* chown_restricted */
+  *(*reply)++ = htonl (0);	/* case_insensitive */
+  *(*reply)++ = htonl (1);	/* case_preserving */
+  return 0;
+}
+
+static error_t
+op3_commit (struct cache_handle *c,
+	    int *p,
+	    int **reply,
+	    int version)
+{
+  struct stat st;
+  error_t err;
+
+  /* Unstable writes to this file, through any handle, were left in the
+     filesystem's cache by op_write; write them out now.  The offset
+     and count are only hints, so sync the whole file.  */
+  __atomic_store_n (&c->unstable, 0, __ATOMIC_RELAXED);
+  err = file_sync (c->port, 1, 0);
+  if (!err)
+    err = io_stat (c->port, &st);
+  if (err)
+    return err;
+
+  *reply = encode_wcc_data (*reply, 0, &st);
+  *(*reply)++ = write_verifier[0];
+  *(*reply)++ = write_verifier[1];
+  return 0;
+}
+
 
 struct proctable nfs2table =
 {
@@ -725,6 +1474,38 @@ struct proctable nfs2table =
   }
 };
 
+struct proctable nfs3table =
+{
+  NFS3PROC_NULL,		/* First proc.  */
+  NFS3PROC_COMMIT,		/* Last proc.  */
+  {
+    { op_null, 0, 0, 0, 0},
+    { op_getattr, 0, 1, 1, 0},
+    { op3_setattr, 0, 1, 1, 2},
+    { op_lookup, 0, 1, 1, 1},
+    { op3_access, 0, 1, 1, 1},
+    { op_readlink, 0, 1, 1, 1},
+    /* READ data beyond what fits in op_read's buffer is sent out of
+       line, so the reply buffer needn't be enlarged.  */
+    { op_read, 0, 1, 1, 1},
+    { op_write, 0, 1, 1, 2},
+    { op3_create, 0, 1, 1, 2},
+    { op3_mkdir, 0, 1, 1, 2},
+    { op3_symlink, 0, 1, 1, 2},
+    { op3_mknod, 0, 1, 1, 2},
+    { op_remove, 0, 1, 1, 2},
+    { op_rmdir, 0, 1, 1, 2},
+    { op_rename, 0, 1, 1, 4},
+    { op_link, 0, 1, 1, 3},
+    { op3_readdir, count_readdir3_buffersize, 1, 1, 1},
+    { op3_readdirplus, count_readdirplus_buffersize, 1, 1, 1},
+    { op3_fsstat, 0, 1, 1, 1},
+    { op3_fsinfo, 0, 1, 1, 1},
+    { op3_pathconf, 0, 1, 1, 1},
+    { op3_commit, 0, 1, 1, 2},
+  }
+};
+
 
 struct proctable mounttable =
 {
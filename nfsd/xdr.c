@@ -22,6 +22,7 @@
 
 #include <sys/stat.h>
 #include <sys/statfs.h>
+#include <sys/sysmacros.h>
 #include <string.h>
 #include "nfsd.h"
 
@@ -63,10 +64,50 @@ hurd_mode_to_nfs_type (mode_t m, int version)
     }
 }
 
+/* Encode VAL as an XDR unsigned hyper into P and return the next
+   thing to come after it.  */
+int *
+encode_uint64 (int *p, uint64_t val)
+{
+  *(p++) = htonl (val >> 32);
+  *(p++) = htonl (val & 0xffffffff);
+  return p;
+}
+
+/* Decode P into VAL and return the next thing to come after it.  */
+int *
+decode_uint64 (int *p, uint64_t *val)
+{
+  *val = (uint64_t) ntohl (p[0]) << 32 | (uint32_t) ntohl (p[1]);
+  return p + 2;
+}
+
 /* Encode ST into P and return the next thing to come after it.  */
 int *
 encode_fattr (int *p, struct stat *st, int version)
 {
+  if (version == 3)
+    {
+      *(p++) = htonl (hurd_mode_to_nfs_type (st->st_mode, version));
+      *(p++) = htonl (hurd_mode_to_nfs_mode (st->st_mode) & 07777);
+      *(p++) = htonl (st->st_nlink);
+      *(p++) = htonl (st->st_uid);
+      *(p++) = htonl (st->st_gid);
+      p = encode_uint64 (p, st->st_size);
+      p = encode_uint64 (p, (uint64_t) st->st_blocks * 512);
+      *(p++) = htonl (major (st->st_rdev));
+      *(p++) = htonl (minor (st->st_rdev));
+      p = encode_uint64 (p, st->st_fsid);
+      p = encode_uint64 (p, st->st_ino);
+      *(p++) = htonl (st->st_atim.tv_sec);
+      *(p++) = htonl (st->st_atim.tv_nsec);
+      *(p++) = htonl (st->st_mtim.tv_sec);
+      *(p++) = htonl (st->st_mtim.tv_nsec);
+      *(p++) = htonl (st->st_ctim.tv_sec);
+      *(p++) = htonl (st->st_ctim.tv_nsec);
+      return p;
+    }
+
   *(p++) = htonl (hurd_mode_to_nfs_type (st->st_mode, version));
   *(p++) = htonl (hurd_mode_to_nfs_mode (st->st_mode));
   *(p++) = htonl (st->st_nlink);
@@ -101,10 +142,49 @@ decode_name (int *p, char **name)
   return p + INTSIZE (len);
 }
 
-/* Encode HANDLE into P and return the next thing to come after it.  */
+/* Encode NFSv3 post-operation attributes ST, or their absence if ST
+   is null, into P and return the next thing to come after it.  */
+int *
+encode_post_op_attr (int *p, struct stat *st)
+{
+  if (!st)
+    {
+      *(p++) = htonl (0);
+      return p;
+    }
+  *(p++) = htonl (1);
+  return encode_fattr (p, st, 3);
+}
+
+/* Encode NFSv3 weak cache consistency data for an object whose
+   attributes were PRE before the operation and are POST after it,
+   either of which may be null, into P and return the next thing to
+   come after it.  */
 int *
-encode_fhandle (int *p, char *handle)
+encode_wcc_data (int *p, struct stat *pre, struct stat *post)
 {
+  if (pre)
+    {
+      *(p++) = htonl (1);
+      p = encode_uint64 (p, pre->st_size);
+      *(p++) = htonl (pre->st_mtim.tv_sec);
+      *(p++) = htonl (pre->st_mtim.tv_nsec);
+      *(p++) = htonl (pre->st_ctim.tv_sec);
+      *(p++) = htonl (pre->st_ctim.tv_nsec);
+    }
+  else
+    *(p++) = htonl (0);
+  return encode_post_op_attr (p, post);
+}
+
+/* Encode HANDLE into P and return the next thing to come after it.
+   NFSv3 and version 3 of the mount protocol use variable length
+   handles; ours are always NFS2_FHSIZE bytes.  */
+int *
+encode_fhandle (int *p, char *handle, int version)
+{
+  if (version == 3)
+    *(p++) = htonl (NFS2_FHSIZE);
   memcpy (p, handle, NFS2_FHSIZE);
   return p + INTSIZE (NFS2_FHSIZE);
 }
@@ -197,6 +277,9 @@ nfs_error_trans (error_t err, int version)
     case ESTALE:
       return NFSERR_STALE;
 
+    case EFBIG:
+      return NFSERR_FBIG;
+
     default:
       if (version == 2)
 	return NFSERR_IO;
@@ -210,6 +293,18 @@ nfs_error_trans (error_t err, int version)
 	  
 	case EOPNOTSUPP:
 	  return NFSERR_NOTSUPP;	/* Are we sure here?  */
+
+	case EMLINK:
+	  return NFSERR_MLINK;
+
+	case EAGAIN:
+	  return NFSERR_JUKEBOX;
+
+	case ENFSNOTSYNC:
+	  return NFSERR_NOT_SYNC;
+
+	case EOVERFLOW:
+	  return NFSERR_TOOSMALL;
 	  
 	default:
 	  return NFSERR_IO;
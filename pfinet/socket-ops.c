@@ -546,3 +546,11 @@ S_socket_recv (struct sock_user *user,
 
   return err;
 }
+
+error_t
+S_socket_splice (struct sock_user *user, mach_port_t source, off_t offset,
+		 size_t amount, size_t *moved)
+{
+  /* Not supported; callers fall back to reading and writing themselves.  */
+  return EOPNOTSUPP;
+}
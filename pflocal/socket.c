@@ -20,6 +20,7 @@
 
 #include <sys/socket.h>
 
+#include <hurd/io.h>
 #include <hurd/pipe.h>
 
 #include "sock.h"
@@ -428,6 +429,114 @@ S_socket_recv (struct sock_user *user,
   return err;
 }
 
+/* Write up to AMOUNT bytes read from SOURCE to USER's socket, without the
+   data passing through the caller.  */
+error_t
+S_socket_splice (struct sock_user *user, mach_port_t source, off_t offset,
+		 size_t amount, size_t *moved)
+{
+  error_t err;
+  struct pq *pq;
+  struct pipe *pipe;
+  struct sock_user *source_user;
+
+  if (!user)
+    return EOPNOTSUPP;
+  if (user->sock->pipe_class != stream_pipe_class)
+    return EOPNOTSUPP;
+
+  /* Don't take anything from SOURCE that could not be written.  */
+  err = sock_acquire_write_pipe (user->sock, &pipe);
+  if (err)
+    return err;
+  if (pipe->flags & PIPE_BROKEN)
+    err = EPIPE;
+  pipe_release_writer (pipe);
+  if (err)
+    return err;
+
+  err = pq_create (&pq);
+  if (err)
+    return err;
+
+  *moved = 0;
+
+  source_user = ports_lookup_port (0, source, sock_user_port_class);
+  if (source_user)
+    /* One of our sockets; take its queued packets as they are.  */
+    {
+      err = sock_acquire_read_pipe (source_user->sock, &pipe);
+      if (err == EPIPE)
+	/* EOF */
+	err = 0;
+      else if (!err && pipe)
+	{
+	  err = pipe_take (pipe,
+			   source_user->sock->flags & PFLOCAL_SOCK_NONBLOCK,
+			   pq, amount, moved);
+	  pipe_release_reader (pipe);
+	}
+      ports_port_deref (source_user);
+    }
+  else
+    /* Something else, so read it ourselves.  */
+    {
+      char buf[2048], *data = buf;
+      mach_msg_type_number_t data_len = sizeof buf;
+
+      err = io_read (source, &data, &data_len, offset, amount);
+      if (!err && data_len > 0)
+	{
+	  if (data != buf && data_len >= PACKET_SIZE_LARGE)
+	    /* The data came out-of-line; queue those very pages.  */
+	    {
+	      struct packet *packet = pq_queue (pq, PACKET_TYPE_DATA, NULL);
+	      if (packet)
+		packet_set_vm_buf (packet, data, data_len);
+	      else
+		{
+		  munmap (data, data_len);
+		  err = ENOBUFS;
+		}
+	    }
+	  else
+	    {
+	      size_t written;
+	      err = (*stream_pipe_class->write) (pq, NULL, data, data_len,
+						 &written);
+	      if (data != buf)
+		munmap (data, data_len);
+	    }
+	  if (!err)
+	    *moved = data_len;
+	}
+    }
+
+  if (!err && *moved > 0)
+    {
+      err = sock_acquire_write_pipe (user->sock, &pipe);
+      if (!err)
+	{
+	  /* The data has already been taken from SOURCE, so wait for room
+	     even if USER is non-blocking rather than lose it.  */
+	  err = pipe_give (pipe, 0, pq);
+	  pipe_release_writer (pipe);
+	}
+    }
+
+  /* Discards anything that couldn't be written, which only happens if
+     the reader went away since we checked, or we were interrupted; the
+     error says so.  */
+  pq_free (pq);
+
+  if (!err)
+    /* Since SOURCE isn't in the receiver position in the rpc, we get a send
+       right for it, which we must deallocate.  */
+    mach_port_deallocate (mach_task_self (), source);
+
+  return err;
+}
+
 error_t
 S_socket_getopt (struct sock_user *user,
 		 int level, int opt,
@@ -115,11 +115,11 @@ S_proc_task2proc (struct proc *callerp,
       error_t err;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2proc (p->p_task_namespace, t, outproc);
 
-      pthread_mutex_lock (&global_lock);
+      reacquire_global_lock ();
 
       if (! err)
 	{
@@ -179,11 +179,11 @@ S_proc_pid2proc (struct proc *callerp,
       error_t err;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2proc (p->p_task_namespace, p->p_task, outproc);
 
-      pthread_mutex_lock (&global_lock);
+      reacquire_global_lock ();
 
       if (! err)
 	{
@@ -395,13 +395,13 @@ S_proc_getprocargs (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
 	err = proc_getprocargs (p->p_task_namespace, pid_sub, buf, buflen);
 
-      pthread_mutex_lock (&global_lock);
+      reacquire_global_lock ();
 
       if (! err)
 	return 0;
@@ -433,13 +433,13 @@ S_proc_getprocenv (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
 	err = proc_getprocenv (p->p_task_namespace, pid_sub, buf, buflen);
 
-      pthread_mutex_lock (&global_lock);
+      reacquire_global_lock ();
 
       if (! err)
 	return 0;
@@ -490,7 +490,7 @@ S_proc_getprocinfo (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
@@ -516,11 +516,11 @@ S_proc_getprocinfo (struct proc *callerp,
 			 &t_logincollection);
 
 	  /* Reacquire the global lock for the hash table lookups.  */
-	  pthread_mutex_lock (&global_lock);
+	  reacquire_global_lock ();
 
 	  if (MACH_PORT_VALID (t_ppid))
 	    {
-	      struct proc *q = task_find (t_ppid);
+	      struct proc *q = task_find_nocreate (t_ppid);
 	      pi->ppid = q ? q->p_pid : (pid_t) -1;
 	      mach_port_deallocate (mach_task_self (), t_ppid);
 	    }
@@ -534,19 +534,19 @@ S_proc_getprocinfo (struct proc *callerp,
 	    }
 	  if (MACH_PORT_VALID (t_pgrp))
 	    {
-	      struct proc *q = task_find (t_pgrp);
+	      struct proc *q = task_find_nocreate (t_pgrp);
 	      pi->pgrp = q ? q->p_pid : (pid_t) -1;
 	      mach_port_deallocate (mach_task_self (), t_pgrp);
 	    }
 	  if (MACH_PORT_VALID (t_session))
 	    {
-	      struct proc *q = task_find (t_session);
+	      struct proc *q = task_find_nocreate (t_session);
 	      pi->session = q ? q->p_pid : (pid_t) -1;
 	      mach_port_deallocate (mach_task_self (), t_session);
 	    }
 	  if (MACH_PORT_VALID (t_logincollection))
 	    {
-	      struct proc *q = task_find (t_logincollection);
+	      struct proc *q = task_find_nocreate (t_logincollection);
 	      pi->logincollection = q ? q->p_pid : (pid_t) -1;
 	      mach_port_deallocate (mach_task_self (), t_logincollection);
 	    }
@@ -554,15 +554,18 @@ S_proc_getprocinfo (struct proc *callerp,
 	  return 0;
 	}
 
-      pthread_mutex_lock (&global_lock);
+      reacquire_global_lock ();
       err = 0;
       /* Fallback.  */
     }
 
   task = p->p_task;
 
-  check_msgport_death (p);
+  /* We only hold STATE_LOCK for reading, so leave it to
+     check_msgport_death to throw away a dead message port.  */
   msgport = p->p_msgport;
+  if (msgport_dead_p (msgport))
+    msgport = MACH_PORT_NULL;
 
   if (*flags & PI_FETCH_THREAD_DETAILS)
     *flags |= PI_FETCH_THREADS;
@@ -606,7 +609,7 @@ S_proc_getprocinfo (struct proc *callerp,
      | (p->p_exec ? PI_EXECED : 0)
      | (p->p_waiting ? PI_WAITING : 0)
      | (!p->p_pgrp->pg_orphcnt ? PI_ORPHAN : 0)
-     | (p->p_msgport == MACH_PORT_NULL ? PI_NOMSG : 0)
+     | (msgport == MACH_PORT_NULL ? PI_NOMSG : 0)
      | (p->p_pgrp->pg_session->s_sid == p->p_pid ? PI_SESSLD : 0)
      | (p->p_noowner ? PI_NOTOWNED : 0)
      | (!p->p_parentset ? PI_NOPARENT : 0)
@@ -632,7 +635,7 @@ S_proc_getprocinfo (struct proc *callerp,
 
   /* Release GLOBAL_LOCK around time consuming bits, and more importatantly,
      potential calls to P's msgport, which can block.  */
-  pthread_mutex_unlock (&global_lock);
+  release_global_lock ();
 
   if (*flags & PI_FETCH_TASKINFO)
     {
@@ -783,11 +786,128 @@ S_proc_getprocinfo (struct proc *callerp,
     *waits_len = waits_used;
 
   /* Reacquire GLOBAL_LOCK to make the central locking code happy.  */
-  pthread_mutex_lock (&global_lock);
+  reacquire_global_lock ();
 
   return err;
 }
 
+/* Make *ARRAY, an array of *SIZE ints of which the first USED are in
+   use, big enough for USED + MORE ints.  *ALLOCED says whether *ARRAY
+   was mmapped by us (rather than being the buffer MiG gave us), and is
+   set if a new array is made.  */
+static error_t
+grow_int_array (int **array, size_t *size, size_t used, size_t more,
+		int *alloced)
+{
+  size_t new_size;
+  int *new_array;
+
+  if (used + more <= *size)
+    return 0;
+
+  new_size = 2 * *size;
+  if (new_size < used + more)
+    new_size = used + more;
+  new_size = round_page (new_size * sizeof (int)) / sizeof (int);
+
+  new_array = mmap (0, new_size * sizeof (int), PROT_READ|PROT_WRITE,
+		    MAP_ANON, 0, 0);
+  if (new_array == MAP_FAILED)
+    return errno;
+
+  if (used > 0)
+    memcpy (new_array, *array, used * sizeof (int));
+  if (*alloced)
+    munmap (*array, *size * sizeof (int));
+  *array = new_array;
+  *size = new_size;
+  *alloced = 1;
+  return 0;
+}
+
+/* Implement proc_getprocinfos as described in <hurd/process.defs>. */
+kern_return_t
+S_proc_getprocinfos (struct proc *callerp,
+		     pid_t *pids,
+		     mach_msg_type_number_t npids,
+		     int flags,
+		     int **piarray,
+		     mach_msg_type_number_t *piarraylen,
+		     int **lengths,
+		     mach_msg_type_number_t *lengthslen,
+		     int **infoflags,
+		     mach_msg_type_number_t *infoflagslen)
+{
+  size_t pi_size = *piarraylen, pi_used = 0;
+  size_t lengths_size = *lengthslen, infoflags_size = *infoflagslen;
+  int pi_alloced = 0, lengths_alloced = 0, infoflags_alloced = 0;
+  mach_msg_type_number_t i;
+  error_t err;
+
+  /* No need to check CALLERP here; we don't use it. */
+
+  /* Thread waits mean an RPC to each process's msgport, which could
+     hold up the whole reply; those who want them must ask for them one
+     process at a time.  */
+  flags &= ~PI_FETCH_THREAD_WAITS;
+
+  err = grow_int_array (lengths, &lengths_size, 0, npids, &lengths_alloced);
+  if (! err)
+    err = grow_int_array (infoflags, &infoflags_size, 0, npids,
+			  &infoflags_alloced);
+  if (err)
+    goto lose;
+
+  for (i = 0; i < npids; i++)
+    {
+      /* Have S_proc_getprocinfo put the record right after the ones we
+	 already have, if there is room for it.  */
+      int *pi = *piarray + pi_used;
+      size_t pi_len = pi_size - pi_used;
+      int pi_flags = flags;
+      char *waits = 0;
+      mach_msg_type_number_t waits_len = 0;
+
+      if (S_proc_getprocinfo (callerp, pids[i], &pi_flags,
+			      &pi, &pi_len, &waits, &waits_len))
+	{
+	  (*lengths)[i] = 0;
+	  (*infoflags)[i] = 0;
+	  continue;
+	}
+
+      if (pi != *piarray + pi_used)
+	/* It didn't fit, and was returned in fresh memory instead.  */
+	{
+	  err = grow_int_array (piarray, &pi_size, pi_used, pi_len,
+				&pi_alloced);
+	  if (! err)
+	    memcpy (*piarray + pi_used, pi, pi_len * sizeof (int));
+	  munmap (pi, pi_len * sizeof (int));
+	  if (err)
+	    goto lose;
+	}
+
+      pi_used += pi_len;
+      (*lengths)[i] = pi_len;
+      (*infoflags)[i] = pi_flags;
+    }
+
+  *piarraylen = pi_used;
+  *lengthslen = npids;
+  *infoflagslen = npids;
+  return 0;
+
+ lose:
+  if (pi_alloced)
+    munmap (*piarray, pi_size * sizeof (int));
+  if (lengths_alloced)
+    munmap (*lengths, lengths_size * sizeof (int));
+  if (infoflags_alloced)
+    munmap (*infoflags, infoflags_size * sizeof (int));
+  return err;
+}
+
 /* Implement proc_make_login_coll as described in <hurd/process.defs>. */
 kern_return_t
 S_proc_make_login_coll (struct proc *p)
@@ -819,16 +939,16 @@ S_proc_getloginid (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
 	err = proc_getloginid (p->p_task_namespace, pid_sub, leader);
       if (! err)
-	/* Acquires global_lock.  */
+	/* Reacquires our locks.  */
 	err = namespace_translate_pids (p->p_task_namespace, leader, 1);
       else
-	pthread_mutex_lock (&global_lock);
+	reacquire_global_lock ();
 
       if (! err)
 	return 0;
@@ -871,16 +991,16 @@ S_proc_getloginpids (struct proc *callerp,
       task_t leader_task;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2pid (l->p_task_namespace, l->p_task, &pid_sub);
       if (! err)
 	err = proc_getloginpids (l->p_task_namespace, pid_sub, pids, npids);
       if (! err)
-	/* Acquires global_lock.  */
+	/* Reacquires our locks.  */
 	err = namespace_translate_pids (l->p_task_namespace, *pids, *npids);
       else
-	pthread_mutex_lock (&global_lock);
+	reacquire_global_lock ();
 
       if (! err)
 	return 0;
@@ -42,27 +42,108 @@ const char *argp_program_version = STANDARD_HURD_VERSION (proc);
 #include "proc_exc_S.h"
 #include "task_notify_S.h"
 
+pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_rwlock_t state_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* Nonzero if this thread holds STATE_LOCK only for reading.  */
+static __thread int state_lock_shared;
+
+/* The first message id of <hurd/process.defs>.  */
+#define PROCESS_SUBSYSTEM 24000
+
+/* Return nonzero if the RPC in <hurd/process.defs> with message id ID
+   only looks at our state, and so can be served holding STATE_LOCK
+   just for reading.  The ids are the RPCs' positions in process.defs,
+   counting skips.  */
+static int
+process_rpc_is_query (mach_msg_id_t id)
+{
+  switch (id - PROCESS_SUBSYSTEM)
+    {
+    case 16:			/* proc_getpids */
+    case 18:			/* proc_get_arg_locations */
+    case 29:			/* proc_pid2task */
+    case 32:			/* proc_proc2task */
+    case 33:			/* proc_pid2proc */
+    case 34:			/* proc_getprocinfo */
+    case 35:			/* proc_getprocargs */
+    case 36:			/* proc_getprocenv */
+    case 38:			/* proc_getloginid */
+    case 39:			/* proc_getloginpids */
+    case 41:			/* proc_getlogin */
+    case 43:			/* proc_getsid */
+    case 44:			/* proc_getsessionpgids */
+    case 45:			/* proc_getsessionpids */
+    case 48:			/* proc_getpgrp */
+    case 49:			/* proc_getpgrppids */
+    case 51:			/* proc_getnports */
+    case 54:			/* proc_is_important */
+    case 56:			/* proc_get_code */
+    case 58:			/* proc_getprocinfos */
+      return 1;
+    default:
+      return 0;
+    }
+}
+
+/* Release the locks this thread holds on our state.  */
+void
+release_global_lock (void)
+{
+  pthread_rwlock_unlock (&state_lock);
+  if (! state_lock_shared)
+    pthread_mutex_unlock (&global_lock);
+}
+
+/* Take again the locks released by release_global_lock.  */
+void
+reacquire_global_lock (void)
+{
+  if (state_lock_shared)
+    pthread_rwlock_rdlock (&state_lock);
+  else
+    {
+      pthread_mutex_lock (&global_lock);
+      pthread_rwlock_wrlock (&state_lock);
+    }
+}
+
+/* Wait for COND to be signalled, releasing our locks meanwhile.  This
+   may only be used by RPCs that change our state.  Return what
+   pthread_hurd_cond_wait_np returns.  */
+int
+wait_global_lock (pthread_cond_t *cond)
+{
+  int cancel;
+
+  assert (! state_lock_shared);
+  pthread_rwlock_unlock (&state_lock);
+  cancel = pthread_hurd_cond_wait_np (cond, &global_lock);
+  pthread_rwlock_wrlock (&state_lock);
+  return cancel;
+}
+
 int
 message_demuxer (mach_msg_header_t *inp,
 		 mach_msg_header_t *outp)
 {
   mig_routine_t routine;
-  if ((routine = process_server_routine (inp)) ||
-      (routine = notify_server_routine (inp)) ||
-      (routine = ports_interrupt_server_routine (inp)) ||
-      (routine = proc_exc_server_routine (inp)) ||
-      (routine = task_notify_server_routine (inp)))
-    {
-      pthread_mutex_lock (&global_lock);
-      (*routine) (inp, outp);
-      pthread_mutex_unlock (&global_lock);
-      return TRUE;
-    }
+  if ((routine = process_server_routine (inp)))
+    state_lock_shared = process_rpc_is_query (inp->msgh_id);
+  else if ((routine = notify_server_routine (inp)) ||
+	   (routine = ports_interrupt_server_routine (inp)) ||
+	   (routine = proc_exc_server_routine (inp)) ||
+	   (routine = task_notify_server_routine (inp)))
+    state_lock_shared = 0;
   else
     return FALSE;
+
+  reacquire_global_lock ();
+  (*routine) (inp, outp);
+  release_global_lock ();
+  return TRUE;
 }
 
-pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
 int startup_fallback;
 
 error_t
@@ -237,6 +318,13 @@ main (int argc, char **argv, char **envp)
 					MACH_MSG_TYPE_MAKE_SEND);
   if (err)
     error (0, err, "Registering task notifications failed");
+  else
+    {
+      /* From now on we hear of every new task, so pick up those
+	 created until now and stop scanning for them.  */
+      add_tasks (MACH_PORT_NULL);
+      tasks_tracked = 1;
+    }
 
   startup = file_name_lookup (_SERVERS_STARTUP, 0, 0);
   if (MACH_PORT_VALID (startup))
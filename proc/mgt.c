@@ -32,6 +32,7 @@
 #include <sys/wait.h>
 #include <mach/mig_errors.h>
 #include <sys/resource.h>
+#include <time.h>
 #include <hurd/auth.h>
 #include <assert.h>
 #include <pids.h>
@@ -110,7 +111,7 @@ S_proc_reauthenticate (struct proc *p, mach_port_t rendport)
   naux_gids = sizeof (agbuf) / sizeof (uid_t);
 
   /* Release the global lock while blocking on the auth server and client.  */
-  pthread_mutex_unlock (&global_lock);
+  release_global_lock ();
   do
     err = auth_server_authenticate (authserver,
 				    rendport, MACH_MSG_TYPE_COPY_SEND,
@@ -120,7 +121,7 @@ S_proc_reauthenticate (struct proc *p, mach_port_t rendport)
 				    &gen_gids, &ngen_gids,
 				    &aux_gids, &naux_gids);
   while (err == EINTR);
-  pthread_mutex_lock (&global_lock);
+  reacquire_global_lock ();
 
   if (err)
     return err;
@@ -538,6 +539,13 @@ store_pid (struct proc *p, void *loc)
   *(*(pid_t **)loc)++ = p->p_pid;
 }
 
+/* How many seconds the task hash may go without a full rescan while
+   tasks_tracked is set.  */
+#define TASK_RESCAN_INTERVAL 300
+
+/* When add_tasks last went through all the kernel's tasks.  */
+static time_t last_task_scan;
+
 /* Implement proc_getallpids as described in <hurd/process.defs>. */
 kern_return_t
 S_proc_getallpids (struct proc *p,
@@ -549,7 +557,11 @@ S_proc_getallpids (struct proc *p,
 
   /* No need to check P here; we don't use it. */
 
-  add_tasks (0);
+  /* New task notifications tell us about tasks as they are created, so
+     only ask the kernel for all of them if we don't get those, or once
+     in a long while in case one was lost.  */
+  if (! tasks_tracked || time (NULL) - last_task_scan >= TASK_RESCAN_INTERVAL)
+    add_tasks (0);
 
   nprocs = 0;
   prociterate (count_up, &nprocs);
@@ -752,8 +764,8 @@ namespace_is_subprocess (struct proc *p)
 /* Translate PIDs valid in NAMESPACE into PIDs valid in our own
    process space.
 
-   Conditions: global_lock is unlocked before calling, and is locked
-   afterwards.  */
+   Conditions: our locks are released before calling (see
+   release_global_lock), and are held again afterwards.  */
 error_t
 namespace_translate_pids (mach_port_t namespace, pid_t *pids, size_t pids_len)
 {
@@ -763,7 +775,7 @@ namespace_translate_pids (mach_port_t namespace, pid_t *pids, size_t pids_len)
   tasks = calloc (pids_len, sizeof *tasks);
   if (tasks == NULL)
     {
-      pthread_mutex_lock (&global_lock);
+      reacquire_global_lock ();
       return ENOMEM;
     }
 
@@ -771,7 +783,7 @@ namespace_translate_pids (mach_port_t namespace, pid_t *pids, size_t pids_len)
     /* We handle errors by checking each returned task.  */
     proc_pid2task (namespace, pids[i], &tasks[i]);
 
-  pthread_mutex_lock (&global_lock);
+  reacquire_global_lock ();
 
   for (i = 0; i < pids_len; i++)
     if (MACH_PORT_VALID (tasks[i]))
@@ -1003,6 +1015,10 @@ add_tasks (task_t task)
       mach_port_deallocate (mach_task_self (), psets[i]);
     }
   munmap (psets, npsets * sizeof (mach_port_t));
+
+  if (!foundp)
+    /* We went through them all.  */
+    last_task_scan = time (NULL);
   return foundp;
 }
 
@@ -1156,6 +1172,15 @@ S_mach_notify_new_task (struct port_info *notify,
       || (kernel_proc != NULL && notify != (struct port_info *) kernel_proc))
     return EOPNOTSUPP;
 
+  /* Record the new task even if its parent is gone, since
+     proc_getallpids relies on these notifications to find tasks.  */
+  childp = task_find_nocreate (task);
+  if (! childp)
+    {
+      mach_port_mod_refs (mach_task_self (), task, MACH_PORT_RIGHT_SEND, +1);
+      childp = new_proc (task);
+    }
+
   parentp = task_find_nocreate (parent);
   if (! parentp)
     {
@@ -1164,13 +1189,6 @@ S_mach_notify_new_task (struct port_info *notify,
       return ESRCH;
     }
 
-  childp = task_find_nocreate (task);
-  if (! childp)
-    {
-      mach_port_mod_refs (mach_task_self (), task, MACH_PORT_RIGHT_SEND, +1);
-      childp = new_proc (task);
-    }
-
   if (MACH_PORT_VALID (parentp->p_task_namespace))
     {
       error_t err;
@@ -95,27 +95,34 @@ check_message_dying (struct proc *p, struct proc *dyingp)
     }
 }
 
+/* Return nonzero if MSGPORT, a message port we hold, has died.  */
+int
+msgport_dead_p (mach_port_t msgport)
+{
+  mach_port_type_t type;
+  error_t err;
+
+  /* Only check if the message port passed away, if we know that it
+     was ever alive.  */
+  if (msgport == MACH_PORT_NULL)
+    return 0;
+
+  err = mach_port_type (mach_task_self (), msgport, &type);
+  return err || (type & MACH_PORT_TYPE_DEAD_NAME);
+}
+
 /* Check if the message port of process P has died.  Return nonzero if
    this has indeed happened.  */
 int
 check_msgport_death (struct proc *p)
 {
-  /* Only check if the message port passed away, if we know that it
-     was ever alive.  */
-  if (p->p_msgport != MACH_PORT_NULL)
+  if (msgport_dead_p (p->p_msgport))
     {
-      mach_port_type_t type;
-      error_t err;
-      
-      err = mach_port_type (mach_task_self (), p->p_msgport, &type);
-      if (err || (type & MACH_PORT_TYPE_DEAD_NAME))
-	{
-	  /* The port appears to be dead; throw it away. */
-	  mach_port_deallocate (mach_task_self (), p->p_msgport);
-	  p->p_msgport = MACH_PORT_NULL;
-	  p->p_deadmsg = 1;
-	  return 1;
-	}
+      /* The port appears to be dead; throw it away. */
+      mach_port_deallocate (mach_task_self (), p->p_msgport);
+      p->p_msgport = MACH_PORT_NULL;
+      p->p_deadmsg = 1;
+      return 1;
     }
 
   return 0;
@@ -144,13 +151,13 @@ S_proc_getmsgport (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
         err = proc_getmsgport (p->p_task_namespace, pid_sub, msgport);
 
-      pthread_mutex_lock (&global_lock);
+      reacquire_global_lock ();
 
       if (! err)
 	{
@@ -166,7 +173,7 @@ S_proc_getmsgport (struct proc *callerp,
     {
       callerp->p_msgportwait = 1;
       p->p_checkmsghangs = 1;
-      cancel = pthread_hurd_cond_wait_np (&callerp->p_wakeup, &global_lock);
+      cancel = wait_global_lock (&callerp->p_wakeup);
       if (callerp->p_dead)
 	return EOPNOTSUPP;
       if (cancel)
@@ -154,16 +154,16 @@ S_proc_getsid (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
         err = proc_getsid (p->p_task_namespace, pid_sub, sid);
       if (! err)
-	/* Acquires global_lock.  */
+	/* Reacquires our locks.  */
 	err = namespace_translate_pids (p->p_task_namespace, sid, 1);
       else
-	pthread_mutex_lock (&global_lock);
+	reacquire_global_lock ();
 
       if (! err)
 	return 0;
@@ -199,16 +199,16 @@ S_proc_getsessionpids (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
         err = proc_getsessionpids (p->p_task_namespace, pid_sub, pids, npidsp);
       if (! err)
-	/* Acquires global_lock.  */
+	/* Reacquires our locks.  */
 	err = namespace_translate_pids (p->p_task_namespace, *pids, *npidsp);
       else
-	pthread_mutex_lock (&global_lock);
+	reacquire_global_lock ();
 
       if (! err)
 	return 0;
@@ -271,16 +271,16 @@ S_proc_getsessionpgids (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
         err = proc_getsessionpgids (p->p_task_namespace, pid_sub, pgids, npgidsp);
       if (! err)
-	/* Acquires global_lock.  */
+	/* Reacquires our locks.  */
 	err = namespace_translate_pids (p->p_task_namespace, *pgids, *npgidsp);
       else
-	pthread_mutex_lock (&global_lock);
+	reacquire_global_lock ();
 
       if (! err)
 	return 0;
@@ -337,16 +337,16 @@ S_proc_getpgrppids (struct proc *callerp,
       pid_t pid_sub;
 
       /* Release global lock while talking to the other proc server.  */
-      pthread_mutex_unlock (&global_lock);
+      release_global_lock ();
 
       err = proc_task2pid (p->p_task_namespace, p->p_task, &pid_sub);
       if (! err)
         err = proc_getpgrppids (p->p_task_namespace, pid_sub, pids, npidsp);
       if (! err)
-	/* Acquires global_lock.  */
+	/* Reacquires our locks.  */
 	err = namespace_translate_pids (p->p_task_namespace, *pids, *npidsp);
       else
-	pthread_mutex_lock (&global_lock);
+	reacquire_global_lock ();
 
       if (! err)
 	return 0;
@@ -150,11 +150,28 @@ struct port_class *exc_class;
 mach_port_t generic_port;	/* messages not related to a specific proc */
 struct proc *kernel_proc;
 
+/* Nonzero once new task notifications keep the task hash up to date,
+   so that listing all processes need not ask the kernel for all its
+   tasks.  */
+int tasks_tracked;
+
+/* GLOBAL_LOCK serializes the RPCs that change our state, and is the
+   lock our condition variables go with.  Those RPCs also hold
+   STATE_LOCK for writing, while RPCs that only look at our state, such
+   as the ones ps uses, hold just STATE_LOCK for reading.  That way
+   queries don't wait for each other, and only briefly for process
+   creation and exit.  Use release_global_lock and
+   reacquire_global_lock to drop whichever of them a thread holds
+   around blocking calls.  */
 pthread_mutex_t global_lock;
+pthread_rwlock_t state_lock;
 
 extern int startup_fallback;	/* (ab)use /hurd/startup's message port */
 
 /* Forward declarations */
+void release_global_lock (void);
+void reacquire_global_lock (void);
+int wait_global_lock (pthread_cond_t *);
 void complete_wait (struct proc *, int);
 int check_uid (struct proc *, uid_t);
 int check_owner (struct proc *, struct proc *);
@@ -168,6 +185,7 @@ void abort_getmsgport (struct proc *);
 int zombie_check_pid (pid_t);
 void check_message_dying (struct proc *, struct proc *);
 int check_msgport_death (struct proc *);
+int msgport_dead_p (mach_port_t);
 void check_dead_execdata_notify (mach_port_t);
 
 void add_proc_to_hash (struct proc *);
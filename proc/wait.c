@@ -228,7 +228,7 @@ S_proc_wait (struct proc *p,
     return EWOULDBLOCK;
 
   p->p_waiting = 1;
-  cancel = pthread_hurd_cond_wait_np (&p->p_wakeup, &global_lock);
+  cancel = wait_global_lock (&p->p_wakeup);
   if (p->p_dead)
     return EOPNOTSUPP;
   if (cancel)
@@ -20,6 +20,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include <hurd/ihash.h>
 #include <hurd/process.h>
 #include <hurd/resource.h>
 #include <mach/vm_param.h>
@@ -30,15 +33,15 @@
 #include "main.h"
 
 /* This module implements the process directories and the files they
-   contain.  A libps proc_stat structure is created for each process
-   node, and is used by the individual file content generators as a
-   source of information.  Each possible file (cmdline, environ, ...) is
-   described in a process_file_desc structure, which specifies which bits
-   of information (ie. libps flags) it needs, and what function should
-   be used to generate the file's contents.
+   contain.  A libps proc_stat structure, part of a process snapshot, is
+   created for each process node, and is used by the individual file
+   content generators as a source of information.  Each possible file
+   (cmdline, environ, ...) is described in a process_file_desc structure,
+   which specifies which bits of information (ie. libps flags) it needs,
+   and what function should be used to generate the file's contents.
 
-   The content generators are defined first, followed by glue logic and
-   entry table.  */
+   The content generators are defined first, followed by the snapshots,
+   glue logic and entry table.  */
 
 
 /* Helper functions */
@@ -347,29 +350,388 @@ struct process_file_desc
   mode_t mode;
 };
 
+
+/* Process snapshots */
+
+/* At least the number of files in entries[] below.  */
+#define PROCESS_FILES 8
+
+/* What is known about a process at some point in time: a proc_stat,
+   with at least PSTAT_OWNER_UID, and the contents of the files
+   generated from it so far.  Process directories and the files being
+   read hold references to these.  With --cache-time, the latest one for
+   each process is also kept in process_cache, for the lookups and reads
+   within that time to share; otherwise each directory has its own, and
+   each file is generated from it only once and later from a new one.  */
+struct process_snapshot
+{
+  pid_t pid;
+  long long time;		/* When it was taken.  */
+
+  /* Protected by process_cache_lock.  */
+  int refs;
+  struct process_snapshot *next_dead;
+
+  pthread_mutex_t lock;		/* Serializes the use of what follows.  */
+  struct proc_stat *ps;
+  struct
+    {
+      const struct process_file_desc *desc;
+      char *contents;
+      ssize_t contents_len;
+    } files[PROCESS_FILES];
+};
+
+/* The latest snapshot of each process, by pid.  */
+static struct hurd_ihash process_cache
+  = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+static pthread_mutex_t process_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* When stale snapshots were last dropped from process_cache.  */
+static long long process_cache_swept;
+
+/* Flags fetched for all the processes at once when the process list is
+   read: the owner, which looking up their directories needs, and all
+   the procinfo stat, statm and status need.  */
+#define PREFETCH_FLAGS (PSTAT_OWNER_UID | PSTAT_PROC_INFO | PSTAT_STATE \
+			| PSTAT_TASK_BASIC | PSTAT_THREAD_BASIC \
+			| PSTAT_NUM_THREADS)
+
+static int
+snapshot_fresh (struct process_snapshot *snap, long long now)
+{
+  return now - snap->time < opt_cache_time;
+}
+
+/* Take a new snapshot of the process PID, with one reference, without
+   fetching anything yet.  */
+static error_t
+snapshot_create (struct ps_context *pc, pid_t pid,
+		 struct process_snapshot **snap)
+{
+  struct process_snapshot *s;
+  error_t err;
+
+  s = calloc (1, sizeof *s);
+  if (! s)
+    return ENOMEM;
+
+  err = _proc_stat_create (pid, pc, &s->ps);
+  if (err)
+    {
+      free (s);
+      return err;
+    }
+
+  s->pid = pid;
+  s->time = procfs_time_ms ();
+  s->refs = 1;
+  pthread_mutex_init (&s->lock, NULL);
+  *snap = s;
+  return 0;
+}
+
+static void
+snapshot_free (struct process_snapshot *snap)
+{
+  int i;
+
+  for (i = 0; i < PROCESS_FILES && snap->files[i].desc; i++)
+    if (! snap->files[i].desc->no_cleanup)
+      free (snap->files[i].contents);
+  _proc_stat_free (snap->ps);
+  pthread_mutex_destroy (&snap->lock);
+  free (snap);
+}
+
+/* Drop a reference to SNAP, adding it to *DEAD if it was the last one.
+   process_cache_lock must be held.  */
+static void
+snapshot_deref_locked (struct process_snapshot *snap,
+		       struct process_snapshot **dead)
+{
+  if (--snap->refs == 0)
+    {
+      snap->next_dead = *dead;
+      *dead = snap;
+    }
+}
+
+static void
+snapshots_free (struct process_snapshot *dead)
+{
+  while (dead)
+    {
+      struct process_snapshot *next = dead->next_dead;
+      snapshot_free (dead);
+      dead = next;
+    }
+}
+
+static void
+snapshot_release (struct process_snapshot *snap)
+{
+  struct process_snapshot *dead = NULL;
+
+  pthread_mutex_lock (&process_cache_lock);
+  snapshot_deref_locked (snap, &dead);
+  pthread_mutex_unlock (&process_cache_lock);
+  snapshots_free (dead);
+}
+
+/* Make SNAP the snapshot of its process in process_cache.  This adds a
+   reference to it, and drops the one to any it replaces, adding them to
+   *DEAD if need be.  Stale snapshots of other processes are dropped
+   too, once every --cache-time at most.  process_cache_lock must be
+   held.  */
+static void
+snapshot_cache_locked (struct process_snapshot *snap,
+		       struct process_snapshot **dead)
+{
+  struct process_snapshot *old;
+
+  if (snap->time - process_cache_swept >= opt_cache_time)
+    {
+      struct process_snapshot *stale = NULL;
+
+      HURD_IHASH_ITERATE (&process_cache, value)
+	{
+	  struct process_snapshot *s = value;
+	  if (! snapshot_fresh (s, snap->time))
+	    {
+	      s->next_dead = stale;
+	      stale = s;
+	    }
+	}
+      while (stale)
+	{
+	  old = stale;
+	  stale = old->next_dead;
+	  hurd_ihash_remove (&process_cache, old->pid);
+	  snapshot_deref_locked (old, dead);
+	}
+      process_cache_swept = snap->time;
+    }
+
+  old = hurd_ihash_find (&process_cache, snap->pid);
+  if (old)
+    {
+      hurd_ihash_remove (&process_cache, old->pid);
+      snapshot_deref_locked (old, dead);
+    }
+
+  if (! hurd_ihash_add (&process_cache, snap->pid, snap))
+    snap->refs++;
+}
+
+/* Return in *SNAP, with a new reference, a snapshot of the process PID:
+   the one in process_cache if it is recent enough, or a new one.  */
+static error_t
+snapshot_get (struct ps_context *pc, pid_t pid,
+	      struct process_snapshot **snap)
+{
+  struct process_snapshot *s, *dead = NULL;
+  error_t err;
+
+  if (opt_cache_time > 0)
+    {
+      pthread_mutex_lock (&process_cache_lock);
+      s = hurd_ihash_find (&process_cache, pid);
+      if (s && snapshot_fresh (s, procfs_time_ms ()))
+	s->refs++;
+      else
+	s = NULL;
+      pthread_mutex_unlock (&process_cache_lock);
+
+      if (s)
+	{
+	  *snap = s;
+	  return 0;
+	}
+    }
+
+  err = snapshot_create (pc, pid, &s);
+  if (err)
+    return err;
+
+  err = proc_stat_set_flags (s->ps, PSTAT_OWNER_UID);
+  if (err || ! proc_stat_has (s->ps, PSTAT_OWNER_UID))
+    {
+      snapshot_free (s);
+      return EIO;
+    }
+
+  if (opt_cache_time > 0)
+    {
+      pthread_mutex_lock (&process_cache_lock);
+      snapshot_cache_locked (s, &dead);
+      pthread_mutex_unlock (&process_cache_lock);
+      snapshots_free (dead);
+    }
+
+  *snap = s;
+  return 0;
+}
+
+void
+process_prefetch (struct ps_context *pc, const pid_t *pids, size_t num_pids)
+{
+  struct process_snapshot **snaps, *dead = NULL;
+  struct proc_stat **procs;
+  size_t i, n;
+  long long now;
+  error_t err;
+
+  if (opt_cache_time <= 0 || num_pids < 2)
+    return;
+
+  snaps = malloc (num_pids * (sizeof *snaps + sizeof *procs));
+  if (! snaps)
+    return;
+  procs = (struct proc_stat **) (snaps + num_pids);
+
+  now = procfs_time_ms ();
+  n = 0;
+  for (i = 0; i < num_pids; i++)
+    {
+      struct process_snapshot *s;
+
+      pthread_mutex_lock (&process_cache_lock);
+      s = hurd_ihash_find (&process_cache, pids[i]);
+      if (s && ! snapshot_fresh (s, now))
+	s = NULL;
+      pthread_mutex_unlock (&process_cache_lock);
+
+      if (! s && ! snapshot_create (pc, pids[i], &snaps[n]))
+	{
+	  procs[n] = snaps[n]->ps;
+	  n++;
+	}
+    }
+
+  err = proc_stats_set_flags (procs, n, PREFETCH_FLAGS);
+
+  pthread_mutex_lock (&process_cache_lock);
+  for (i = 0; i < n; i++)
+    {
+      if (! err && proc_stat_has (procs[i], PSTAT_OWNER_UID))
+	snapshot_cache_locked (snaps[i], &dead);
+      snapshot_deref_locked (snaps[i], &dead);
+    }
+  pthread_mutex_unlock (&process_cache_lock);
+
+  snapshots_free (dead);
+  free (snaps);
+}
+
+/* Return in *CONTENTS and *CONTENTS_LEN those of the file DESC
+   generated from SNAP, generating them if this was not done yet.  They
+   belong to SNAP.  */
+static error_t
+snapshot_get_contents (struct process_snapshot *snap,
+		       const struct process_file_desc *desc,
+		       char **contents, ssize_t *contents_len)
+{
+  error_t err = 0;
+  int i;
+
+  pthread_mutex_lock (&snap->lock);
+
+  for (i = 0; i < PROCESS_FILES && snap->files[i].desc; i++)
+    if (snap->files[i].desc == desc)
+      break;
+  assert (i < PROCESS_FILES);
+
+  if (snap->files[i].desc)
+    {
+      *contents = snap->files[i].contents;
+      *contents_len = snap->files[i].contents_len;
+    }
+  else
+    {
+      /* Fetch the required information.  */
+      err = proc_stat_set_flags (snap->ps, desc->needs);
+      if (err || ! proc_stat_has (snap->ps, desc->needs))
+	err = EIO;
+      else
+	{
+	  /* Call the actual content generator (see the definitions
+	     above).  */
+	  *contents_len = desc->get_contents (snap->ps, contents);
+	  if (*contents_len >= 0)
+	    {
+	      snap->files[i].desc = desc;
+	      snap->files[i].contents = *contents;
+	      snap->files[i].contents_len = *contents_len;
+	    }
+	}
+    }
+
+  pthread_mutex_unlock (&snap->lock);
+  return err;
+}
+
+/* Whether the file DESC has been generated from SNAP.  */
+static int
+snapshot_has_contents (struct process_snapshot *snap,
+		       const struct process_file_desc *desc)
+{
+  int i, found = 0;
+
+  pthread_mutex_lock (&snap->lock);
+  for (i = 0; i < PROCESS_FILES && snap->files[i].desc; i++)
+    if (snap->files[i].desc == desc)
+      found = 1;
+  pthread_mutex_unlock (&snap->lock);
+
+  return found;
+}
+
+
+/* File nodes, whose contents come from the snapshots.  */
+
 struct process_file_node
 {
   const struct process_file_desc *desc;
-  struct proc_stat *ps;
+
+  /* The snapshot of the directory, and the one the contents come from,
+     if any, to which we hold a reference.  */
+  struct process_snapshot *dir;
+  struct process_snapshot *snap;
 };
 
-/* FIXME: lock the parent! */
 static error_t
 process_file_get_contents (void *hook, char **contents, ssize_t *contents_len)
 {
   struct process_file_node *file = hook;
+  struct process_snapshot *snap = file->dir;
   error_t err;
 
-  /* Fetch the required information.  */
-  err = proc_stat_set_flags (file->ps, file->desc->needs);
-  if (err)
-    return EIO;
-  if ((proc_stat_flags (file->ps) & file->desc->needs) != file->desc->needs)
-    return EIO;
+  /* Use the snapshot of the directory while it is recent enough, or if
+     caching is off, the first time only, so that reading the file again
+     gets fresh contents.  */
+  if (opt_cache_time > 0
+      ? snapshot_fresh (snap, procfs_time_ms ())
+      : ! snapshot_has_contents (snap, file->desc))
+    {
+      pthread_mutex_lock (&process_cache_lock);
+      snap->refs++;
+      pthread_mutex_unlock (&process_cache_lock);
+    }
+  else
+    {
+      err = snapshot_get (snap->ps->context, snap->pid, &snap);
+      if (err)
+	return err == ENOMEM ? ENOMEM : EIO;
+    }
 
-  /* Call the actual content generator (see the definitions below).  */
-  *contents_len = file->desc->get_contents (file->ps, contents);
-  return 0;
+  err = snapshot_get_contents (snap, file->desc, contents, contents_len);
+  if (err || *contents_len < 0 || ! *contents)
+    /* procfs_refresh will not call us back for these.  */
+    snapshot_release (snap);
+  else
+    file->snap = snap;
+  return err;
 }
 
 static void
@@ -377,8 +739,12 @@ process_file_cleanup_contents (void *hook, char *contents, ssize_t len)
 {
   struct process_file_node *file = hook;
 
-  if (! file->desc->no_cleanup)
-    free (contents);
+  /* The contents belong to the snapshot.  */
+  if (file->snap)
+    {
+      snapshot_release (file->snap);
+      file->snap = NULL;
+    }
 }
 
 static struct node *
@@ -397,13 +763,14 @@ process_file_make_node (void *dir_hook, const void *entry_hook)
     return NULL;
 
   f->desc = entry_hook;
-  f->ps = dir_hook;
+  f->dir = dir_hook;
+  f->snap = NULL;
 
   np = procfs_make_node (&ops, f);
   if (! np)
     return NULL;
 
-  procfs_node_chown (np, proc_stat_owner_uid (f->ps));
+  procfs_node_chown (np, proc_stat_owner_uid (f->dir->ps));
   if (f->desc->mode)
     procfs_node_chmod (np, f->desc->mode);
 
@@ -484,33 +851,26 @@ process_lookup_pid (struct ps_context *pc, pid_t pid, struct node **np)
 {
   static const struct procfs_dir_ops dir_ops = {
     .entries = entries,
-    .cleanup = (void (*)(void *)) _proc_stat_free,
+    .cleanup = (void (*)(void *)) snapshot_release,
     .entry_ops = {
       .make_node = process_file_make_node,
     },
   };
-  struct proc_stat *ps;
+  struct process_snapshot *snap;
   int owner;
   error_t err;
 
-  err = _proc_stat_create (pid, pc, &ps);
+  err = snapshot_get (pc, pid, &snap);
   if (err == ESRCH)
     return ENOENT;
   if (err)
     return EIO;
 
-  err = proc_stat_set_flags (ps, PSTAT_OWNER_UID);
-  if (err || ! (proc_stat_flags (ps) & PSTAT_OWNER_UID))
-    {
-      _proc_stat_free (ps);
-      return EIO;
-    }
-
-  *np = procfs_dir_make_node (&dir_ops, ps);
+  *np = procfs_dir_make_node (&dir_ops, snap);
   if (! *np)
     return ENOMEM;
 
-  owner = proc_stat_owner_uid (ps);
+  owner = proc_stat_owner_uid (snap->ps);
   procfs_node_chown (*np, owner >= 0 ? owner : opt_anon_owner);
   return 0;
 }
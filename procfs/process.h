@@ -25,3 +25,11 @@
 error_t
 process_lookup_pid (struct ps_context *pc, pid_t pid, struct node **np);
 
+
+/* With --cache-time, fetch the basic information about the NUM_PIDS
+   processes in PIDS, all at once, for the lookups of their directories
+   and the reads of their files to use.  This is done when the whole list
+   of processes is read, as monitoring tools do before looking at each
+   of them.  */
+void
+process_prefetch (struct ps_context *pc, const pid_t *pids, size_t num_pids);
@@ -21,10 +21,12 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 #include <mach.h>
 #include <hurd/netfs.h>
 #include <hurd/fshelp.h>
 #include "procfs.h"
+#include "main.h"
 
 struct netnode
 {
@@ -39,6 +41,28 @@ struct netnode
   struct node *parent;
 };
 
+/* Contents of the nodes whose ops have shared_contents set, and when
+   they were generated.  */
+struct shared_contents
+{
+  struct shared_contents *next;
+  const struct procfs_node_ops *ops;
+  char *contents;
+  ssize_t contents_len;
+  long long time;
+};
+
+static struct shared_contents *shared_contents;
+static pthread_mutex_t shared_contents_lock = PTHREAD_MUTEX_INITIALIZER;
+
+long long
+procfs_time_ms (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
 void
 procfs_cleanup_contents_with_free (void *hook, char *cont, ssize_t len)
 {
@@ -132,20 +156,95 @@ procfs_make_ino (struct node *np, const char *filename)
   return (unsigned long) jrand48 (x);
 }
 
+/* Return in *CONTENTS a malloced copy of the contents shared by the
+   nodes with OPS, if there are recent enough ones.  */
+static int
+get_shared_contents (const struct procfs_node_ops *ops,
+		     char **contents, ssize_t *contents_len)
+{
+  struct shared_contents *sc;
+  int found = 0;
+
+  pthread_mutex_lock (&shared_contents_lock);
+  for (sc = shared_contents; sc; sc = sc->next)
+    if (sc->ops == ops)
+      break;
+  if (sc && procfs_time_ms () - sc->time < opt_cache_time)
+    {
+      *contents = malloc (sc->contents_len ?: 1);
+      if (*contents)
+	{
+	  memcpy (*contents, sc->contents, sc->contents_len);
+	  *contents_len = sc->contents_len;
+	  found = 1;
+	}
+    }
+  pthread_mutex_unlock (&shared_contents_lock);
+
+  return found;
+}
+
+/* Keep a copy of CONTENTS, just generated for a node with OPS, for the
+   other nodes with them.  */
+static void
+set_shared_contents (const struct procfs_node_ops *ops,
+		     const char *contents, ssize_t contents_len)
+{
+  struct shared_contents *sc;
+  char *copy;
+
+  copy = malloc (contents_len ?: 1);
+  if (! copy)
+    return;
+  memcpy (copy, contents, contents_len);
+
+  pthread_mutex_lock (&shared_contents_lock);
+  for (sc = shared_contents; sc; sc = sc->next)
+    if (sc->ops == ops)
+      break;
+  if (! sc)
+    {
+      sc = malloc (sizeof *sc);
+      if (! sc)
+	{
+	  pthread_mutex_unlock (&shared_contents_lock);
+	  free (copy);
+	  return;
+	}
+      sc->ops = ops;
+      sc->next = shared_contents;
+      shared_contents = sc;
+    }
+  else
+    free (sc->contents);
+  sc->contents = copy;
+  sc->contents_len = contents_len;
+  sc->time = procfs_time_ms ();
+  pthread_mutex_unlock (&shared_contents_lock);
+}
+
 error_t procfs_get_contents (struct node *np, char **data, ssize_t *data_len)
 {
   if (! np->nn->contents && np->nn->ops->get_contents)
     {
+      const struct procfs_node_ops *ops = np->nn->ops;
+      int shared = ops->shared_contents && opt_cache_time > 0;
       char *contents;
       ssize_t contents_len;
       error_t err;
 
-      contents_len = -1;
-      err = np->nn->ops->get_contents (np->nn->hook, &contents, &contents_len);
-      if (err)
-	return err;
-      if (contents_len < 0)
-	return ENOMEM;
+      if (! shared || ! get_shared_contents (ops, &contents, &contents_len))
+	{
+	  contents_len = -1;
+	  err = ops->get_contents (np->nn->hook, &contents, &contents_len);
+	  if (err)
+	    return err;
+	  if (contents_len < 0)
+	    return ENOMEM;
+
+	  if (shared)
+	    set_shared_contents (ops, contents, contents_len);
+	}
 
       np->nn->contents = contents;
       np->nn->contents_len = contents_len;
@@ -54,6 +54,11 @@ struct procfs_node_ops
 
   /* Get the passive translator record.  */
   error_t (*get_translator) (void *hook, char **argz, size_t *argz_len);
+
+  /* If nonzero, the contents are the same for all the nodes using these
+     ops, and are shared between them for up to --cache-time.  Their
+     cleanup_contents must then be procfs_cleanup_contents_with_free.  */
+  int shared_contents;
 };
 
 /* These helper functions can be used as procfs_node_ops.cleanup_contents. */
@@ -64,6 +69,10 @@ void procfs_cleanup_contents_with_vm_deallocate (void *, char *, ssize_t);
    enough memory.  In this case, ops->cleanup will be invoked.  */
 struct node *procfs_make_node (const struct procfs_node_ops *ops, void *hook);
 
+/* Return the time in milliseconds, from a monotonic clock.  This is
+   what --cache-time is measured with.  */
+long long procfs_time_ms (void);
+
 /* Set the owner of the node NP.  Must be called right after the node
    has been created.  */
 void procfs_node_chown (struct node *np, uid_t owner);
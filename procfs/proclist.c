@@ -52,6 +52,8 @@ proclist_get_contents (void *hook, char **contents, ssize_t *contents_len)
 	  assert (n >= 0);
 	  *contents_len += (n + 1);
 	}
+
+      process_prefetch (pc, pids, num_pids);
     }
   else
     err = ENOMEM;
@@ -685,6 +685,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_version,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .shared_contents = 1,
     },
   },
   {
@@ -692,6 +693,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_uptime,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .shared_contents = 1,
     },
   },
   {
@@ -699,6 +701,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_stat,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .shared_contents = 1,
     },
   },
   {
@@ -706,6 +709,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_loadavg,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .shared_contents = 1,
     },
   },
   {
@@ -713,6 +717,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_meminfo,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .shared_contents = 1,
     },
   },
   {
@@ -720,6 +725,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_vmstat,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .shared_contents = 1,
     },
   },
   {
@@ -727,6 +733,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_cmdline,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .shared_contents = 1,
     },
   },
   {
@@ -742,6 +749,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_slabinfo,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .shared_contents = 1,
     },
   },
   {
@@ -749,6 +757,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_filesystems,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .shared_contents = 1,
     },
   },
   {
@@ -756,6 +765,7 @@ static const struct procfs_dir_entry rootdir_entries[] = {
     .hook = & (struct procfs_node_ops) {
       .get_contents = rootdir_gc_swaps,
       .cleanup_contents = procfs_cleanup_contents_with_free,
+      .shared_contents = 1,
     },
   },
 #ifdef PROFILE
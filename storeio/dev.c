@@ -20,6 +20,7 @@
 
 #include <hurd.h>
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include <hurd/pager.h>
 #include <hurd/store.h>
@@ -27,112 +28,383 @@
 
 #include "dev.h"
 
-/* These functions deal with the buffer used for doing non-block-aligned I/O. */
+/* These functions deal with the cache used for doing non-block-aligned
+   and small I/O.  */
 
-static inline int
-dev_buf_is_active (struct dev *dev)
+/* Return the hash chain for device offset OFFS in DEV's cache.  */
+static inline struct dev_block **
+cache_bucket (struct dev *dev, off_t offs)
 {
-  return dev->buf_offs >= 0;
+  return &dev->cache_hash[(offs >> dev->store->log2_block_size)
+			  % dev->cache_nblocks];
 }
 
-/* Invalidate DEV's buffer, writing it to disk if necessary.  */
+/* Remove block B from its hash chain.  DEV->cache_lock must be held.  */
+static void
+cache_unhash (struct dev *dev, struct dev_block *b)
+{
+  struct dev_block **bp;
+
+  if (b->offs < 0)
+    return;
+  for (bp = cache_bucket (dev, b->offs); *bp != b; bp = &(*bp)->hnext)
+    assert (*bp);
+  *bp = b->hnext;
+  b->offs = -1;
+}
+
+/* Make block B the most recently used.  DEV->cache_lock must be held.  */
+static void
+cache_touch (struct dev *dev, struct dev_block *b)
+{
+  if (dev->cache_mru == b)
+    return;
+
+  /* Unlink...  */
+  b->lru_prev->lru_next = b->lru_next;
+  if (b->lru_next)
+    b->lru_next->lru_prev = b->lru_prev;
+  else
+    dev->cache_lru = b->lru_prev;
+
+  /* ... and put at the front.  */
+  b->lru_prev = 0;
+  b->lru_next = dev->cache_mru;
+  dev->cache_mru->lru_prev = b;
+  dev->cache_mru = b;
+}
+
+/* Write block B back to DEV's store if it's dirty.  B must be locked.  */
+static error_t
+cache_writeback (struct dev *dev, struct dev_block *b)
+{
+  if (b->dirty)
+    {
+      size_t amount;
+      struct store *store = dev->store;
+      error_t err =
+	store_write (store, b->offs >> store->log2_block_size,
+		     b->data, store->block_size, &amount);
+      if (!err && amount < store->block_size)
+	err = EIO;
+      if (err)
+	return err;
+      b->dirty = 0;
+      __atomic_add_fetch (&dev->cache_writebacks, 1, __ATOMIC_RELEASE);
+    }
+  return 0;
+}
+
+/* Return the least recently used block in DEV's cache that nobody is
+   using and which is clean (if CLEAN) or 0 if there is none.
+   DEV->cache_lock must be held.  */
+static struct dev_block *
+cache_victim (struct dev *dev, int clean)
+{
+  struct dev_block *b;
+  for (b = dev->cache_lru; b; b = b->lru_prev)
+    if (b->refs == 0 && (!clean || !b->dirty))
+      return b;
+  return 0;
+}
+
+/* Put the LEN bytes at DATA, read from DEV's store at OFFS, in the cache
+   as whole blocks, provided there is a clean block free for each and
+   they're not already cached.  This is used for read-ahead, so it
+   doesn't wait for anything.  DEV->cache_lock must be held.  */
+static void
+cache_install (struct dev *dev, off_t offs, void *data, size_t len)
+{
+  size_t block_size = dev->store->block_size;
+
+  for (; len >= block_size; offs += block_size, data += block_size,
+	 len -= block_size)
+    {
+      struct dev_block *b;
+
+      for (b = *cache_bucket (dev, offs); b; b = b->hnext)
+	if (b->offs == offs)
+	  break;
+      if (b)
+	continue;
+
+      b = cache_victim (dev, 1);
+      if (! b)
+	return;
+
+      cache_unhash (dev, b);
+      memcpy (b->data, data, block_size);
+      b->valid = 1;
+      b->offs = offs;
+      b->hnext = *cache_bucket (dev, offs);
+      *cache_bucket (dev, offs) = b;
+      cache_touch (dev, b);
+    }
+}
+
+/* Read the contents of block B, which is locked and unused by anyone
+   else, from DEV's store.  If READAHEAD is nonzero, also read that many
+   blocks following it, and put them in the cache too.  */
 static error_t
-dev_buf_discard (struct dev *dev)
+cache_fill (struct dev *dev, struct dev_block *b, unsigned readahead)
 {
-  if (dev_buf_is_active (dev))
+  struct store *store = dev->store;
+  size_t block_size = store->block_size;
+  size_t want = block_size * (1 + readahead);
+  void *buf = b->data;
+  size_t buf_len = block_size;
+  unsigned long writebacks;
+  error_t err;
+
+  /* A block written back while we read may have been evicted since, and
+     then what we read of it is stale: don't keep the read-ahead then.
+     Blocks still cached are safe, as cache_install skips them.  */
+  writebacks = __atomic_load_n (&dev->cache_writebacks, __ATOMIC_ACQUIRE);
+
+  if (store->size > 0 && b->offs + want > store->size)
+    want = store->size - b->offs;
+  if (want > block_size)
+    buf_len = 0;		/* Let the store allocate it.  */
+
+  err = store_read (store, b->offs >> store->log2_block_size, want,
+		    &buf, &buf_len);
+  if (err)
+    return err;
+  if (buf_len < block_size)
+    err = EIO;
+  else
     {
-      if (dev->buf_dirty)
+      if (buf != b->data)
+	memcpy (b->data, buf, block_size);
+      b->valid = 1;
+
+      if (buf_len > block_size)
 	{
-	  size_t amount;
-	  struct store *store = dev->store;
-	  error_t err =
-	    store_write (store, dev->buf_offs >> store->log2_block_size,
-			 dev->buf, store->block_size, &amount);
-	  if (!err && amount < store->block_size)
-	    err = EIO;
-	  if (err)
-	    return err;
-	  dev->buf_dirty = 0;
+	  pthread_mutex_lock (&dev->cache_lock);
+	  if (__atomic_load_n (&dev->cache_writebacks, __ATOMIC_ACQUIRE)
+	      == writebacks)
+	    cache_install (dev, b->offs + block_size, buf + block_size,
+			   buf_len - block_size);
+	  pthread_mutex_unlock (&dev->cache_lock);
 	}
-      dev->buf_offs = -1;
     }
-  return 0;
+
+  if (buf != b->data)
+    munmap (buf, want);
+
+  return err;
 }
 
-/* Make DEV's buffer active, reading the block from DEV's store which
-   contains OFFS.  */
+/* Return in *BP the block in DEV's cache holding device offset OFFS
+   (which must be block aligned), locked and with a reference, which the
+   caller must give back with cache_release.  If FILL, make sure that it
+   holds the block's contents, otherwise the caller is going to
+   overwrite all of it.  */
 static error_t
-dev_buf_fill (struct dev *dev, off_t offs)
+cache_get (struct dev *dev, off_t offs, int fill, struct dev_block **bp)
 {
+  struct dev_block *b;
+  unsigned readahead = 0;
   error_t err;
-  unsigned block_mask = dev->block_mask;
-  void *buf = dev->buf;
-  struct store *store = dev->store;
-  size_t buf_len = store->block_size;
 
-  if (dev_buf_is_active (dev))
+  pthread_mutex_lock (&dev->cache_lock);
+
+  /* Sequential access triggers read-ahead on a miss.  */
+  if (offs == dev->cache_next)
+    readahead = dev->cache_readahead;
+  dev->cache_next = offs + dev->store->block_size;
+
+  for (;;)
     {
-      if ((dev->buf_offs & ~block_mask) == (offs & ~block_mask))
-	return 0;			/* Correct block alredy in buffer.  */
-      else
+      for (b = *cache_bucket (dev, offs); b; b = b->hnext)
+	if (b->offs == offs)
+	  break;
+      if (b)
 	{
-	  err = dev_buf_discard (dev);
+	  readahead = 0;
+	  break;
+	}
+
+      b = cache_victim (dev, 0);
+      if (! b)
+	/* Every block is in use; wait for one to be released.  */
+	pthread_cond_wait (&dev->cache_wakeup, &dev->cache_lock);
+      else if (b->dirty)
+	/* Write it back first.  It stays findable meanwhile, so nobody
+	   reads stale data from the store.  */
+	{
+	  b->refs++;
+	  pthread_mutex_unlock (&dev->cache_lock);
+	  pthread_mutex_lock (&b->lock);
+	  err = cache_writeback (dev, b);
+	  pthread_mutex_unlock (&b->lock);
+	  pthread_mutex_lock (&dev->cache_lock);
+	  b->refs--;
 	  if (err)
-	    return err;
+	    {
+	      pthread_cond_broadcast (&dev->cache_wakeup);
+	      pthread_mutex_unlock (&dev->cache_lock);
+	      return err;
+	    }
+	}
+      else
+	/* Reuse a clean block.  */
+	{
+	  cache_unhash (dev, b);
+	  b->valid = 0;
+	  b->offs = offs;
+	  b->hnext = *cache_bucket (dev, offs);
+	  *cache_bucket (dev, offs) = b;
+	  break;
 	}
     }
 
-  err = store_read (store, offs >> store->log2_block_size, store->block_size,
-		    &buf, &buf_len);
-  if (err)
-    return err;
+  b->refs++;
+  cache_touch (dev, b);
+  pthread_mutex_unlock (&dev->cache_lock);
 
-  if (buf != dev->buf)
+  pthread_mutex_lock (&b->lock);
+  if (fill && !b->valid)
     {
-      munmap (dev->buf, store->block_size);
-      dev->buf = buf;
+      err = cache_fill (dev, b, readahead);
+      if (err)
+	{
+	  pthread_mutex_unlock (&b->lock);
+	  pthread_mutex_lock (&dev->cache_lock);
+	  b->refs--;
+	  pthread_cond_broadcast (&dev->cache_wakeup);
+	  pthread_mutex_unlock (&dev->cache_lock);
+	  return err;
+	}
     }
 
-  dev->buf_offs = offs & ~block_mask;
-
+  *bp = b;
   return 0;
 }
-
-/* Do an in-buffer partial-block I/O operation.  */
+
+/* Give back block B, gotten from cache_get.  If DIRTIED, the caller
+   changed its contents.  */
+static void
+cache_release (struct dev *dev, struct dev_block *b, int dirtied)
+{
+  if (dirtied)
+    {
+      b->valid = 1;
+      b->dirty = 1;
+    }
+  pthread_mutex_unlock (&b->lock);
+
+  pthread_mutex_lock (&dev->cache_lock);
+  if (--b->refs == 0)
+    pthread_cond_broadcast (&dev->cache_wakeup);
+  pthread_mutex_unlock (&dev->cache_lock);
+}
+
+/* Write back any dirty blocks in DEV's cache within the LEN bytes at
+   OFFS (or all of them, if LEN is 0).  If INVALIDATE, also drop them
+   from the cache; the caller must then hold DEV->io_lock for writing.  */
 static error_t
-dev_buf_rw (struct dev *dev, size_t buf_offs, size_t *io_offs, size_t *len,
-	    error_t (*const buf_rw) (size_t buf_offs,
-				     size_t io_offs, size_t len))
+cache_flush (struct dev *dev, off_t offs, size_t len, int invalidate)
 {
-  size_t block_size = dev->store->block_size;
+  error_t err = 0;
+  unsigned i;
+
+  for (i = 0; i < dev->cache_nblocks && !err; i++)
+    {
+      struct dev_block *b = &dev->cache_blocks[i];
+
+      pthread_mutex_lock (&dev->cache_lock);
+      if (len > 0
+	  && (b->offs < offs || b->offs >= offs + (off_t) len))
+	{
+	  pthread_mutex_unlock (&dev->cache_lock);
+	  continue;
+	}
+      b->refs++;
+      pthread_mutex_unlock (&dev->cache_lock);
+
+      pthread_mutex_lock (&b->lock);
+      if (invalidate)
+	b->dirty = 0;		/* The caller is overwriting it.  */
+      else
+	err = cache_writeback (dev, b);
+      pthread_mutex_unlock (&b->lock);
+
+      pthread_mutex_lock (&dev->cache_lock);
+      if (invalidate)
+	{
+	  cache_unhash (dev, b);
+	  b->valid = 0;
+	}
+      if (--b->refs == 0)
+	pthread_cond_broadcast (&dev->cache_wakeup);
+      pthread_mutex_unlock (&dev->cache_lock);
+    }
 
-  assert (dev_buf_is_active (dev));
+  return err;
+}
 
-  if (buf_offs + *len >= block_size)
-    /* Only part of BUF lies within the buffer (or everything up
-       to the end of the block, in which case we want to flush
-       the buffer anyway).  */
+/* Set up DEV's cache; DEV->store must be open.  */
+static error_t
+cache_init (struct dev *dev)
+{
+  size_t block_size = dev->store->block_size;
+  unsigned n = dev->cache_nblocks, i;
+  void *data;
+
+  if (n == 0)
+    n = dev->cache_nblocks = 1;
+
+  data = mmap (0, n * block_size, PROT_READ|PROT_WRITE, MAP_ANON, 0, 0);
+  if (data == MAP_FAILED)
+    return ENOMEM;
+  dev->cache_blocks = calloc (n, sizeof *dev->cache_blocks);
+  dev->cache_hash = calloc (n, sizeof *dev->cache_hash);
+  if (!dev->cache_blocks || !dev->cache_hash)
     {
-      size_t buf_len = block_size - buf_offs;
-      error_t err = (*buf_rw) (buf_offs, *io_offs, buf_len);
-      if (err)
-	return err;
-      *io_offs += buf_len;
-      *len -= buf_len;
-      return dev_buf_discard (dev);
+      free (dev->cache_blocks);
+      free (dev->cache_hash);
+      munmap (data, n * block_size);
+      return ENOMEM;
     }
-  else
-    /* All I/O is within the block.  */
+
+  for (i = 0; i < n; i++)
     {
-      error_t err = (*buf_rw) (buf_offs, *io_offs, *len);
-      if (err)
-	return err;
-      *io_offs += *len;
-      *len = 0;
-      return 0;
+      struct dev_block *b = &dev->cache_blocks[i];
+      b->offs = -1;
+      b->data = data + i * block_size;
+      pthread_mutex_init (&b->lock, NULL);
+      b->lru_prev = i > 0 ? &dev->cache_blocks[i - 1] : 0;
+      b->lru_next = i + 1 < n ? &dev->cache_blocks[i + 1] : 0;
     }
+  dev->cache_mru = &dev->cache_blocks[0];
+  dev->cache_lru = &dev->cache_blocks[n - 1];
+
+  /* Don't let read-ahead flush out more than a quarter of the cache.  */
+  dev->cache_readahead = n / 4;
+  if (dev->cache_readahead > DEV_CACHE_READAHEAD_MAX)
+    dev->cache_readahead = DEV_CACHE_READAHEAD_MAX;
+  dev->cache_next = -1;
+  dev->cache_writebacks = 0;
+
+  pthread_mutex_init (&dev->cache_lock, NULL);
+  pthread_cond_init (&dev->cache_wakeup, NULL);
+  return 0;
 }
-
+
+/* Free DEV's cache, writing back whatever is dirty.  */
+static void
+cache_free (struct dev *dev)
+{
+  cache_flush (dev, 0, 0, 0);
+  munmap (dev->cache_blocks[0].data,
+	  dev->cache_nblocks * dev->store->block_size);
+  free (dev->cache_blocks);
+  free (dev->cache_hash);
+  dev->cache_blocks = 0;
+  dev->cache_hash = 0;
+}
+
 /* Called with DEV->lock held.  Try to open the store underlying DEV.  */
 error_t
 dev_open (struct dev *dev)
@@ -161,18 +433,15 @@ dev_open (struct dev *dev)
      to support this.  */
   store_set_flags (dev->store, STORE_INACTIVE);
 
-  dev->buf = mmap (0, dev->store->block_size, PROT_READ|PROT_WRITE,
-		   MAP_ANON, 0, 0);
-  if (dev->buf == MAP_FAILED)
-    {
-      store_free (dev->store);
-      dev->store = 0;
-      return ENOMEM;
-    }
-
   if (!dev->inhibit_cache)
     {
-      dev->buf_offs = -1;
+      err = cache_init (dev);
+      if (err)
+	{
+	  store_free (dev->store);
+	  dev->store = 0;
+	  return err;
+	}
       pthread_rwlock_init (&dev->io_lock, NULL);
       dev->block_mask = (1 << dev->store->log2_block_size) - 1;
       dev->pager = 0;
@@ -195,15 +464,13 @@ dev_close (struct dev *dev)
       if (dev->pager != NULL)
 	pager_shutdown (dev->pager);
 
-      dev_buf_discard (dev);
-
-      munmap (dev->buf, dev->store->block_size);
+      cache_free (dev);
     }
 
   store_free (dev->store);
   dev->store = 0;
 }
-
+
 /* Try and write out any pending writes to DEV.  If WAIT is true, will wait
    for any paging activity to cease.  */
 error_t
@@ -218,115 +485,85 @@ dev_sync(struct dev *dev, int wait)
   if (dev->pager != NULL)
     pager_sync (dev->pager, wait);
 
-  pthread_rwlock_wrlock (&dev->io_lock);
-  err = dev_buf_discard (dev);
+  pthread_rwlock_rdlock (&dev->io_lock);
+  err = cache_flush (dev, 0, 0, 0);
   pthread_rwlock_unlock (&dev->io_lock);
 
   return err;
 }
-
-/* Takes care of buffering I/O to/from DEV for a transfer at position OFFS,
-   length LEN; the amount of I/O successfully done is returned in AMOUNT.
-   BUF_RW is called to do I/O that's entirely inside DEV's internal buffer,
-   and RAW_RW to do I/O directly to DEV's store.  */
-static inline error_t
-buffered_rw (struct dev *dev, off_t offs, size_t len, size_t *amount,
-	     error_t (* const buf_rw) (size_t buf_offs,
-				       size_t io_offs, size_t len),
-	     error_t (* const raw_rw) (off_t offs,
-				       size_t io_offs, size_t len,
-				       size_t *amount))
-{
-  error_t err = 0;
-  unsigned block_mask = dev->block_mask;
-  unsigned block_size = dev->store->block_size;
-  size_t io_offs = 0;		/* Offset within this I/O operation.  */
-  unsigned block_offs = offs & block_mask; /* Offset within a block.  */
-
-  pthread_rwlock_wrlock (&dev->io_lock);
-
-  if (block_offs != 0)
-    /* The start of the I/O isn't block aligned.  */
-    {
-      err = dev_buf_fill (dev, offs);
-      if (! err)
-	err = dev_buf_rw (dev, block_offs, &io_offs, &len, buf_rw);
-    }
 
-  if (!err && len > 0)
-    /* Now the I/O should be block aligned.  */
-    {
-      if (len >= block_size)
-	{
-	  size_t amount;
-	  err = dev_buf_discard (dev);
-	  if (! err)
-	    err =
-	      (*raw_rw) (offs + io_offs, io_offs, len & ~block_mask, &amount);
-	  if (! err)
-	    {
-	      io_offs += amount;
-	      len -= amount;
-	    }
-	}
-      if (len > 0 && len < block_size)
-	/* All full blocks were written successfully, so write
-	   the tail end into the buffer.  */
-	{
-	  err = dev_buf_fill (dev, offs + io_offs);
-	  if (! err)
-	    err = dev_buf_rw (dev, 0, &io_offs, &len, buf_rw);
-	}
-    }
-
-  if (! err)
-    *amount = io_offs;
-
-  pthread_rwlock_unlock (&dev->io_lock);
-
-  return err;
-}
-
-/* Takes care of buffering I/O to/from DEV for a transfer at position OFFS,
-   length LEN, and direction DIR.  BUF_RW is called to do I/O to/from data
-   buffered in DEV, and RAW_RW to do I/O directly to DEV's store.  */
+/* Takes care of caching I/O to/from DEV for a transfer at position OFFS,
+   length LEN, and direction DIR (nonzero for writing); the amount of I/O
+   successfully done is returned in AMOUNT.  BUF_RW is called to do I/O
+   to/from the device block at BLOCK, and RAW_RW to do I/O directly to
+   DEV's store.  */
 static inline error_t
-dev_rw (struct dev *dev, off_t offs, size_t len, size_t *amount,
-	error_t (* const buf_rw) (size_t buf_offs,
+dev_rw (struct dev *dev, off_t offs, size_t len, size_t *amount, int dir,
+	error_t (* const buf_rw) (void *block, size_t block_offs,
 				  size_t io_offs, size_t len),
 	error_t (* const raw_rw) (off_t offs,
 				  size_t io_offs, size_t len,
 				  size_t *amount))
 {
-  error_t err;
+  error_t err = 0;
   unsigned block_mask = dev->block_mask;
+  unsigned block_size = dev->store->block_size;
+  size_t io_offs = 0;		/* Offset within this I/O operation.  */
 
   if (offs < 0 || offs > dev->store->size)
     return EINVAL;
   else if (offs + len > dev->store->size)
     len = dev->store->size - offs;
 
-  pthread_rwlock_rdlock (&dev->io_lock);
-  if (dev_buf_is_active (dev)
-      || (offs & block_mask) != 0 || (len & block_mask) != 0)
-    /* Some non-aligned I/O has been done, or is needed, so we need to deal
-       with DEV's buffer, which means getting an exclusive lock.  */
+  if ((offs & block_mask) == 0 && (len & block_mask) == 0
+      && dev->cache_bypass > 0 && len >= dev->cache_bypass)
+    /* Big block-aligned I/O goes straight to the store, once any cached
+       blocks it covers are dealt with: written back before a read, and
+       dropped for a write.  */
     {
-      /* Acquire a writer lock instead of a reader lock.  Note that other
-	 writers may have acquired the lock by the time we get it.  */
+      if (dir)
+	pthread_rwlock_wrlock (&dev->io_lock);
+      else
+	pthread_rwlock_rdlock (&dev->io_lock);
+      err = cache_flush (dev, offs, len, dir);
+      if (! err)
+	err = (*raw_rw) (offs, 0, len, amount);
       pthread_rwlock_unlock (&dev->io_lock);
-      err = buffered_rw (dev, offs, len, amount, buf_rw, raw_rw);
+      return err;
     }
-  else
-    /* Only block-aligned I/O is being done, so things are easy.  */
+
+  pthread_rwlock_rdlock (&dev->io_lock);
+  while (len > 0)
     {
-      err = (*raw_rw) (offs, 0, len, amount);
-      pthread_rwlock_unlock (&dev->io_lock);
+      unsigned block_offs = offs & block_mask; /* Offset within a block.  */
+      size_t block_len = block_size - block_offs;
+      struct dev_block *b;
+
+      if (block_len > len)
+	block_len = len;
+
+      /* A write of a whole block needn't read it first.  */
+      err = cache_get (dev, offs - block_offs,
+		       !dir || block_len < block_size, &b);
+      if (err)
+	break;
+      err = (*buf_rw) (b->data, block_offs, io_offs, block_len);
+      cache_release (dev, b, dir && !err);
+      if (err)
+	break;
+
+      offs += block_len;
+      io_offs += block_len;
+      len -= block_len;
     }
+  pthread_rwlock_unlock (&dev->io_lock);
+
+  if (! err)
+    *amount = io_offs;
 
   return err;
 }
-
+
 /* Write LEN bytes from BUF to DEV, returning the amount actually written in
    AMOUNT.  If successful, 0 is returned, otherwise an error code is
    returned.  */
@@ -334,10 +571,10 @@ error_t
 dev_write (struct dev *dev, off_t offs, void *buf, size_t len,
 	   size_t *amount)
 {
-  error_t buf_write (size_t buf_offs, size_t io_offs, size_t len)
+  error_t buf_write (void *block, size_t block_offs,
+		     size_t io_offs, size_t len)
     {
-      memcpy (dev->buf + buf_offs, buf + io_offs, len);
-      dev->buf_dirty = 1;
+      memcpy (block + block_offs, buf + io_offs, len);
       return 0;
     }
   error_t raw_write (off_t offs, size_t io_offs, size_t len, size_t *amount)
@@ -369,7 +606,7 @@ dev_write (struct dev *dev, off_t offs, void *buf, size_t len,
 			  buf, len, amount);
     }
 
-  return dev_rw (dev, offs, len, amount, buf_write, raw_write);
+  return dev_rw (dev, offs, len, amount, 1, buf_write, raw_write);
 }
 
 /* Read up to WHOLE_AMOUNT bytes from DEV, returned in BUF and LEN in the
@@ -381,24 +618,29 @@ dev_read (struct dev *dev, off_t offs, size_t whole_amount,
 {
   error_t err;
   int allocated_buf = 0;
+  /* Make sure *BUF has room for the whole read.  This is called for each
+     block that goes through the cache, so only allocate the first time;
+     *LEN is the room there is until dev_rw sets it to the amount read.  */
   error_t ensure_buf ()
     {
-      if (*len < whole_amount)
+      if (! allocated_buf && *len < whole_amount)
 	{
 	  void *new = mmap (0, whole_amount, PROT_READ|PROT_WRITE,
 			    MAP_ANON, 0, 0);
 	  if (new == (void *) -1)
 	    return errno;
 	  *buf = new;
+	  *len = whole_amount;
 	  allocated_buf = 1;
 	}
       return 0;
     }
-  error_t buf_read (size_t buf_offs, size_t io_offs, size_t len)
+  error_t buf_read (void *block, size_t block_offs,
+		    size_t io_offs, size_t len)
     {
       error_t err = ensure_buf ();
       if (! err)
-	memcpy (*buf + io_offs, dev->buf + buf_offs, len);
+	memcpy (*buf + io_offs, block + block_offs, len);
       return err;
     }
   error_t raw_read (off_t offs, size_t io_offs, size_t len, size_t *amount)
@@ -465,7 +707,7 @@ dev_read (struct dev *dev, off_t offs, size_t whole_amount,
 			 whole_amount, buf, len);
     }
 
-  err = dev_rw (dev, offs, whole_amount, len, buf_read, raw_read);
+  err = dev_rw (dev, offs, whole_amount, len, 0, buf_read, raw_read);
   if (err && allocated_buf)
     munmap (*buf, whole_amount);
 
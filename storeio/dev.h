@@ -28,6 +28,29 @@
 
 extern struct trivfs_control *storeio_fsys;
 
+/* One device block in a dev's cache.  */
+struct dev_block
+{
+  /* These are protected by the dev's CACHE_LOCK.  */
+  off_t offs;			/* Device offset of the block, or -1.  */
+  unsigned refs;		/* Users; the block can't be reused while set.  */
+  struct dev_block *hnext;	/* Hash chain.  */
+  struct dev_block *lru_next, *lru_prev;
+
+  /* These are protected by LOCK, which users hold while they have a
+     reference; while REFS is zero, they are protected by CACHE_LOCK.
+     Only clean blocks change OFFS.  */
+  pthread_mutex_t lock;
+  void *data;
+  int valid;			/* DATA holds the contents of OFFS.  */
+  int dirty;			/* DATA must be written back to OFFS.  */
+};
+
+/* Defaults for the cache parameters.  */
+#define DEV_CACHE_BLOCKS_DEFAULT	64
+#define DEV_CACHE_BYPASS_DEFAULT	(64 * 1024)
+#define DEV_CACHE_READAHEAD_MAX		8
+
 /* Information about backend store, which we presumptively call a "device".  */
 struct dev
 {
@@ -68,17 +91,33 @@ struct dev
      device block.  */
   unsigned block_mask;
 
-  /* Lock to arbitrate I/O through this device.  Block I/O can occur in
-     parallel, and requires only a reader-lock.
-     Non-block I/O is always serialized, and requires a writer-lock.  */
+  /* The number of blocks to cache, and the size from which block
+     aligned I/O skips the cache (0 means never); set by options.  */
+  unsigned cache_nblocks;
+  size_t cache_bypass;
+
+  /* Lock to arbitrate I/O through this device.  Reads, and all I/O going
+     through the cache, can occur in parallel, and require only a
+     reader-lock.  Writes that bypass the cache require a writer-lock,
+     so that the cache can't pick up stale data meanwhile.  */
   pthread_rwlock_t io_lock;
 
-  /* Non-block I/O is buffered through BUF.  BUF_OFFS is the device offset
-     corresponding to the start of BUF (which holds one block); if it is -1,
-     then BUF is inactive.  */
-  void *buf;
-  off_t buf_offs;
-  int buf_dirty;
+  /* I/O that isn't block aligned, or is smaller than CACHE_BYPASS, goes
+     through a write-back cache of CACHE_NBLOCKS device blocks.  Blocks
+     are found through CACHE_HASH, and reused in least recently used
+     order.  CACHE_LOCK protects the cache structure and CACHE_NEXT; each
+     block has its own lock for its contents, so that I/O on different
+     blocks proceeds in parallel.  */
+  struct dev_block *cache_blocks;
+  struct dev_block **cache_hash;
+  struct dev_block *cache_mru, *cache_lru;
+  pthread_mutex_t cache_lock;
+  pthread_cond_t cache_wakeup;	/* Signalled when a block is released.  */
+  unsigned cache_readahead;	/* Blocks to read ahead for sequential I/O.  */
+  off_t cache_next;		/* Offset just after the last block used.  */
+  /* Bumped (atomically) each time a block is written back, so that
+     read-ahead can tell whether the store changed under it.  */
+  unsigned long cache_writebacks;
 
   struct pager *pager;
   pthread_mutex_t pager_lock;
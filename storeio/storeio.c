@@ -38,6 +38,11 @@ static struct argp_option options[] =
   {"readonly", 'r', 0,	  0,"Disallow writing"},
   {"writable", 'w', 0,	  0,"Allow writing"},
   {"no-cache", 'c', 0,	  0,"Never cache data--user io does direct device io"},
+  {"cache-blocks", 'b', "N", 0,
+   "Cache N device blocks for small and unaligned io (default 64)"},
+  {"cache-bypass", 'B', "BYTES", 0,
+   "Do block-aligned io of at least BYTES directly to the device"
+   " (default 65536, 0 to always use the cache)"},
   {"no-file-io", 'F', 0,  0,"Never perform io via plain file io RPCs"},
   {"no-fileio",  0,   0, OPTION_ALIAS | OPTION_HIDDEN},
   {"enforced",  'e', 0,	  0,"Never reveal underlying devices, even to root"},
@@ -70,6 +75,23 @@ parse_opt (int key, char *arg, struct argp_state *state)
     case 'w': params->dev->readonly = 0; break;
 
     case 'c': params->dev->inhibit_cache = 1; break;
+
+    case 'b':
+    case 'B':
+      {
+	char *end;
+	unsigned long val = strtoul (arg, &end, 0);
+	if (end == arg || *end != '\0')
+	  {
+	    argp_error (state, "%s: Invalid number", arg);
+	    return EINVAL;
+	  }
+	if (key == 'b')
+	  params->dev->cache_nblocks = val ?: 1;
+	else
+	  params->dev->cache_bypass = val;
+      }
+      break;
     case 'e': params->dev->enforced = 1; break;
     case 'F': params->dev->no_fileio = 1; break;
 
@@ -130,6 +152,8 @@ main (int argc, char *argv[])
 
   memset (&device, 0, sizeof device);
   pthread_mutex_init (&device.lock, NULL);
+  device.cache_nblocks = DEV_CACHE_BLOCKS_DEFAULT;
+  device.cache_bypass = DEV_CACHE_BYPASS_DEFAULT;
 
   params.dev = &device;
   argp_parse (&argp, argc, argv, 0, 0, &params);
@@ -171,6 +195,22 @@ trivfs_append_args (struct trivfs_control *trivfs_control,
   if (!err && dev->inhibit_cache)
     err = argz_add (argz, argz_len, "--no-cache");
 
+  if (!err && !dev->inhibit_cache
+      && dev->cache_nblocks != DEV_CACHE_BLOCKS_DEFAULT)
+    {
+      char buf[40];
+      snprintf (buf, sizeof buf, "--cache-blocks=%u", dev->cache_nblocks);
+      err = argz_add (argz, argz_len, buf);
+    }
+
+  if (!err && !dev->inhibit_cache
+      && dev->cache_bypass != DEV_CACHE_BYPASS_DEFAULT)
+    {
+      char buf[40];
+      snprintf (buf, sizeof buf, "--cache-bypass=%zu", dev->cache_bypass);
+      err = argz_add (argz, argz_len, buf);
+    }
+
   if (!err && dev->enforced)
     err = argz_add (argz, argz_len, "--enforced");
 
@@ -111,6 +111,72 @@ write_character (int c)
   echo_pstart = output_psize;
 }
 
+/* Tell if output_character does anything to C other than pass it to
+   poutput, given output flags OFLAG.  */
+static inline int
+output_special_p (int oflag, int c)
+{
+  if (!(oflag & OPOST))
+    return 0;
+  return (((oflag & ONLCR) && c == '\n')
+	  || (!external_processing && (oflag & OXTABS) && c == '\t')
+	  || ((oflag & ONOEOT) && c == CHAR_EOT)
+	  || ((oflag & OLCASE) && isalpha (c)));
+}
+
+/* Place the N characters at DATA on the output queue, doing normal
+   processing.  This is the same as calling write_character on each,
+   but runs of characters that need no output processing go onto the
+   queue in one piece.  */
+void
+write_characters (const char *data, size_t n)
+{
+  int oflag = termstate.c_oflag;
+
+  while (n)
+    {
+      size_t run, i;
+
+      for (run = 0; run < n; run++)
+	if (output_special_p (oflag, data[run]))
+	  break;
+
+      if (run == 0)
+	{
+	  output_character (data[0]);
+	  run = 1;
+	}
+      else if (!(termflags & FLUSH_OUTPUT))
+	{
+	  /* Keep track of the cursor as poutput would.  */
+	  for (i = 0; i < run; i++)
+	    {
+	      int c = data[i];
+
+	      if ((c >= ' ') && (c < '\177'))
+		output_psize++;
+	      else if (c == '\r')
+		output_psize = 0;
+	      else if (c == '\t')
+		{
+		  output_psize++;
+		  while (output_psize % 8)
+		    output_psize++;
+		}
+	      else if (c == '\b')
+		output_psize--;
+	    }
+	  enqueue_bulk (&outputq, data, run);
+	}
+
+      data += run;
+      n -= run;
+    }
+
+  echo_qsize = 0;
+  echo_pstart = output_psize;
+}
+
 /* Report the width of character C as printed by output_character,
    if output_psize were at LOC. . */
 int
@@ -606,6 +672,108 @@ alldone:
   return flush;
 }
 
+/* If under the current settings input_character would do nothing to
+   most characters but put them on INPUTQ, return nonzero and set
+   SPECIAL[C] for each character C that still needs input_character.
+   Otherwise return 0.  */
+static int
+input_bulk_setup (char special[256])
+{
+  int lflag = termstate.c_lflag;
+  int iflag = termstate.c_iflag;
+  cc_t *cc = termstate.c_cc;
+
+  if ((lflag & ICANON) || (iflag & (INPCK | IXOFF | ISTRIP | PARMRK)))
+    return 0;
+  if (!external_processing
+      && ((lflag & ECHO) || (iflag & ILCASE)))
+    return 0;
+
+  memset (special, 0, 256);
+
+#define SPECIAL(c) \
+  do { if ((c) != _POSIX_VDISABLE) special[(unsigned char) (c)] = 1; } \
+  while (0)
+
+  /* This catches VSTART whether or not IXON is set, since alldone in
+     input_character resumes output for it.  */
+  SPECIAL (cc[VSTART]);
+
+  if (!external_processing)
+    {
+      if (lflag & ECHONL)
+	special['\n'] = 1;
+      if (lflag & IEXTEN)
+	{
+	  SPECIAL (cc[VLNEXT]);
+	  SPECIAL (cc[VDISCARD]);
+	}
+      if (lflag & ISIG)
+	{
+	  SPECIAL (cc[VINTR]);
+	  SPECIAL (cc[VQUIT]);
+	  SPECIAL (cc[VSUSP]);
+	}
+      if (iflag & IXON)
+	SPECIAL (cc[VSTOP]);
+      if (iflag & (ICRNL | IGNCR))
+	special['\r'] = 1;
+      if (iflag & INLCR)
+	special['\n'] = 1;
+    }
+#undef SPECIAL
+
+  return 1;
+}
+
+/* Place the N newly input characters at DATA on the input queue, as
+   input_character would one at a time; in raw modes runs of ordinary
+   characters go onto the queue in one piece.  If the rest of the
+   characters should be dropped, return 1; else return 0.  */
+int
+input_characters (const char *data, size_t n)
+{
+  char special[256];
+  int bulk = input_bulk_setup (special);
+
+  while (n)
+    {
+      size_t run = 0;
+
+      if (bulk && qavail (inputq)
+	  && (external_processing || !(termflags & LAST_LNEXT)))
+	{
+	  /* Don't go further past the high water mark than the
+	     character at a time path would.  */
+	  size_t room = inputq->hiwat - qsize (inputq) + 1;
+
+	  while (run < n && run < room
+		 && !special[(unsigned char) data[run]])
+	    run++;
+	}
+
+      if (run == 0)
+	{
+	  if (input_character (data[0]))
+	    return 1;
+	  run = 1;
+	}
+      else
+	{
+	  echo_qsize += run;
+	  enqueue_bulk (&inputq, data, run);
+	  if (termstate.c_iflag & IXANY)
+	    termflags &= ~USER_OUTPUT_SUSP;
+	  (*bottom->start_output) ();
+	}
+
+      data += run;
+      n -= run;
+    }
+
+  return 0;
+}
+
 
 /* This is called by the lower half when a break is received. */
 void
@@ -761,3 +929,83 @@ reallocate_queue (struct queue *q)
     }
   return q;
 }
+
+/* Add the N characters at DATA to *QP.  This has the same effect as
+   calling enqueue on each of them in turn, but the waiters are woken
+   at most once.  */
+void
+enqueue_bulk (struct queue **qp, const char *data, size_t n)
+{
+  struct queue *q = *qp;
+  int was_empty = !qsize (q);
+
+  if (!n)
+    return;
+
+  while (n)
+    {
+      size_t room, i;
+
+      if (q->ce - q->array == q->arraylen)
+	q = *qp = reallocate_queue (q);
+
+      room = q->arraylen - (q->ce - q->array);
+      if (room > n)
+	room = n;
+      for (i = 0; i < room; i++)
+	q->ce[i] = data[i];
+      q->ce += room;
+      data += room;
+      n -= room;
+    }
+
+  if (was_empty)
+    {
+      pthread_cond_broadcast (q->wait);
+      pthread_cond_broadcast (&select_alert);
+      if (q == inputq)
+	{
+	  if (pty_select_alert != NULL)
+	    pthread_cond_broadcast (pty_select_alert);
+	  call_asyncs (O_READ);
+	}
+    }
+
+  if (!q->susp && (qsize (q) > q->hiwat))
+    q->susp = 1;
+}
+
+/* Remove the first N characters from Q and store them, unquoted, at
+   DATA.  This has the same effect as calling dequeue N times, but the
+   waiters are woken at most once.  */
+void
+dequeue_bulk (struct queue *q, char *data, size_t n)
+{
+  int beep = 0;
+  size_t i;
+
+  assert (qsize (q) >= n);
+  if (!n)
+    return;
+
+  for (i = 0; i < n; i++)
+    data[i] = q->cs[i] & ~QUEUE_QUOTE_MARK;
+  q->cs += n;
+
+  if (q->susp && (qsize (q) < q->lowat))
+    {
+      q->susp = 0;
+      beep = 1;
+    }
+  if (qsize (q) == 0)
+    beep = 1;
+  if (beep)
+    {
+      pthread_cond_broadcast (q->wait);
+      pthread_cond_broadcast (&select_alert);
+      if (q == inputq && pty_select_alert != NULL)
+	pthread_cond_broadcast (pty_select_alert);
+      else if (q == outputq)
+	call_asyncs (O_WRITE);
+    }
+}
@@ -372,8 +372,7 @@ pty_io_read (struct trivfs_protid *cred,
 	  *cp++ = TIOCPKT_DATA;
 	  --size;
 	}
-      while (size--)
-	*cp++ = dequeue (outputq);
+      dequeue_bulk (outputq, cp, size);
     }
 
   pthread_mutex_unlock (&global_lock);
@@ -388,7 +387,7 @@ pty_io_write (struct trivfs_protid *cred,
 	      mach_msg_type_number_t datalen,
 	      mach_msg_type_number_t *amount)
 {
-  int i, flush;
+  int flush;
   int cancel = 0;
 
   pthread_mutex_lock (&global_lock);
@@ -417,27 +416,21 @@ pty_io_write (struct trivfs_protid *cred,
 	  return EINTR;
 	}
 
-      for (i = 0; i < datalen; i++)
-	enqueue (&inputq, data[i]);
+      enqueue_bulk (&inputq, data, datalen);
 
       /* Extra garbage charater */
       enqueue (&inputq, 0);
     }
   else if (termstate.c_cflag & CREAD)
-    for (i = 0; i < datalen; i++)
-      {
-	flush = input_character (data[i]);
-
-	if (flush)
-	  {
-	    if (packet_mode)
-	      {
-		control_byte |= TIOCPKT_FLUSHREAD;
-		wake_reader ();
-	      }
-	    break;
-	  }
-      }
+    {
+      flush = input_characters (data, datalen);
+
+      if (flush && packet_mode)
+	{
+	  control_byte |= TIOCPKT_FLUSHREAD;
+	  wake_reader ();
+	}
+    }
 
   pthread_mutex_unlock (&global_lock);
 
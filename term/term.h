@@ -275,6 +275,8 @@ dequeue (struct queue *q)
 #endif /* Use extern inlines.  */
 
 struct queue *reallocate_queue (struct queue *);
+void enqueue_bulk (struct queue **qp, const char *data, size_t n);
+void dequeue_bulk (struct queue *q, char *data, size_t n);
 
 #if defined(__USE_EXTERN_INLINES) || defined(TERM_DEFINE_EI)
 /* Add C to *QP. */
@@ -363,6 +365,7 @@ queue_erase (struct queue *q)
 
 /* Functions devio is supposed to call */
 int input_character (int);
+int input_characters (const char *, size_t);
 void report_carrier_on (void);
 void report_carrier_off (void);
 void report_carrier_error (error_t);
@@ -376,6 +379,7 @@ void output_character (int);
 void copy_rawq (void);
 void rescan_inputq (void);
 void write_character (int);
+void write_characters (const char *, size_t);
 void init_users (void);
 
 extern char *tty_arg;
@@ -599,8 +599,11 @@ trivfs_S_io_write (struct trivfs_protid *cred,
     }
 
   cancel = 0;
-  for (i = 0; i < datalen; i++)
+  i = 0;
+  while (i < datalen)
     {
+      size_t n;
+
       while (!qavail (outputq) && !cancel)
 	{
 	  err = (*bottom->start_output) ();
@@ -616,7 +619,12 @@ trivfs_S_io_write (struct trivfs_protid *cred,
       if (cancel)
 	break;
 
-      write_character (data[i]);
+      /* Queue as much as will fit below the high water mark.  */
+      n = outputq->hiwat - qsize (outputq) + 1;
+      if (n > datalen - i)
+	n = datalen - i;
+      write_characters (data + i, n);
+      i += n;
     }
 
   *amt = i;
@@ -724,40 +732,45 @@ trivfs_S_io_read (struct trivfs_protid *cred,
 
   cancel = 0;
   cp = *data;
-  for (i = 0; i < max; i++)
+  if (remote_input_mode
+      || (!(termstate.c_lflag & ICANON)
+	  && (!(termstate.c_lflag & ISIG)
+	      || termstate.c_cc[VDSUSP] == _POSIX_VDISABLE)))
     {
-      char c = dequeue (inputq);
-
-      if (remote_input_mode)
-	*cp++ = c;
-      else
-	{
-	  /* Unless this is EOF, add it to the response. */
-	  if (!(termstate.c_lflag & ICANON)
-	      || !CCEQ (termstate.c_cc[VEOF], c))
-	    *cp++ = c;
-
-	  /* If this is a break character, then finish now. */
-	  if ((termstate.c_lflag & ICANON)
-	      && (c == '\n'
-		  || CCEQ (termstate.c_cc[VEOF], c)
-		  || CCEQ (termstate.c_cc[VEOL], c)
-		  || CCEQ (termstate.c_cc[VEOL2], c)))
-	    break;
-
-	  /* If this is the delayed suspend character, then signal now. */
-	  if ((termstate.c_lflag & ISIG)
-	      && CCEQ (termstate.c_cc[VDSUSP], c))
-	    {
-	      /* The CANCEL flag is being used here to tell the return
-		 below to make sure we don't signal EOF on a VDUSP that
-		 happens at the front of a line.  */
-	      send_signal (SIGTSTP);
-	      cancel = 1;
-	      break;
-	    }
-	}
+      /* No character needs a look; take them all at once.  */
+      dequeue_bulk (inputq, cp, max);
+      cp += max;
     }
+  else
+    for (i = 0; i < max; i++)
+      {
+	char c = dequeue (inputq);
+
+	/* Unless this is EOF, add it to the response. */
+	if (!(termstate.c_lflag & ICANON)
+	    || !CCEQ (termstate.c_cc[VEOF], c))
+	  *cp++ = c;
+
+	/* If this is a break character, then finish now. */
+	if ((termstate.c_lflag & ICANON)
+	    && (c == '\n'
+		|| CCEQ (termstate.c_cc[VEOF], c)
+		|| CCEQ (termstate.c_cc[VEOL], c)
+		|| CCEQ (termstate.c_cc[VEOL2], c)))
+	  break;
+
+	/* If this is the delayed suspend character, then signal now. */
+	if ((termstate.c_lflag & ISIG)
+	    && CCEQ (termstate.c_cc[VDSUSP], c))
+	  {
+	    /* The CANCEL flag is being used here to tell the return
+	       below to make sure we don't signal EOF on a VDUSP that
+	       happens at the front of a line.  */
+	    send_signal (SIGTSTP);
+	    cancel = 1;
+	    break;
+	  }
+      }
 
   if (remote_input_mode && qsize (inputq) == 1)
     dequeue (inputq);
@@ -24,11 +24,85 @@
 #include "tmpfs.h"
 #include <stdlib.h>
 
+/* Hash a directory entry name for the index.  */
+static hurd_ihash_key_t
+dirindex_hash (const void *name)
+{
+  return (hurd_ihash_key_t) hurd_ihash_hash32 (name, strlen (name), 0);
+}
+
+/* Compare two directory entry names for the index.  */
+static int
+dirindex_compare (const void *name1, const void *name2)
+{
+  return strcmp (name1, name2) == 0;
+}
+
+/* Free the index of directory DN, if it has one.  */
+static void
+dirindex_free (struct disknode *dn)
+{
+  struct tmpfs_dirent *d;
+
+  if (dn->u.dir.index != 0)
+    {
+      for (d = dn->u.dir.entries; d != 0; d = d->next)
+	{
+	  free (d->pos);
+	  d->pos = 0;
+	}
+      hurd_ihash_destroy (&dn->u.dir.index->names);
+      free (dn->u.dir.index);
+      dn->u.dir.index = 0;
+    }
+}
+
+/* Build an index for the directory DN, whose last entry's NEXT pointer
+   is TAILP.  If memory is short, just leave the directory unindexed;
+   lookups still work, only slower.  */
+static void
+dirindex_build (struct disknode *dn, struct tmpfs_dirent **tailp)
+{
+  struct tmpfs_dirindex *index;
+  struct tmpfs_dirent *d, **prevp;
+
+  index = malloc (sizeof *index);
+  if (index == 0)
+    return;
+
+  hurd_ihash_init (&index->names, offsetof (struct tmpfs_dirent_pos, locp));
+  hurd_ihash_set_gki (&index->names, dirindex_hash, dirindex_compare);
+  index->tailp = tailp;
+  index->next_seq = 0;
+  index->cursor_valid = 0;
+
+  for (prevp = &dn->u.dir.entries; (d = *prevp) != 0; prevp = &d->next)
+    {
+      struct tmpfs_dirent_pos *pos = malloc (sizeof *pos);
+
+      if (pos == 0
+	  || hurd_ihash_add (&index->names, (hurd_ihash_key_t) d->name, pos))
+	{
+	  free (pos);
+	  dn->u.dir.index = index;
+	  dirindex_free (dn);
+	  return;
+	}
+      pos->entry = d;
+      pos->prevp = prevp;
+      pos->seq = index->next_seq++;
+      d->pos = pos;
+    }
+
+  dn->u.dir.index = index;
+}
+
 error_t
 diskfs_init_dir (struct node *dp, struct node *pdp, struct protid *cred)
 {
   dp->dn->u.dir.dotdot = pdp->dn;
   dp->dn->u.dir.entries = 0;
+  dp->dn->u.dir.index = 0;
 
   /* Increase hardlink count for parent directory */
   pdp->dn_stat.st_nlink++;
@@ -46,6 +120,7 @@ diskfs_clear_directory (struct node *dp, struct node *pdp,
     return ENOTEMPTY;
   assert (dp->dn_stat.st_size == 0);
   assert (dp->dn->u.dir.dotdot == pdp->dn);
+  dirindex_free (dp->dn);
 
   /* Decrease hardlink count for parent directory */
   pdp->dn_stat.st_nlink--;
@@ -66,6 +141,7 @@ diskfs_get_directs (struct node *dp, int entry, int n,
 		    char **data, size_t *datacnt,
 		    vm_size_t bufsiz, int *amt)
 {
+  struct tmpfs_dirindex *index = dp->dn->u.dir.index;
   struct tmpfs_dirent *d;
   struct dirent *entp;
   int i;
@@ -114,8 +190,17 @@ diskfs_get_directs (struct node *dp, int entry, int n,
       entp = (void *) entp + entp->d_reclen;
     }
 
-  /* Skip ahead to the desired entry.  */
-  for (d = dp->dn->u.dir.entries; i < entry && d != 0; d = d->next)
+  /* Skip ahead to the desired entry.  Readers usually fetch a big
+     directory in consecutive chunks, so start from where the last call
+     left off if that's not past ENTRY.  */
+  d = dp->dn->u.dir.entries;
+  if (index != 0 && index->cursor_valid
+      && i < index->cursor_entry && index->cursor_entry <= entry)
+    {
+      d = index->cursor;
+      i = index->cursor_entry;
+    }
+  for (; i < entry && d != 0; d = d->next)
     ++i;
 
   if (i < entry)
@@ -140,6 +225,13 @@ diskfs_get_directs (struct node *dp, int entry, int n,
       entp = (void *) entp + rlen;
     }
 
+  if (index != 0)
+    {
+      index->cursor = d;
+      index->cursor_entry = i;
+      index->cursor_valid = 1;
+    }
+
   *datacnt = (char *) entp - *data;
   *amt = i - entry;
 
@@ -149,7 +241,7 @@ diskfs_get_directs (struct node *dp, int entry, int n,
 
 struct dirstat
 {
-  struct tmpfs_dirent **prevp;
+  struct tmpfs_dirent *entry;	/* The entry found, if any.  */
   int dotdot;
 };
 const size_t diskfs_dirstat_size = sizeof (struct dirstat);
@@ -157,7 +249,7 @@ const size_t diskfs_dirstat_size = sizeof (struct dirstat);
 void
 diskfs_null_dirstat (struct dirstat *ds)
 {
-  ds->prevp = 0;
+  ds->entry = 0;
 }
 
 error_t
@@ -174,7 +266,8 @@ diskfs_lookup_hard (struct node *dp,
 		    struct protid *cred)
 {
   const size_t namelen = strlen (name);
-  struct tmpfs_dirent *d, **prevp;
+  struct tmpfs_dirindex *index = dp->dn->u.dir.index;
+  struct tmpfs_dirent *d;
 
   if (type == REMOVE || type == RENAME)
     assert (np);
@@ -225,24 +318,31 @@ diskfs_lookup_hard (struct node *dp,
 	}
     }
 
-  for (d = *(prevp = &dp->dn->u.dir.entries); d != 0;
-       d = *(prevp = &d->next))
-    if (d->namelen == namelen && !memcmp (d->name, name, namelen))
-      {
-	if (ds)
-	  ds->prevp = prevp;
-
-	if (np)
-	  return diskfs_cached_lookup ((ino_t) (uintptr_t) d->dn, np);
-	else
-	  return 0;
-      }
+  if (index != 0)
+    {
+      struct tmpfs_dirent_pos *pos
+	= hurd_ihash_find (&index->names, (hurd_ihash_key_t) name);
+      d = pos ? pos->entry : 0;
+    }
+  else
+    for (d = dp->dn->u.dir.entries; d != 0; d = d->next)
+      if (d->namelen == namelen && !memcmp (d->name, name, namelen))
+	break;
 
   if (ds)
-    ds->prevp = prevp;
+    ds->entry = d;
+
+  if (d == 0)
+    {
+      if (np)
+	*np = 0;
+      return ENOENT;
+    }
+
   if (np)
-    *np = 0;
-  return ENOENT;
+    return diskfs_cached_lookup ((ino_t) (uintptr_t) d->dn, np);
+  else
+    return 0;
 }
 
 
@@ -254,7 +354,8 @@ diskfs_direnter_hard (struct node *dp, const char *name,
   const size_t namelen = strlen (name);
   const size_t entsize
 	  = (offsetof (struct dirent, d_name[1]) + namelen + 7) & ~7;
-  struct tmpfs_dirent *new;
+  struct tmpfs_dirindex *index;
+  struct tmpfs_dirent *new, **tailp;
 
   if (round_page (tmpfs_space_used + entsize) / vm_page_size
       > tmpfs_page_limit)
@@ -266,9 +367,52 @@ diskfs_direnter_hard (struct node *dp, const char *name,
 
   new->next = 0;
   new->dn = np->dn;
+  new->pos = 0;
   new->namelen = namelen;
   memcpy (new->name, name, namelen + 1);
-  *ds->prevp = new;
+
+  /* New entries go at the end, so that readdir positions of existing
+     entries don't move.  Small directories are just walked; once one
+     gets big enough, index it.  */
+  index = dp->dn->u.dir.index;
+  if (index == 0)
+    {
+      int count = 0;
+
+      for (tailp = &dp->dn->u.dir.entries; *tailp != 0;
+	   tailp = &(*tailp)->next)
+	++count;
+      if (count >= TMPFS_DIRINDEX_THRESHOLD)
+	{
+	  dirindex_build (dp->dn, tailp);
+	  index = dp->dn->u.dir.index;
+	}
+    }
+
+  if (index != 0)
+    {
+      struct tmpfs_dirent_pos *pos = malloc (sizeof *pos);
+
+      if (pos == 0
+	  || hurd_ihash_add (&index->names, (hurd_ihash_key_t) new->name, pos))
+	{
+	  free (pos);
+	  free (new);
+	  return ENOSPC;
+	}
+      tailp = index->tailp;
+      index->tailp = &new->next;
+      pos->entry = new;
+      pos->prevp = tailp;
+      pos->seq = index->next_seq++;
+      new->pos = pos;
+
+      /* A readdir cursor sitting at the end now sits on the new entry.  */
+      if (index->cursor_valid && index->cursor == 0)
+	index->cursor = new;
+    }
+
+  *tailp = new;
 
   dp->dn_stat.st_size += entsize;
   adjust_used (entsize);
@@ -286,7 +430,7 @@ diskfs_dirrewrite_hard (struct node *dp, struct node *np,
   if (ds->dotdot)
     dp->dn->u.dir.dotdot = np->dn;
   else
-    (*ds->prevp)->dn = np->dn;
+    ds->entry->dn = np->dn;
 
   return 0;
 }
@@ -294,17 +438,52 @@ diskfs_dirrewrite_hard (struct node *dp, struct node *np,
 error_t
 diskfs_dirremove_hard (struct node *dp, struct dirstat *ds)
 {
-  struct tmpfs_dirent *d = *ds->prevp;
+  struct tmpfs_dirindex *index = dp->dn->u.dir.index;
+  struct tmpfs_dirent *d = ds->entry;
   const size_t entsize
 	  = (offsetof (struct dirent, d_name[1]) + d->namelen + 7) & ~7;
 
-  *ds->prevp = d->next;
+  if (index != 0)
+    {
+      struct tmpfs_dirent_pos *pos = d->pos;
+
+      hurd_ihash_locp_remove (&index->names, pos->locp);
+      if (index->tailp == &d->next)
+	index->tailp = pos->prevp;
+
+      /* Keep the readdir cursor on the same entry; everything after D
+	 moves down one position.  */
+      if (index->cursor_valid)
+	{
+	  if (index->cursor == d)
+	    index->cursor = d->next;
+	  else if (index->cursor == 0 || pos->seq < index->cursor->pos->seq)
+	    index->cursor_entry--;
+	}
+
+      *pos->prevp = d->next;
+      if (d->next != 0)
+	d->next->pos->prevp = pos->prevp;
+      free (pos);
+    }
+  else
+    {
+      struct tmpfs_dirent **prevp;
+
+      for (prevp = &dp->dn->u.dir.entries; *prevp != d;
+	   prevp = &(*prevp)->next)
+	assert (*prevp != 0);
+      *prevp = d->next;
+    }
 
   if (dp->dirmod_reqs != 0)
     diskfs_notice_dirchange (dp, DIR_CHANGED_UNLINK, d->name);
 
   free (d);
 
+  if (dp->dn->u.dir.entries == 0)
+    dirindex_free (dp->dn);
+
   adjust_used (-entsize);
   dp->dn_stat.st_size -= entsize;
   dp->dn_stat.st_blocks = ((sizeof *dp->dn + dp->dn->translen
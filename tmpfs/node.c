@@ -29,18 +29,42 @@
 unsigned int num_files;
 static unsigned int gen;
 
-/* all_nodes is a list of all nodes.
-
-   Access to all_nodes and all_nodes_nr_items is protected by
-   all_nodes_lock.
-
-   Every node in all_nodes carries a light reference.  When we are
-   asked to give up that light reference, we reacquire our lock
+/* The node table holds all nodes.  Since the inode number of a node
+   is the address of its disknode, there's nothing to look up: the
+   table only records which disknodes have a live node, through their
+   HNEXT and HPREVP fields.  It is split into shards, picked by hashing
+   the disknode address, so that unrelated nodes being created and
+   dropped in parallel don't all contend for one lock.
+
+   Access to a shard's NODES list and NR_ITEMS is protected by its
+   LOCK.
+
+   Every node in the table carries a light reference.  When we are
+   asked to give up that light reference, we reacquire the shard lock
    momentarily to check whether someone else reacquired a
    reference.  */
-struct node *all_nodes;
-static size_t all_nodes_nr_items;
-pthread_rwlock_t all_nodes_lock = PTHREAD_RWLOCK_INITIALIZER;
+#define NODE_TABLE_SHARDS 64	/* must be a power of two */
+
+struct node_table_shard
+{
+  pthread_rwlock_t lock;
+  struct node *nodes;
+  size_t nr_items;
+} __attribute__ ((aligned (64)));
+
+static struct node_table_shard node_table[NODE_TABLE_SHARDS] =
+  {
+    [0 ... NODE_TABLE_SHARDS - 1] = { .lock = PTHREAD_RWLOCK_INITIALIZER }
+  };
+
+/* Return the node table shard for DN.  */
+static inline struct node_table_shard *
+node_shard (struct disknode *dn)
+{
+  /* Disknodes are malloc'd, so the low bits carry no information.  */
+  uint32_t h = (uint32_t) ((uintptr_t) dn >> 4) * 0x9e3779b1U;
+  return &node_table[h >> 26 & (NODE_TABLE_SHARDS - 1)];
+}
 
 error_t
 diskfs_alloc_node (struct node *dp, mode_t mode, struct node **npp)
@@ -54,11 +78,10 @@ diskfs_alloc_node (struct node *dp, mode_t mode, struct node **npp)
   if (round_page (get_used () + sizeof *dn) / vm_page_size
       > tmpfs_page_limit)
     {
-      pthread_rwlock_unlock (&all_nodes_lock);
       free (dn);
       return ENOSPC;
     }
-  dn->gen = gen++;
+  dn->gen = __atomic_fetch_add (&gen, 1, __ATOMIC_RELAXED);
   __atomic_add_fetch (&num_files, 1, __ATOMIC_RELAXED);
   adjust_used (sizeof *dn);
 
@@ -69,13 +92,16 @@ diskfs_alloc_node (struct node *dp, mode_t mode, struct node **npp)
 void
 diskfs_free_node (struct node *np, mode_t mode)
 {
+  struct node_table_shard *shard = node_shard (np->dn);
+
   switch (np->dn->type)
     {
     case DT_REG:
       if (np->dn->u.reg.memobj != MACH_PORT_NULL) {
 	vm_deallocate (mach_task_self (), np->dn->u.reg.memref, 4096);
 	mach_port_deallocate (mach_task_self (), np->dn->u.reg.memobj);
-      }	
+      }
+      free (np->dn->u.reg.data);
       break;
     case DT_DIR:
       assert (np->dn->u.dir.entries == 0);
@@ -85,12 +111,12 @@ diskfs_free_node (struct node *np, mode_t mode)
       break;
     }
 
-  pthread_rwlock_wrlock (&all_nodes_lock);
+  pthread_rwlock_wrlock (&shard->lock);
   *np->dn->hprevp = np->dn->hnext;
   if (np->dn->hnext != 0)
     np->dn->hnext->dn->hprevp = np->dn->hprevp;
-  all_nodes_nr_items -= 1;
-  pthread_rwlock_unlock (&all_nodes_lock);
+  shard->nr_items -= 1;
+  pthread_rwlock_unlock (&shard->lock);
 
   free (np->dn);
   np->dn = 0;
@@ -122,8 +148,7 @@ diskfs_node_norefs (struct node *np)
       switch (np->dn->type)
 	{
 	case DT_REG:
-	  assert (np->allocsize % vm_page_size == 0);
-	  np->dn->u.reg.allocpages = np->allocsize / vm_page_size;
+	  np->dn->u.reg.allocsize = np->allocsize;
 	  break;
 	case DT_CHR:
 	case DT_BLK:
@@ -145,7 +170,7 @@ recompute_blocks (struct node *np)
   switch (dn->type)
     {
     case DT_REG:
-      np->allocsize = dn->u.reg.allocpages * vm_page_size;
+      np->allocsize = dn->u.reg.allocsize;
       st->st_blocks += np->allocsize;
       break;
     case DT_LNK:
@@ -168,23 +193,24 @@ error_t
 diskfs_cached_lookup (ino_t inum, struct node **npp)
 {
   struct disknode *dn = (void *) (uintptr_t) inum;
+  struct node_table_shard *shard = node_shard (dn);
   struct node *np;
 
   assert (npp);
 
-  pthread_rwlock_rdlock (&all_nodes_lock);
+  pthread_rwlock_rdlock (&shard->lock);
   if (dn->hprevp != 0)		/* There is already a node.  */
     goto gotit;
   else
     /* Create the new node.  */
     {
       struct stat *st;
-      pthread_rwlock_unlock (&all_nodes_lock);
+      pthread_rwlock_unlock (&shard->lock);
 
       np = diskfs_make_node (dn);
       np->cache_id = (ino_t) (uintptr_t) dn;
 
-      pthread_rwlock_wrlock (&all_nodes_lock);
+      pthread_rwlock_wrlock (&shard->lock);
       if (dn->hprevp != NULL)
         {
           /* We lost a race.  */
@@ -192,14 +218,14 @@ diskfs_cached_lookup (ino_t inum, struct node **npp)
           goto gotit;
         }
 
-      dn->hnext = all_nodes;
+      dn->hnext = shard->nodes;
       if (dn->hnext)
 	dn->hnext->dn->hprevp = &dn->hnext;
-      dn->hprevp = &all_nodes;
-      all_nodes = np;
-      all_nodes_nr_items += 1;
+      dn->hprevp = &shard->nodes;
+      shard->nodes = np;
+      shard->nr_items += 1;
       diskfs_nref_light (np);
-      pthread_rwlock_unlock (&all_nodes_lock);
+      pthread_rwlock_unlock (&shard->lock);
 
       st = &np->dn_stat;
       memset (st, 0, sizeof *st);
@@ -235,7 +261,7 @@ diskfs_cached_lookup (ino_t inum, struct node **npp)
   assert (np->dn == dn);
   assert (*dn->hprevp == np);
   diskfs_nref (np);
-  pthread_rwlock_unlock (&all_nodes_lock);
+  pthread_rwlock_unlock (&shard->lock);
   pthread_mutex_lock (&np->lock);
   *npp = np;
   return 0;
@@ -245,45 +271,68 @@ error_t
 diskfs_node_iterate (error_t (*fun) (struct node *))
 {
   error_t err = 0;
-  size_t num_nodes;
-  struct node *node, **node_list, **p;
+  struct node **node_list = 0;
+  size_t node_list_size = 0;
+  int i;
 
-  pthread_rwlock_rdlock (&all_nodes_lock);
+  /* Take one shard at a time, so that neither the lock hold time nor
+     the size of the copy grows with the total number of nodes.  */
+  for (i = 0; i < NODE_TABLE_SHARDS && !err; i++)
+    {
+      struct node_table_shard *shard = &node_table[i];
+      size_t num_nodes;
+      struct node *node, **p;
 
-  /* We must copy everything from the hash table into another data structure
-     to avoid running into any problems with the hash-table being modified
-     during processing (normally we delegate access to hash-table with
-     all_nodes_lock, but we can't hold this while locking the
-     individual node locks).  */
+      pthread_rwlock_rdlock (&shard->lock);
 
-  num_nodes = all_nodes_nr_items;
+      /* We must copy everything from the shard into another data
+	 structure to avoid running into any problems with the shard
+	 being modified during processing (normally we delegate access
+	 to the shard with its lock, but we can't hold this while
+	 locking the individual node locks).  */
 
-  p = node_list = alloca (num_nodes * sizeof (struct node *));
-  for (node = all_nodes; node != 0; node = node->dn->hnext)
-    {
-      *p++ = node;
+      num_nodes = shard->nr_items;
+      if (num_nodes > node_list_size)
+	{
+	  p = realloc (node_list, num_nodes * sizeof (struct node *));
+	  if (p == 0)
+	    {
+	      pthread_rwlock_unlock (&shard->lock);
+	      err = ENOMEM;
+	      break;
+	    }
+	  node_list = p;
+	  node_list_size = num_nodes;
+	}
 
-      /* We acquire a hard reference for node, but without using
-	 diskfs_nref.  We do this so that diskfs_new_hardrefs will not
-	 get called.  */
-      refcounts_ref (&node->refcounts, NULL);
-    }
+      p = node_list;
+      for (node = shard->nodes; node != 0; node = node->dn->hnext)
+	{
+	  *p++ = node;
+
+	  /* We acquire a hard reference for node, but without using
+	     diskfs_nref.  We do this so that diskfs_new_hardrefs will not
+	     get called.  */
+	  refcounts_ref (&node->refcounts, NULL);
+	}
 
-  pthread_rwlock_unlock (&all_nodes_lock);
+      pthread_rwlock_unlock (&shard->lock);
 
-  p = node_list;
-  while (num_nodes-- > 0)
-    {
-      node = *p++;
-      if (!err)
+      p = node_list;
+      while (num_nodes-- > 0)
 	{
-	  pthread_mutex_lock (&node->lock);
-	  err = (*fun) (node);
-	  pthread_mutex_unlock (&node->lock);
+	  node = *p++;
+	  if (!err)
+	    {
+	      pthread_mutex_lock (&node->lock);
+	      err = (*fun) (node);
+	      pthread_mutex_unlock (&node->lock);
+	    }
+	  diskfs_nrele (node);
 	}
-      diskfs_nrele (node);
     }
 
+  free (node_list);
   return err;
 }
 
@@ -295,7 +344,9 @@ diskfs_node_iterate (error_t (*fun) (struct node *))
 void
 diskfs_try_dropping_softrefs (struct node *np)
 {
-  pthread_rwlock_wrlock (&all_nodes_lock);
+  struct node_table_shard *shard = node_shard (np->dn);
+
+  pthread_rwlock_wrlock (&shard->lock);
   if (np->cache_id != 0)
     {
       /* Check if someone reacquired a reference.  */
@@ -306,16 +357,16 @@ diskfs_try_dropping_softrefs (struct node *np)
 	{
 	  /* A reference was reacquired.  It's fine, we didn't touch
 	     anything yet. */
-	  pthread_rwlock_unlock (&all_nodes_lock);
+	  pthread_rwlock_unlock (&shard->lock);
 	  return;
 	}
 
       /* Just let go of the weak reference.  The node will be removed
-	 from all_nodes in diskfs_free_node.  */
+	 from the node table in diskfs_free_node.  */
       np->cache_id = 0;
       diskfs_nrele_light (np);
     }
-  pthread_rwlock_unlock (&all_nodes_lock);
+  pthread_rwlock_unlock (&shard->lock);
 }
 
 /* The user must define this funcction.  Node NP has some light
@@ -424,6 +475,83 @@ diskfs_node_reload (struct node *node)
 }
 
 
+/* Give the regular file NP a memory object, rounding its allocation up
+   to a whole page, and move the contents of an inline file into it.  */
+static error_t
+create_memobj (struct node *np)
+{
+  struct disknode *const dn = np->dn;
+  off_t size = round_page (np->allocsize);
+  error_t err;
+
+  assert (dn->u.reg.memobj == MACH_PORT_NULL);
+
+  err = default_pager_object_create (default_pager, &dn->u.reg.memobj, size);
+  if (err)
+    return err;
+  assert (dn->u.reg.memobj != MACH_PORT_NULL);
+
+  /* XXX we need to keep a reference to the object, or GNU Mach
+     will terminate it when we release the map. */
+  dn->u.reg.memref = 0;
+  err = vm_map (mach_task_self (), &dn->u.reg.memref, 4096, 0, 1,
+		dn->u.reg.memobj, 0, 0, VM_PROT_NONE, VM_PROT_NONE,
+		VM_INHERIT_NONE);
+  assert_perror (err);
+
+  if (dn->u.reg.data != 0)
+    {
+      vm_address_t addr = 0;
+
+      err = vm_map (mach_task_self (), &addr, size, 0, 1,
+		    dn->u.reg.memobj, 0, 0,
+		    VM_PROT_READ|VM_PROT_WRITE, VM_PROT_READ|VM_PROT_WRITE,
+		    VM_INHERIT_NONE);
+      if (err)
+	{
+	  vm_deallocate (mach_task_self (), dn->u.reg.memref, 4096);
+	  mach_port_deallocate (mach_task_self (), dn->u.reg.memobj);
+	  dn->u.reg.memobj = MACH_PORT_NULL;
+	  return err;
+	}
+      memcpy ((void *) addr, dn->u.reg.data, np->allocsize);
+      vm_deallocate (mach_task_self (), addr, size);
+
+      free (dn->u.reg.data);
+      dn->u.reg.data = 0;
+    }
+
+  adjust_used (size - np->allocsize);
+  np->allocsize = dn->u.reg.allocsize = size;
+  recompute_blocks (np);
+  return 0;
+}
+
+/* Read or write the contents of an inline file directly, without
+   creating a memory object for it.  */
+static error_t
+rdwr_hook (struct node *np, char *data, off_t offset, size_t *amt, int dir)
+{
+  struct disknode *const dn = np->dn;
+
+  if (dn->type != DT_REG || dn->u.reg.memobj != MACH_PORT_NULL
+      || dn->u.reg.data == 0)
+    return EINVAL;
+
+  if (offset >= np->allocsize)
+    *amt = 0;
+  else if (*amt > np->allocsize - offset)
+    *amt = np->allocsize - offset;
+
+  if (dir)
+    memcpy (dn->u.reg.data + offset, data, *amt);
+  else
+    memcpy (data, dn->u.reg.data + offset, *amt);
+  return 0;
+}
+error_t (*diskfs_rdwr_hook)(struct node *np, char *data, off_t offset,
+			    size_t *amt, int dir) = rdwr_hook;
+
 /* The user must define this function.  Truncate locked node NP to be SIZE
    bytes long.  (If NP is already less than or equal to SIZE bytes
    long, do nothing.)  If this is a symlink (and diskfs_shortcut_symlink
@@ -446,6 +574,28 @@ diskfs_truncate (struct node *np, off_t size)
 
   assert (np->dn->type == DT_REG);
 
+  if (np->dn->u.reg.data != 0)
+    {
+      /* An inline file just shrinks its buffer.  */
+      if (size == 0)
+	{
+	  free (np->dn->u.reg.data);
+	  np->dn->u.reg.data = 0;
+	}
+      else
+	{
+	  char *data = realloc (np->dn->u.reg.data, size);
+	  if (data != 0)
+	    np->dn->u.reg.data = data;
+	}
+
+      np->dn_stat.st_size = size;
+      adjust_used (size - np->allocsize);
+      np->allocsize = np->dn->u.reg.allocsize = size;
+      recompute_blocks (np);
+      return 0;
+    }
+
   if (default_pager == MACH_PORT_NULL)
     return EIO;
 
@@ -471,8 +621,8 @@ diskfs_truncate (struct node *np, off_t size)
   /* Otherwise it never had any real contents.  */
 
   adjust_used (size - np->allocsize);
-  np->dn_stat.st_blocks += (size - np->allocsize) / 512;
-  np->allocsize = size;
+  np->allocsize = np->dn->u.reg.allocsize = size;
+  recompute_blocks (np);
 
   return 0;
 }
@@ -484,33 +634,73 @@ diskfs_truncate (struct node *np, off_t size)
 error_t
 diskfs_grow (struct node *np, off_t size, struct protid *cred)
 {
-  assert (np->dn->type == DT_REG);
+  struct disknode *const dn = np->dn;
+  error_t err;
+
+  assert (dn->type == DT_REG);
 
   if (np->allocsize >= size)
     return 0;
 
-  off_t set_size = size;
-  size = round_page (size);
-  if (round_page (get_used () + size - np->allocsize)
-      / vm_page_size > tmpfs_page_limit)
-    return ENOSPC;
+  if (dn->u.reg.memobj == MACH_PORT_NULL && size <= tmpfs_inline_max
+      && (dn->u.reg.data != 0 || np->allocsize == 0))
+    {
+      /* Small enough to keep in the node.  */
+      char *data;
 
-  if (default_pager == MACH_PORT_NULL)
-    return EIO;
+      if (round_page (get_used () + size - np->allocsize)
+	  / vm_page_size > tmpfs_page_limit)
+	return ENOSPC;
 
-  if (np->dn->u.reg.memobj != MACH_PORT_NULL)
+      data = realloc (dn->u.reg.data, size);
+      if (data == 0)
+	return ENOSPC;
+      memset (data + np->allocsize, 0, size - np->allocsize);
+      dn->u.reg.data = data;
+    }
+  else
     {
-      /* Increase the limit the memory object will allow to be accessed.  */
-      error_t err = default_pager_object_set_size (np->dn->u.reg.memobj, set_size);
-      if (err == MIG_BAD_ID)	/* Old default pager, never limited it.  */
-	err = 0;
-      if (err)
-	return err;
+      /* Grow a whole chunk at a time, so that a file being appended to
+	 doesn't cost a trip to the default pager for every write.  If
+	 the chunk doesn't fit in what's left, settle for what was asked
+	 for.  */
+      off_t want = round_page (size);
+      size = ((size + tmpfs_chunk_size - 1) / tmpfs_chunk_size
+	      * tmpfs_chunk_size);
+      if (round_page (get_used () + size - np->allocsize)
+	  / vm_page_size > tmpfs_page_limit)
+	size = want;
+      if (round_page (get_used () + size - np->allocsize)
+	  / vm_page_size > tmpfs_page_limit)
+	return ENOSPC;
+
+      if (default_pager == MACH_PORT_NULL)
+	return EIO;
+
+      if (dn->u.reg.data != 0)
+	{
+	  /* Outgrown inline storage.  */
+	  err = create_memobj (np);
+	  if (err)
+	    return err;
+	}
+
+      if (dn->u.reg.memobj != MACH_PORT_NULL)
+	{
+	  /* Increase the limit the memory object will allow to be
+	     accessed.  That's the whole chunk, since we won't be called
+	     again until it's full.  */
+	  err = default_pager_object_set_size (dn->u.reg.memobj, size);
+	  if (err == MIG_BAD_ID)	/* Old default pager, never limited it.  */
+	    err = 0;
+	  if (err)
+	    return err;
+	}
     }
 
   adjust_used (size - np->allocsize);
-  np->dn_stat.st_blocks += (size - np->allocsize) / 512;
-  np->allocsize = size;
+  np->allocsize = dn->u.reg.allocsize = size;
+  recompute_blocks (np);
   return 0;
 }
 
@@ -537,26 +727,16 @@ diskfs_get_filemap (struct node *np, vm_prot_t prot)
      pager how big to make its bitmaps.  This is just an optimization for
      the default pager; the memory object can be expanded at any time just
      by accessing more of it.  (It also optimizes the case of empty files
-     so we might never make a memory object at all.) */
+     so we might never make a memory object at all.)  Inline files only
+     get one if they're mapped.  */
   if (np->dn->u.reg.memobj == MACH_PORT_NULL)
     {
-      error_t err = default_pager_object_create (default_pager,
-						 &np->dn->u.reg.memobj,
-						 np->allocsize);
+      err = create_memobj (np);
       if (err)
 	{
 	  errno = err;
 	  return MACH_PORT_NULL;
 	}
-      assert (np->dn->u.reg.memobj != MACH_PORT_NULL);
-      
-      /* XXX we need to keep a reference to the object, or GNU Mach
-	 will terminate it when we release the map. */
-      np->dn->u.reg.memref = 0;
-      vm_map (mach_task_self (), &np->dn->u.reg.memref, 4096, 0, 1,
-	      np->dn->u.reg.memobj, 0, 0, VM_PROT_NONE, VM_PROT_NONE,
-	      VM_INHERIT_NONE);
-      assert_perror (err);
     }
 
   /* XXX always writable */
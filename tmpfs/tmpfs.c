@@ -55,6 +55,8 @@ mach_port_t default_pager;
 
 off_t tmpfs_page_limit, tmpfs_space_used;
 mode_t tmpfs_root_mode = -1;
+size_t tmpfs_inline_max = TMPFS_INLINE_MAX_DEFAULT;
+size_t tmpfs_chunk_size = TMPFS_CHUNK_SIZE_DEFAULT;
 
 error_t
 diskfs_set_statfs (struct statfs *st)
@@ -99,11 +101,19 @@ diskfs_reload_global_state ()
 int diskfs_synchronous = 0;
 
 #define OPT_SIZE 600	/* --size */
+#define OPT_INLINE_MAX 601	/* --inline-max */
+#define OPT_CHUNK_SIZE 602	/* --chunk-size */
 
 static const struct argp_option options[] =
 {
   {"mode", 'm', "MODE", 0, "Permissions (octal) for root directory"},
   {"size", OPT_SIZE, "MAX-BYTES", 0, "Maximum size"},
+  {"inline-max", OPT_INLINE_MAX, "BYTES", 0,
+   "Keep the contents of files up to this size in the node itself"
+   " (default 2K, 0 disables)"},
+  {"chunk-size", OPT_CHUNK_SIZE, "BYTES", 0,
+   "Allocate space for bigger files this many bytes at a time"
+   " (default 64K)"},
   {NULL,}
 };
 
@@ -111,6 +121,8 @@ struct option_values
 {
   off_t size;
   mode_t mode;
+  off_t inline_max;
+  off_t chunk_size;
 };
 
 /* Parse the size string ARG, and set *NEWSIZE with the resulting size.  */
@@ -191,6 +203,8 @@ parse_opt (int key, char *arg, struct argp_state *state)
       state->hook = values;
       values->size = -1;
       values->mode = -1;
+      values->inline_max = -1;
+      values->chunk_size = -1;
       break;
     case ARGP_KEY_FINI:
       free (values);
@@ -223,6 +237,27 @@ parse_opt (int key, char *arg, struct argp_state *state)
       }
       break;
 
+    case OPT_INLINE_MAX:	/* --inline-max=BYTES */
+      {
+	error_t err = parse_opt_size (arg, state, &values->inline_max);
+	if (err)
+	  return err;
+      }
+      break;
+
+    case OPT_CHUNK_SIZE:	/* --chunk-size=BYTES */
+      {
+	error_t err = parse_opt_size (arg, state, &values->chunk_size);
+	if (err)
+	  return err;
+	if (values->chunk_size == 0)
+	  {
+	    argp_error (state, "chunk size must not be zero");
+	    return EINVAL;
+	  }
+      }
+      break;
+
     case ARGP_KEY_NO_ARGS:
       if (values->size < 0)
 	{
@@ -258,6 +293,10 @@ parse_opt (int key, char *arg, struct argp_state *state)
       /* All options parse successfully, so implement ours if possible.  */
       tmpfs_page_limit = values->size / vm_page_size;
       tmpfs_root_mode = values->mode;
+      if (values->inline_max >= 0)
+	tmpfs_inline_max = values->inline_max;
+      if (values->chunk_size >= 0)
+	tmpfs_chunk_size = round_page (values->chunk_size);
       break;
 
     default:
@@ -275,6 +314,21 @@ diskfs_append_args (char **argz, size_t *argz_len)
   /* Get the standard things.  */
   err = diskfs_append_std_options (argz, argz_len);
 
+  if (!err && tmpfs_inline_max != TMPFS_INLINE_MAX_DEFAULT)
+    {
+      char buf[100];
+      snprintf (buf, sizeof buf, "--inline-max=%zu", tmpfs_inline_max);
+      err = argz_add (argz, argz_len, buf);
+    }
+
+  if (!err && tmpfs_chunk_size != TMPFS_CHUNK_SIZE_DEFAULT)
+    {
+      char buf[100];
+      snprintf (buf, sizeof buf, "--chunk-size=%zu", tmpfs_chunk_size);
+      err = argz_add (argz, argz_len, buf);
+    }
+
+  /* The size goes last, since it's an argument rather than an option.  */
   if (!err)
     {
       off_t lim = tmpfs_page_limit * vm_page_size;
@@ -21,6 +21,7 @@ the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
 #define _tmpfs_h 1
 
 #include <hurd/diskfs.h>
+#include <hurd/ihash.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <stdint.h>
@@ -48,12 +49,14 @@ struct disknode
     {
       mach_port_t memobj;
       vm_address_t memref;
-      unsigned int allocpages;	/* largest size while memobj was live */
+      off_t allocsize;		/* allocated size, as in struct node */
+      char *data;		/* malloc'd contents of an inline file */
     } reg;
     struct
     {
       struct tmpfs_dirent *entries;
       struct disknode *dotdot;
+      struct tmpfs_dirindex *index; /* null until the directory grows */
     } dir;
     dev_t chr, blk;
   } u;
@@ -63,13 +66,54 @@ struct disknode
 
 struct tmpfs_dirent
 {
-  struct tmpfs_dirent *next;
+  struct tmpfs_dirent *next;	/* Entries are kept in order of creation.  */
   struct disknode *dn;
+  struct tmpfs_dirent_pos *pos;	/* null unless the directory is indexed */
   uint8_t namelen;
   char name[0];
 };
 
+/* What a directory's index keeps about each of its entries.  Small
+   directories don't have these, and removing an entry from one walks
+   the list to find the pointer to it.  */
+struct tmpfs_dirent_pos
+{
+  struct tmpfs_dirent *entry;
+  struct tmpfs_dirent **prevp;	/* Whichever pointer points to ENTRY.  */
+  hurd_ihash_locp_t locp;	/* Position in the index's hash table.  */
+  uint64_t seq;			/* Creation order.  */
+};
+
+/* Directories with more entries than this get a tmpfs_dirindex.  */
+#define TMPFS_DIRINDEX_THRESHOLD 32
+
+/* Lookup and readdir acceleration for big directories.  */
+struct tmpfs_dirindex
+{
+  struct hurd_ihash names;	/* Entries, keyed by name.  */
+  struct tmpfs_dirent **tailp;	/* NEXT pointer of the last entry.  */
+  uint64_t next_seq;
+
+  /* Where the last readdir stopped: CURSOR is the entry at position
+     CURSOR_ENTRY (counting . and ..), or null if that's the end.  Kept
+     up to date as entries come and go, so that reading a directory in
+     chunks doesn't rescan it from the start each time.  */
+  int cursor_valid;
+  int cursor_entry;
+  struct tmpfs_dirent *cursor;
+};
+
 extern off_t tmpfs_page_limit;
+
+/* Regular files no bigger than TMPFS_INLINE_MAX bytes keep their contents
+   in U.REG.DATA instead of a memory object.  Bigger files grow their
+   memory object TMPFS_CHUNK_SIZE bytes (a multiple of the page size) at
+   a time.  */
+extern size_t tmpfs_inline_max;
+extern size_t tmpfs_chunk_size;
+
+#define TMPFS_INLINE_MAX_DEFAULT	2048
+#define TMPFS_CHUNK_SIZE_DEFAULT	(64 * 1024)
 extern mach_port_t default_pager;
 
 /* These two must be accessed using atomic operations.  */
@@ -0,0 +1,214 @@
+/* Make a block-compressed image for the zblock store
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111, USA. */
+
+/* The image format is described in libstore/zblock.c.  The header is
+   written last, once the position of the index is known.  */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <argp.h>
+#include <error.h>
+#include <errno.h>
+#include <endian.h>
+#include <zlib.h>
+
+#include <version.h>
+
+const char *argp_program_version = STANDARD_HURD_VERSION (mkzblock);
+
+#define ZBLOCK_MAGIC		"HURDZBLK"
+#define ZBLOCK_VERSION		1
+
+struct zblock_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t block_size;
+  uint64_t size;
+  uint64_t index_offset;
+};
+
+static const struct argp_option options[] =
+{
+  {"block-size", 'b', "BYTES", 0,
+   "Compress the input in blocks of BYTES bytes, a power of two"
+   " (default 65536)"},
+  {"level", 'l', "LEVEL", 0, "zlib compression level, 0 to 9 (default 9)"},
+  {0}
+};
+static const char args_doc[] = "INPUT OUTPUT";
+static const char doc[] = "Make a block-compressed image of INPUT in OUTPUT."
+"\vThe image can be opened with the zblock store type, for instance"
+" `zblock:file:OUTPUT', which only decompresses the blocks that are read.";
+
+/* Read up to LEN bytes from FD into BUF, stopping only at end of file.  */
+static size_t
+read_block (int fd, const char *name, char *buf, size_t len)
+{
+  size_t done = 0;
+
+  while (done < len)
+    {
+      ssize_t rd = read (fd, buf + done, len - done);
+      if (rd < 0)
+	error (1, errno, "%s", name);
+      if (rd == 0)
+	break;
+      done += rd;
+    }
+  return done;
+}
+
+static void
+write_all (int fd, const char *name, const void *buf, size_t len)
+{
+  while (len > 0)
+    {
+      ssize_t wr = write (fd, buf, len);
+      if (wr < 0)
+	error (1, errno, "%s", name);
+      buf += wr;
+      len -= wr;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  size_t block_size = 65536;
+  int level = 9;
+  const char *in_name = 0, *out_name = 0;
+  struct zblock_header hdr;
+  uint64_t *index = 0;
+  size_t num_blocks = 0, index_alloced = 0, len;
+  uint64_t size = 0, offs;
+  uLongf cbuf_size;
+  char *buf, *cbuf;
+  int in, out;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      char *end;
+
+      switch (key)
+	{
+	case 'b':
+	  block_size = strtoul (arg, &end, 0);
+	  if (*end || block_size == 0 || (block_size & (block_size - 1)))
+	    argp_error (state, "%s: not a power of two", arg);
+	  break;
+	case 'l':
+	  level = strtol (arg, &end, 0);
+	  if (*end || level < 0 || level > 9)
+	    argp_error (state, "%s: bad compression level", arg);
+	  break;
+	case ARGP_KEY_ARG:
+	  if (state->arg_num == 0)
+	    in_name = arg;
+	  else if (state->arg_num == 1)
+	    out_name = arg;
+	  else
+	    return ARGP_ERR_UNKNOWN;
+	  break;
+	case ARGP_KEY_END:
+	  if (state->arg_num < 2)
+	    argp_usage (state);
+	  break;
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp argp = { options, parse_opt, args_doc, doc };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  in = open (in_name, O_RDONLY);
+  if (in < 0)
+    error (1, errno, "%s", in_name);
+  out = open (out_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (out < 0)
+    error (1, errno, "%s", out_name);
+
+  cbuf_size = compressBound (block_size);
+  buf = malloc (block_size);
+  cbuf = malloc (cbuf_size);
+  if (! buf || ! cbuf)
+    error (1, ENOMEM, "buffers");
+
+  /* The blocks follow the header, each either compressed or, if that
+     doesn't make it any smaller, as it is.  */
+  offs = sizeof hdr;
+  if (lseek (out, offs, SEEK_SET) < 0)
+    error (1, errno, "%s", out_name);
+
+  while ((len = read_block (in, in_name, buf, block_size)) > 0)
+    {
+      uLongf clen = cbuf_size;
+
+      if (num_blocks + 1 >= index_alloced)
+	{
+	  index_alloced = index_alloced ? 2 * index_alloced : 1024;
+	  index = realloc (index, index_alloced * sizeof *index);
+	  if (! index)
+	    error (1, ENOMEM, "index");
+	}
+      index[num_blocks++] = htobe64 (offs);
+
+      if (compress2 ((Bytef *) cbuf, &clen, (const Bytef *) buf, len,
+		     level) == Z_OK && clen < len)
+	write_all (out, out_name, cbuf, clen);
+      else
+	{
+	  clen = len;
+	  write_all (out, out_name, buf, len);
+	}
+      offs += clen;
+      size += len;
+
+      if (len < block_size)
+	/* Only the last block may be short.  */
+	break;
+    }
+
+  if (size == 0)
+    error (1, 0, "%s: empty input", in_name);
+
+  index[num_blocks] = htobe64 (offs);
+  write_all (out, out_name, index, (num_blocks + 1) * sizeof *index);
+
+  memset (&hdr, 0, sizeof hdr);
+  memcpy (hdr.magic, ZBLOCK_MAGIC, sizeof hdr.magic);
+  hdr.version = htobe32 (ZBLOCK_VERSION);
+  hdr.block_size = htobe32 (block_size);
+  hdr.size = htobe64 (size);
+  hdr.index_offset = htobe64 (offs);
+  if (pwrite (out, &hdr, sizeof hdr, 0) != sizeof hdr)
+    error (1, errno, "%s", out_name);
+
+  if (close (out) < 0)
+    error (1, errno, "%s", out_name);
+  close (in);
+
+  return 0;
+}
@@ -0,0 +1,178 @@
+/* Show the RPC statistics of a libports server.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <hurd.h>
+#include <hurd/ports.h>
+#include <argp.h>
+#include <error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <version.h>
+
+#include "msgids.h"
+#include "portstats_U.h"
+
+const char *argp_program_version = STANDARD_HURD_VERSION (portstats);
+
+static const struct argp_option options[] =
+{
+  {"histogram", 'H', 0, 0,
+   "Also print a histogram of the service times of each kind of RPC."},
+  {"no-translator", 'N', 0, 0,
+   "Ask the server of FILE itself, not the translator sitting on it."},
+  {0}
+};
+
+static const char args_doc[] = "FILE";
+static const char doc[] = "Show the RPC statistics of the server of FILE."
+"\vThe server must keep statistics: libports servers do when started with "
+"LIBPORTS_STATS set in their environment.  They are counted for all the "
+"ports in the same port bucket as FILE, usually all its server's files.";
+
+static void
+print_msgid (mach_msg_id_t msgid, int width)
+{
+  const struct msgid_info *info = msgid_info (msgid);
+  if (info)
+    printf ("%-*s", width, info->name);
+  else
+    printf ("%-*d", width, (int) msgid);
+}
+
+/* Sort statistics by total service time, most first.  */
+static int
+compare_stats (const void *a, const void *b)
+{
+  const struct ports_msgid_stats *x = a, *y = b;
+  return (x->service_time < y->service_time ? 1
+	  : x->service_time > y->service_time ? -1 : 0);
+}
+
+static void
+print_histogram (const struct ports_msgid_stats *s)
+{
+  uint64_t most = 0;
+  int b, last = 0;
+
+  for (b = 0; b < PORTS_STATS_BUCKETS; b++)
+    if (s->buckets[b])
+      {
+	last = b;
+	if (s->buckets[b] > most)
+	  most = s->buckets[b];
+      }
+  for (b = 0; b <= last; b++)
+    {
+      int width = most ? s->buckets[b] * 40 / most : 0;
+      if (b == 0)
+	printf ("  %10s", "< 1us");
+      else
+	printf ("  %8lluus", 1ULL << (b - 1));
+      printf (" %10llu |%.*s\n", (unsigned long long) s->buckets[b],
+	      width, "****************************************");
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *file = 0;
+  int histogram = 0, flags = 0;
+  struct ports_msgid_stats *stats;
+  mach_msg_type_number_t len = 0;
+  mach_port_t node;
+  size_t count, i;
+  uint64_t calls = 0, in_flight = 0;
+  error_t err;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'H':
+	  histogram = 1;
+	  break;
+	case 'N':
+	  flags |= O_NOTRANS;
+	  break;
+	case ARGP_KEY_ARG:
+	  if (file)
+	    argp_usage (state);
+	  file = arg;
+	  break;
+	case ARGP_KEY_NO_ARGS:
+	  argp_usage (state);
+	  return EINVAL;
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp_child children[] =
+    {
+      { .argp=&msgid_argp, },
+      { 0 }
+    };
+  const struct argp argp = { options, parse_opt, args_doc, doc, children };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  node = file_name_lookup (file, flags, 0);
+  if (node == MACH_PORT_NULL)
+    error (1, errno, "%s", file);
+
+  stats = 0;
+  err = portstats_get (node, (data_t *) &stats, &len);
+  if (err == MIG_BAD_ID || err == EOPNOTSUPP)
+    error (1, 0, "%s: the server keeps no RPC statistics", file);
+  if (err)
+    error (1, err, "%s", file);
+  mach_port_deallocate (mach_task_self (), node);
+
+  count = len / sizeof *stats;
+  qsort (stats, count, sizeof *stats, compare_stats);
+
+  printf ("%-28s %10s %8s %10s %10s %10s %6s\n", "RPC", "CALLS", "ERRORS",
+	  "MEAN(us)", "MAX(us)", "WAIT(us)", "ACTIVE");
+  for (i = 0; i < count; i++)
+    {
+      const struct ports_msgid_stats *s = &stats[i];
+
+      print_msgid (s->msgid, 28);
+      printf (" %10llu %8llu %10.3f %10.3f %10.3f %6u\n",
+	      (unsigned long long) s->count, (unsigned long long) s->errors,
+	      s->count ? s->service_time / 1e3 / s->count : 0.0,
+	      s->max_service_time / 1e3,
+	      s->count ? s->wait_time / 1e3 / s->count : 0.0,
+	      (unsigned int) s->in_flight);
+      if (histogram)
+	print_histogram (s);
+
+      calls += s->count;
+      in_flight += s->in_flight;
+    }
+  printf ("%llu calls, %llu in progress\n",
+	  (unsigned long long) calls, (unsigned long long) in_flight);
+
+  munmap (stats, len);
+  return 0;
+}
@@ -0,0 +1,345 @@
+/* Decode binary traces written by rpctrace --binary.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <mach.h>
+#include <hurd/ihash.h>
+#include <argp.h>
+#include <error.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <version.h>
+
+#include "msgids.h"
+#include "rpctrace.h"
+
+const char *argp_program_version = STANDARD_HURD_VERSION (rpcdecode);
+
+static const struct argp_option options[] =
+{
+  {"histogram", 'H', 0, 0,
+   "Instead of listing the messages, print a histogram of the time taken "
+   "by each kind of RPC, from request to reply."},
+  {0}
+};
+
+static const char args_doc[] = "FILE";
+static const char doc[] = "Decode a trace written by rpctrace --binary.";
+
+/* Requests still waiting for their reply, by reply port.  */
+struct pending
+{
+  uint64_t time;
+  int32_t msgid;
+};
+
+static struct hurd_ihash pending_ihash
+  = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+
+/* Latencies are counted in buckets of powers of two microseconds; the
+   first one holds everything under 1us.  */
+#define NBUCKETS 32
+
+/* What we know about one kind of RPC, for --histogram.  */
+struct rpc_stats
+{
+  int32_t msgid;
+  uint64_t count;
+  uint64_t total, max;		/* Nanoseconds.  */
+  uint64_t buckets[NBUCKETS];
+};
+
+static struct hurd_ihash stats_ihash
+  = HURD_IHASH_INITIALIZER (HURD_IHASH_NO_LOCP);
+
+static uint64_t lost;
+
+static const char *
+msgid_name (mach_msg_id_t msgid)
+{
+  const struct msgid_info *info = msgid_info (msgid);
+  return info ? info->name : 0;
+}
+
+static void
+print_msgid (mach_msg_id_t msgid)
+{
+  const char *name = msgid_name (msgid);
+  if (name)
+    printf ("%s", name);
+  else
+    printf ("%d", (int) msgid);
+}
+
+/* Remember that the request R is waiting for its reply.  */
+static void
+add_pending (const struct rpctrace_record *r)
+{
+  struct pending *p = malloc (sizeof *p);
+  if (! p)
+    error (1, ENOMEM, "pending requests");
+  p->time = r->time;
+  p->msgid = r->msgid;
+
+  free (hurd_ihash_find (&pending_ihash, r->reply_port));
+  if (hurd_ihash_add (&pending_ihash, r->reply_port, p))
+    error (1, ENOMEM, "pending requests");
+}
+
+/* Find the request the reply R answers, forget it, and return how long
+   it took in nanoseconds, or -1 if it cannot be found.  */
+static int64_t
+reply_latency (const struct rpctrace_record *r)
+{
+  struct pending *p = hurd_ihash_find (&pending_ihash, r->reply_port);
+  int64_t latency;
+
+  if (! p || p->msgid + 100 != r->msgid)
+    return -1;
+  latency = r->time - p->time;
+  hurd_ihash_remove (&pending_ihash, r->reply_port);
+  free (p);
+  return latency;
+}
+
+/* Print the record R, at TIME nanoseconds into the trace.  */
+static void
+list_record (const struct rpctrace_record *r, uint64_t time)
+{
+  int64_t latency;
+
+  printf ("%12.6f ", time / 1e9);
+  switch (r->kind)
+    {
+    case RPCTRACE_REQUEST:
+    case RPCTRACE_SIMPLE:
+    case RPCTRACE_NOTIFICATION:
+      printf ("%4u->", (unsigned int) r->port);
+      print_msgid (r->msgid);
+      printf (" (%u bytes)", (unsigned int) r->size);
+      if (r->kind == RPCTRACE_REQUEST)
+	{
+	  printf (" ...%u", (unsigned int) r->reply_port);
+	  add_pending (r);
+	}
+      else if (r->kind == RPCTRACE_NOTIFICATION)
+	printf (" notification");
+      if (r->from_task)
+	printf (" task %u->%u", (unsigned int) r->from_task,
+		(unsigned int) r->to_task);
+      break;
+
+    case RPCTRACE_REPLY:
+      printf ("%u... ", (unsigned int) r->reply_port);
+      print_msgid (r->msgid);
+      if (r->retcode == 0)
+	printf (" = 0");
+      else
+	printf (" = %#x (%s)", r->retcode, strerror (r->retcode));
+      latency = reply_latency (r);
+      if (latency >= 0)
+	printf (" in %.3fus", latency / 1e3);
+      break;
+
+    case RPCTRACE_LOST:
+      printf ("*** %u messages lost", (unsigned int) r->size);
+      break;
+
+    default:
+      printf ("*** unknown record type %u", (unsigned int) r->kind);
+      break;
+    }
+  putchar ('\n');
+}
+
+/* Count the record R in the histograms.  */
+static void
+count_record (const struct rpctrace_record *r)
+{
+  struct rpc_stats *s;
+  int64_t latency;
+  uint64_t us;
+  int b;
+
+  switch (r->kind)
+    {
+    case RPCTRACE_REQUEST:
+      add_pending (r);
+      return;
+    case RPCTRACE_LOST:
+      lost += r->size;
+      return;
+    case RPCTRACE_REPLY:
+      break;
+    default:
+      return;
+    }
+
+  latency = reply_latency (r);
+  if (latency < 0)
+    return;
+
+  s = hurd_ihash_find (&stats_ihash, r->msgid - 100);
+  if (! s)
+    {
+      s = calloc (1, sizeof *s);
+      if (! s || hurd_ihash_add (&stats_ihash, r->msgid - 100, s))
+	error (1, ENOMEM, "statistics");
+      s->msgid = r->msgid - 100;
+    }
+
+  s->count++;
+  s->total += latency;
+  if (latency > s->max)
+    s->max = latency;
+  for (b = 0, us = latency / 1000; us > 0 && b < NBUCKETS - 1; us >>= 1)
+    b++;
+  s->buckets[b]++;
+}
+
+/* Sort statistics by total time, most first.  */
+static int
+compare_stats (const void *a, const void *b)
+{
+  const struct rpc_stats *x = *(struct rpc_stats *const *) a;
+  const struct rpc_stats *y = *(struct rpc_stats *const *) b;
+  return x->total < y->total ? 1 : x->total > y->total ? -1 : 0;
+}
+
+static void
+print_histograms (void)
+{
+  struct rpc_stats **all;
+  size_t n = 0, i;
+
+  all = malloc (stats_ihash.nr_items * sizeof *all);
+  if (stats_ihash.nr_items > 0 && ! all)
+    error (1, ENOMEM, "statistics");
+  HURD_IHASH_ITERATE (&stats_ihash, value)
+    all[n++] = value;
+  qsort (all, n, sizeof *all, compare_stats);
+
+  for (i = 0; i < n; i++)
+    {
+      struct rpc_stats *s = all[i];
+      uint64_t most = 0;
+      int b, last = 0;
+
+      print_msgid (s->msgid);
+      printf (": %llu calls, total %.3fms, mean %.3fus, max %.3fus\n",
+	      (unsigned long long) s->count, s->total / 1e6,
+	      s->total / 1e3 / s->count, s->max / 1e3);
+
+      for (b = 0; b < NBUCKETS; b++)
+	if (s->buckets[b])
+	  {
+	    last = b;
+	    if (s->buckets[b] > most)
+	      most = s->buckets[b];
+	  }
+      for (b = 0; b <= last; b++)
+	{
+	  int width = s->buckets[b] * 40 / most;
+	  if (b == 0)
+	    printf ("  %10s", "< 1us");
+	  else
+	    printf ("  %8lluus", 1ULL << (b - 1));
+	  printf (" %10llu |%.*s\n", (unsigned long long) s->buckets[b],
+		  width, "****************************************");
+	}
+    }
+
+  if (lost)
+    printf ("%llu messages were lost\n", (unsigned long long) lost);
+  free (all);
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *file = 0;
+  int histogram = 0;
+  struct rpctrace_header header;
+  struct rpctrace_record r;
+  uint64_t start = 0;
+  int first = 1;
+  FILE *fp;
+
+  error_t parse_opt (int key, char *arg, struct argp_state *state)
+    {
+      switch (key)
+	{
+	case 'H':
+	  histogram = 1;
+	  break;
+	case ARGP_KEY_ARG:
+	  if (file)
+	    argp_usage (state);
+	  file = arg;
+	  break;
+	case ARGP_KEY_NO_ARGS:
+	  argp_usage (state);
+	  return EINVAL;
+	default:
+	  return ARGP_ERR_UNKNOWN;
+	}
+      return 0;
+    }
+  const struct argp_child children[] =
+    {
+      { .argp=&msgid_argp, },
+      { 0 }
+    };
+  const struct argp argp = { options, parse_opt, args_doc, doc, children };
+
+  argp_parse (&argp, argc, argv, 0, 0, 0);
+
+  fp = fopen (file, "r");
+  if (! fp)
+    error (1, errno, "%s", file);
+  if (fread (&header, sizeof header, 1, fp) != 1
+      || memcmp (header.magic, RPCTRACE_MAGIC, sizeof header.magic))
+    error (1, 0, "%s: not an rpctrace binary trace", file);
+  if (header.version != RPCTRACE_VERSION
+      || header.record_size != sizeof r)
+    error (1, 0, "%s: unsupported trace version %u", file,
+	   (unsigned int) header.version);
+
+  while (fread (&r, sizeof r, 1, fp) == 1)
+    {
+      if (first)
+	{
+	  start = r.time;
+	  first = 0;
+	}
+      if (histogram)
+	count_record (&r);
+      else
+	list_record (&r, r.time - start);
+    }
+  if (ferror (fp))
+    error (1, errno, "%s", file);
+  fclose (fp);
+
+  if (histogram)
+    print_histograms ();
+
+  return 0;
+}
@@ -38,8 +38,11 @@
 #include <stddef.h>
 #include <argz.h>
 #include <envz.h>
+#include <time.h>
+#include <sys/param.h>
 
 #include "msgids.h"
+#include "rpctrace.h"
 
 const char *argp_program_version = STANDARD_HURD_VERSION (rpctrace);
 
@@ -49,6 +52,10 @@ static const struct argp_option options[] =
 {
   {"output", 'o', "FILE", 0, "Send trace output to FILE instead of stderr."},
   {0, 's', "SIZE", 0, "Specify the maximum string size to print (the default is 80)."},
+  {"binary", 'B', 0, 0,
+   "Write a binary trace to the output file, for rpcdecode to read later."},
+  {"buffer-size", 'b', "RECORDS", 0,
+   "With --binary, buffer this many messages (the default is 65536)."},
   {0, 'E', "var[=value]", 0,
    "Set/change (var=value) or remove (var) an environment variable among the "
    "ones inherited by the executed process."},
@@ -258,6 +265,12 @@ static void print_data (mach_msg_type_name_t type,
 			mach_msg_type_number_t nelt,
 			mach_msg_type_number_t eltsize);
 
+/* In binary mode, OSTREAM is null and this is called instead of all the
+   above for each message.  */
+static void trace_record (unsigned int kind, const mach_msg_header_t *msg,
+			  mach_port_t port, mach_port_t reply_port,
+			  int retcode, task_t from, task_t to);
+
 
 /*** Mechanics of tracing messages and interposing on ports ***/
 
@@ -844,7 +857,7 @@ print_contents (mach_msg_header_t *inp,
 
       if (first)
 	first = 0;
-      else
+      else if (ostream)
 	putc (' ', ostream);
 
       /* Note that MACH_MSG_TYPE_PORT_NAME does not indicate a port right.
@@ -872,6 +885,12 @@ print_contents (mach_msg_header_t *inp,
 
 	      str = rewrite_right (&portnames[i], &newtypes[i], req);
 
+	      if (i > 0 && newtypes[i] != newtypes[0])
+		poly = 1;
+
+	      if (! ostream)
+		continue;
+
 	      putc ((i == 0 && nelt > 1) ? '{' : ' ', ostream);
 
 	      if (portnames[i] == MACH_PORT_NULL)
@@ -885,10 +904,8 @@ print_contents (mach_msg_header_t *inp,
 		  else
 		    fprintf (ostream, "%3u", (unsigned int) portnames[i]);
 		}
-	      if (i > 0 && newtypes[i] != newtypes[0])
-		poly = 1;
 	    }
-	  if (nelt > 1)
+	  if (nelt > 1 && ostream)
 	    putc ('}', ostream);
 
 	  if (poly)
@@ -947,7 +964,7 @@ print_contents (mach_msg_header_t *inp,
 		type->msgt_name = newtypes[0];
 	    }
 	}
-      else
+      else if (ostream)
 	print_data (name, data, nelt, eltsize);
     }
 }
@@ -1286,11 +1303,19 @@ trace_and_forward (mach_msg_header_t *inp, mach_msg_header_t *outp)
 	  req->is_req = FALSE;
 	  /* This sure looks like an RPC reply message.  */
 	  mig_reply_header_t *rh = (void *) inp;
-	  print_reply_header ((struct send_once_info *) info, rh, req);
-	  putc (' ', ostream);
-	  fflush (ostream);
+	  if (ostream)
+	    {
+	      print_reply_header ((struct send_once_info *) info, rh, req);
+	      putc (' ', ostream);
+	      fflush (ostream);
+	    }
+	  else
+	    trace_record (RPCTRACE_REPLY, inp, MACH_PORT_NULL,
+			  info->pi.port_right, rh->RetCode,
+			  MACH_PORT_NULL, MACH_PORT_NULL);
 	  print_contents (&rh->Head, rh + 1, req);
-	  putc ('\n', ostream);
+	  if (ostream)
+	    putc ('\n', ostream);
 
 	  if (inp->msgh_id == 2161)/* the reply message for thread_create */
 	    wrap_new_thread (inp, req);
@@ -1306,7 +1331,8 @@ trace_and_forward (mach_msg_header_t *inp, mach_msg_header_t *outp)
 	  struct req_info *req = NULL;
 
 	  /* Print something about the message header.  */
-	  print_request_header ((struct sender_info *) info, inp);
+	  if (ostream)
+	    print_request_header ((struct sender_info *) info, inp);
 	  /* It's a notification message. */
 	  if (inp->msgh_id <= 72 && inp->msgh_id >= 64)
 	    {
@@ -1329,18 +1355,30 @@ trace_and_forward (mach_msg_header_t *inp, mach_msg_header_t *outp)
 	  /* If it's the notification message, req is NULL.
 	   * TODO again, it's difficult to handle mach_notify_port_destroyed */
 	  print_contents (inp, inp + 1, req);
+
+	  if (! ostream)
+	    trace_record (inp->msgh_id <= 72 && inp->msgh_id >= 64
+			  ? RPCTRACE_NOTIFICATION
+			  : inp->msgh_local_port == MACH_PORT_NULL
+			  ? RPCTRACE_SIMPLE : RPCTRACE_REQUEST,
+			  inp, info->pi.port_right, inp->msgh_local_port, 0,
+			  req ? req->from : MACH_PORT_NULL,
+			  req ? req->to : MACH_PORT_NULL);
+
 	  if (inp->msgh_local_port == MACH_PORT_NULL) /* simpleroutine */
 	    {
 	      /* If it's a simpleroutine,
 	       * we don't need the request information any more. */
 	      req = remove_request (inp->msgh_id, reply_port);
 	      free (req);
-	      fprintf (ostream, ");\n");
+	      if (ostream)
+		fprintf (ostream, ");\n");
 	    }
-	  else
+	  else if (ostream)
 	    /* Leave a partial line that will be finished later.  */
 	    fprintf (ostream, ")");
-	  fflush (ostream);
+	  if (ostream)
+	    fflush (ostream);
 
 	  /* If it's the first request from the traced task,
 	   * wrap the all threads in the task. */
@@ -1607,6 +1645,181 @@ print_data (mach_msg_type_name_t type,
 }
 
 
+/*** Binary trace output ***/
+
+/* Formatting every message as it goes by slows the traced program down
+   a lot.  With --binary, the tracing thread only copies a few words
+   about each message into TRACE_RING, and another thread writes them to
+   the output file in big chunks.  If the ring is full, messages are
+   counted as lost rather than making the tracing thread wait.  */
+
+static struct rpctrace_record *trace_ring;
+static size_t trace_ring_size = 65536; /* A power of two.  */
+
+/* Records are put in at TRACE_HEAD and taken out at TRACE_TAIL; both
+   only ever grow, and are reduced modulo TRACE_RING_SIZE to index the
+   ring.  Only the tracing thread advances TRACE_HEAD and counts
+   TRACE_LOST, and only the writer thread advances TRACE_TAIL and takes
+   TRACE_LOST back to zero.  */
+static size_t trace_head, trace_tail;
+static unsigned int trace_lost;
+
+static int trace_fd;
+static int trace_done;
+static pthread_t trace_writer;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trace_wakeup = PTHREAD_COND_INITIALIZER;
+
+static void
+trace_record (unsigned int kind, const mach_msg_header_t *msg,
+	      mach_port_t port, mach_port_t reply_port,
+	      int retcode, task_t from, task_t to)
+{
+  size_t head = trace_head;
+  size_t used = head - __atomic_load_n (&trace_tail, __ATOMIC_ACQUIRE);
+  struct rpctrace_record *r;
+  struct timespec ts;
+
+  if (used == trace_ring_size)
+    {
+      __atomic_add_fetch (&trace_lost, 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  r = &trace_ring[head & (trace_ring_size - 1)];
+  r->time = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+  r->kind = kind;
+  r->msgid = msg->msgh_id;
+  r->port = port;
+  r->reply_port = reply_port;
+  r->size = msg->msgh_size;
+  r->retcode = retcode;
+  r->from_task = from;
+  r->to_task = to;
+  __atomic_store_n (&trace_head, head + 1, __ATOMIC_RELEASE);
+
+  /* Wake the writer up when the ring gets half full, rather than
+     letting it poll faster.  */
+  if (used + 1 == trace_ring_size / 2)
+    {
+      pthread_mutex_lock (&trace_lock);
+      pthread_cond_signal (&trace_wakeup);
+      pthread_mutex_unlock (&trace_lock);
+    }
+}
+
+/* Write LEN bytes at BUF to the trace file.  */
+static void
+trace_write (const void *buf, size_t len)
+{
+  while (len > 0)
+    {
+      ssize_t n = write (trace_fd, buf, len);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  error (1, errno, "writing trace");
+	}
+      buf += n;
+      len -= n;
+    }
+}
+
+/* The writer thread: write out what is in the ring when it is half
+   full, or at least every tenth of a second, until the trace is
+   done.  */
+static void *
+trace_writer_function (void *arg)
+{
+  int done;
+
+  do
+    {
+      struct timespec until;
+      size_t head, tail;
+      unsigned int lost;
+
+      clock_gettime (CLOCK_REALTIME, &until);
+      until.tv_nsec += 100000000;
+      if (until.tv_nsec >= 1000000000)
+	{
+	  until.tv_sec++;
+	  until.tv_nsec -= 1000000000;
+	}
+
+      pthread_mutex_lock (&trace_lock);
+      while (! trace_done
+	     && (__atomic_load_n (&trace_head, __ATOMIC_ACQUIRE) - trace_tail
+		 < trace_ring_size / 2))
+	if (pthread_cond_timedwait (&trace_wakeup, &trace_lock, &until))
+	  break;
+      done = trace_done;
+      pthread_mutex_unlock (&trace_lock);
+
+      head = __atomic_load_n (&trace_head, __ATOMIC_ACQUIRE);
+      tail = trace_tail;
+      while (tail != head)
+	{
+	  size_t start = tail & (trace_ring_size - 1);
+	  size_t n = MIN (head - tail, trace_ring_size - start);
+	  trace_write (&trace_ring[start], n * sizeof *trace_ring);
+	  tail += n;
+	}
+      __atomic_store_n (&trace_tail, tail, __ATOMIC_RELEASE);
+
+      lost = __atomic_exchange_n (&trace_lost, 0, __ATOMIC_RELAXED);
+      if (lost)
+	{
+	  struct rpctrace_record r = { .kind = RPCTRACE_LOST, .size = lost };
+	  struct timespec ts;
+	  clock_gettime (CLOCK_MONOTONIC, &ts);
+	  r.time = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	  trace_write (&r, sizeof r);
+	}
+    }
+  while (! done);
+
+  return 0;
+}
+
+/* Open FILE for a binary trace and start the writer thread.  */
+static void
+trace_start (const char *file)
+{
+  struct rpctrace_header header = { .version = RPCTRACE_VERSION,
+				    .record_size = sizeof *trace_ring };
+  error_t err;
+
+  trace_ring = calloc (trace_ring_size, sizeof *trace_ring);
+  if (! trace_ring)
+    error (1, ENOMEM, "trace buffer");
+
+  trace_fd = open (file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (trace_fd < 0)
+    error (1, errno, "%s", file);
+  memcpy (header.magic, RPCTRACE_MAGIC, sizeof header.magic);
+  trace_write (&header, sizeof header);
+
+  err = pthread_create (&trace_writer, NULL, trace_writer_function, NULL);
+  if (err)
+    error (1, err, "pthread_create");
+}
+
+/* Write out everything left in the ring and close the trace.  */
+static void
+trace_finish (void)
+{
+  pthread_mutex_lock (&trace_lock);
+  trace_done = 1;
+  pthread_cond_signal (&trace_wakeup);
+  pthread_mutex_unlock (&trace_lock);
+
+  pthread_join (trace_writer, NULL);
+  close (trace_fd);
+}
+
 /*** Main program and child startup ***/
 
 
@@ -1676,6 +1889,7 @@ int
 main (int argc, char **argv, char **envp)
 {
   const char *outfile = 0;
+  int binary = 0;
   char **cmd_argv = 0;
   pthread_t thread;
   error_t err;
@@ -1696,6 +1910,22 @@ main (int argc, char **argv, char **envp)
 	  strsize = atoi (arg);
 	  break;
 
+	case 'B':
+	  binary = 1;
+	  break;
+
+	case 'b':
+	  {
+	    size_t size = strtoul (arg, 0, 0);
+	    if (size < 2)
+	      argp_error (state, "buffer size must be at least 2");
+	    /* Round it up to a power of two.  */
+	    for (trace_ring_size = 2; trace_ring_size < size;
+		 trace_ring_size *= 2)
+	      ;
+	  }
+	  break;
+
 	case 'E':
 	  if (envz == NULL)
 	    {
@@ -1752,15 +1982,25 @@ main (int argc, char **argv, char **envp)
 			    &unknown_task);
   assert_perror (err);
 
-  if (outfile)
+  if (binary)
     {
-      ostream = fopen (outfile, "w");
-      if (!ostream)
-	error (1, errno, "%s", outfile);
+      if (! outfile)
+	error (1, 0, "--binary needs an output file (--output)");
+      trace_start (outfile);
+      ostream = NULL;
     }
   else
-    ostream = stderr;
-  setlinebuf (ostream);
+    {
+      if (outfile)
+	{
+	  ostream = fopen (outfile, "w");
+	  if (!ostream)
+	    error (1, errno, "%s", outfile);
+	}
+      else
+	ostream = stderr;
+      setlinebuf (ostream);
+    }
 
   traced_bucket = ports_create_bucket ();
   traced_class = ports_create_class (&traced_clean, NULL);
@@ -1805,11 +2045,15 @@ main (int argc, char **argv, char **envp)
     if (pid != child)
       error (1, errno, "waitpid");
     if (WIFEXITED (status))
-      fprintf (ostream, "Child %d exited with %d\n",
+      fprintf (ostream ?: stderr, "Child %d exited with %d\n",
 	       pid, WEXITSTATUS (status));
     else
-      fprintf (ostream, "Child %d %s\n", pid, strsignal (WTERMSIG (status)));
+      fprintf (ostream ?: stderr, "Child %d %s\n",
+	       pid, strsignal (WTERMSIG (status)));
   }
+
+  if (binary)
+    trace_finish ();
   
   ports_destroy_right (notify_pi);
   free (envz);
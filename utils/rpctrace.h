@@ -0,0 +1,63 @@
+/* Binary trace format written by rpctrace and read by rpcdecode.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This file is part of the GNU Hurd.
+
+   The GNU Hurd is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   The GNU Hurd is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the GNU Hurd.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef _HURD_RPCTRACE_H_
+#define _HURD_RPCTRACE_H_
+
+#include <stdint.h>
+
+/* A trace is a header followed by records, all in the byte order of the
+   machine that wrote it.  */
+
+#define RPCTRACE_MAGIC		"RPCTRACE"
+#define RPCTRACE_VERSION	1
+
+struct rpctrace_header
+{
+  char magic[8];		/* RPCTRACE_MAGIC, without the null.  */
+  uint32_t version;		/* RPCTRACE_VERSION.  */
+  uint32_t record_size;		/* sizeof (struct rpctrace_record).  */
+};
+
+/* Kinds of records.  */
+enum
+  {
+    RPCTRACE_REQUEST = 1,	/* A request that expects a reply.  */
+    RPCTRACE_SIMPLE,		/* A message that expects no reply.  */
+    RPCTRACE_NOTIFICATION,	/* A notification from the kernel.  */
+    RPCTRACE_REPLY,		/* The reply to a REQUEST.  */
+    RPCTRACE_LOST,		/* SIZE records did not fit in the buffer.  */
+  };
+
+/* One traced message.  Port names are rpctrace's own.  A reply goes with
+   the request that has the same REPLY_PORT and a MSGID 100 less.  */
+struct rpctrace_record
+{
+  uint64_t time;		/* Nanoseconds, from CLOCK_MONOTONIC.  */
+  uint32_t kind;		/* RPCTRACE_* above.  */
+  int32_t msgid;
+  uint32_t port;		/* The port the message was sent to.  */
+  uint32_t reply_port;
+  uint32_t size;		/* Size of the message in bytes.  */
+  int32_t retcode;		/* For a reply, its return code.  */
+  uint32_t from_task;		/* For a request, the sending task...  */
+  uint32_t to_task;		/* ...and the receiving one, if known.  */
+};
+
+#endif	/* _HURD_RPCTRACE_H_ */